@@ -2,3 +2,5 @@
 
 glslc src/shaders/triangles.vert -o src/shaders/triangles.vert.spv
 glslc src/shaders/triangles.frag -o src/shaders/triangles.frag.spv
+glslc src/shaders/hud.vert -o src/shaders/hud.vert.spv
+glslc src/shaders/hud.frag -o src/shaders/hud.frag.spv
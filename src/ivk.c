@@ -7,7 +7,12 @@
 #include "ivk_buffers.h"
 #include "ivk_validation.h"
 #include "ivk_pipeline.h"
+#include "ivk_memory.h"
 #include "ivk_util.h"
+#include "ivk_timer.h"
+#include "ivk_trace.h"
+#include "ivk_thread.h"
+#include "ivk_atomic.h"
 #include "cglm/cglm.h"
 
 /* Required device extensions */
@@ -17,26 +22,36 @@ static const char* g_device_extensions[ 1 ] =
     };
 static const unsigned int g_device_extensions_count = 1;
 
+/* Upper bound on the enabled device extensions, required plus optional */
+#define MAX_DEVICE_EXTENSIONS   12
+
+/* How often a minimized window is checked off the event thread */
+#define MINIMIZED_POLL_MS       10
 
-/* Global context for IVK library */
-static IVK_Context g_ivk_context;
 
 /* External validation layer information */
 extern const char* g_validation_layers[];
 extern const unsigned int g_validation_layer_cnt;
 
-/* Keep track of the current frame */
-static unsigned int g_current_frame;
-
 
 /*** Static functions for initialization ***/
 /*
- * Creates the Vulkan instance for IVK
+ * Creates the Vulkan instance for IVK. False if it could
+ * not be created, or only below Vulkan 1.2.
+ */
+static bool ivk_create_instance
+    (
+    IVK_Context*    context,
+    unsigned int    instance_extension_count,
+    const char**    instance_extensions
+    );
+
+/*
+ * Returns the instance-level API version supported by the loader
  */
-static void ivk_create_instance
+static uint32_t ivk_query_instance_version
     (
-    unsigned int instance_extension_count,
-    const char** instance_extensions
+    void
     );
 
 /*
@@ -45,7 +60,7 @@ static void ivk_create_instance
  */
 static void ivk_select_physical_device
     (
-    void
+    IVK_Context*    context
     );
 
 /*
@@ -53,6 +68,7 @@ static void ivk_select_physical_device
  */
 static bool ivk_is_device_suitable
     (
+    IVK_Context*    context,
     VkPhysicalDevice
     );
 
@@ -61,15 +77,96 @@ static bool ivk_is_device_suitable
  */
 static bool ivk_select_queue_families
     (
+    IVK_Context*    context,
+    VkPhysicalDevice
+    );
+
+/*
+ * Checks whether the physical device can report when
+ * presents reach the display ( VK_KHR_present_id and
+ * VK_KHR_present_wait ).
+ */
+static bool ivk_is_present_wait_supported
+    (
+    IVK_Context*    context,
     VkPhysicalDevice
     );
 
+/*
+ * Returns the alignment of host memory imported through
+ * VK_EXT_external_memory_host, 0 if it is not supported.
+ */
+static VkDeviceSize ivk_query_host_pointer_alignment
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device
+    );
+
+/*
+ * Checks that the device can draw with a pipeline state.
+ * Lines and points need fillModeNonSolid.
+ */
+static bool ivk_is_pipeline_state_supported
+    (
+    IVK_Context*                    context,
+    const IVK_pipeline_state_type*  state
+    );
+
+/*
+ * Queries which extended dynamic state levels the physical
+ * device supports. Returns IVK_DYNAMIC_STATE_* bits.
+ */
+static unsigned int ivk_query_dynamic_state_support
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device
+    );
+
+/*
+ * Checks whether a device extension is supported
+ */
+static bool ivk_is_device_extension_supported
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device,
+    const char*         extension_name
+    );
+
+/*
+ * Collects the presents that reached the display and
+ * updates the latency statistics. Never blocks.
+ */
+static void ivk_poll_present_latency
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Readback callback of the shared memory output, publishes
+ * the frame into the ring
+ */
+static void ivk_shm_output_frame
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    );
+
+/*
+ * Readback reserve callback of the shared memory output.
+ * The GPU may only copy into slots the consumer released.
+ */
+static bool ivk_shm_output_reserve
+    (
+    unsigned int    busy_count,
+    void*           user_data
+    );
+
 /*
  * Creates a logical device.
  */
 static void ivk_create_logical_device
     (
-    void
+    IVK_Context*    context
     );
 
 /*
@@ -80,7 +177,7 @@ static void ivk_create_logical_device
  */
 static void ivk_create_window_surface
     (
-    void
+    IVK_Context*    context
     );
 
 
@@ -93,7 +190,17 @@ static void ivk_create_window_surface
  */
 static void ivk_init_presentation
     (
-    void
+    IVK_Context*    context,
+    VkSwapchainKHR  old_swapchain
+    );
+
+/*
+ * Initializes the offscreen images that replace the
+ * swapchain when headless.
+ */
+static void ivk_init_offscreen
+    (
+    IVK_Context*    context
     );
 
 /*
@@ -101,7 +208,36 @@ static void ivk_init_presentation
  */
 static void ivk_clean_presentation
     (
-    void
+    IVK_Context*    context
+    );
+
+/*
+ * Moves the presentation objects out of the context
+ */
+static void ivk_detach_presentation
+    (
+    IVK_Context*                context,
+    IVK_swapchain_retired_type* retired
+    );
+
+/*
+ * Queues the current presentation objects for destruction
+ * once the frames using them have completed.
+ */
+static void ivk_retire_presentation
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Destroys the retired presentation objects whose last frame
+ * is at or below completed_value on the frame timeline.
+ * UINT64_MAX, once the device is idle, destroys all of them.
+ */
+static void ivk_release_retired_presentation
+    (
+    IVK_Context*    context,
+    uint64_t        completed_value
     );
 
 /*
@@ -110,7 +246,7 @@ static void ivk_clean_presentation
  */
 static void ivk_recreate_presentation
     (
-    void
+    IVK_Context*    context
     );
 
 
@@ -119,7 +255,7 @@ static void ivk_recreate_presentation
  */
 static void ivk_create_renderpass
     (
-    void
+    IVK_Context*    context
     );
 
 /*
@@ -127,7 +263,7 @@ static void ivk_create_renderpass
  */
 static void ivk_create_framebuffers
     (
-    void
+    IVK_Context*    context
     );
 
 /*
@@ -135,7 +271,7 @@ static void ivk_create_framebuffers
  */
 static void ivk_create_command_pools
     (
-    void
+    IVK_Context*    context
     );
 
 /*
@@ -143,7 +279,7 @@ static void ivk_create_command_pools
  */
 static void ivk_create_command_buffers
     (
-    void
+    IVK_Context*    context
     );
 
 /*
@@ -151,272 +287,1565 @@ static void ivk_create_command_buffers
  */
 static void ivk_record_command_buffer
     (
+    IVK_Context*            context,
+    VkCommandBuffer         command_buffer,
+    unsigned int            image_index,
+    const IVK_draw_type*    draws,
+    uint32_t                draw_count
+    );
+
+/*
+ * Grows the current frame slot's instance buffer to hold
+ * instance_count transforms. The slot must be idle.
+ */
+static bool ivk_reserve_instances
+    (
+    IVK_Context*    context,
+    uint32_t        instance_count
+    );
+
+/*
+ * Begins rendering to a swapchain image, either with the
+ * render pass or with dynamic rendering.
+ */
+static void ivk_begin_scene_pass
+    (
+    IVK_Context*    context,
+    VkCommandBuffer command_buffer,
+    unsigned int    image_index
+    );
+
+/*
+ * Ends rendering to a swapchain image. Its transition, to
+ * the presentation layout or to the copy layout for the
+ * headless or read back frames, is left in the batch for
+ * the end of the frame.
+ */
+static void ivk_end_scene_pass
+    (
+    IVK_Context*    context,
     VkCommandBuffer command_buffer,
     unsigned int    image_index
     );
 
+/*
+ * Records the performance overlay into the scene pass
+ */
+static void ivk_record_hud
+    (
+    IVK_Context*    context,
+    VkCommandBuffer command_buffer
+    );
+
+/*
+ * Reads the usage and budget of the memory heaps into the
+ * statistics. Without VK_EXT_memory_budget only the heap
+ * sizes are known.
+ */
+static void ivk_query_memory_heaps
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Hands the memory of the current frame slot to the frame
+ * being built. Memory of the slot's previous frame is
+ * released once the GPU is past it; is_slot_idle skips the
+ * wait when the caller has already waited.
+ */
+static void ivk_claim_frame_arena
+    (
+    IVK_Context*    context,
+    bool            is_slot_idle
+    );
+
+/*
+ * Queues an object for destruction once the frames
+ * submitted so far have completed
+ */
+static void ivk_defer_destroy
+    (
+    IVK_Context*        context,
+    IVK_deletion_type*  deletion
+    );
+
 /*
  * Creates the synchronization primitives.
  */
 static void ivk_create_sync_objects
     (
-    void
+    IVK_Context*    context
+    );
+
+/*
+ * Presents the rendered image and updates the latency
+ * statistics.
+ */
+static void ivk_present_image
+    (
+    IVK_Context*    context,
+    unsigned int    image_index,
+    uint64_t        acquire_ns
     );
 
 /*** Function definitions ***/
 /*
- * Initializes IVK library
+ * Initializes an IVK context. Contexts share nothing but the
+ * host allocator, and the instance if config asks for it, so
+ * each can render from its own thread. The instance
+ * extensions are unused with a shared instance. False if no
+ * Vulkan 1.2 instance could be created, the context is then
+ * unusable.
  */
-void ivk_init
+bool ivk_init
     (
-    unsigned int instance_extension_count,
-    const char** instance_extensions,
-    GLFWwindow*  window
+    IVK_Context*            context,
+    unsigned int            instance_extension_count,
+    const char**            instance_extensions,
+    GLFWwindow*             window,
+    const IVK_config_type*  config
     )
 {
-g_ivk_context.glfw_window = window;
-g_current_frame = 0;
+/* Local variables */
+IVK_config_type             _config = { 0 };
+VkPhysicalDeviceProperties  _properties = { 0 };
+uint64_t                    _start_ns = ivk_timer_now_ns();
+uint64_t                    _phase_ns = _start_ns;
+
+if( config )
+    {
+    _config = *config;
+    }
 
-/* Create the instance */
-ivk_create_instance( instance_extension_count, instance_extensions );
+memset( context, 0, sizeof( *context ) );
+context->glfw_window = window;
+context->is_event_thread = true;
+context->headless = _config.headless;
+context->offscreen_extent = _config.offscreen_extent;
+context->use_dynamic_rendering = _config.dynamic_rendering;
+context->use_extended_dynamic_state = _config.extended_dynamic_state;
+context->resize_wait_idle = _config.resize_wait_idle;
+context->use_gpu_profiler = _config.gpu_profiler || _config.hud;
+context->use_hud = _config.hud;
+context->present_policy = _config.present_policy;
+context->frames_in_flight_override = _config.frames_in_flight;
+context->material_count = 1;
+ivk_resource_create( IVK_RESOURCE_MAX_BUFFERS, IVK_RESOURCE_MAX_MESHES, &context->resources );
+ivk_deletion_queue_create( &context->deletion_queue );
+ivk_set_frames_in_flight( context, _config.frames_in_flight ? _config.frames_in_flight : IVK_DEFAULT_FRAMES_IN_FLIGHT );
+ivk_pipeline_default_state( &context->pipeline_state );
+
+/* Headless, the offscreen images are left ready to be copied from
+rather than presented */
+context->target_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+if( context->headless )
+    {
+    context->swapchain_format = _config.offscreen_format ? _config.offscreen_format : IVK_OFFSCREEN_DEFAULT_FORMAT;
+    context->target_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    }
+
+/* The allocation callbacks have to be in place before the instance,
+every object is destroyed with the callbacks it was created with. They
+are process-wide, so the first context decides for all of them. */
+context->host_allocator = ivk_host_allocator_settle( _config.track_host_memory );
+context->use_host_allocator = _config.track_host_memory && context->host_allocator;
+if( _config.track_host_memory && !context->host_allocator )
+    {
+    printf( "Host memory tracking is off, the first context has to ask for it.\n" );
+    }
+ivk_arena_create( IVK_SCRATCH_ARENA_SIZE, true, &context->scratch_arena );
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+    ivk_arena_create( IVK_FRAME_ARENA_SIZE, true, &context->frame_arenas[ i ] );
+    context->frame_arena_value[ i ] = 0;
+    }
+
+/* Create the instance, unless another context's is shared. That one
+was created the same way, at the same version. */
+context->vk_instance = _config.instance;
+context->owns_instance = ( _config.instance == VK_NULL_HANDLE );
+context->instance_version = ivk_query_instance_version();
+context->instance_version = ( context->instance_version > IVK_MAX_API_VERSION ) ? IVK_MAX_API_VERSION : context->instance_version;
+if( context->owns_instance &&
+    !ivk_create_instance( context, instance_extension_count, instance_extensions ) )
+    {
+    /* Nothing of Vulkan's exists yet, only the host memory */
+    ivk_deletion_queue_destroy( &context->device_funcs, VK_NULL_HANDLE, &context->deletion_queue );
+    ivk_resource_destroy( VK_NULL_HANDLE, &context->resources );
+    ivk_arena_destroy( &context->scratch_arena );
+    for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+        {
+        ivk_arena_destroy( &context->frame_arenas[ i ] );
+        }
+    return false;
+    }
+ivk_dispatch_load_instance( context->vk_instance, &context->instance_funcs );
 
 /* Set the window surface */
-ivk_create_window_surface();
+if( !context->headless )
+    {
+    ivk_create_window_surface( context );
+    }
+
+context->stats.init_instance_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - _phase_ns );
+_phase_ns = ivk_timer_now_ns();
 
 /* Select the physical device */
-ivk_select_physical_device();
+ivk_select_physical_device( context );
+context->instance_funcs.vkGetPhysicalDeviceProperties( context->vk_physical_device, &_properties );
+memcpy( context->stats.device_name, _properties.deviceName, sizeof( context->stats.device_name ) );
+ivk_caps_print( context->stats.device_name, &context->caps );
+
+/* Fall back to the render pass if dynamic rendering is unavailable */
+if( context->use_dynamic_rendering && !context->caps.dynamic_rendering )
+    {
+    printf( "Dynamic rendering not supported, using a render pass.\n" );
+    context->use_dynamic_rendering = false;
+    }
+
+/* Same for extended dynamic state; the pipelines are then keyed
+only on the state that has to be baked in */
+context->pipeline_cache.dynamic_state_flags = 0;
+if( context->use_extended_dynamic_state )
+    {
+    context->pipeline_cache.dynamic_state_flags = ivk_query_dynamic_state_support( context, context->vk_physical_device );
+    if( !( context->pipeline_cache.dynamic_state_flags & IVK_DYNAMIC_STATE_1_BIT ) )
+        {
+        printf( "Extended dynamic state not supported, using static pipeline state.\n" );
+        context->use_extended_dynamic_state = false;
+        context->pipeline_cache.dynamic_state_flags = 0;
+        }
+    }
+
+/* Measure the present latency where the device can tell */
+context->use_present_wait = !context->headless &&
+                                 ivk_is_present_wait_supported( context, context->vk_physical_device );
+context->stats.is_present_wait_enabled = context->use_present_wait;
+
+/* Pipeline statistics are an optional device feature */
+context->use_gpu_statistics = false;
+if( context->use_gpu_profiler && _config.gpu_statistics )
+    {
+    context->use_gpu_statistics = context->caps.pipeline_statistics;
+    if( !context->use_gpu_statistics )
+        {
+        printf( "Pipeline statistics queries not supported.\n" );
+        }
+    }
+
+/* Heap usage for the statistics, where the driver can tell */
+context->use_memory_budget = ivk_is_device_extension_supported( context, context->vk_physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+
+/* Host memory imports let the readback copy straight into the
+shared memory output */
+context->host_pointer_alignment = ivk_query_host_pointer_alignment( context, context->vk_physical_device );
+context->use_external_memory_host = ( context->host_pointer_alignment != 0 );
 
 /* Create a logical device */
-ivk_create_logical_device();
+ivk_create_logical_device( context );
+context->stats.init_device_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - _phase_ns );
 
-ivk_init_presentation();
+ivk_init_presentation( context, VK_NULL_HANDLE );
 
-/* Create the renderpass */
-ivk_create_renderpass();
+/* Dynamic rendering draws straight into the image views, so no
+render pass or framebuffers are needed */
+if( !context->use_dynamic_rendering )
+    {
+    /* Create the renderpass */
+    ivk_create_renderpass( context );
 
-/* Create the framebuffers */
-ivk_create_framebuffers();
+    /* Create the framebuffers */
+    ivk_create_framebuffers( context );
+    }
 
-/* Create the pipeline layout and the pipeline */
-ivk_pipeline_create_layout( g_ivk_context.vk_device, &g_ivk_context.vk_pipeline_layout );
-ivk_pipeline_create
+/* Create the pipeline layout and the default pipeline, so the first
+frame does not pay for it */
+_phase_ns = ivk_timer_now_ns();
+ivk_pipeline_create_layout( context->vk_device, &context->vk_pipeline_layout );
+ivk_pipeline_cache_get
     (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_pipeline_layout,
-    g_ivk_context.swapchain_extent,
-    g_ivk_context.vk_renderpass,
-    NULL,
-    NULL,
-    &g_ivk_context.vk_pipeline
+    &context->pipeline_cache,
+    context->vk_device,
+    context->vk_pipeline_layout,
+    context->swapchain_extent,
+    context->vk_renderpass,
+    context->swapchain_format,
+    &context->pipeline_state
     );
+context->stats.init_pipeline_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - _phase_ns );
 
 /* Create the command pool */
-ivk_create_command_pools();
+ivk_create_command_pools( context );
 
 /* Create the command buffer */
-ivk_create_command_buffers();
+ivk_create_command_buffers( context );
 
 /* Create the semaphores and the fence */
-ivk_create_sync_objects();
+ivk_create_sync_objects( context );
+
+/* Room for the transforms of a small scene, grown on demand */
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+    ivk_draw_create_instance_buffer
+        (
+        context->vk_device,
+        context->vk_physical_device,
+        IVK_DRAW_INITIAL_INSTANCES,
+        &context->instance_buffers[ i ]
+        );
+    }
+
+/* One query pool per frame slot, on the queue the frames go to */
+if( context->use_gpu_profiler )
+    {
+    context->use_gpu_profiler = ivk_gpu_profiler_create
+        (
+        &context->device_funcs,
+        context->vk_device,
+        context->vk_physical_device,
+        context->vk_graphics_family_idx,
+        IVK_MAX_FRAMES_IN_FLIGHT,
+        context->use_gpu_statistics,
+        &context->gpu_profiler
+        );
+    }
+
+/* The overlay draws into the same targets as the scene */
+if( context->use_hud )
+    {
+    context->use_hud = ivk_hud_create
+        (
+        &context->device_funcs,
+        context->vk_device,
+        context->vk_physical_device,
+        context->vk_transfer_command_pool,
+        context->vk_transfer_queue,
+        context->vk_transfer_family_idx,
+        context->vk_graphics_family_idx,
+        context->vk_renderpass,
+        context->swapchain_format,
+        IVK_MAX_FRAMES_IN_FLIGHT,
+        &context->hud
+        );
+    context->is_hud_visible = context->use_hud;
+    context->stats.upload_bytes += IVK_HUD_MAX_QUADS * 6 * sizeof( unsigned int );
+    }
+
+/* The temporaries of the initialization are gone */
+ivk_arena_clear( &context->scratch_arena );
+
+context->stats.init_total_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - _start_ns );
 
-/* Free these after initialization as they are no longer necessary */
-//ivk_swapchain_free_support( &g_ivk_context.swapchain_details );
+return true;
 
 }
 
 
 /*
- * Initializes the triangle for rendering
+ * Uploads an indexed mesh, for the draw records.
+ * IVK_INVALID_HANDLE if the mesh pool is full.
  */
-void ivk_init_triangle
+IVK_mesh_handle_type ivk_create_mesh
     (
-    ivk_2p3c_type*  triangle_data,
+    IVK_Context*    context,
+    ivk_2p3c_type*  vertex_data,
     unsigned int    vert_cnt,
     unsigned int*   index_data,
     unsigned int    index_cnt
     )
 {
-g_ivk_context.index_count = index_cnt;
+/* Local variables */
+VkBuffer                _vertex_buffer = VK_NULL_HANDLE;
+VkDeviceMemory          _vertex_memory = VK_NULL_HANDLE;
+VkBuffer                _index_buffer = VK_NULL_HANDLE;
+VkDeviceMemory          _index_memory = VK_NULL_HANDLE;
+IVK_buffer_handle_type  _vertex_handle = IVK_INVALID_HANDLE;
+IVK_buffer_handle_type  _index_handle = IVK_INVALID_HANDLE;
+IVK_mesh_handle_type    _mesh = IVK_INVALID_HANDLE;
+
+/* Check for room first, nothing to undo on the GPU then */
+if( context->resources.meshes.map.count == context->resources.meshes.map.capacity ||
+    context->resources.buffers.map.count + 2 > context->resources.buffers.map.capacity )
+    {
+    printf( "No room for another mesh.\n" );
+    return IVK_INVALID_HANDLE;
+    }
 
 ivk_buffer_create_vbo
     (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_physical_device,
-    g_ivk_context.vk_transfer_command_pool,
-    g_ivk_context.vk_transfer_queue,
-    triangle_data,
+    &context->device_funcs,
+    context->vk_device,
+    context->vk_physical_device,
+    context->vk_transfer_command_pool,
+    context->vk_transfer_queue,
+    context->vk_transfer_family_idx,
+    context->vk_graphics_family_idx,
+    vertex_data,
     vert_cnt,
-    &g_ivk_context.triangle_vert_buffer,
-    &g_ivk_context.triangle_buffer_memory
+    &_vertex_buffer,
+    &_vertex_memory
     );
 
 ivk_buffer_create_ibo
     (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_physical_device,
-    g_ivk_context.vk_transfer_command_pool,
-    g_ivk_context.vk_transfer_queue,
+    &context->device_funcs,
+    context->vk_device,
+    context->vk_physical_device,
+    context->vk_transfer_command_pool,
+    context->vk_transfer_queue,
+    context->vk_transfer_family_idx,
+    context->vk_graphics_family_idx,
     index_data,
     index_cnt,
-    &g_ivk_context.triangle_index_buffer,
-    &g_ivk_context.triangle_index_buffer_memory
+    &_index_buffer,
+    &_index_memory
     );
+
+_vertex_handle = ivk_resource_add_buffer( &context->resources, _vertex_buffer, _vertex_memory, vert_cnt * sizeof( vertex_data[ 0 ] ) );
+_index_handle = ivk_resource_add_buffer( &context->resources, _index_buffer, _index_memory, index_cnt * sizeof( index_data[ 0 ] ) );
+_mesh = ivk_resource_add_mesh( &context->resources, _vertex_handle, _index_handle, index_cnt );
+
+context->stats.upload_bytes += vert_cnt * sizeof( vertex_data[ 0 ] ) + index_cnt * sizeof( index_data[ 0 ] );
+
+return _mesh;
+
 }
 
 
 /*
- * Renders to the screen.
+ * Destroys a mesh and its buffers, once the frames in
+ * flight are done with them. The handle goes stale.
  */
-void ivk_render
+void ivk_destroy_mesh
     (
-    void
+    IVK_Context*            context,
+    IVK_mesh_handle_type    mesh
     )
 {
 /* Local variables */
-unsigned int            _image_index = 0;
-VkSubmitInfo            _submit_info = { 0 };
-VkSemaphore             _wait_semaphores[] = { g_ivk_context.image_available_semaphore[ g_current_frame ] };
-VkPipelineStageFlags    _wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-VkSemaphore             _signal_semaphores[] = { g_ivk_context.render_finished_semaphore[ g_current_frame ] };
-VkPresentInfoKHR        _present_info = { 0 };
-VkSwapchainKHR          _swapchains[] = { g_ivk_context.vk_swapchain };
-VkResult                _ret = VK_SUCCESS;
-
-/* Set up the submit info */
-_submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-_submit_info.waitSemaphoreCount = 1;
-_submit_info.pWaitSemaphores = _wait_semaphores;
-_submit_info.pWaitDstStageMask = _wait_stages;
-_submit_info.signalSemaphoreCount = 1;
-_submit_info.pSignalSemaphores = _signal_semaphores;
-
-/* Wait for the previous frame to finish */
-__vk( vkWaitForFences( g_ivk_context.vk_device, 1, &g_ivk_context.in_flight_fence[ g_current_frame ], VK_TRUE, UINT64_MAX ) );
+IVK_buffer_handle_type  _buffer_handles[ 2 ];
+VkBuffer                _buffer = VK_NULL_HANDLE;
+VkDeviceMemory          _memory = VK_NULL_HANDLE;
 
-/* Acquire the next image */
-_ret = vkAcquireNextImageKHR
-    (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_swapchain,
-    UINT64_MAX,
-    g_ivk_context.image_available_semaphore[ g_current_frame ],
-    VK_NULL_HANDLE,
-    &_image_index
-    );
-switch( _ret )
+if( mesh == IVK_INVALID_HANDLE )
     {
-    case VK_ERROR_OUT_OF_DATE_KHR:
-        ivk_recreate_presentation();
-        return;
-    case VK_SUBOPTIMAL_KHR:
-    case VK_SUCCESS:
-        break;
-    default:
-        printf( "Error acquiring image.\n" );
-        break;
+    return;
     }
 
-/* Reset the fence */
-__vk( vkResetFences( g_ivk_context.vk_device, 1, &g_ivk_context.in_flight_fence[ g_current_frame ] ) );
-
-/* Reset the command buffer */
-__vk( vkResetCommandBuffer( g_ivk_context.vk_command_buffer[ g_current_frame ], 0 ) );
-
-/* Record the commands in the command buffer */
-ivk_record_command_buffer( g_ivk_context.vk_command_buffer[ g_current_frame ], _image_index );
+ivk_resource_remove_mesh( &context->resources, mesh, &_buffer_handles[ 0 ], &_buffer_handles[ 1 ] );
 
-_submit_info.commandBufferCount = 1;
-_submit_info.pCommandBuffers = &g_ivk_context.vk_command_buffer[ g_current_frame ];
+/* The frames in flight may still draw it */
+for( unsigned int i = 0; i < 2; i++ )
+    {
+    ivk_resource_remove_buffer( &context->resources, _buffer_handles[ i ], &_buffer, &_memory );
+    ivk_destroy_buffer( context, _buffer );
+    ivk_free_memory( context, _memory );
+    }
 
-/* Submit the command buffer */
-__vk( vkQueueSubmit
-        (
-        g_ivk_context.vk_graphics_queue,
-        1,
-        &_submit_info,
-        g_ivk_context.in_flight_fence[ g_current_frame ]
-        ) );
+}
 
-/* Set up the presentation */
-_present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-_present_info.waitSemaphoreCount = 1;
-_present_info.pWaitSemaphores = _signal_semaphores;
-_present_info.swapchainCount = 1;
-_present_info.pSwapchains = _swapchains;
-_present_info.pImageIndices = &_image_index;
-_present_info.pResults = NULL;
 
-/* Present to the screen */
-_ret = vkQueuePresentKHR( g_ivk_context.vk_present_queue, &_present_info );
-switch( _ret )
+/*
+ * Adds a pipeline state for the draw records to refer to.
+ * Returns its material ID, 0 ( the default state ) if the
+ * table is full or the device cannot draw the state.
+ */
+uint32_t ivk_create_material
+    (
+    IVK_Context*                    context,
+    const IVK_pipeline_state_type*  state
+    )
+{
+if( context->material_count == IVK_DRAW_MAX_MATERIALS )
     {
-    case VK_ERROR_OUT_OF_DATE_KHR:
-    case VK_SUBOPTIMAL_KHR:
-        ivk_recreate_presentation();
-        break;
-    case VK_SUCCESS:
-        break;
-    default:
-        printf( "Error acquiring image.\n" );
-        break;
+    printf( "No room for another material, using the default.\n" );
+    return 0;
+    }
+if( !ivk_is_pipeline_state_supported( context, state ) )
+    {
+    return 0;
     }
 
-/* Move on to the next frame */
-g_current_frame = ( g_current_frame + 1 ) % MAX_FRAMES_IN_FLIGHT;
+context->materials[ context->material_count ] = *state;
+return context->material_count++;
 
 }
 
 
 /*
- * Teardown of IVK library
+ * Sets the pipeline state ( culling, topology, depth test... )
+ * used from the next frame on. A state the device cannot
+ * draw is ignored.
  */
-void ivk_teardown
+void ivk_set_pipeline_state
     (
-    void
+    IVK_Context*                    context,
+    const IVK_pipeline_state_type*  state
     )
 {
-/* Wait for everything to finish before tearing down the application */
-vkDeviceWaitIdle( g_ivk_context.vk_device );
-
-ivk_clean_presentation();
-
-vkDestroyBuffer( g_ivk_context.vk_device, g_ivk_context.triangle_vert_buffer, NULL );
-vkFreeMemory( g_ivk_context.vk_device, g_ivk_context.triangle_buffer_memory, NULL );
-vkDestroyBuffer( g_ivk_context.vk_device, g_ivk_context.triangle_index_buffer, NULL );
-vkFreeMemory( g_ivk_context.vk_device, g_ivk_context.triangle_index_buffer_memory, NULL );
-
-for( unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
+if( !ivk_is_pipeline_state_supported( context, state ) )
     {
-    vkDestroySemaphore( g_ivk_context.vk_device, g_ivk_context.image_available_semaphore[ i ], NULL );
-    vkDestroySemaphore( g_ivk_context.vk_device, g_ivk_context.render_finished_semaphore[ i ], NULL );
-    vkDestroyFence( g_ivk_context.vk_device, g_ivk_context.in_flight_fence[ i ], NULL );
+    return;
     }
 
-vkDestroyCommandPool( g_ivk_context.vk_device, g_ivk_context.vk_graphics_command_pool, NULL );
-vkDestroyCommandPool( g_ivk_context.vk_device, g_ivk_context.vk_transfer_command_pool, NULL );
-vkDestroyPipeline( g_ivk_context.vk_device, g_ivk_context.vk_pipeline, NULL );
-
-vkDestroyRenderPass( g_ivk_context.vk_device, g_ivk_context.vk_renderpass, NULL );
-vkDestroyPipelineLayout( g_ivk_context.vk_device, g_ivk_context.vk_pipeline_layout, NULL );
-vkDestroySurfaceKHR( g_ivk_context.vk_instance, g_ivk_context.vk_surface, NULL );
-vkDestroyDevice( g_ivk_context.vk_device, NULL );
-vkDestroyInstance( g_ivk_context.vk_instance, NULL );
+context->pipeline_state = *state;
 
 }
 
 
 /*
- * Creates the Vulkan instance for IVK
+ * Returns the number of distinct pipelines built so far
  */
-static void ivk_create_instance
+unsigned int ivk_get_pipeline_count
     (
-    unsigned int instance_extension_count,
-    const char** instance_extensions
+    IVK_Context*    context
     )
 {
-/* Local variables */
+return context->pipeline_cache.count;
+
+}
+
+
+/*
+ * Calls the device commands straight into the driver, the
+ * default, or through the loader's exports. The loader is
+ * kept to measure the direct calls against.
+ */
+void ivk_set_direct_dispatch
+    (
+    IVK_Context*    context,
+    bool            is_direct
+    )
+{
+ivk_dispatch_load_device( context->vk_device, context->instance_funcs.vkGetDeviceProcAddr, is_direct, &context->device_funcs );
+ivk_pipeline_load_dynamic_state
+    (
+    context->instance_funcs.vkGetDeviceProcAddr,
+    context->vk_device,
+    is_direct,
+    ( context->caps.api_version >= VK_API_VERSION_1_3 ),
+    context->pipeline_cache.dynamic_state_flags,
+    &context->dynamic_state_funcs
+    );
+
+}
+
+
+/*
+ * Returns what the device supports, and has enabled
+ */
+const IVK_caps_type* ivk_get_caps
+    (
+    IVK_Context*    context
+    )
+{
+return &context->caps;
+
+}
+
+
+/*
+ * Returns the queues of the device by role, for the
+ * subsystems that submit on their own
+ */
+const IVK_queue_plan_type* ivk_get_queue_plan
+    (
+    IVK_Context*    context
+    )
+{
+return &context->queue_plan;
+
+}
+
+
+/*
+ * Sets how many frames the CPU may run ahead of the GPU.
+ * Fewer frames lower the latency, more frames absorb hitches.
+ */
+void ivk_set_frames_in_flight
+    (
+    IVK_Context*    context,
+    unsigned int    frames_in_flight
+    )
+{
+if( frames_in_flight < 1 )
+    {
+    frames_in_flight = 1;
+    }
+else if( frames_in_flight > IVK_MAX_FRAMES_IN_FLIGHT )
+    {
+    frames_in_flight = IVK_MAX_FRAMES_IN_FLIGHT;
+    }
+
+/* Each slot remembers the timeline value of its last frame, so
+switching the depth mid-run never reuses a busy slot */
+context->frames_in_flight = frames_in_flight;
+context->current_frame %= frames_in_flight;
+
+}
+
+
+/*
+ * Switches the presentation policy. The swapchain is rebuilt
+ * at the start of the next frame.
+ */
+void ivk_set_present_policy
+    (
+    IVK_Context*            context,
+    IVK_present_policy_type policy
+    )
+{
+context->present_policy = policy;
+context->is_presentation_dirty = true;
+
+}
+
+
+/*
+ * Resizes the offscreen images. They are rebuilt at the
+ * start of the next frame. Headless only.
+ */
+void ivk_set_offscreen_extent
+    (
+    IVK_Context*    context,
+    unsigned int    width,
+    unsigned int    height
+    )
+{
+if( !context->headless )
+    {
+    printf( "Offscreen extent is only used headless.\n" );
+    return;
+    }
+
+context->offscreen_extent.width = width;
+context->offscreen_extent.height = height;
+context->is_presentation_dirty = true;
+
+}
+
+
+/*
+ * Copies every rendered frame back to the CPU through a
+ * ring of slot_count host buffers. The callback receives
+ * each frame once the GPU is done with it, a few frames
+ * later, from within ivk_render. Frames are dropped rather
+ * than waited for when all the slots are busy.
+ */
+bool ivk_enable_readback
+    (
+    IVK_Context*                context,
+    unsigned int                slot_count,
+    IVK_readback_callback_type  callback,
+    void*                       user_data
+    )
+{
+if( context->use_readback )
+    {
+    ivk_disable_readback( context );
+    }
+
+/* Offscreen images can always be copied from, swapchain images only
+if the surface allows it */
+if( !context->headless &&
+    !( context->swapchain_details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT ) )
+    {
+    printf( "Swapchain images cannot be read back.\n" );
+    return false;
+    }
+
+context->use_readback = ivk_readback_create
+    (
+    slot_count,
+    context->swapchain_format,
+    callback,
+    user_data,
+    &context->readback
+    );
+
+return context->use_readback;
+
+}
+
+
+/*
+ * Stops the readback. The frames still in flight are
+ * delivered first.
+ */
+void ivk_disable_readback
+    (
+    IVK_Context*    context
+    )
+{
+if( !context->use_readback )
+    {
+    return;
+    }
+
+ivk_wait_idle( context );
+ivk_readback_poll( &context->device_funcs, &context->readback, context->vk_device, context->frame_number );
+ivk_readback_destroy( context->vk_device, &context->readback );
+context->use_readback = false;
+
+}
+
+
+/*
+ * Publishes every rendered frame into the named shared
+ * memory ring of slot_count slots, for another process to
+ * consume. Takes over the readback. Where the device can
+ * import host memory the frames are copied by the GPU
+ * straight into the ring. Frames larger than the current
+ * extent, or finding the ring full, are dropped.
+ */
+bool ivk_enable_shm_output
+    (
+    IVK_Context*    context,
+    const char*     name,
+    unsigned int    slot_count
+    )
+{
+/* Local variables */
+void*           _slot_pixels[ IVK_READBACK_MAX_SLOTS ];
+size_t          _slot_size = 0;
+
+ivk_disable_shm_output( context );
+
+/* The readback and the ring go round in lockstep, slot i of one
+is slot i of the other */
+if( slot_count > IVK_READBACK_MAX_SLOTS )
+    {
+    slot_count = IVK_READBACK_MAX_SLOTS;
+    }
+if( !ivk_enable_readback( context, slot_count, ivk_shm_output_frame, &context->shm_ring ) )
+    {
+    return false;
+    }
+slot_count = context->readback.slot_count;
+
+_slot_size = ( size_t )context->swapchain_extent.width * context->swapchain_extent.height * context->readback.pixel_size;
+if( !ivk_shm_ring_create
+        (
+        name,
+        slot_count,
+        _slot_size,
+        ( size_t )context->host_pointer_alignment,
+        &context->shm_ring
+        ) )
+    {
+    ivk_disable_readback( context );
+    return false;
+    }
+
+/* Import the slots of the ring as the readback buffers, so there is
+no copy left on the CPU */
+if( context->use_external_memory_host )
+    {
+    for( unsigned int i = 0; i < slot_count; i++ )
+        {
+        _slot_pixels[ i ] = ivk_shm_ring_slot_pixels( &context->shm_ring, i );
+        }
+
+    ivk_readback_import_host_memory
+        (
+        &context->readback,
+        context->get_memory_host_pointer_properties,
+        &_slot_pixels[ 0 ],
+        context->shm_ring.header->slot_stride,
+        ivk_shm_output_reserve,
+        &context->shm_ring
+        );
+    }
+
+context->use_shm_output = true;
+
+return true;
+
+}
+
+
+/*
+ * Stops the shared memory output and removes the ring
+ */
+void ivk_disable_shm_output
+    (
+    IVK_Context*    context
+    )
+{
+if( !context->use_shm_output )
+    {
+    return;
+    }
+
+/* Publish what is still in flight before the ring goes */
+context->stats.is_shm_zero_copy = ( context->readback.host_memory[ 0 ] != NULL );
+ivk_disable_readback( context );
+context->stats.shm_published_count = context->shm_ring.header->write_index;
+context->stats.shm_dropped_count = context->shm_ring.header->dropped_count;
+ivk_shm_ring_close( &context->shm_ring );
+context->use_shm_output = false;
+
+}
+
+
+/*
+ * Fills in up to max_count GPU zone summaries ( the whole
+ * frame, the scene pass, the readback copy ), returns the
+ * number of zones. Needs IVK_config_type::gpu_profiler.
+ */
+unsigned int ivk_get_gpu_profile
+    (
+    IVK_Context*                context,
+    IVK_gpu_zone_report_type*   reports,
+    unsigned int                max_count
+    )
+{
+/* Local variables */
+uint64_t    _completed_value = 0;
+
+if( !context->use_gpu_profiler )
+    {
+    return 0;
+    }
+
+/* Pick up the frames completed since the last render */
+__vk( context->device_funcs.vkGetSemaphoreCounterValue( context->vk_device, context->frame_timeline, &_completed_value ) );
+ivk_gpu_profiler_collect( &context->gpu_profiler, context->vk_device, _completed_value );
+
+return ivk_gpu_profiler_report( &context->gpu_profiler, reports, max_count );
+
+}
+
+
+/*
+ * Writes the GPU zone summaries to path, as CSV or JSON
+ * depending on the extension
+ */
+bool ivk_dump_gpu_profile
+    (
+    IVK_Context*    context,
+    const char*     path
+    )
+{
+/* Local variables */
+uint64_t    _completed_value = 0;
+
+if( !context->use_gpu_profiler )
+    {
+    return false;
+    }
+
+__vk( context->device_funcs.vkGetSemaphoreCounterValue( context->vk_device, context->frame_timeline, &_completed_value ) );
+ivk_gpu_profiler_collect( &context->gpu_profiler, context->vk_device, _completed_value );
+
+return ivk_gpu_profiler_dump( &context->gpu_profiler, path );
+
+}
+
+
+/*
+ * Shows or hides the performance overlay. Needs
+ * IVK_config_type::hud.
+ */
+void ivk_show_hud
+    (
+    IVK_Context*    context,
+    bool            is_visible
+    )
+{
+context->is_hud_visible = context->use_hud && is_visible;
+
+}
+
+
+/*
+ * Lets ivk_render fan its per-draw work out on jobs, NULL
+ * to do it all inline. Called from a thread other than the
+ * one that created jobs, it runs inline anyway.
+ */
+void ivk_set_job_system
+    (
+    IVK_Context*            context,
+    IVK_job_system_type*    jobs
+    )
+{
+context->jobs = jobs;
+
+}
+
+
+/*
+ * Returns size bytes of memory for the frame being built,
+ * aligned to alignment ( 0 for the default ). It stays
+ * valid until the frame's slot comes round again and the
+ * GPU is done with the frame. NULL if out of memory.
+ */
+void* ivk_frame_alloc
+    (
+    IVK_Context*    context,
+    size_t          size,
+    size_t          alignment
+    )
+{
+ivk_claim_frame_arena( context, false );
+return ivk_arena_alloc( &context->frame_arenas[ context->current_frame ], size, alignment );
+
+}
+
+
+/*
+ * Returns the current position in the frame's memory, for
+ * temporaries that can go before the frame does
+ */
+IVK_arena_mark_type ivk_frame_mark
+    (
+    IVK_Context*    context
+    )
+{
+ivk_claim_frame_arena( context, false );
+return ivk_arena_mark( &context->frame_arenas[ context->current_frame ] );
+
+}
+
+
+/*
+ * Releases the frame's memory allocated since mark
+ */
+void ivk_frame_reset
+    (
+    IVK_Context*        context,
+    IVK_arena_mark_type mark
+    )
+{
+ivk_arena_reset( &context->frame_arenas[ context->current_frame ], mark );
+
+}
+
+
+/*
+ * Destroys a buffer once the frames submitted so far are
+ * done with it, without waiting for them
+ */
+void ivk_destroy_buffer
+    (
+    IVK_Context*    context,
+    VkBuffer        buffer
+    )
+{
+/* Local variables */
+IVK_deletion_type   _deletion = { 0 };
+
+_deletion.kind = IVK_DELETION_BUFFER;
+_deletion.object.buffer = buffer;
+ivk_defer_destroy( context, &_deletion );
+
+}
+
+
+/*
+ * Destroys an image once the frames submitted so far are
+ * done with it
+ */
+void ivk_destroy_image
+    (
+    IVK_Context*    context,
+    VkImage         image
+    )
+{
+/* Local variables */
+IVK_deletion_type   _deletion = { 0 };
+
+_deletion.kind = IVK_DELETION_IMAGE;
+_deletion.object.image = image;
+ivk_defer_destroy( context, &_deletion );
+
+}
+
+
+/*
+ * Destroys an image view once the frames submitted so far
+ * are done with it
+ */
+void ivk_destroy_image_view
+    (
+    IVK_Context*    context,
+    VkImageView     image_view
+    )
+{
+/* Local variables */
+IVK_deletion_type   _deletion = { 0 };
+
+_deletion.kind = IVK_DELETION_IMAGE_VIEW;
+_deletion.object.image_view = image_view;
+ivk_defer_destroy( context, &_deletion );
+
+}
+
+
+/*
+ * Destroys a pipeline once the frames submitted so far are
+ * done with it
+ */
+void ivk_destroy_pipeline
+    (
+    IVK_Context*    context,
+    VkPipeline      pipeline
+    )
+{
+/* Local variables */
+IVK_deletion_type   _deletion = { 0 };
+
+_deletion.kind = IVK_DELETION_PIPELINE;
+_deletion.object.pipeline = pipeline;
+ivk_defer_destroy( context, &_deletion );
+
+}
+
+
+/*
+ * Frees device memory once the frames submitted so far are
+ * done with it. Free it after what is bound to it.
+ */
+void ivk_free_memory
+    (
+    IVK_Context*    context,
+    VkDeviceMemory  memory
+    )
+{
+/* Local variables */
+IVK_deletion_type   _deletion = { 0 };
+
+_deletion.kind = IVK_DELETION_MEMORY;
+_deletion.object.memory = memory;
+ivk_defer_destroy( context, &_deletion );
+
+}
+
+
+/*
+ * Retrieves the runtime statistics
+ */
+void ivk_get_stats
+    (
+    IVK_Context*    context,
+    IVK_stats_type* stats
+    )
+{
+context->stats.frame_count = context->frame_number;
+context->stats.is_readback_enabled = context->use_readback;
+context->stats.readback_delivered_count = context->readback.delivered_count;
+context->stats.readback_dropped_count = context->readback.dropped_count;
+if( context->use_shm_output )
+    {
+    context->stats.shm_published_count = context->shm_ring.header->write_index;
+    context->stats.shm_dropped_count = context->shm_ring.header->dropped_count;
+    context->stats.is_shm_zero_copy = ( context->readback.host_memory[ 0 ] != NULL );
+    }
+ivk_query_memory_heaps( context );
+if( context->use_host_allocator )
+    {
+    context->stats.host_bytes = 0;
+    context->stats.host_allocation_count = 0;
+    for( unsigned int i = 0; i < IVK_MEMORY_SCOPE_COUNT; i++ )
+        {
+        context->stats.host_bytes += context->host_allocator->scopes[ i ].bytes;
+        context->stats.host_allocation_count += context->host_allocator->scopes[ i ].total_allocation_count;
+        }
+    }
+context->stats.frame_memory_high_water = 0;
+context->stats.frame_memory_overflow_count = 0;
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+    if( context->frame_arenas[ i ].high_water > context->stats.frame_memory_high_water )
+        {
+        context->stats.frame_memory_high_water = context->frame_arenas[ i ].high_water;
+        }
+    context->stats.frame_memory_overflow_count += context->frame_arenas[ i ].overflow_count;
+    }
+context->stats.deferred_destroy_count = context->deletion_queue.count;
+context->stats.destroyed_count = context->deletion_queue.destroyed_count;
+*stats = context->stats;
+
+}
+
+
+/*
+ * Waits for all the submitted frames to complete
+ */
+void ivk_wait_idle
+    (
+    IVK_Context*    context
+    )
+{
+/* Local variables */
+VkSemaphoreWaitInfo _wait_info = { 0 };
+
+_wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+_wait_info.semaphoreCount = 1;
+_wait_info.pSemaphores = &context->frame_timeline;
+_wait_info.pValues = &context->frame_number;
+__vk( context->device_funcs.vkWaitSemaphores( context->vk_device, &_wait_info, UINT64_MAX ) );
+
+}
+
+
+/*
+ * Renders a frame, to the screen or headless to the
+ * next offscreen image.
+ */
+void ivk_render
+    (
+    IVK_Context*            context,
+    const IVK_draw_type*    draws,
+    uint32_t                draw_count
+    )
+{
+/* Local variables */
+unsigned int            _image_index = 0;
+uint64_t                _frame_value = context->frame_number + 1;
+VkSemaphoreWaitInfo     _wait_info = { 0 };
+VkSubmitInfo            _submit_info = { 0 };
+VkTimelineSemaphoreSubmitInfo
+                        _timeline_submit_info = { 0 };
+VkSemaphore             _wait_semaphores[ 1 ];
+uint64_t                _wait_values[ 1 ] = { 0 };
+unsigned int            _wait_count = 0;
+VkPipelineStageFlags    _wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+VkSemaphore             _signal_semaphores[ 2 ];
+uint64_t                _signal_values[ 2 ];
+unsigned int            _signal_count = 0;
+VkResult                _ret = VK_SUCCESS;
+uint64_t                _acquire_ns = 0;
+uint64_t                _completed_value = 0;
+uint64_t                _start_ns = ivk_timer_now_ns();
+uint64_t                _wait_ns = 0;
+
+IVK_TRACE_BEGIN( "ivk_render" );
+
+/* Start to start is the frame time the user sees */
+if( context->last_render_ns != 0 )
+    {
+    context->last_frame_ms = IVK_NS_TO_MS( _start_ns - context->last_render_ns );
+    IVK_STATS_AVERAGE( context->stats.frame_ms, context->last_frame_ms );
+    }
+context->last_render_ns = _start_ns;
+
+/* A new policy applies before the frame slot is picked, since it can
+change the frames in flight */
+if( context->is_presentation_dirty )
+    {
+    context->is_presentation_dirty = false;
+    ivk_recreate_presentation( context );
+    }
+
+/* Wait for the last frame recorded in this slot to finish. With N slots
+in rotation this keeps at most N frames in flight. */
+_wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+_wait_info.semaphoreCount = 1;
+_wait_info.pSemaphores = &context->frame_timeline;
+_wait_info.pValues = &context->frame_slot_value[ context->current_frame ];
+IVK_TRACE_BEGIN( "frame wait" );
+_wait_ns = ivk_timer_now_ns();
+__vk( context->device_funcs.vkWaitSemaphores( context->vk_device, &_wait_info, UINT64_MAX ) );
+_wait_ns = ivk_timer_now_ns() - _wait_ns;
+IVK_TRACE_END( "frame wait" );
+
+/* The slot's memory from its previous frame can go */
+ivk_claim_frame_arena( context, true );
+
+/* Destroy what the completed frames were the last to use, older
+swapchains included, then hand out the frames whose copies and timings
+have landed */
+__vk( context->device_funcs.vkGetSemaphoreCounterValue( context->vk_device, context->frame_timeline, &_completed_value ) );
+ivk_release_retired_presentation( context, _completed_value );
+if( context->deletion_queue.count > 0 )
+    {
+    IVK_TRACE_BEGIN( "deferred destroy" );
+    ivk_deletion_queue_flush( &context->device_funcs, context->vk_device, &context->deletion_queue, _completed_value );
+    IVK_TRACE_END( "deferred destroy" );
+    }
+if( context->use_readback )
+    {
+    IVK_TRACE_BEGIN( "readback poll" );
+    ivk_readback_poll( &context->device_funcs, &context->readback, context->vk_device, _completed_value );
+    IVK_TRACE_END( "readback poll" );
+    }
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_collect( &context->gpu_profiler, context->vk_device, _completed_value );
+    }
+
+if( context->headless )
+    {
+    /* There is one offscreen image per frame slot, and the wait above
+    guarantees the GPU is done with it */
+    _image_index = context->current_frame;
+    }
+else
+    {
+    /* Acquire the next image */
+    IVK_TRACE_BEGIN( "acquire" );
+    _acquire_ns = ivk_timer_now_ns();
+    _ret = context->device_funcs.vkAcquireNextImageKHR
+        (
+        context->vk_device,
+        context->vk_swapchain,
+        UINT64_MAX,
+        context->image_available_semaphore[ context->current_frame ],
+        VK_NULL_HANDLE,
+        &_image_index
+        );
+    IVK_TRACE_END( "acquire" );
+    _wait_ns += ivk_timer_now_ns() - _acquire_ns;
+    switch( _ret )
+        {
+        case VK_ERROR_OUT_OF_DATE_KHR:
+            ivk_recreate_presentation( context );
+            IVK_TRACE_END( "ivk_render" );
+            return;
+        case VK_SUBOPTIMAL_KHR:
+        case VK_SUCCESS:
+            break;
+        default:
+            printf( "Error acquiring image.\n" );
+            break;
+        }
+
+    /* The render finished semaphore belongs to the image, as the
+    presentation engine holds on to it until the image comes back */
+    _wait_semaphores[ _wait_count++ ] = context->image_available_semaphore[ context->current_frame ];
+    _signal_semaphores[ _signal_count ] = context->render_finished_semaphores[ _image_index ];
+    _signal_values[ _signal_count++ ] = 0; /* Binary, ignored */
+    }
+
+_acquire_ns = ivk_timer_now_ns();
+
+/* Reset the command buffer */
+IVK_TRACE_BEGIN( "record" );
+__vk( context->device_funcs.vkResetCommandBuffer( context->vk_command_buffer[ context->current_frame ], 0 ) );
+
+/* Record the commands in the command buffer */
+ivk_record_command_buffer( context, context->vk_command_buffer[ context->current_frame ], _image_index, draws, draw_count );
+IVK_TRACE_END( "record" );
+
+_signal_semaphores[ _signal_count ] = context->frame_timeline;
+_signal_values[ _signal_count++ ] = _frame_value;
+
+_timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+_timeline_submit_info.waitSemaphoreValueCount = _wait_count;
+_timeline_submit_info.pWaitSemaphoreValues = _wait_values;
+_timeline_submit_info.signalSemaphoreValueCount = _signal_count;
+_timeline_submit_info.pSignalSemaphoreValues = _signal_values;
+
+/* Set up the submit info */
+_submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+_submit_info.pNext = &_timeline_submit_info;
+_submit_info.waitSemaphoreCount = _wait_count;
+_submit_info.pWaitSemaphores = _wait_semaphores;
+_submit_info.pWaitDstStageMask = _wait_stages;
+_submit_info.signalSemaphoreCount = _signal_count;
+_submit_info.pSignalSemaphores = _signal_semaphores;
+_submit_info.commandBufferCount = 1;
+_submit_info.pCommandBuffers = &context->vk_command_buffer[ context->current_frame ];
+
+/* Submit the command buffer */
+IVK_TRACE_BEGIN( "submit" );
+__vk( context->device_funcs.vkQueueSubmit
+        (
+        context->vk_graphics_queue,
+        1,
+        &_submit_info,
+        VK_NULL_HANDLE
+        ) );
+IVK_TRACE_END( "submit" );
+context->frame_number = _frame_value;
+context->frame_slot_value[ context->current_frame ] = _frame_value;
+
+/* Offscreen images stay where they are */
+if( !context->headless )
+    {
+    IVK_TRACE_BEGIN( "present" );
+    ivk_present_image( context, _image_index, _acquire_ns );
+    IVK_TRACE_END( "present" );
+    }
+
+/* Move on to the next frame */
+context->current_frame = ( context->current_frame + 1 ) % context->frames_in_flight;
+
+IVK_STATS_AVERAGE( context->stats.cpu_frame_ms, IVK_NS_TO_MS( ivk_timer_now_ns() - _start_ns - _wait_ns ) );
+
+IVK_TRACE_END( "ivk_render" );
+
+}
+
+
+/*
+ * Presents the rendered image and updates the latency
+ * statistics.
+ */
+static void ivk_present_image
+    (
+    IVK_Context*    context,
+    unsigned int    image_index,
+    uint64_t        acquire_ns
+    )
+{
+/* Local variables */
+VkPresentInfoKHR        _present_info = { 0 };
+VkPresentIdKHR          _present_id = { 0 };
+uint64_t                _present_id_value = 0;
+VkSwapchainKHR          _swapchains[ 1 ];
+VkResult                _ret = VK_SUCCESS;
+uint64_t                _present_ns = 0;
+
+/* Set up the presentation */
+_swapchains[ 0 ] = context->vk_swapchain;
+_present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+_present_info.waitSemaphoreCount = 1;
+_present_info.pWaitSemaphores = &context->render_finished_semaphores[ image_index ];
+_present_info.swapchainCount = 1;
+_present_info.pSwapchains = _swapchains;
+_present_info.pImageIndices = &image_index;
+_present_info.pResults = NULL;
+
+/* Tag the present so we can tell when it reaches the display */
+if( context->use_present_wait )
+    {
+    _present_id_value = context->frame_number;
+    _present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    _present_id.swapchainCount = 1;
+    _present_id.pPresentIds = &_present_id_value;
+    _present_info.pNext = &_present_id;
+    }
+
+/* Present to the screen */
+_present_ns = ivk_timer_now_ns();
+_ret = context->device_funcs.vkQueuePresentKHR( context->vk_present_queue, &_present_info );
+
+/* Acquire to present covers recording and submission */
+IVK_STATS_AVERAGE( context->stats.acquire_to_present_ms, IVK_NS_TO_MS( _present_ns - acquire_ns ) );
+if( context->use_present_wait &&
+    ( _ret == VK_SUCCESS || _ret == VK_SUBOPTIMAL_KHR ) )
+    {
+    /* Drop the oldest if the display is that far behind */
+    if( context->pending_present_count == IVK_MAX_PENDING_PRESENTS )
+        {
+        memmove( &context->pending_presents[ 0 ], &context->pending_presents[ 1 ], ( IVK_MAX_PENDING_PRESENTS - 1 ) * sizeof( context->pending_presents[ 0 ] ) );
+        context->pending_present_count--;
+        }
+    context->pending_presents[ context->pending_present_count ].present_id = _present_id_value;
+    context->pending_presents[ context->pending_present_count ].present_ns = _present_ns;
+    context->pending_present_count++;
+    }
+switch( _ret )
+    {
+    case VK_ERROR_OUT_OF_DATE_KHR:
+    case VK_SUBOPTIMAL_KHR:
+        ivk_recreate_presentation( context );
+        break;
+    case VK_SUCCESS:
+        break;
+    default:
+        printf( "Error acquiring image.\n" );
+        break;
+    }
+
+/* Check on the earlier presents */
+ivk_poll_present_latency( context );
+
+}
+
+
+/*
+ * Collects the presents that reached the display and
+ * updates the latency statistics. Never blocks.
+ */
+static void ivk_poll_present_latency
+    (
+    IVK_Context*    context
+    )
+{
+/* Local variables */
+unsigned int    _done_count = 0;
+uint64_t        _now_ns = 0;
+VkResult        _ret = VK_SUCCESS;
+
+if( !context->use_present_wait || context->pending_present_count == 0 )
+    {
+    return;
+    }
+
+/* Presents complete in order, stop at the first one still pending. The
+result is only as fine as the polling, i.e. one frame. */
+_now_ns = ivk_timer_now_ns();
+while( _done_count < context->pending_present_count )
+    {
+    _ret = context->wait_for_present
+        (
+        context->vk_device,
+        context->vk_swapchain,
+        context->pending_presents[ _done_count ].present_id,
+        0
+        );
+    if( _ret != VK_SUCCESS )
+        {
+        break;
+        }
+
+    IVK_STATS_AVERAGE
+        (
+        context->stats.present_to_display_ms,
+        IVK_NS_TO_MS( _now_ns - context->pending_presents[ _done_count ].present_ns )
+        );
+    _done_count++;
+    }
+
+context->pending_present_count -= _done_count;
+memmove
+    (
+    &context->pending_presents[ 0 ],
+    &context->pending_presents[ _done_count ],
+    context->pending_present_count * sizeof( context->pending_presents[ 0 ] )
+    );
+
+}
+
+
+/*
+ * Readback callback of the shared memory output, publishes
+ * the frame into the ring
+ */
+static void ivk_shm_output_frame
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    )
+{
+ivk_shm_ring_write
+    (
+    ( IVK_shm_ring_type* )user_data,
+    frame->frame_number,
+    frame->width,
+    frame->height,
+    frame->row_pitch,
+    ( uint32_t )frame->format,
+    frame->pixels,
+    frame->size
+    );
+
+}
+
+
+/*
+ * Readback reserve callback of the shared memory output.
+ * The GPU may only copy into slots the consumer released.
+ */
+static bool ivk_shm_output_reserve
+    (
+    unsigned int    busy_count,
+    void*           user_data
+    )
+{
+return ivk_shm_ring_has_room( ( const IVK_shm_ring_type* )user_data, busy_count );
+
+}
+
+
+/*
+ * Teardown of IVK library
+ */
+void ivk_teardown
+    (
+    IVK_Context*    context
+    )
+{
+/* Wait for everything to finish before tearing down the application */
+context->device_funcs.vkDeviceWaitIdle( context->vk_device );
+
+ivk_disable_shm_output( context );
+ivk_disable_readback( context );
+
+ivk_release_retired_presentation( context, UINT64_MAX );
+ivk_clean_presentation( context );
+
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_destroy( context->vk_device, &context->gpu_profiler );
+    context->use_gpu_profiler = false;
+    }
+
+if( context->use_hud )
+    {
+    ivk_hud_destroy( context->vk_device, &context->hud );
+    context->use_hud = false;
+    context->is_hud_visible = false;
+    }
+
+ivk_deletion_queue_destroy( &context->device_funcs, context->vk_device, &context->deletion_queue );
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+    ivk_draw_destroy_instance_buffer( context->vk_device, &context->instance_buffers[ i ] );
+    }
+ivk_resource_destroy( context->vk_device, &context->resources );
+
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+    context->device_funcs.vkDestroySemaphore( context->vk_device, context->image_available_semaphore[ i ], g_ivk_host_allocator );
+    }
+context->device_funcs.vkDestroySemaphore( context->vk_device, context->frame_timeline, g_ivk_host_allocator );
+
+context->device_funcs.vkDestroyCommandPool( context->vk_device, context->vk_graphics_command_pool, g_ivk_host_allocator );
+context->device_funcs.vkDestroyCommandPool( context->vk_device, context->vk_transfer_command_pool, g_ivk_host_allocator );
+ivk_pipeline_cache_destroy( &context->pipeline_cache, context->vk_device );
+
+context->device_funcs.vkDestroyRenderPass( context->vk_device, context->vk_renderpass, g_ivk_host_allocator );
+context->device_funcs.vkDestroyPipelineLayout( context->vk_device, context->vk_pipeline_layout, g_ivk_host_allocator );
+if( !context->headless )
+    {
+    context->instance_funcs.vkDestroySurfaceKHR( context->vk_instance, context->vk_surface, g_ivk_host_allocator );
+    }
+ivk_swapchain_free_support( &context->swapchain_details );
+context->device_funcs.vkDestroyDevice( context->vk_device, g_ivk_host_allocator );
+if( context->owns_instance )
+    {
+    context->instance_funcs.vkDestroyInstance( context->vk_instance, g_ivk_host_allocator );
+    }
+
+/* Whatever is still live now was leaked by the driver or the loader */
+if( context->use_host_allocator )
+    {
+    ivk_host_allocator_report( context->host_allocator );
+    ivk_arena_report( &context->scratch_arena, "scratch" );
+    for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+        {
+        ivk_arena_report( &context->frame_arenas[ i ], "frame" );
+        }
+    context->use_host_allocator = false;
+    }
+ivk_arena_destroy( &context->scratch_arena );
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+    ivk_arena_destroy( &context->frame_arenas[ i ] );
+    }
+
+}
+
+
+/*
+ * Creates the Vulkan instance for IVK. False if it could
+ * not be created, or only below Vulkan 1.2.
+ */
+static bool ivk_create_instance
+    (
+    IVK_Context*    context,
+    unsigned int    instance_extension_count,
+    const char**    instance_extensions
+    )
+{
+/* Local variables */
 VkApplicationInfo       app_info = { 0 };
 VkInstanceCreateInfo    create_info = { 0 };
+VkResult                _result = VK_SUCCESS;
 
 /* Application information */
 app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -424,7 +1853,17 @@ app_info.pApplicationName = "IVK";
 app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
 app_info.pEngineName = "No Engine";
 app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
-app_info.apiVersion = VK_API_VERSION_1_0;
+
+/* Request the newest version IVK knows. Frame pacing needs timeline
+semaphores ( Vulkan 1.2 ); the devices' features are capped at this
+version, so dynamic rendering and sync2 need Vulkan 1.3 here too. */
+app_info.apiVersion = context->instance_version;
+if( app_info.apiVersion < VK_API_VERSION_1_2 )
+    {
+    printf( "IVK needs a Vulkan 1.2 instance, the loader only has %u.%u.\n",
+            VK_API_VERSION_MAJOR( app_info.apiVersion ), VK_API_VERSION_MINOR( app_info.apiVersion ) );
+    return false;
+    }
 
 /* Instance information */
 create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -434,26 +1873,62 @@ create_info.ppEnabledExtensionNames = instance_extensions;
 create_info.enabledLayerCount = 0;
 
 /* Local variables */
-unsigned int        _layer_count = 0;
-VkLayerProperties*  _supported_layers = NULL;
+unsigned int        _layer_count = 0;
+VkLayerProperties*  _supported_layers = NULL;
+
+/* The layers are only asked for in validating builds, and only
+where they are installed */
+if( VALIDATION_ENABLED )
+    {
+    if( ivk_check_validation_layer_support() )
+        {
+        create_info.enabledLayerCount = g_validation_layer_cnt;
+        create_info.ppEnabledLayerNames = g_validation_layers;
+        }
+    else
+        {
+        printf( "Validation layers requested but not supported.\n" );
+        }
+    }
+
+_result = vkCreateInstance
+    (
+    &create_info,
+    g_ivk_host_allocator,
+    &context->vk_instance
+    );
+if( _result != VK_SUCCESS )
+    {
+    printf( "Could not create the Vulkan instance ( %d ).\n", _result );
+    context->vk_instance = VK_NULL_HANDLE;
+    return false;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Returns the instance-level API version supported by the loader
+ */
+static uint32_t ivk_query_instance_version
+    (
+    void
+    )
+{
+/* Local variables */
+PFN_vkEnumerateInstanceVersion  _enumerate_instance_version = NULL;
+uint32_t                        _version = VK_API_VERSION_1_0;
 
-/* Check for validation layer support */
-if( VALIDATION_ENABLED && !ivk_check_validation_layer_support() )
-    {
-    printf( "Validation layers requested but not supported.\n" );
-    }
-else
+/* Vulkan 1.0 loaders do not export vkEnumerateInstanceVersion */
+_enumerate_instance_version = ( PFN_vkEnumerateInstanceVersion )vkGetInstanceProcAddr( NULL, "vkEnumerateInstanceVersion" );
+if( _enumerate_instance_version )
     {
-    create_info.enabledLayerCount = g_validation_layer_cnt;
-    create_info.ppEnabledLayerNames = g_validation_layers;
+    __vk( _enumerate_instance_version( &_version ) );
     }
 
-__vk( vkCreateInstance
-        (
-        &create_info,
-        NULL,
-        &g_ivk_context.vk_instance
-        ) );
+return _version;
 
 }
 
@@ -465,41 +1940,63 @@ __vk( vkCreateInstance
  */
 static void ivk_select_physical_device
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
 unsigned int        _device_count = 0;
 VkPhysicalDevice*   _physical_devices = NULL;
+VkPhysicalDevice    _best_device = VK_NULL_HANDLE;
+IVK_caps_type       _caps = { 0 };
+uint32_t            _score = 0;
+uint32_t            _best_score = 0;
+IVK_arena_mark_type _mark = ivk_arena_mark( &context->scratch_arena );
 
-__vk( vkEnumeratePhysicalDevices( g_ivk_context.vk_instance, &_device_count, NULL ) );
+__vk( context->instance_funcs.vkEnumeratePhysicalDevices( context->vk_instance, &_device_count, NULL ) );
 if( _device_count == 0 )
     {
     printf( "No valid GPUs found.\n" );
     return;
     }
 
-_physical_devices = ( VkPhysicalDevice* )malloc( _device_count * sizeof( VkPhysicalDevice ) );
-__vk( vkEnumeratePhysicalDevices( g_ivk_context.vk_instance, &_device_count, &_physical_devices[ 0 ] ) );
-
+_physical_devices = ( VkPhysicalDevice* )ivk_arena_alloc( &context->scratch_arena, _device_count * sizeof( VkPhysicalDevice ), 0 );
 if( !_physical_devices )
     {
     printf( "Querying the physical devices failed.\n" );
     return;
     }
 
+__vk( context->instance_funcs.vkEnumeratePhysicalDevices( context->vk_instance, &_device_count, &_physical_devices[ 0 ] ) );
+
+/* Take the best scoring of the suitable devices */
 for( unsigned int i = 0; i < _device_count; i++ )
     {
-    if( ivk_is_device_suitable( _physical_devices[ i ] ) )
+    ivk_caps_query( &context->instance_funcs, _physical_devices[ i ], context->instance_version, &_caps );
+    _score = ivk_caps_score( &_caps );
+    if( _score == 0 )
         {
-        g_ivk_context.vk_physical_device = _physical_devices[ i ];
-        break;
+        printf( "Timeline semaphores not supported.\n" );
+        continue;
+        }
+    if( _score > _best_score && ivk_is_device_suitable( context, _physical_devices[ i ] ) )
+        {
+        _best_score = _score;
+        _best_device = _physical_devices[ i ];
+        context->caps = _caps;
         }
     }
 
-free( _physical_devices );
+/* The queue families and swapchain details are those of the device
+checked last, check the best one again to keep its own */
+if( _best_device != VK_NULL_HANDLE && _best_device != _physical_devices[ _device_count - 1 ] )
+    {
+    ivk_is_device_suitable( context, _best_device );
+    }
+context->vk_physical_device = _best_device;
+
+ivk_arena_reset( &context->scratch_arena, _mark );
 
-if( !g_ivk_context.vk_physical_device )
+if( !context->vk_physical_device )
     {
     printf( "Failed to find physical device.\n" );
     return;
@@ -515,23 +2012,31 @@ return;
  */
 static bool ivk_is_device_suitable
     (
+    IVK_Context*        context,
     VkPhysicalDevice    physical_device
     )
 {
 /* Local variables */
-VkPhysicalDeviceProperties  _device_properties = { 0 };
 bool                        _is_device_suitable = true;
 unsigned int                _extension_count = 0;
 VkExtensionProperties*      _available_extensions = NULL;
+IVK_arena_mark_type         _mark = ivk_arena_mark( &context->scratch_arena );
 
-/* Check for discrete GPU */
-//vkGetPhysicalDeviceProperties( physical_device, &_device_properties );
-//_is_device_suitable &= _device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+/* Headless, any device with a graphics queue will do */
+if( context->headless )
+    {
+    return ivk_select_queue_families( context, physical_device );
+    }
 
 /* Check for swapchain support */
-__vk( vkEnumerateDeviceExtensionProperties( physical_device, NULL, &_extension_count, NULL ) );
-_available_extensions = ( VkExtensionProperties* )malloc( _extension_count * sizeof( VkExtensionProperties ) );
-__vk( vkEnumerateDeviceExtensionProperties( physical_device, NULL, &_extension_count, &_available_extensions[ 0 ] ) );
+__vk( context->instance_funcs.vkEnumerateDeviceExtensionProperties( physical_device, NULL, &_extension_count, NULL ) );
+_available_extensions = ( VkExtensionProperties* )ivk_arena_alloc( &context->scratch_arena, _extension_count * sizeof( VkExtensionProperties ), 0 );
+if( !_available_extensions )
+    {
+    printf( "Querying the device extensions failed.\n" );
+    return false;
+    }
+__vk( context->instance_funcs.vkEnumerateDeviceExtensionProperties( physical_device, NULL, &_extension_count, &_available_extensions[ 0 ] ) );
 for( unsigned int i = 0; i < g_device_extensions_count; i++ )
     {
     bool    _is_extension_supported = false;
@@ -547,54 +2052,55 @@ for( unsigned int i = 0; i < g_device_extensions_count; i++ )
         {
         _is_device_suitable = false;
         printf( "Device extension %s not supported.\n", g_device_extensions[ i ] );
-        free( _available_extensions );
+        ivk_arena_reset( &context->scratch_arena, _mark );
         return _is_device_suitable;
         }
     }
-/* Check for swapchain adequacy */
+ivk_arena_reset( &context->scratch_arena, _mark );
+
+/* Check for swapchain adequacy. The details of the device checked
+before are dropped, the chosen device's are kept for the swapchain. */
+ivk_swapchain_free_support( &context->swapchain_details );
 ivk_swapchain_query_support
     (
     physical_device,
-    g_ivk_context.vk_surface,
-    &g_ivk_context.swapchain_details
+    context->vk_surface,
+    &context->swapchain_details
     );
-if( g_ivk_context.swapchain_details.format_count == 0 || g_ivk_context.swapchain_details.present_modes_count == 0 )
+if( context->swapchain_details.format_count == 0 || context->swapchain_details.present_modes_count == 0 )
     {
     _is_device_suitable = false;
     printf( "Inadequate swapchain.\n" );
-    free( _available_extensions );
     return _is_device_suitable;
     }
 
 /* Check for the necessary queue families. */
-_is_device_suitable &= ivk_select_queue_families( physical_device );
+_is_device_suitable &= ivk_select_queue_families( context, physical_device );
 
-free( _available_extensions );
 return _is_device_suitable;
 }
 
 
 /*
  * Selects the appropriate queue families.
- * The queue families will be different for graphics and presentation.
+ * Graphics and presentation share one whenever the device allows.
  */
 static bool ivk_select_queue_families
     (
+    IVK_Context*        context,
     VkPhysicalDevice    physical_device
     )
 {
-/* Local constants */
-#define INVALID_QUEUE  ( ( unsigned int )( -1 ) )
-
 /* Local variables */
-unsigned int                _graphics_family = INVALID_QUEUE;
-unsigned int                _present_family  = INVALID_QUEUE;
-unsigned int                _transfer_family  = INVALID_QUEUE;
 unsigned int                _queue_family_cnt = 0;
 VkQueueFamilyProperties*    _queue_families = NULL;
+VkBool32                    _present_support[ IVK_QUEUE_MAX_FAMILIES ] = { 0 };
+IVK_queue_plan_type         _plan = { 0 };
+bool                        _is_planned = false;
+IVK_arena_mark_type         _mark = ivk_arena_mark( &context->scratch_arena );
 
-vkGetPhysicalDeviceQueueFamilyProperties( physical_device, &_queue_family_cnt, NULL );
-_queue_families = ( VkQueueFamilyProperties* )malloc( _queue_family_cnt * sizeof( VkQueueFamilyProperties ) );
+context->instance_funcs.vkGetPhysicalDeviceQueueFamilyProperties( physical_device, &_queue_family_cnt, NULL );
+_queue_families = ( VkQueueFamilyProperties* )ivk_arena_alloc( &context->scratch_arena, _queue_family_cnt * sizeof( VkQueueFamilyProperties ), 0 );
 
 if( !_queue_families )
     {
@@ -602,55 +2108,230 @@ if( !_queue_families )
     return false;
     }
 
-vkGetPhysicalDeviceQueueFamilyProperties( physical_device, &_queue_family_cnt, &_queue_families[ 0 ] );
+context->instance_funcs.vkGetPhysicalDeviceQueueFamilyProperties( physical_device, &_queue_family_cnt, &_queue_families[ 0 ] );
+_queue_family_cnt = ( _queue_family_cnt > IVK_QUEUE_MAX_FAMILIES ) ? IVK_QUEUE_MAX_FAMILIES : _queue_family_cnt;
+
+/* Nothing is presented headless */
+for( unsigned int i = 0; !context->headless && i < _queue_family_cnt; i++ )
+    {
+    __vk( context->instance_funcs.vkGetPhysicalDeviceSurfaceSupportKHR( physical_device, i, context->vk_surface, &_present_support[ i ] ) );
+    }
+
+_is_planned = ivk_queue_plan( _queue_families, _queue_family_cnt, context->headless ? NULL : _present_support, &_plan );
+ivk_arena_reset( &context->scratch_arena, _mark );
+if( !_is_planned )
+    {
+    return false;
+    }
+
+context->queue_plan = _plan;
+context->vk_graphics_family_idx = _plan.roles[ IVK_QUEUE_GRAPHICS ].family;
+context->vk_present_family_idx  = _plan.roles[ IVK_QUEUE_PRESENT ].family;
+context->vk_transfer_family_idx = _plan.roles[ IVK_QUEUE_TRANSFER ].family;
+
+return true;
+
+}
+
+
+/*
+ * Checks whether the physical device can report when
+ * presents reach the display ( VK_KHR_present_id and
+ * VK_KHR_present_wait ).
+ */
+static bool ivk_is_present_wait_supported
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device
+    )
+{
+/* Local variables */
+VkPhysicalDevicePresentIdFeaturesKHR    _present_id_features = { 0 };
+VkPhysicalDevicePresentWaitFeaturesKHR  _present_wait_features = { 0 };
+VkPhysicalDeviceFeatures2               _features = { 0 };
+
+if( !ivk_is_device_extension_supported( context, physical_device, VK_KHR_PRESENT_ID_EXTENSION_NAME ) ||
+    !ivk_is_device_extension_supported( context, physical_device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME ) )
+    {
+    return false;
+    }
+
+_present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+_present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+_present_id_features.pNext = &_present_wait_features;
+_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+_features.pNext = &_present_id_features;
+context->instance_funcs.vkGetPhysicalDeviceFeatures2( physical_device, &_features );
+
+return( _present_id_features.presentId && _present_wait_features.presentWait );
+
+}
+
+
+/*
+ * Returns the alignment of host memory imported through
+ * VK_EXT_external_memory_host, 0 if it is not supported.
+ */
+static VkDeviceSize ivk_query_host_pointer_alignment
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device
+    )
+{
+/* Local variables */
+VkPhysicalDeviceExternalMemoryHostPropertiesEXT
+                                _host_properties = { 0 };
+VkPhysicalDeviceProperties2     _properties = { 0 };
+
+if( !ivk_is_device_extension_supported( context, physical_device, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME ) )
+    {
+    return 0;
+    }
+
+_host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+_properties.pNext = &_host_properties;
+context->instance_funcs.vkGetPhysicalDeviceProperties2( physical_device, &_properties );
+
+return( _host_properties.minImportedHostPointerAlignment );
+
+}
+
+
+/*
+ * Checks that the device can draw with a pipeline state.
+ * Lines and points need fillModeNonSolid.
+ */
+static bool ivk_is_pipeline_state_supported
+    (
+    IVK_Context*                    context,
+    const IVK_pipeline_state_type*  state
+    )
+{
+if( state->polygon_mode != VK_POLYGON_MODE_FILL && !context->caps.fill_mode_non_solid )
+    {
+    printf( "Polygon mode %d not supported, the device lacks fillModeNonSolid.\n", ( int )state->polygon_mode );
+    return false;
+    }
+
+return true;
+
+}
+
 
-/* The queue families for graphics and presentation must be different */
-for( unsigned int i = 0; i < _queue_family_cnt; i++ )
+/*
+ * Queries which extended dynamic state levels the physical
+ * device supports. Returns IVK_DYNAMIC_STATE_* bits.
+ */
+static unsigned int ivk_query_dynamic_state_support
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device
+    )
+{
+/* Local variables */
+VkPhysicalDeviceExtendedDynamicStateFeaturesEXT     _eds1_features = { 0 };
+VkPhysicalDeviceExtendedDynamicState2FeaturesEXT    _eds2_features = { 0 };
+VkPhysicalDeviceExtendedDynamicState3FeaturesEXT    _eds3_features = { 0 };
+VkPhysicalDeviceExtendedDynamicState3PropertiesEXT  _eds3_properties = { 0 };
+VkPhysicalDeviceFeatures2                           _features = { 0 };
+VkPhysicalDeviceProperties2                         _properties = { 0 };
+unsigned int                                        _flags = 0;
+
+if( context->caps.api_version < VK_API_VERSION_1_1 )
     {
-    VkBool32    _present_supported = VK_FALSE;
+    return 0;
+    }
 
-    if( _queue_families[ i ].queueFlags & VK_QUEUE_GRAPHICS_BIT )
+/* Extended dynamic state 1 and 2 are core in Vulkan 1.3 */
+if( context->caps.api_version >= VK_API_VERSION_1_3 )
+    {
+    _flags |= IVK_DYNAMIC_STATE_1_BIT | IVK_DYNAMIC_STATE_2_BIT;
+    }
+else
+    {
+    _eds1_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+    _eds2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+    _eds1_features.pNext = &_eds2_features;
+    _features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    _features.pNext = &_eds1_features;
+    context->instance_funcs.vkGetPhysicalDeviceFeatures2( physical_device, &_features );
+
+    if( ivk_is_device_extension_supported( context, physical_device, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME ) &&
+        _eds1_features.extendedDynamicState )
         {
-        if( _graphics_family == INVALID_QUEUE )
-            {
-            _graphics_family = i;
-            continue;
-            }
+        _flags |= IVK_DYNAMIC_STATE_1_BIT;
         }
-    else if( _queue_families[ i ].queueFlags & VK_QUEUE_TRANSFER_BIT)
+    if( ivk_is_device_extension_supported( context, physical_device, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME ) &&
+        _eds2_features.extendedDynamicState2 )
         {
-        if( _transfer_family == INVALID_QUEUE )
-            {
-            _transfer_family = i;
-            continue;
-            }
+        _flags |= IVK_DYNAMIC_STATE_2_BIT;
         }
+    }
+
+/* Extended dynamic state 3 is extension-only */
+if( ivk_is_device_extension_supported( context, physical_device, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME ) )
+    {
+    _eds3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+    _features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    _features.pNext = &_eds3_features;
+    context->instance_funcs.vkGetPhysicalDeviceFeatures2( physical_device, &_features );
 
-    __vk( vkGetPhysicalDeviceSurfaceSupportKHR( physical_device, i, g_ivk_context.vk_surface, &_present_supported ) );
-    if( _present_supported && _present_family == INVALID_QUEUE )
+    _eds3_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_PROPERTIES_EXT;
+    _properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    _properties.pNext = &_eds3_properties;
+    context->instance_funcs.vkGetPhysicalDeviceProperties2( physical_device, &_properties );
+
+    if( _eds3_features.extendedDynamicState3PolygonMode )
         {
-        _present_family = i;
-        continue;
+        _flags |= IVK_DYNAMIC_STATE_3_BIT;
+        }
+    if( _eds3_properties.dynamicPrimitiveTopologyUnrestricted )
+        {
+        _flags |= IVK_DYNAMIC_STATE_ANY_TOPOLOGY_BIT;
         }
-
     }
 
-if( _graphics_family == INVALID_QUEUE || _present_family == INVALID_QUEUE || _transfer_family == INVALID_QUEUE )
+return _flags;
+
+}
+
+
+/*
+ * Checks whether a device extension is supported
+ */
+static bool ivk_is_device_extension_supported
+    (
+    IVK_Context*        context,
+    VkPhysicalDevice    physical_device,
+    const char*         extension_name
+    )
+{
+/* Local variables */
+unsigned int            _extension_count = 0;
+VkExtensionProperties*  _available_extensions = NULL;
+bool                    _is_supported = false;
+IVK_arena_mark_type     _mark = ivk_arena_mark( &context->scratch_arena );
+
+__vk( context->instance_funcs.vkEnumerateDeviceExtensionProperties( physical_device, NULL, &_extension_count, NULL ) );
+_available_extensions = ( VkExtensionProperties* )ivk_arena_alloc( &context->scratch_arena, _extension_count * sizeof( VkExtensionProperties ), 0 );
+if( !_available_extensions )
     {
-    free( _queue_families );
-    printf( "No queue families found.\n" );
     return false;
     }
+__vk( context->instance_funcs.vkEnumerateDeviceExtensionProperties( physical_device, NULL, &_extension_count, &_available_extensions[ 0 ] ) );
 
-g_ivk_context.vk_graphics_family_idx = _graphics_family;
-g_ivk_context.vk_present_family_idx  = _present_family;
-g_ivk_context.vk_transfer_family_idx = _transfer_family;
-
-free( _queue_families );
-return true;
+for( unsigned int i = 0; i < _extension_count; i++ )
+    {
+    if( strcmp( extension_name, _available_extensions[ i ].extensionName ) == 0 )
+        {
+        _is_supported = true;
+        break;
+        }
+    }
 
-/* Undefine local constants */
-#undef INVALILD_QUEUE
+ivk_arena_reset( &context->scratch_arena, _mark );
+return _is_supported;
 
 }
 
@@ -660,40 +2341,109 @@ return true;
  */
 static void ivk_create_logical_device
     (
-    void
+    IVK_Context*    context
     )
 {
 
 /* Local variables */
-VkDeviceQueueCreateInfo     _queue_create_info_arr[ 3 ] = { 0 };
+VkDeviceQueueCreateInfo     _queue_create_info_arr[ IVK_QUEUE_ROLE_COUNT ] = { 0 };
+unsigned int                _queue_create_info_count = 0;
 VkDeviceCreateInfo          _device_create_info = { 0 };
-VkPhysicalDeviceFeatures    _device_features = { 0 }; /* Not used */
-float                       _queue_priorities = 1.0f;
-
-/* Set up the graphics queue */
-_queue_create_info_arr[ 0 ].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-_queue_create_info_arr[ 0 ].queueFamilyIndex = g_ivk_context.vk_graphics_family_idx;
-_queue_create_info_arr[ 0 ].pQueuePriorities = &_queue_priorities;
-_queue_create_info_arr[ 0 ].queueCount = 1;
-
-/* Set up the presentation queue */
-_queue_create_info_arr[ 1 ].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-_queue_create_info_arr[ 1 ].queueFamilyIndex = g_ivk_context.vk_present_family_idx;
-_queue_create_info_arr[ 1 ].pQueuePriorities = &_queue_priorities;
-_queue_create_info_arr[ 1 ].queueCount = 1;
-
-/* Set up the transfer queue */
-_queue_create_info_arr[ 2 ].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-_queue_create_info_arr[ 2 ].queueFamilyIndex = g_ivk_context.vk_transfer_family_idx;
-_queue_create_info_arr[ 2 ].pQueuePriorities = &_queue_priorities;
-_queue_create_info_arr[ 2 ].queueCount = 1;
+IVK_caps_type               _enabled_caps = context->caps;
+IVK_caps_features_type      _device_features = { 0 };
+VkPhysicalDeviceExtendedDynamicStateFeaturesEXT
+                            _eds1_features = { 0 };
+VkPhysicalDeviceExtendedDynamicState2FeaturesEXT
+                            _eds2_features = { 0 };
+VkPhysicalDeviceExtendedDynamicState3FeaturesEXT
+                            _eds3_features = { 0 };
+VkPhysicalDevicePresentIdFeaturesKHR
+                            _present_id_features = { 0 };
+VkPhysicalDevicePresentWaitFeaturesKHR
+                            _present_wait_features = { 0 };
+void*                       _features_chain = NULL;
+const char*                 _extensions[ MAX_DEVICE_EXTENSIONS ];
+unsigned int                _extension_count = 0;
+unsigned int                _dynamic_state_flags = context->pipeline_cache.dynamic_state_flags;
+bool                        _is_core_13 = false;
+
+/* Required extensions first. Headless needs none of them. */
+for( unsigned int i = 0; !context->headless && i < g_device_extensions_count; i++ )
+    {
+    _extensions[ _extension_count++ ] = g_device_extensions[ i ];
+    }
+
+_is_core_13 = ( context->caps.api_version >= VK_API_VERSION_1_3 );
+
+/* One create info per family of the queue plan */
+_queue_create_info_count = ivk_queue_get_create_infos( &context->queue_plan, &_queue_create_info_arr[ 0 ] );
 
 _device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 _device_create_info.pQueueCreateInfos = &_queue_create_info_arr[ 0 ];
-_device_create_info.queueCreateInfoCount = 3;
-_device_create_info.pEnabledFeatures = &_device_features;
-_device_create_info.enabledExtensionCount = g_device_extensions_count;
-_device_create_info.ppEnabledExtensionNames = &g_device_extensions[ 0 ];
+_device_create_info.queueCreateInfoCount = _queue_create_info_count;
+_device_create_info.pEnabledFeatures = &_device_features.features;
+
+/* Every core feature the device has is turned on, those cost nothing
+unused. Pipeline statistics are only needed for the profiler. */
+_enabled_caps.pipeline_statistics = context->use_gpu_statistics;
+_features_chain = ivk_caps_get_features( &_enabled_caps, _features_chain, &_device_features );
+
+/* Extended dynamic state 1 and 2 only need enabling before Vulkan 1.3 */
+if( ( _dynamic_state_flags & IVK_DYNAMIC_STATE_1_BIT ) && !_is_core_13 )
+    {
+    _extensions[ _extension_count++ ] = VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME;
+    _eds1_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+    _eds1_features.extendedDynamicState = VK_TRUE;
+    _eds1_features.pNext = _features_chain;
+    _features_chain = &_eds1_features;
+    }
+if( ( _dynamic_state_flags & IVK_DYNAMIC_STATE_2_BIT ) && !_is_core_13 )
+    {
+    _extensions[ _extension_count++ ] = VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME;
+    _eds2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+    _eds2_features.extendedDynamicState2 = VK_TRUE;
+    _eds2_features.pNext = _features_chain;
+    _features_chain = &_eds2_features;
+    }
+if( _dynamic_state_flags & IVK_DYNAMIC_STATE_3_BIT )
+    {
+    _extensions[ _extension_count++ ] = VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME;
+    _eds3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+    _eds3_features.extendedDynamicState3PolygonMode = VK_TRUE;
+    _eds3_features.pNext = _features_chain;
+    _features_chain = &_eds3_features;
+    }
+
+/* Present id and wait measure when frames reach the display */
+if( context->use_present_wait )
+    {
+    _extensions[ _extension_count++ ] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+    _extensions[ _extension_count++ ] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+    _present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    _present_id_features.presentId = VK_TRUE;
+    _present_id_features.pNext = _features_chain;
+    _features_chain = &_present_id_features;
+    _present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    _present_wait_features.presentWait = VK_TRUE;
+    _present_wait_features.pNext = _features_chain;
+    _features_chain = &_present_wait_features;
+    }
+
+/* Heap usage, no features to enable */
+if( context->use_memory_budget )
+    {
+    _extensions[ _extension_count++ ] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+
+/* Host memory imports, no features to enable */
+if( context->use_external_memory_host )
+    {
+    _extensions[ _extension_count++ ] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+    }
+
+_device_create_info.pNext = _features_chain;
+_device_create_info.enabledExtensionCount = _extension_count;
+_device_create_info.ppEnabledExtensionNames = &_extensions[ 0 ];
 
 #if defined( VALIDATION_ENABLED ) && ( VALIDATION_ENABLED == 1 )
     _device_create_info.enabledLayerCount = g_validation_layer_cnt;
@@ -703,29 +2453,44 @@ _device_create_info.ppEnabledExtensionNames = &g_device_extensions[ 0 ];
 #endif
 
 /* Create the logical device */
-__vk( vkCreateDevice( g_ivk_context.vk_physical_device, &_device_create_info, NULL, &g_ivk_context.vk_device ) );
+__vk( context->instance_funcs.vkCreateDevice( context->vk_physical_device, &_device_create_info, g_ivk_host_allocator, &context->vk_device ) );
+
+/* From here on the device commands skip the loader */
+ivk_dispatch_load_device( context->vk_device, context->instance_funcs.vkGetDeviceProcAddr, true, &context->device_funcs );
 
 /* Obtain the queue handles */
-vkGetDeviceQueue
-    (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_graphics_family_idx,
-    0,
-    &g_ivk_context.vk_graphics_queue
-    );
-vkGetDeviceQueue
-    (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_present_family_idx,
-    0,
-    &g_ivk_context.vk_present_queue
-    );
-vkGetDeviceQueue
+ivk_queue_resolve( context->vk_device, &context->queue_plan );
+context->vk_graphics_queue = context->queue_plan.roles[ IVK_QUEUE_GRAPHICS ].queue;
+if( !context->headless )
+    {
+    context->vk_present_queue = context->queue_plan.roles[ IVK_QUEUE_PRESENT ].queue;
+    }
+context->vk_transfer_queue = context->queue_plan.roles[ IVK_QUEUE_TRANSFER ].queue;
+ivk_queue_print( &context->queue_plan );
+
+/* Load the present wait command */
+if( context->use_present_wait )
+    {
+    context->wait_for_present = ( PFN_vkWaitForPresentKHR )context->instance_funcs.vkGetDeviceProcAddr( context->vk_device, "vkWaitForPresentKHR" );
+    }
+
+/* Load the host memory import query */
+if( context->use_external_memory_host )
+    {
+    context->get_memory_host_pointer_properties =
+        ( PFN_vkGetMemoryHostPointerPropertiesEXT )context->instance_funcs.vkGetDeviceProcAddr( context->vk_device, "vkGetMemoryHostPointerPropertiesEXT" );
+    context->use_external_memory_host = ( context->get_memory_host_pointer_properties != NULL );
+    }
+
+/* Load the dynamic state commands */
+ivk_pipeline_load_dynamic_state
     (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_transfer_family_idx,
-    0,
-    &g_ivk_context.vk_transfer_queue
+    context->instance_funcs.vkGetDeviceProcAddr,
+    context->vk_device,
+    true,
+    _is_core_13,
+    _dynamic_state_flags,
+    &context->dynamic_state_funcs
     );
 
 return;
@@ -741,15 +2506,15 @@ return;
  */
 static void ivk_create_window_surface
     (
-    void
+    IVK_Context*    context
     )
 {
 glfwCreateWindowSurface
     (
-    g_ivk_context.vk_instance,
-    g_ivk_context.glfw_window,
-    NULL,
-    &g_ivk_context.vk_surface
+    context->vk_instance,
+    context->glfw_window,
+    g_ivk_host_allocator,
+    &context->vk_surface
     );
 
 return;
@@ -764,117 +2529,351 @@ return;
  * - creates image views
  * - creates framebuffers
  */
-static void ivk_init_presentation
+static void ivk_init_presentation
+    (
+    IVK_Context*    context,
+    VkSwapchainKHR  old_swapchain
+    )
+{
+/* Local variables */
+VkSemaphoreCreateInfo   _semaphore_create_info = { 0 };
+int                     _window_width = 0;
+int                     _window_height = 0;
+VkExtent2D              _window_extent = { 0 };
+
+if( context->headless )
+    {
+    ivk_init_offscreen( context );
+    return;
+    }
+
+/* Resolve the presentation policy. Frames in flight given at init
+take precedence over the policy's. */
+ivk_swapchain_resolve_policy
+    (
+    context->present_policy,
+    &context->swapchain_details,
+    &context->present_params
+    );
+if( !context->frames_in_flight_override )
+    {
+    ivk_set_frames_in_flight( context, context->present_params.frames_in_flight );
+    }
+
+/* Only used if the surface leaves the extent to the swapchain */
+glfwGetFramebufferSize( context->glfw_window, &_window_width, &_window_height );
+_window_extent.width = ( uint32_t )_window_width;
+_window_extent.height = ( uint32_t )_window_height;
+
+/* Create the swapchain */
+ivk_swapchain_create
+    (
+    context->vk_device,
+    &context->swapchain_details,
+    context->vk_surface,
+    context->vk_graphics_family_idx,
+    context->vk_present_family_idx,
+    &context->present_params,
+    _window_extent,
+    old_swapchain,
+    &context->vk_swapchain,
+    &context->swapchain_format,
+    &context->swapchain_extent
+    );
+
+/* Retrieve the swapchain images */
+ivk_swapchain_retrieve_images
+    (
+    context->vk_device,
+    context->vk_swapchain,
+    &context->swapchain_image_count,
+    &context->vk_images
+    );
+
+/* Create the image views for the images in the swapchain */
+ivk_swapchain_create_image_views
+    (
+    context->vk_device,
+    context->swapchain_image_count,
+    context->vk_images,
+    context->swapchain_format,
+    &context->vk_image_views
+    );
+
+/* One render finished semaphore per swapchain image */
+_semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+context->render_finished_semaphores = ( VkSemaphore* )calloc( context->swapchain_image_count, sizeof( VkSemaphore ) );
+if( !context->render_finished_semaphores )
+    {
+    printf( "Failed to allocate memory for the semaphores.\n" );
+    return;
+    }
+for( unsigned int i = 0; i < context->swapchain_image_count; i++ )
+    {
+    __vk( context->device_funcs.vkCreateSemaphore( context->vk_device, &_semaphore_create_info, g_ivk_host_allocator, &context->render_finished_semaphores[ i ] ) );
+    }
+
+}
+
+
+/*
+ * Initializes the offscreen images that replace the
+ * swapchain when headless.
+ */
+static void ivk_init_offscreen
+    (
+    IVK_Context*    context
+    )
+{
+/* One image per frame slot, so a slot never waits on another */
+context->swapchain_image_count = IVK_MAX_FRAMES_IN_FLIGHT;
+context->swapchain_extent = context->offscreen_extent;
+
+if( !ivk_offscreen_create_images
+        (
+        context->vk_device,
+        context->vk_physical_device,
+        context->swapchain_image_count,
+        context->swapchain_extent,
+        context->swapchain_format,
+        &context->vk_images,
+        &context->vk_images_memory
+        ) )
+    {
+    context->swapchain_image_count = 0;
+    return;
+    }
+
+ivk_swapchain_create_image_views
+    (
+    context->vk_device,
+    context->swapchain_image_count,
+    context->vk_images,
+    context->swapchain_format,
+    &context->vk_image_views
+    );
+
+}
+
+
+/*
+ * Cleans up the presentation objects.
+ * The swapchain images are automatically freed when destroying the
+ * swapchain.
+ */
+static void ivk_clean_presentation
+    (
+    IVK_Context*    context
+    )
+{
+/* Local variables */
+IVK_swapchain_retired_type  _presentation = { 0 };
+
+ivk_detach_presentation( context, &_presentation );
+ivk_swapchain_destroy_retired( context->vk_device, &_presentation );
+
+}
+
+
+/*
+ * Moves the presentation objects out of the context
+ */
+static void ivk_detach_presentation
+    (
+    IVK_Context*                context,
+    IVK_swapchain_retired_type* retired
+    )
+{
+retired->swapchain = context->vk_swapchain;
+retired->image_count = context->swapchain_image_count;
+retired->images = context->vk_images;
+retired->images_memory = context->vk_images_memory;
+retired->image_views = context->vk_image_views;
+retired->framebuffers = context->vk_framebuffers;
+retired->semaphores = context->render_finished_semaphores;
+
+context->vk_swapchain = VK_NULL_HANDLE;
+context->swapchain_image_count = 0;
+context->vk_images = NULL;
+context->vk_images_memory = NULL;
+context->vk_image_views = NULL;
+context->vk_framebuffers = NULL;
+context->render_finished_semaphores = NULL;
+
+}
+
+
+/*
+ * Queues the current presentation objects for destruction
+ * once the frames using them have completed.
+ */
+static void ivk_retire_presentation
     (
-    void
+    IVK_Context*    context
     )
 {
-/* Create the swapchain */
-ivk_swapchain_create
-    (
-    g_ivk_context.vk_device,
-    &g_ivk_context.swapchain_details,
-    g_ivk_context.vk_surface,
-    g_ivk_context.vk_graphics_family_idx,
-    g_ivk_context.vk_present_family_idx,
-    &g_ivk_context.vk_swapchain,
-    &g_ivk_context.swapchain_format,
-    &g_ivk_context.swapchain_extent
-    );
+/* Local variables */
+IVK_swapchain_retired_type* _retired = NULL;
 
-/* Retrieve the swapchain images */
-ivk_swapchain_retrieve_images
-    (
-    g_ivk_context.vk_device,
-    g_ivk_context.vk_swapchain,
-    &g_ivk_context.swapchain_image_count,
-    &g_ivk_context.vk_images
-    );
+/* Only happens when resizing faster than the frames complete */
+if( context->retired_swapchain_count == IVK_MAX_RETIRED_SWAPCHAINS )
+    {
+    context->device_funcs.vkDeviceWaitIdle( context->vk_device );
+    ivk_release_retired_presentation( context, UINT64_MAX );
+    }
 
-/* Create the image views for the images in the swapchain */
-ivk_swapchain_create_image_views
-    (
-    g_ivk_context.vk_device,
-    g_ivk_context.swapchain_image_count,
-    g_ivk_context.vk_images,
-    g_ivk_context.swapchain_format,
-    &g_ivk_context.vk_image_views
-    );
+_retired = &context->retired_swapchains[ context->retired_swapchain_count++ ];
+ivk_detach_presentation( context, _retired );
+
+/* The last frame submitted is the last to render into the old images.
+When the present queue is the graphics queue, its present waits on the
+old semaphore ahead of the next frame's submit, so once that next frame
+completes the semaphores are free too. A separate present queue is not
+ordered by the frame timeline, so its presents are waited for here; a
+resize is rare enough for that. Headless, there are no presents. */
+if( context->headless )
+    {
+    _retired->retire_value = context->frame_number;
+    }
+else if( context->vk_present_queue != context->vk_graphics_queue )
+    {
+    context->device_funcs.vkQueueWaitIdle( context->vk_present_queue );
+    _retired->retire_value = context->frame_number;
+    }
+else
+    {
+    _retired->retire_value = context->frame_number + 1;
+    }
 
 }
 
 
 /*
- * Cleans up the presentation objects.
- * The swapchain images are automatically freed when destroying the
- * swapchain.
+ * Destroys the retired presentation objects whose last frame
+ * is at or below completed_value on the frame timeline.
+ * UINT64_MAX, once the device is idle, destroys all of them.
  */
-static void ivk_clean_presentation
+static void ivk_release_retired_presentation
     (
-    void
+    IVK_Context*    context,
+    uint64_t        completed_value
     )
 {
-/* Destroy the framebuffers */
-for( unsigned int i = 0; i < g_ivk_context.swapchain_image_count; i++ )
+/* Local variables */
+unsigned int    _kept_count = 0;
+
+for( unsigned int i = 0; i < context->retired_swapchain_count; i++ )
     {
-    vkDestroyFramebuffer( g_ivk_context.vk_device, g_ivk_context.vk_framebuffers[ i ], NULL );
+    if( context->retired_swapchains[ i ].retire_value <= completed_value )
+        {
+        ivk_swapchain_destroy_retired( context->vk_device, &context->retired_swapchains[ i ] );
+        }
+    else
+        {
+        context->retired_swapchains[ _kept_count++ ] = context->retired_swapchains[ i ];
+        }
     }
-free( g_ivk_context.vk_framebuffers );
-
-ivk_swapchain_destroy_image_views( g_ivk_context.vk_device, g_ivk_context.swapchain_image_count, g_ivk_context.vk_image_views );
-vkDestroySwapchainKHR( g_ivk_context.vk_device, g_ivk_context.vk_swapchain, NULL );
+context->retired_swapchain_count = _kept_count;
 
 }
 
 
 /*
  * Re-creates the presentation objects when the swapchain
- * is inadequate.
+ * is inadequate. The new swapchain replaces the old one
+ * without draining the GPU; the old objects are retired
+ * and destroyed once their frames have completed.
  */
 static void ivk_recreate_presentation
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
-int _width  = 0;
-int _height = 0;
+uint64_t        _start_ns = 0;
+double          _hitch_ms = 0.0;
+VkSwapchainKHR  _old_swapchain = VK_NULL_HANDLE;
 
-/* Wait for the GPU to finish any ongoing operation */
-vkDeviceWaitIdle( g_ivk_context.vk_device );
+/* Only the capabilities follow the window, the formats and present
+modes queried at init still hold */
+if( !context->headless )
+    {
+    __vk( context->instance_funcs.vkGetPhysicalDeviceSurfaceCapabilitiesKHR
+            (
+            context->vk_physical_device,
+            context->vk_surface,
+            &context->swapchain_details.capabilities
+            ) );
+
+    /* If the current extent is 0, the window was minimized and
+    the application needs to wait. Off the event thread the events
+    are not ours to pump, the surface is polled instead. */
+    while( context->swapchain_details.capabilities.currentExtent.width == 0 ||
+           context->swapchain_details.capabilities.currentExtent.height == 0 )
+        {
+        if( context->is_event_thread )
+            {
+            glfwWaitEvents();
+            }
+        else
+            {
+            /* Stopping must not wait for the window to come back, the
+            next render tries again */
+            if( context->stop_request && IVK_ATOMIC_LOAD( context->stop_request ) )
+                {
+                context->is_presentation_dirty = true;
+                return;
+                }
+            ivk_thread_sleep_ms( MINIMIZED_POLL_MS );
+            }
+        __vk( context->instance_funcs.vkGetPhysicalDeviceSurfaceCapabilitiesKHR
+                (
+                context->vk_physical_device,
+                context->vk_surface,
+                &context->swapchain_details.capabilities
+                ) );
+        }
+    }
 
-/* Check for swapchain adequacy */
-ivk_swapchain_free_support( &g_ivk_context.swapchain_details );
-ivk_swapchain_query_support
-    (
-    g_ivk_context.vk_physical_device,
-    g_ivk_context.vk_surface,
-    &g_ivk_context.swapchain_details
-    );
+/* Time the hitch from here, waiting on a minimized window is not one */
+_start_ns = ivk_timer_now_ns();
+IVK_TRACE_BEGIN( "swapchain recreate" );
 
-/* If the max Image extent is 0, the window was minimized and
-the application needs to wait */
-_width = g_ivk_context.swapchain_details.capabilities.maxImageExtent.width;
-_height = g_ivk_context.swapchain_details.capabilities.maxImageExtent.height;
-while( _width == 0 ||
-       _height == 0 )
+/* Draining the GPU is only kept around to compare against */
+if( context->resize_wait_idle )
     {
-    glfwGetFramebufferSize( g_ivk_context.glfw_window, &_width, &_height );
-    glfwWaitEvents();
+    context->device_funcs.vkDeviceWaitIdle( context->vk_device );
     }
 
-ivk_swapchain_free_support( &g_ivk_context.swapchain_details );
-ivk_swapchain_query_support
-    (
-    g_ivk_context.vk_physical_device,
-    g_ivk_context.vk_surface,
-    &g_ivk_context.swapchain_details
-    );
+_old_swapchain = context->vk_swapchain;
+ivk_retire_presentation( context );
+ivk_init_presentation( context, _old_swapchain );
+
+/* Present ids restart with the new swapchain */
+context->pending_present_count = 0;
+
+/* With dynamic rendering the swapchain and views are all there is */
+if( !context->use_dynamic_rendering )
+    {
+    ivk_create_framebuffers( context );
+    }
 
-ivk_clean_presentation();
-ivk_init_presentation();
+/* The device was drained above, nothing uses the old objects */
+if( context->resize_wait_idle )
+    {
+    ivk_release_retired_presentation( context, UINT64_MAX );
+    }
 
-ivk_create_framebuffers();
+/* Keep track of the resize hitches */
+IVK_TRACE_END( "swapchain recreate" );
+_hitch_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - _start_ns );
+context->stats.resize_count++;
+context->stats.last_resize_ms = _hitch_ms;
+context->stats.total_resize_ms += _hitch_ms;
+if( _hitch_ms > context->stats.max_resize_ms )
+    {
+    context->stats.max_resize_ms = _hitch_ms;
+    }
 
 }
 
@@ -884,7 +2883,7 @@ ivk_create_framebuffers();
  */
 static void ivk_create_renderpass
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
@@ -892,16 +2891,16 @@ VkAttachmentDescription _color_attachment = { 0 };
 VkAttachmentReference   _color_attachment_reference = { 0 };
 VkSubpassDescription    _subpass = { 0 };
 VkRenderPassCreateInfo  _renderpass_create_info = { 0 };
-VkSubpassDependency     _dependency = { 0 };
+VkSubpassDependency     _dependencies[ 2 ] = { 0 };
 
-_color_attachment.format = g_ivk_context.swapchain_format;
+_color_attachment.format = context->swapchain_format;
 _color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
 _color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 _color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 _color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 _color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 _color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-_color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+_color_attachment.finalLayout = context->target_layout;
 
 _color_attachment_reference.attachment = 0;
 _color_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -910,27 +2909,37 @@ _subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 _subpass.colorAttachmentCount = 1;
 _subpass.pColorAttachments = &_color_attachment_reference;
 
-_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-_dependency.dstSubpass = 0;
-_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-_dependency.srcAccessMask = 0;
-_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+_dependencies[ 0 ].srcSubpass = VK_SUBPASS_EXTERNAL;
+_dependencies[ 0 ].dstSubpass = 0;
+_dependencies[ 0 ].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+_dependencies[ 0 ].srcAccessMask = 0;
+_dependencies[ 0 ].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+_dependencies[ 0 ].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+/* The readback copies the image after the pass. The transition to the
+final layout happens inside this dependency, so the copy's barrier can
+chain on its transfer stage. */
+_dependencies[ 1 ].srcSubpass = 0;
+_dependencies[ 1 ].dstSubpass = VK_SUBPASS_EXTERNAL;
+_dependencies[ 1 ].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+_dependencies[ 1 ].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+_dependencies[ 1 ].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+_dependencies[ 1 ].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
 _renderpass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 _renderpass_create_info.attachmentCount = 1;
 _renderpass_create_info.pAttachments = &_color_attachment;
 _renderpass_create_info.subpassCount = 1;
-_renderpass_create_info.dependencyCount = 1;
-_renderpass_create_info.pDependencies = &_dependency;
+_renderpass_create_info.dependencyCount = 2;
+_renderpass_create_info.pDependencies = &_dependencies[ 0 ];
 _renderpass_create_info.pSubpasses = &_subpass;
 
-__vk( vkCreateRenderPass
+__vk( context->device_funcs.vkCreateRenderPass
         (
-        g_ivk_context.vk_device,
+        context->vk_device,
         &_renderpass_create_info,
-        NULL,
-        &g_ivk_context.vk_renderpass
+        g_ivk_host_allocator,
+        &context->vk_renderpass
         ) );
 
 }
@@ -941,35 +2950,35 @@ __vk( vkCreateRenderPass
  */
 static void ivk_create_framebuffers
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
 VkFramebufferCreateInfo _framebuffer_create_info = { 0 };
 
 /* Allocate memory for the framebuffers */
-g_ivk_context.vk_framebuffers = ( VkFramebuffer* )calloc( g_ivk_context.swapchain_image_count, sizeof( VkFramebuffer ) );
+context->vk_framebuffers = ( VkFramebuffer* )calloc( context->swapchain_image_count, sizeof( VkFramebuffer ) );
 
-if( !g_ivk_context.vk_framebuffers )
+if( !context->vk_framebuffers )
     {
     printf( "Failed to allocate memory for the framebuffers.\n" );
     return;
     }
-for( unsigned int i = 0; i < g_ivk_context.swapchain_image_count; i++ )
+for( unsigned int i = 0; i < context->swapchain_image_count; i++ )
     {
-    VkImageView _attachments[] = { g_ivk_context.vk_image_views[ i ] };
+    VkImageView _attachments[] = { context->vk_image_views[ i ] };
 
     memset( &_framebuffer_create_info, 0, sizeof( _framebuffer_create_info ) );
     _framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    _framebuffer_create_info.renderPass = g_ivk_context.vk_renderpass;
+    _framebuffer_create_info.renderPass = context->vk_renderpass;
     _framebuffer_create_info.attachmentCount = 1;
     _framebuffer_create_info.pAttachments = _attachments;
-    _framebuffer_create_info.width = g_ivk_context.swapchain_extent.width;
-    _framebuffer_create_info.height = g_ivk_context.swapchain_extent.height;
+    _framebuffer_create_info.width = context->swapchain_extent.width;
+    _framebuffer_create_info.height = context->swapchain_extent.height;
     _framebuffer_create_info.layers = 1;
 
     /* Create the framebuffer */
-    __vk( vkCreateFramebuffer( g_ivk_context.vk_device, &_framebuffer_create_info, NULL, &g_ivk_context.vk_framebuffers[ i ] ) );
+    __vk( context->device_funcs.vkCreateFramebuffer( context->vk_device, &_framebuffer_create_info, g_ivk_host_allocator, &context->vk_framebuffers[ i ] ) );
     }
 }
 
@@ -979,7 +2988,7 @@ for( unsigned int i = 0; i < g_ivk_context.swapchain_image_count; i++ )
  */
 static void ivk_create_command_pools
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
@@ -987,25 +2996,25 @@ VkCommandPoolCreateInfo _command_pool_create_info[ 2 ] = { 0 };
 
 _command_pool_create_info[ 0 ].sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 _command_pool_create_info[ 0 ].flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-_command_pool_create_info[ 0 ].queueFamilyIndex = ( uint32_t )g_ivk_context.vk_graphics_family_idx;
+_command_pool_create_info[ 0 ].queueFamilyIndex = ( uint32_t )context->vk_graphics_family_idx;
 
 _command_pool_create_info[ 1 ].sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 _command_pool_create_info[ 1 ].flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-_command_pool_create_info[ 1 ].queueFamilyIndex = ( uint32_t )g_ivk_context.vk_transfer_family_idx;
+_command_pool_create_info[ 1 ].queueFamilyIndex = ( uint32_t )context->vk_transfer_family_idx;
 
-__vk( vkCreateCommandPool
+__vk( context->device_funcs.vkCreateCommandPool
         (
-        g_ivk_context.vk_device,
+        context->vk_device,
         &_command_pool_create_info[ 0 ],
-        NULL,
-        &g_ivk_context.vk_graphics_command_pool
+        g_ivk_host_allocator,
+        &context->vk_graphics_command_pool
         ) );
-__vk( vkCreateCommandPool
+__vk( context->device_funcs.vkCreateCommandPool
         (
-        g_ivk_context.vk_device,
+        context->vk_device,
         &_command_pool_create_info[ 1 ],
-        NULL,
-        &g_ivk_context.vk_transfer_command_pool
+        g_ivk_host_allocator,
+        &context->vk_transfer_command_pool
         ) );
 
 }
@@ -1016,22 +3025,22 @@ __vk( vkCreateCommandPool
  */
 static void ivk_create_command_buffers
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
 VkCommandBufferAllocateInfo _command_buffer_alloc_info = { 0 };
 
 _command_buffer_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-_command_buffer_alloc_info.commandPool = g_ivk_context.vk_graphics_command_pool;
+_command_buffer_alloc_info.commandPool = context->vk_graphics_command_pool;
 _command_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-_command_buffer_alloc_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+_command_buffer_alloc_info.commandBufferCount = IVK_MAX_FRAMES_IN_FLIGHT;
 
-__vk( vkAllocateCommandBuffers
+__vk( context->device_funcs.vkAllocateCommandBuffers
         (
-        g_ivk_context.vk_device,
+        context->vk_device,
         &_command_buffer_alloc_info,
-        &g_ivk_context.vk_command_buffer[ 0 ]
+        &context->vk_command_buffer[ 0 ]
         ) );
 
 }
@@ -1042,55 +3051,501 @@ __vk( vkAllocateCommandBuffers
  */
 static void ivk_record_command_buffer
     (
-    VkCommandBuffer command_buffer,
-    unsigned int    image_index
+    IVK_Context*            context,
+    VkCommandBuffer         command_buffer,
+    unsigned int            image_index,
+    const IVK_draw_type*    draws,
+    uint32_t                draw_count
     )
 {
 /* Local variables */
 VkCommandBufferBeginInfo    _command_buffer_begin_info = { 0 };
-VkRenderPassBeginInfo       _render_pass_begin_info = { 0 };
-VkClearValue                _clear_color = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
 VkViewport                  _viewport = { 0 };
 VkRect2D                    _scissor = { 0 };
-VkBuffer                    _vert_buffers[] = { 0 };
-VkDeviceSize                _offsets[] = { 0 };
+VkDeviceSize                _offset = 0;
+VkPipeline                  _pipeline = VK_NULL_HANDLE;
+const IVK_mesh_pool_type*   _meshes = &context->resources.meshes;
+IVK_instance_buffer_type*   _instances = &context->instance_buffers[ context->current_frame ];
+IVK_arena_type*             _arena = &context->frame_arenas[ context->current_frame ];
+IVK_arena_mark_type         _mark = ivk_arena_mark( _arena );
+IVK_draw_batch_type*        _batches = NULL;
+uint32_t                    _batch_count = 0;
+uint32_t                    _material = UINT32_MAX;
+uint32_t                    _mesh_index = UINT32_MAX;
+const IVK_pipeline_state_type*
+                            _state = NULL;
 
 _command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 _command_buffer_begin_info.flags = 0;
 _command_buffer_begin_info.pInheritanceInfo = NULL;
 
-_render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-_render_pass_begin_info.renderPass = g_ivk_context.vk_renderpass;
-_render_pass_begin_info.framebuffer = g_ivk_context.vk_framebuffers[ image_index ];
-_render_pass_begin_info.renderArea.offset.x = 0;
-_render_pass_begin_info.renderArea.offset.y = 0;
-_render_pass_begin_info.renderArea.extent = g_ivk_context.swapchain_extent;
-_render_pass_begin_info.clearValueCount = 1;
-_render_pass_begin_info.pClearValues = &_clear_color;
-
 _viewport.x = 0.0f;
 _viewport.y = 0.0f;
-_viewport.width = g_ivk_context.swapchain_extent.width;
-_viewport.height = g_ivk_context.swapchain_extent.height;
+_viewport.width = context->swapchain_extent.width;
+_viewport.height = context->swapchain_extent.height;
 _viewport.minDepth = 0.0f;
 _viewport.maxDepth = 1.0f;
 
 _scissor.offset.x = 0.0f;
 _scissor.offset.y = 0.0f;
-_scissor.extent = g_ivk_context.swapchain_extent;
+_scissor.extent = context->swapchain_extent;
+
+/* Sort and merge the draws, their transforms go straight to the
+slot's instance buffer */
+context->materials[ 0 ] = context->pipeline_state;
+if( ivk_reserve_instances( context, draw_count ) )
+    {
+    _batch_count = ivk_draw_build_batches( _meshes, draws, draw_count, _arena, context->jobs, _instances->transforms, &_batches );
+    }
+
+context->frame_draw_count = 0;
+context->frame_bind_count = 0;
+
+__vk( context->device_funcs.vkBeginCommandBuffer( command_buffer, &_command_buffer_begin_info ) );
+ivk_barrier_begin( &context->device_funcs, context->caps.synchronization2, command_buffer, &context->barriers );
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_begin_frame( &context->gpu_profiler, command_buffer, context->current_frame, context->frame_number + 1 );
+    ivk_gpu_profiler_begin_zone( &context->gpu_profiler, command_buffer, "scene" );
+    }
+ivk_begin_scene_pass( context, command_buffer, image_index );
+context->device_funcs.vkCmdSetViewport( command_buffer, 0, 1, &_viewport );
+context->device_funcs.vkCmdSetScissor( command_buffer, 0, 1, &_scissor );
+if( _batch_count > 0 )
+    {
+    context->device_funcs.vkCmdBindVertexBuffers( command_buffer, 1, 1, &_instances->buffer, &_offset );
+    context->frame_bind_count++;
+    }
+
+/* The batches come sorted, so pipelines and meshes are only bound
+when they change */
+for( uint32_t i = 0; i < _batch_count; i++ )
+    {
+    if( _batches[ i ].material != _material )
+        {
+        _material = _batches[ i ].material;
+        _state = ( _material < context->material_count ) ? &context->materials[ _material ] : &context->pipeline_state;
+
+        /* Only a change to the static state can need a new pipeline */
+        _pipeline = ivk_pipeline_cache_get
+            (
+            &context->pipeline_cache,
+            context->vk_device,
+            context->vk_pipeline_layout,
+            context->swapchain_extent,
+            context->vk_renderpass,
+            context->swapchain_format,
+            _state
+            );
+        if( _pipeline != VK_NULL_HANDLE )
+            {
+            context->device_funcs.vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline );
+            ivk_pipeline_set_dynamic_state
+                (
+                &context->dynamic_state_funcs,
+                command_buffer,
+                context->pipeline_cache.dynamic_state_flags,
+                _state
+                );
+            context->frame_bind_count++;
+            }
+        }
+
+    /* The material's pipeline could not be built, its batches are dropped */
+    if( _pipeline == VK_NULL_HANDLE )
+        {
+        continue;
+        }
+    if( _batches[ i ].mesh_index != _mesh_index )
+        {
+        _mesh_index = _batches[ i ].mesh_index;
+        context->device_funcs.vkCmdBindVertexBuffers( command_buffer, 0, 1, &_meshes->vk_vertex_buffers[ _mesh_index ], &_offset );
+        context->device_funcs.vkCmdBindIndexBuffer( command_buffer, _meshes->vk_index_buffers[ _mesh_index ], 0, VK_INDEX_TYPE_UINT32 );
+        context->frame_bind_count += 2;
+        }
+    context->device_funcs.vkCmdDrawIndexed
+        (
+        command_buffer,
+        _meshes->index_counts[ _mesh_index ],
+        _batches[ i ].instance_count,
+        0,
+        0,
+        _batches[ i ].first_instance
+        );
+    context->frame_draw_count++;
+    }
+context->stats.draw_count = context->frame_draw_count;
+context->stats.bind_count = context->frame_bind_count;
+context->stats.instance_count = draw_count;
+ivk_arena_reset( _arena, _mark );
+
+/* The overlay goes last, over the scene */
+if( context->is_hud_visible )
+    {
+    ivk_record_hud( context, command_buffer );
+    }
+ivk_end_scene_pass( context, command_buffer, image_index );
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_end_zone( &context->gpu_profiler, command_buffer );
+    }
+
+/* Copy the frame out for the CPU, it is picked up once the frame
+completes */
+if( context->use_readback )
+    {
+    if( context->use_gpu_profiler )
+        {
+        ivk_gpu_profiler_begin_zone( &context->gpu_profiler, command_buffer, "readback" );
+        }
+    ivk_readback_record
+        (
+        &context->device_funcs,
+        &context->readback,
+        context->vk_device,
+        context->vk_physical_device,
+        command_buffer,
+        &context->barriers,
+        context->vk_images[ image_index ],
+        &context->target_state,
+        context->swapchain_extent,
+        context->frame_number + 1
+        );
+    }
+
+/* The image ends the frame in its target layout, whether it was read
+back, dropped by the readback or not read back at all. Its transition
+goes out with the readback's, in one barrier. */
+ivk_barrier_image
+    (
+    &context->barriers,
+    context->vk_images[ image_index ],
+    VK_IMAGE_ASPECT_COLOR_BIT,
+    VK_PIPELINE_STAGE_2_NONE,
+    VK_ACCESS_2_NONE,
+    context->target_layout,
+    &context->target_state
+    );
+ivk_barrier_flush( &context->barriers );
+if( context->use_readback && context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_end_zone( &context->gpu_profiler, command_buffer );
+    }
+
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_end_frame( &context->gpu_profiler, command_buffer );
+    }
+__vk( context->device_funcs.vkEndCommandBuffer( command_buffer ) );
+
+}
+
+
+/*
+ * Grows the current frame slot's instance buffer to hold
+ * instance_count transforms. The slot must be idle.
+ */
+static bool ivk_reserve_instances
+    (
+    IVK_Context*    context,
+    uint32_t        instance_count
+    )
+{
+/* Local variables */
+IVK_instance_buffer_type*   _instances = &context->instance_buffers[ context->current_frame ];
+uint32_t                    _capacity = _instances->capacity ? _instances->capacity : IVK_DRAW_INITIAL_INSTANCES;
+
+if( instance_count <= _instances->capacity )
+    {
+    return true;
+    }
+
+/* Doubling keeps a growing scene from reallocating every frame */
+while( _capacity < instance_count )
+    {
+    _capacity *= 2;
+    }
+
+/* The slot's previous frame is done with the old buffer */
+ivk_draw_destroy_instance_buffer( context->vk_device, _instances );
+return ivk_draw_create_instance_buffer( context->vk_device, context->vk_physical_device, _capacity, _instances );
+
+}
+
+
+/*
+ * Begins rendering to a swapchain image, either with the
+ * render pass or with dynamic rendering.
+ */
+static void ivk_begin_scene_pass
+    (
+    IVK_Context*    context,
+    VkCommandBuffer command_buffer,
+    unsigned int    image_index
+    )
+{
+/* Local variables */
+VkClearValue                _clear_color = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
+VkRenderPassBeginInfo       _render_pass_begin_info = { 0 };
+VkRenderingAttachmentInfo   _color_attachment = { 0 };
+VkRenderingInfo             _rendering_info = { 0 };
+
+if( !context->use_dynamic_rendering )
+    {
+    _render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    _render_pass_begin_info.renderPass = context->vk_renderpass;
+    _render_pass_begin_info.framebuffer = context->vk_framebuffers[ image_index ];
+    _render_pass_begin_info.renderArea.offset.x = 0;
+    _render_pass_begin_info.renderArea.offset.y = 0;
+    _render_pass_begin_info.renderArea.extent = context->swapchain_extent;
+    _render_pass_begin_info.clearValueCount = 1;
+    _render_pass_begin_info.pClearValues = &_clear_color;
+
+    context->device_funcs.vkCmdBeginRenderPass( command_buffer, &_render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE );
+    return;
+    }
+
+/* Without a render pass the layout transition is ours to do. The
+previous contents are discarded, matching the render pass' UNDEFINED
+initial layout, and the acquire semaphore's wait orders it after the
+presentation engine. */
+ivk_barrier_reset( VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_IMAGE_LAYOUT_UNDEFINED, &context->target_state );
+ivk_barrier_image
+    (
+    &context->barriers,
+    context->vk_images[ image_index ],
+    VK_IMAGE_ASPECT_COLOR_BIT,
+    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    &context->target_state
+    );
+ivk_barrier_flush( &context->barriers );
+
+_color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+_color_attachment.imageView = context->vk_image_views[ image_index ];
+_color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+_color_attachment.resolveMode = VK_RESOLVE_MODE_NONE;
+_color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+_color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+_color_attachment.clearValue = _clear_color;
+
+_rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+_rendering_info.renderArea.offset.x = 0;
+_rendering_info.renderArea.offset.y = 0;
+_rendering_info.renderArea.extent = context->swapchain_extent;
+_rendering_info.layerCount = 1;
+_rendering_info.colorAttachmentCount = 1;
+_rendering_info.pColorAttachments = &_color_attachment;
+
+context->device_funcs.vkCmdBeginRendering( command_buffer, &_rendering_info );
+
+}
+
+
+/*
+ * Ends rendering to a swapchain image. Its transition, to
+ * the presentation layout or to the copy layout for the
+ * headless or read back frames, is left in the batch for
+ * the end of the frame.
+ */
+static void ivk_end_scene_pass
+    (
+    IVK_Context*    context,
+    VkCommandBuffer command_buffer,
+    unsigned int    image_index
+    )
+{
+/* Local variables */
+VkPipelineStageFlags2   _next_stages = VK_PIPELINE_STAGE_2_NONE;
+VkAccessFlags2          _next_access = VK_ACCESS_2_NONE;
+VkImageLayout           _next_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+if( !context->use_dynamic_rendering )
+    {
+    context->device_funcs.vkCmdEndRenderPass( command_buffer );
+
+    /* The render pass' last dependency already made the rendering
+    visible to transfer reads, in the final layout */
+    ivk_barrier_reset( VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, context->target_layout, &context->target_state );
+    context->target_state.read_stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    context->target_state.read_access = VK_ACCESS_2_TRANSFER_READ_BIT;
+    return;
+    }
+
+context->device_funcs.vkCmdEndRendering( command_buffer );
+
+/* Transition to the presentation layout, which the present waits for
+through the semaphore, or headless to the copy layout. A frame read
+back goes straight to the copy layout, the readback then needs no
+transition of its own. */
+_next_layout = context->target_layout;
+if( context->headless || context->use_readback )
+    {
+    _next_stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    _next_access = VK_ACCESS_2_TRANSFER_READ_BIT;
+    }
+if( context->use_readback )
+    {
+    _next_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    }
+ivk_barrier_image
+    (
+    &context->barriers,
+    context->vk_images[ image_index ],
+    VK_IMAGE_ASPECT_COLOR_BIT,
+    _next_stages,
+    _next_access,
+    _next_layout,
+    &context->target_state
+    );
+
+}
+
+
+/*
+ * Records the performance overlay into the scene pass
+ */
+static void ivk_record_hud
+    (
+    IVK_Context*    context,
+    VkCommandBuffer command_buffer
+    )
+{
+/* Local variables */
+IVK_hud_stats_type  _stats = { 0 };
+uint64_t            _now_ns = ivk_timer_now_ns();
+
+/* The heaps change slowly and the query is not free */
+if( _now_ns - context->heap_query_ns >= IVK_HUD_TEXT_INTERVAL_NS )
+    {
+    ivk_query_memory_heaps( context );
+    context->heap_query_ns = _now_ns;
+    }
+
+_stats.frame_ms = context->last_frame_ms;
+_stats.cpu_ms = context->stats.cpu_frame_ms;
+_stats.gpu_ms = -1.0;
+if( context->use_gpu_profiler && context->gpu_profiler.zones[ 0 ].sample_count > 0 )
+    {
+    _stats.gpu_ms = context->gpu_profiler.zones[ 0 ].average_ms;
+    }
+_stats.draw_count = context->stats.draw_count;
+_stats.bind_count = context->stats.bind_count;
+_stats.upload_bytes = context->stats.upload_bytes;
+_stats.heap_count = ( context->stats.heap_count < IVK_HUD_MAX_HEAPS ) ? context->stats.heap_count : IVK_HUD_MAX_HEAPS;
+_stats.has_heap_usage = context->stats.is_heap_usage_known;
+for( unsigned int i = 0; i < _stats.heap_count; i++ )
+    {
+    _stats.heap_usage[ i ] = context->stats.heap_usage[ i ];
+    _stats.heap_size[ i ] = context->stats.heap_budget[ i ];
+    }
+
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_begin_zone( &context->gpu_profiler, command_buffer, "hud" );
+    }
+ivk_hud_record( &context->hud, command_buffer, context->current_frame, context->swapchain_extent, &_stats );
+if( context->use_gpu_profiler )
+    {
+    ivk_gpu_profiler_end_zone( &context->gpu_profiler, command_buffer );
+    }
+
+}
+
+
+/*
+ * Reads the usage and budget of the memory heaps into the
+ * statistics. Without VK_EXT_memory_budget only the heap
+ * sizes are known.
+ */
+static void ivk_query_memory_heaps
+    (
+    IVK_Context*    context
+    )
+{
+/* Local variables */
+VkPhysicalDeviceMemoryBudgetPropertiesEXT
+                                    _budget = { 0 };
+VkPhysicalDeviceMemoryProperties2   _properties = { 0 };
+
+_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+if( context->use_memory_budget )
+    {
+    _budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    _properties.pNext = &_budget;
+    }
+context->instance_funcs.vkGetPhysicalDeviceMemoryProperties2( context->vk_physical_device, &_properties );
+
+context->stats.heap_count = _properties.memoryProperties.memoryHeapCount;
+context->stats.is_heap_usage_known = context->use_memory_budget;
+for( unsigned int i = 0; i < _properties.memoryProperties.memoryHeapCount; i++ )
+    {
+    context->stats.heap_usage[ i ] = _budget.heapUsage[ i ];
+    context->stats.heap_budget[ i ] = context->use_memory_budget ? _budget.heapBudget[ i ] : _properties.memoryProperties.memoryHeaps[ i ].size;
+    }
+
+}
+
+
+/*
+ * Hands the memory of the current frame slot to the frame
+ * being built. Memory of the slot's previous frame is
+ * released once the GPU is past it; is_slot_idle skips the
+ * wait when the caller has already waited.
+ */
+static void ivk_claim_frame_arena
+    (
+    IVK_Context*    context,
+    bool            is_slot_idle
+    )
+{
+/* Local variables */
+VkSemaphoreWaitInfo _wait_info = { 0 };
+uint64_t            _frame_value = context->frame_number + 1;
+
+if( context->frame_arena_value[ context->current_frame ] == _frame_value )
+    {
+    return;
+    }
+
+if( !is_slot_idle )
+    {
+    _wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    _wait_info.semaphoreCount = 1;
+    _wait_info.pSemaphores = &context->frame_timeline;
+    _wait_info.pValues = &context->frame_slot_value[ context->current_frame ];
+    __vk( context->device_funcs.vkWaitSemaphores( context->vk_device, &_wait_info, UINT64_MAX ) );
+    }
 
-_vert_buffers[ 0 ] = g_ivk_context.triangle_vert_buffer;
+ivk_arena_clear( &context->frame_arenas[ context->current_frame ] );
+context->frame_arena_value[ context->current_frame ] = _frame_value;
 
-__vk( vkBeginCommandBuffer( command_buffer, &_command_buffer_begin_info ) );
-vkCmdBeginRenderPass( command_buffer, &_render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE );
-vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, g_ivk_context.vk_pipeline );
-vkCmdSetViewport( command_buffer, 0, 1, &_viewport );
-vkCmdSetScissor( command_buffer, 0, 1, &_scissor );
-vkCmdBindVertexBuffers( command_buffer, 0, 1, _vert_buffers, _offsets );
-vkCmdBindIndexBuffer( command_buffer, g_ivk_context.triangle_index_buffer, 0, VK_INDEX_TYPE_UINT32 );
-vkCmdDrawIndexed( command_buffer, g_ivk_context.index_count, 1, 0, 0, 0 );
-vkCmdEndRenderPass( command_buffer );
-__vk( vkEndCommandBuffer( command_buffer ) );
+}
+
+
+/*
+ * Queues an object for destruction once the frames
+ * submitted so far have completed
+ */
+static void ivk_defer_destroy
+    (
+    IVK_Context*        context,
+    IVK_deletion_type*  deletion
+    )
+{
+/* Nothing recorded from here on can use the object, so the last frame
+submitted is the last that may */
+deletion->retire_value = context->frame_number;
+if( ivk_deletion_queue_push( &context->deletion_queue, deletion ) )
+    {
+    return;
+    }
+
+/* Out of memory to queue it, stall instead so the queue empties */
+ivk_wait_idle( context );
+ivk_deletion_queue_flush( &context->device_funcs, context->vk_device, &context->deletion_queue, context->frame_number );
+ivk_deletion_queue_push( &context->deletion_queue, deletion );
 
 }
 
@@ -1100,21 +3555,28 @@ __vk( vkEndCommandBuffer( command_buffer ) );
  */
 static void ivk_create_sync_objects
     (
-    void
+    IVK_Context*    context
     )
 {
 /* Local variables */
-VkSemaphoreCreateInfo   _semaphore_create_info = { 0 };
-VkFenceCreateInfo       _fence_create_info = { 0 };
+VkSemaphoreCreateInfo       _semaphore_create_info = { 0 };
+VkSemaphoreTypeCreateInfo   _semaphore_type_create_info = { 0 };
 
 _semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-_fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-_fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-for( unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
+/* The acquire semaphores are per frame slot */
+for( unsigned int i = 0; i < IVK_MAX_FRAMES_IN_FLIGHT; i++ )
     {
-    __vk( vkCreateSemaphore( g_ivk_context.vk_device, &_semaphore_create_info, NULL, &g_ivk_context.image_available_semaphore[ i ] ) );
-    __vk( vkCreateSemaphore( g_ivk_context.vk_device, &_semaphore_create_info, NULL, &g_ivk_context.render_finished_semaphore[ i ] ) );
-    __vk( vkCreateFence( g_ivk_context.vk_device, &_fence_create_info, NULL, &g_ivk_context.in_flight_fence[ i ] ) );
+    __vk( context->device_funcs.vkCreateSemaphore( context->vk_device, &_semaphore_create_info, g_ivk_host_allocator, &context->image_available_semaphore[ i ] ) );
+    context->frame_slot_value[ i ] = 0;
     }
+
+/* A single timeline paces all the frames; frame N signals value N */
+_semaphore_type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+_semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+_semaphore_type_create_info.initialValue = 0;
+_semaphore_create_info.pNext = &_semaphore_type_create_info;
+__vk( context->device_funcs.vkCreateSemaphore( context->vk_device, &_semaphore_create_info, g_ivk_host_allocator, &context->frame_timeline ) );
+context->frame_number = 0;
+
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdbool.h>
 #include "vulkan/vulkan.h"
 
 /* This needs to go away ASAP */
@@ -10,6 +11,21 @@
 #include "ivk_buffers.h"
 #include "ivk_util.h"
 #include "ivk_swapchain.h"
+#include "ivk_pipeline.h"
+#include "ivk_offscreen.h"
+#include "ivk_readback.h"
+#include "ivk_shm.h"
+#include "ivk_gpu_profiler.h"
+#include "ivk_hud.h"
+#include "ivk_memory.h"
+#include "ivk_deletion.h"
+#include "ivk_draw.h"
+#include "ivk_job.h"
+#include "ivk_queue.h"
+#include "ivk_caps.h"
+#include "ivk_dispatch.h"
+#include "ivk_barrier.h"
+#include "ivk_resource.h"
 
 /*
  * Debug macros
@@ -20,22 +36,169 @@
     #define VALIDATION_ENABLED  0
 #endif
 
-#define MAX_FRAMES_IN_FLIGHT    2
+/*
+ * Frame pacing limits. The frames in flight are set at init
+ * time, between 1 and IVK_MAX_FRAMES_IN_FLIGHT.
+ */
+#define IVK_MAX_FRAMES_IN_FLIGHT        4
+#define IVK_DEFAULT_FRAMES_IN_FLIGHT    2
+
+/*
+ * Maximum number of replaced swapchains waiting for their
+ * frames to complete
+ */
+#define IVK_MAX_RETIRED_SWAPCHAINS      8
+
+/*
+ * Maximum number of presents waiting to reach the display
+ */
+#define IVK_MAX_PENDING_PRESENTS        8
+
+/*
+ * Scratch memory for the temporaries of the initialization,
+ * and per frame slot for those of the frames. Both grow to
+ * what the workload needs.
+ */
+#define IVK_SCRATCH_ARENA_SIZE          ( 64 * 1024 )
+#define IVK_FRAME_ARENA_SIZE            ( 64 * 1024 )
 
+/*
+ * Folds a sample into a rolling average
+ */
+#define IVK_STATS_SMOOTHING             0.05
+#define IVK_STATS_AVERAGE( avg, sample ) \
+    ( ( avg ) = ( avg ) + IVK_STATS_SMOOTHING * ( ( sample ) - ( avg ) ) )
+
+/*
+ * Initialization options. A zero-initialized struct (or
+ * passing NULL) selects the default behavior.
+ */
+typedef struct
+    {
+    bool                dynamic_rendering;  /* Render with VK_KHR_dynamic_rendering
+                                               instead of a render pass, if supported */
+    bool                extended_dynamic_state;
+                                            /* Set cull mode, front face, topology, depth
+                                               test etc. in the command buffer, if supported */
+    IVK_present_policy_type
+                        present_policy;
+    unsigned int        frames_in_flight;   /* 1 to IVK_MAX_FRAMES_IN_FLIGHT, 0 to follow
+                                               the present policy */
+    bool                resize_wait_idle;   /* Drain the GPU on resize. Slower, kept to
+                                               measure the resize hitch against */
+    bool                headless;           /* Render into offscreen images, without a
+                                               window, surface or present queue */
+    VkExtent2D          offscreen_extent;   /* Headless only */
+    VkFormat            offscreen_format;   /* Headless only, VK_FORMAT_UNDEFINED for
+                                               IVK_OFFSCREEN_DEFAULT_FORMAT */
+    bool                gpu_profiler;       /* Time the passes of each frame on the GPU */
+    bool                gpu_statistics;     /* Also count the shader invocations, if supported */
+    bool                hud;                /* Draw the performance overlay, implies
+                                               gpu_profiler */
+    bool                track_host_memory;  /* Give Vulkan counting allocation callbacks,
+                                               report them at teardown. Process-wide,
+                                               the first context decides for all */
+    VkInstance          instance;           /* Another context's instance to share, it
+                                               must outlive this context. VK_NULL_HANDLE
+                                               to create one. */
+    } IVK_config_type;
+
+/*
+ * Runtime statistics
+ */
+typedef struct
+    {
+    char                device_name[ VK_MAX_PHYSICAL_DEVICE_NAME_SIZE ];
+    double              init_instance_ms;   /* ivk_init, instance and surface */
+    double              init_device_ms;     /* Device selection and creation */
+    double              init_pipeline_ms;   /* Layout and default pipeline */
+    double              init_total_ms;
+    uint64_t            frame_count;        /* Frames submitted so far */
+    unsigned int        resize_count;
+    double              last_resize_ms;     /* CPU time spent recreating the swapchain */
+    double              max_resize_ms;
+    double              total_resize_ms;
+    double              acquire_to_present_ms;
+                                            /* Rolling average, CPU side */
+    double              present_to_display_ms;
+                                            /* Rolling average, needs VK_KHR_present_wait */
+    bool                is_present_wait_enabled;
+    bool                is_readback_enabled;
+                                            /* By ivk_enable_readback or the shared
+                                               memory output */
+    unsigned int        readback_delivered_count;
+    unsigned int        readback_dropped_count;
+                                            /* Frames not read back as all the
+                                               slots were busy */
+    uint64_t            shm_published_count;
+    uint64_t            shm_dropped_count;  /* Frames the consumer had no room for */
+    bool                is_shm_zero_copy;   /* Copied straight into the shared memory */
+    double              frame_ms;           /* Rolling average, start to start */
+    double              cpu_frame_ms;       /* Rolling average of the CPU work in
+                                               ivk_render, without the waits */
+    unsigned int        draw_count;         /* Draw calls recorded in the last frame */
+    unsigned int        instance_count;     /* Draw records in the last frame */
+    unsigned int        bind_count;         /* Pipeline and buffer binds in the last frame */
+    uint64_t            upload_bytes;       /* Staged to the GPU so far */
+    unsigned int        heap_count;
+    VkDeviceSize        heap_usage[ VK_MAX_MEMORY_HEAPS ];
+                                            /* Needs VK_EXT_memory_budget */
+    VkDeviceSize        heap_budget[ VK_MAX_MEMORY_HEAPS ];
+                                            /* The heap size without VK_EXT_memory_budget */
+    bool                is_heap_usage_known;
+    uint64_t            host_bytes;         /* Live in the allocation callbacks, needs
+                                               IVK_config_type::track_host_memory */
+    uint64_t            host_allocation_count;
+                                            /* Made so far */
+    size_t              frame_memory_high_water;
+                                            /* Most memory a frame slot held */
+    unsigned int        frame_memory_overflow_count;
+                                            /* Frame allocations that went to
+                                               the heap */
+    unsigned int        deferred_destroy_count;
+                                            /* Objects waiting for the GPU to
+                                               be done with them */
+    uint64_t            destroyed_count;    /* Deferred objects destroyed so far */
+    } IVK_stats_type;
+
+typedef struct
+    {
+    uint64_t            present_id;
+    uint64_t            present_ns;
+    } IVK_pending_present_type;
+
+/*
+ * Everything a renderer owns. The caller keeps it and passes
+ * it to every call; one thread at a time per context.
+ */
 typedef struct
     {
     /* Graphics components */
     VkInstance          vk_instance;
+    bool                owns_instance;      /* Not shared from another context */
+    uint32_t            instance_version;   /* API version the instance was created at */
     VkPhysicalDevice    vk_physical_device;
+    IVK_caps_type       caps;               /* Of the physical device */
     VkDevice            vk_device;
+    IVK_instance_funcs_type
+                        instance_funcs;
+    IVK_device_funcs_type
+                        device_funcs;       /* Every device command ivk.c calls */
     VkCommandPool       vk_graphics_command_pool;
     VkQueue             vk_graphics_queue;
     unsigned int        vk_graphics_family_idx;
     VkDescriptorSetLayout vk_pipeline_descriptor_set_layout;
     VkPipelineLayout    vk_pipeline_layout;
-    VkPipeline          vk_pipeline;
-    VkCommandBuffer     vk_command_buffer[ MAX_FRAMES_IN_FLIGHT ];
-    VkRenderPass        vk_renderpass;
+    IVK_pipeline_cache_type
+                        pipeline_cache;
+    IVK_pipeline_state_type
+                        pipeline_state;     /* State used for the next frame */
+    IVK_dynamic_state_funcs_type
+                        dynamic_state_funcs;
+    VkCommandBuffer     vk_command_buffer[ IVK_MAX_FRAMES_IN_FLIGHT ];
+    VkRenderPass        vk_renderpass;      /* VK_NULL_HANDLE with dynamic rendering */
+    bool                use_dynamic_rendering;
+    bool                use_extended_dynamic_state;
 
     /* Transfer components */
     VkQueue             vk_transfer_queue;
@@ -44,9 +207,14 @@ typedef struct
 
     /* Presentation components */
     GLFWwindow*         glfw_window;
+    bool                is_event_thread;    /* Rendering on the thread that polls the
+                                               window events, so it may wait on them */
+    volatile uint32_t*  stop_request;       /* Off the event thread, set once the
+                                               renderer is asked to stop. May be NULL. */
     VkSurfaceKHR        vk_surface;
     unsigned int        vk_present_family_idx;
     VkQueue             vk_present_queue;
+    IVK_queue_plan_type queue_plan;         /* Every queue created, by role */
 
     /* Swapchain information */
     IVK_swapchain_details_type
@@ -57,49 +225,438 @@ typedef struct
     unsigned int        swapchain_image_count;
     VkImage*            vk_images;
     VkImageView*        vk_image_views;
-    VkFramebuffer*      vk_framebuffers;
+    VkFramebuffer*      vk_framebuffers;    /* NULL with dynamic rendering */
+    IVK_swapchain_retired_type
+                        retired_swapchains[ IVK_MAX_RETIRED_SWAPCHAINS ];
+    unsigned int        retired_swapchain_count;
+    bool                resize_wait_idle;
+
+    /* Presentation policy */
+    IVK_present_policy_type
+                        present_policy;
+    IVK_present_params_type
+                        present_params;
+    bool                is_presentation_dirty;
+    unsigned int        frames_in_flight_override;
+
+    /* Present latency measurement */
+    bool                use_present_wait;
+    PFN_vkWaitForPresentKHR
+                        wait_for_present;
+    IVK_pending_present_type
+                        pending_presents[ IVK_MAX_PENDING_PRESENTS ];
+    unsigned int        pending_present_count;
+
+    /* Offscreen targets, headless only. The images take the
+    place of the swapchain images. */
+    bool                headless;
+    VkExtent2D          offscreen_extent;   /* Requested size */
+    VkDeviceMemory*     vk_images_memory;
+    VkImageLayout       target_layout;      /* Layout the images are left in */
+    IVK_barrier_state_type
+                        target_state;       /* Of the image being rendered */
+    IVK_barrier_batch_type
+                        barriers;           /* Of the command buffer being recorded */
+
+    /* Readback of the rendered frames */
+    bool                use_readback;
+    IVK_readback_type   readback;
+
+    /* GPU timing of the frames */
+    bool                use_gpu_profiler;
+    bool                use_gpu_statistics;
+    IVK_gpu_profiler_type
+                        gpu_profiler;
+
+    /* Performance overlay */
+    bool                use_hud;
+    bool                is_hud_visible;
+    IVK_hud_type        hud;
+    bool                use_memory_budget;
+    uint64_t            heap_query_ns;      /* When the heaps were last queried */
+
+    /* Frame statistics */
+    uint64_t            last_render_ns;     /* Start of the previous ivk_render */
+    double              last_frame_ms;
+    unsigned int        frame_draw_count;   /* Of the frame being recorded */
+    unsigned int        frame_bind_count;
+
+    /* Shared memory output, fed by the readback */
+    bool                use_shm_output;
+    IVK_shm_ring_type   shm_ring;
+    bool                use_external_memory_host;
+    VkDeviceSize        host_pointer_alignment;
+    PFN_vkGetMemoryHostPointerPropertiesEXT
+                        get_memory_host_pointer_properties;
 
     /* Synchronization mechanisms */
-    VkSemaphore         image_available_semaphore[ MAX_FRAMES_IN_FLIGHT ];
-    VkSemaphore         render_finished_semaphore[ MAX_FRAMES_IN_FLIGHT ];
-    VkFence             in_flight_fence[ MAX_FRAMES_IN_FLIGHT ];
-
-    /* User data - will go away soon */
-    VkBuffer            triangle_vert_buffer;
-    VkDeviceMemory      triangle_buffer_memory;
-    VkBuffer            triangle_index_buffer;
-    VkDeviceMemory      triangle_index_buffer_memory;
-    unsigned int        index_count;
+    unsigned int        frames_in_flight;
+    unsigned int        current_frame;      /* Frame slot being recorded */
+    VkSemaphore         frame_timeline;     /* Signaled with the frame number */
+    uint64_t            frame_number;       /* Last frame submitted */
+    uint64_t            frame_slot_value[ IVK_MAX_FRAMES_IN_FLIGHT ];
+                                            /* Last frame submitted from each slot */
+    VkSemaphore         image_available_semaphore[ IVK_MAX_FRAMES_IN_FLIGHT ];
+    VkSemaphore*        render_finished_semaphores;
+                                            /* One per swapchain image */
+
+    /* Host memory */
+    bool                use_host_allocator;
+    IVK_host_allocator_type*
+                        host_allocator;     /* Process-wide, shared by the contexts */
+    IVK_arena_type      scratch_arena;      /* Initialization only */
+    IVK_arena_type      frame_arenas[ IVK_MAX_FRAMES_IN_FLIGHT ];
+    uint64_t            frame_arena_value[ IVK_MAX_FRAMES_IN_FLIGHT ];
+                                            /* Frame each slot's memory belongs to */
+
+    /* Statistics */
+    IVK_stats_type      stats;
+
+    /* Meshes and the buffers behind them */
+    IVK_resource_table_type
+                        resources;
+    IVK_deletion_queue_type
+                        deletion_queue;     /* Drained after each frame wait */
+    IVK_instance_buffer_type
+                        instance_buffers[ IVK_MAX_FRAMES_IN_FLIGHT ];
+    IVK_pipeline_state_type
+                        materials[ IVK_DRAW_MAX_MATERIALS ];
+                                            /* 0 is pipeline_state */
+    uint32_t            material_count;
+    IVK_job_system_type*
+                        jobs;               /* May be NULL */
     } IVK_Context;
 
 
 /*
- * Initializes IVK library
+ * Initializes an IVK context. Contexts share nothing but the
+ * host allocator, and the instance if config asks for it, so
+ * each can render from its own thread. The instance
+ * extensions are unused with a shared instance. False if no
+ * Vulkan 1.2 instance could be created, the context is then
+ * unusable.
  */
-void ivk_init
+bool ivk_init
     (
-    unsigned int instance_extension_count,
-    const char** instance_extensions,
-    GLFWwindow*  window
+    IVK_Context*            context,
+    unsigned int            instance_extension_count,
+    const char**            instance_extensions,
+    GLFWwindow*             window,     /* NULL when headless */
+    const IVK_config_type*  config
     );
 
 /*
- * Initializes the triangle for rendering
+ * Uploads an indexed mesh, for the draw records.
+ * IVK_INVALID_HANDLE if the mesh pool is full.
  */
-void ivk_init_triangle
+IVK_mesh_handle_type ivk_create_mesh
     (
-    ivk_2p3c_type*  triangle_data,
+    IVK_Context*    context,
+    ivk_2p3c_type*  vertex_data,
     unsigned int    vert_cnt,
     unsigned int*   index_data,
     unsigned int    index_cnt
     );
 
 /*
- * Renders to the screen.
+ * Destroys a mesh and its buffers, once the frames in
+ * flight are done with them. The handle goes stale.
+ */
+void ivk_destroy_mesh
+    (
+    IVK_Context*            context,
+    IVK_mesh_handle_type    mesh
+    );
+
+/*
+ * Adds a pipeline state for the draw records to refer to.
+ * Returns its material ID, 0 ( the default state ) if the
+ * table is full or the device cannot draw the state.
+ */
+uint32_t ivk_create_material
+    (
+    IVK_Context*                    context,
+    const IVK_pipeline_state_type*  state
+    );
+
+/*
+ * Sets the pipeline state ( culling, topology, depth test... )
+ * used from the next frame on. A state the device cannot
+ * draw is ignored.
+ */
+void ivk_set_pipeline_state
+    (
+    IVK_Context*                    context,
+    const IVK_pipeline_state_type*  state
+    );
+
+/*
+ * Returns the number of distinct pipelines built so far
+ */
+unsigned int ivk_get_pipeline_count
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Calls the device commands straight into the driver, the
+ * default, or through the loader's exports. The loader is
+ * kept to measure the direct calls against.
+ */
+void ivk_set_direct_dispatch
+    (
+    IVK_Context*    context,
+    bool            is_direct
+    );
+
+/*
+ * Returns what the device supports, and has enabled
+ */
+const IVK_caps_type* ivk_get_caps
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Returns the queues of the device by role, for the
+ * subsystems that submit on their own
+ */
+const IVK_queue_plan_type* ivk_get_queue_plan
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Sets how many frames the CPU may run ahead of the GPU.
+ * Fewer frames lower the latency, more frames absorb hitches.
+ */
+void ivk_set_frames_in_flight
+    (
+    IVK_Context*    context,
+    unsigned int    frames_in_flight
+    );
+
+/*
+ * Switches the presentation policy. The swapchain is rebuilt
+ * at the start of the next frame.
+ */
+void ivk_set_present_policy
+    (
+    IVK_Context*            context,
+    IVK_present_policy_type policy
+    );
+
+/*
+ * Resizes the offscreen images. They are rebuilt at the
+ * start of the next frame. Headless only.
+ */
+void ivk_set_offscreen_extent
+    (
+    IVK_Context*    context,
+    unsigned int    width,
+    unsigned int    height
+    );
+
+/*
+ * Copies every rendered frame back to the CPU through a
+ * ring of slot_count host buffers. The callback receives
+ * each frame once the GPU is done with it, a few frames
+ * later, from within ivk_render. Frames are dropped rather
+ * than waited for when all the slots are busy.
+ */
+bool ivk_enable_readback
+    (
+    IVK_Context*                context,
+    unsigned int                slot_count,
+    IVK_readback_callback_type  callback,
+    void*                       user_data
+    );
+
+/*
+ * Stops the readback. The frames still in flight are
+ * delivered first.
+ */
+void ivk_disable_readback
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Publishes every rendered frame into the named shared
+ * memory ring of slot_count slots, for another process to
+ * consume. Takes over the readback. Where the device can
+ * import host memory the frames are copied by the GPU
+ * straight into the ring. Frames larger than the current
+ * extent, or finding the ring full, are dropped.
+ */
+bool ivk_enable_shm_output
+    (
+    IVK_Context*    context,
+    const char*     name,
+    unsigned int    slot_count
+    );
+
+/*
+ * Stops the shared memory output and removes the ring
+ */
+void ivk_disable_shm_output
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Fills in up to max_count GPU zone summaries ( the whole
+ * frame, the scene pass, the readback copy ), returns the
+ * number of zones. Needs IVK_config_type::gpu_profiler.
+ */
+unsigned int ivk_get_gpu_profile
+    (
+    IVK_Context*                context,
+    IVK_gpu_zone_report_type*   reports,
+    unsigned int                max_count
+    );
+
+/*
+ * Writes the GPU zone summaries to path, as CSV or JSON
+ * depending on the extension
+ */
+bool ivk_dump_gpu_profile
+    (
+    IVK_Context*    context,
+    const char*     path
+    );
+
+/*
+ * Shows or hides the performance overlay. Needs
+ * IVK_config_type::hud.
+ */
+void ivk_show_hud
+    (
+    IVK_Context*    context,
+    bool            is_visible
+    );
+
+/*
+ * Lets ivk_render fan its per-draw work out on jobs, NULL
+ * to do it all inline. Called from a thread other than the
+ * one that created jobs, it runs inline anyway.
+ */
+void ivk_set_job_system
+    (
+    IVK_Context*            context,
+    IVK_job_system_type*    jobs
+    );
+
+/*
+ * Returns size bytes of memory for the frame being built,
+ * aligned to alignment ( 0 for the default ). It stays
+ * valid until the frame's slot comes round again and the
+ * GPU is done with the frame. NULL if out of memory.
+ */
+void* ivk_frame_alloc
+    (
+    IVK_Context*    context,
+    size_t          size,
+    size_t          alignment
+    );
+
+/*
+ * Returns the current position in the frame's memory, for
+ * temporaries that can go before the frame does
+ */
+IVK_arena_mark_type ivk_frame_mark
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Releases the frame's memory allocated since mark
+ */
+void ivk_frame_reset
+    (
+    IVK_Context*        context,
+    IVK_arena_mark_type mark
+    );
+
+/*
+ * Destroys a buffer once the frames submitted so far are
+ * done with it, without waiting for them
+ */
+void ivk_destroy_buffer
+    (
+    IVK_Context*    context,
+    VkBuffer        buffer
+    );
+
+/*
+ * Destroys an image once the frames submitted so far are
+ * done with it
+ */
+void ivk_destroy_image
+    (
+    IVK_Context*    context,
+    VkImage         image
+    );
+
+/*
+ * Destroys an image view once the frames submitted so far
+ * are done with it
+ */
+void ivk_destroy_image_view
+    (
+    IVK_Context*    context,
+    VkImageView     image_view
+    );
+
+/*
+ * Destroys a pipeline once the frames submitted so far are
+ * done with it
+ */
+void ivk_destroy_pipeline
+    (
+    IVK_Context*    context,
+    VkPipeline      pipeline
+    );
+
+/*
+ * Frees device memory once the frames submitted so far are
+ * done with it. Free it after what is bound to it.
+ */
+void ivk_free_memory
+    (
+    IVK_Context*    context,
+    VkDeviceMemory  memory
+    );
+
+/*
+ * Retrieves the runtime statistics
+ */
+void ivk_get_stats
+    (
+    IVK_Context*    context,
+    IVK_stats_type* stats
+    );
+
+/*
+ * Waits for all the submitted frames to complete
+ */
+void ivk_wait_idle
+    (
+    IVK_Context*    context
+    );
+
+/*
+ * Renders a frame, to the screen or headless to the
+ * next offscreen image. The draws are sorted by layer,
+ * material and mesh, and the draws of the same mesh and
+ * material merged into instanced draw calls. They are
+ * consumed before the call returns.
  */
 void ivk_render
     (
-    void
+    IVK_Context*            context,
+    const IVK_draw_type*    draws,
+    uint32_t                draw_count
     );
 
 /*
@@ -107,6 +664,6 @@ void ivk_render
  */
 void ivk_teardown
     (
-    void
+    IVK_Context*    context
     );
     
\ No newline at end of file
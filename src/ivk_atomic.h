@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * Acquire loads and release stores, enough for a single
+ * producer and a single consumer to hand data over, also
+ * across processes. The variables must be naturally
+ * aligned, and declared volatile.
+ *
+ * IVK_ATOMIC_CAS_PTR replaces *ptr with desired if it still
+ * holds expected, and evaluates to whether it did.
+ * IVK_ATOMIC_CAS_U64 does the same for a uint64_t, and
+ * IVK_ATOMIC_ADD_U64 adds to one and evaluates to the sum.
+ * IVK_ATOMIC_EXCHANGE_U32 stores into a uint32_t and
+ * evaluates to what it held, as a full barrier.
+ * IVK_ATOMIC_FENCE orders every access before it against
+ * every access after it, loads after stores included.
+ */
+#if defined( _MSC_VER )
+    #include <intrin.h>
+
+    /* Volatile accesses already order like this under the
+    default /volatile:ms, the barriers stop the compiler */
+    #define IVK_ATOMIC_LOAD( ptr )              \
+            ( *( ptr ) )
+    #define IVK_ATOMIC_STORE( ptr, value ) do { \
+            _ReadWriteBarrier();                \
+            *( ptr ) = ( value );               \
+        } while( 0 )
+    #define IVK_ATOMIC_CAS_PTR( ptr, expected, desired ) \
+            ( _InterlockedCompareExchangePointer( ( void* volatile* )( ptr ), ( desired ), ( expected ) ) == ( expected ) )
+    #define IVK_ATOMIC_CAS_U64( ptr, expected, desired ) \
+            ( ( uint64_t )_InterlockedCompareExchange64( ( volatile __int64* )( ptr ), ( __int64 )( desired ), ( __int64 )( expected ) ) == ( expected ) )
+    #define IVK_ATOMIC_ADD_U64( ptr, value )    \
+            ( ( uint64_t )_InterlockedExchangeAdd64( ( volatile __int64* )( ptr ), ( __int64 )( value ) ) + ( value ) )
+    #define IVK_ATOMIC_EXCHANGE_U32( ptr, value ) \
+            ( ( uint32_t )_InterlockedExchange( ( volatile long* )( ptr ), ( long )( value ) ) )
+    #define IVK_ATOMIC_FENCE()                  \
+            MemoryBarrier()
+#else
+    #define IVK_ATOMIC_LOAD( ptr )              \
+            __atomic_load_n( ( ptr ), __ATOMIC_ACQUIRE )
+    #define IVK_ATOMIC_STORE( ptr, value )      \
+            __atomic_store_n( ( ptr ), ( value ), __ATOMIC_RELEASE )
+    #define IVK_ATOMIC_CAS_PTR( ptr, expected, desired ) \
+            __sync_bool_compare_and_swap( ( ptr ), ( expected ), ( desired ) )
+    #define IVK_ATOMIC_CAS_U64( ptr, expected, desired ) \
+            __sync_bool_compare_and_swap( ( ptr ), ( expected ), ( desired ) )
+    #define IVK_ATOMIC_ADD_U64( ptr, value )    \
+            __atomic_add_fetch( ( ptr ), ( value ), __ATOMIC_ACQ_REL )
+    #define IVK_ATOMIC_EXCHANGE_U32( ptr, value ) \
+            __atomic_exchange_n( ( ptr ), ( value ), __ATOMIC_SEQ_CST )
+    #define IVK_ATOMIC_FENCE()                  \
+            __atomic_thread_fence( __ATOMIC_SEQ_CST )
+#endif
@@ -0,0 +1,420 @@
+#include <string.h>
+
+#include "ivk_barrier.h"
+
+/*
+ * Accesses that write, the others read
+ */
+#define WRITE_ACCESS                                        \
+    ( VK_ACCESS_2_SHADER_WRITE_BIT                          \
+    | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT                  \
+    | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT                \
+    | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT        \
+    | VK_ACCESS_2_TRANSFER_WRITE_BIT                        \
+    | VK_ACCESS_2_HOST_WRITE_BIT                            \
+    | VK_ACCESS_2_MEMORY_WRITE_BIT )
+
+/*
+ * The synchronization2 bits with a Vulkan 1.0 equivalent
+ */
+#define LEGACY_BITS             0xFFFFFFFFull
+
+/*** Static functions ***/
+/*
+ * Works out whether an access needs a barrier after the
+ * last one, with which source masks, and records it as
+ * the last access
+ */
+static bool resolve
+    (
+    VkPipelineStageFlags2   stages,
+    VkAccessFlags2          access,
+    VkImageLayout           layout,
+    IVK_barrier_state_type* state,
+    VkPipelineStageFlags2*  src_stages,
+    VkAccessFlags2*         src_access
+    );
+
+/*
+ * Records the batch with the Vulkan 1.0 barrier
+ */
+static void flush_legacy
+    (
+    IVK_barrier_batch_type* batch
+    );
+
+/*
+ * Narrows synchronization2 stages to Vulkan 1.0 ones, none
+ * becoming empty_stage
+ */
+static VkPipelineStageFlags to_legacy_stages
+    (
+    VkPipelineStageFlags2   stages,
+    VkPipelineStageFlags    empty_stage
+    );
+
+/*
+ * Narrows synchronization2 accesses to Vulkan 1.0 ones
+ */
+static VkAccessFlags to_legacy_access
+    (
+    VkAccessFlags2          access
+    );
+
+
+/*
+ * Starts gathering barriers for a command buffer
+ */
+void ivk_barrier_begin
+    (
+    const IVK_device_funcs_type*    funcs,
+    bool                            use_sync2,
+    VkCommandBuffer                 command_buffer,
+    IVK_barrier_batch_type*         batch
+    )
+{
+batch->funcs = funcs;
+batch->use_sync2 = use_sync2;
+batch->command_buffer = command_buffer;
+batch->buffer_count = 0;
+batch->image_count = 0;
+
+}
+
+
+/*
+ * Forgets the accesses of a resource, e.g. once a semaphore
+ * wait at stages orders it after them. The next access only
+ * waits for stages.
+ */
+void ivk_barrier_reset
+    (
+    VkPipelineStageFlags2   stages,
+    VkImageLayout           layout,
+    IVK_barrier_state_type* state
+    )
+{
+state->write_stages = stages;
+state->write_access = VK_ACCESS_2_NONE;
+state->read_stages = VK_PIPELINE_STAGE_2_NONE;
+state->read_access = VK_ACCESS_2_NONE;
+state->layout = layout;
+
+}
+
+
+/*
+ * Adds the barrier, if any, that an access to the whole
+ * buffer needs after its last one
+ */
+void ivk_barrier_buffer
+    (
+    IVK_barrier_batch_type* batch,
+    VkBuffer                buffer,
+    VkPipelineStageFlags2   stages,
+    VkAccessFlags2          access,
+    IVK_barrier_state_type* state
+    )
+{
+/* Local variables */
+VkBufferMemoryBarrier2* _barrier = NULL;
+VkPipelineStageFlags2   _src_stages = VK_PIPELINE_STAGE_2_NONE;
+VkAccessFlags2          _src_access = VK_ACCESS_2_NONE;
+
+if( !resolve( stages, access, state->layout, state, &_src_stages, &_src_access ) )
+    {
+    return;
+    }
+
+/* The barriers of one flush happen at once, a second one for the same
+buffer has to come after the first */
+for( uint32_t i = 0; i < batch->buffer_count; i++ )
+    {
+    if( batch->buffers[ i ].buffer == buffer )
+        {
+        ivk_barrier_flush( batch );
+        break;
+        }
+    }
+if( batch->buffer_count == IVK_BARRIER_MAX_BUFFERS )
+    {
+    ivk_barrier_flush( batch );
+    }
+
+_barrier = &batch->buffers[ batch->buffer_count++ ];
+memset( _barrier, 0, sizeof( *_barrier ) );
+_barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+_barrier->srcStageMask = _src_stages;
+_barrier->srcAccessMask = _src_access;
+_barrier->dstStageMask = stages;
+_barrier->dstAccessMask = access;
+_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+_barrier->buffer = buffer;
+_barrier->offset = 0;
+_barrier->size = VK_WHOLE_SIZE;
+
+}
+
+
+/*
+ * Adds the barrier, if any, that an access to the image in
+ * layout needs after its last one. A change of layout always
+ * takes one.
+ */
+void ivk_barrier_image
+    (
+    IVK_barrier_batch_type* batch,
+    VkImage                 image,
+    VkImageAspectFlags      aspect_mask,
+    VkPipelineStageFlags2   stages,
+    VkAccessFlags2          access,
+    VkImageLayout           layout,
+    IVK_barrier_state_type* state
+    )
+{
+/* Local variables */
+VkImageMemoryBarrier2*  _barrier = NULL;
+VkPipelineStageFlags2   _src_stages = VK_PIPELINE_STAGE_2_NONE;
+VkAccessFlags2          _src_access = VK_ACCESS_2_NONE;
+VkImageLayout           _old_layout = state->layout;
+
+if( !resolve( stages, access, layout, state, &_src_stages, &_src_access ) )
+    {
+    return;
+    }
+
+for( uint32_t i = 0; i < batch->image_count; i++ )
+    {
+    if( batch->images[ i ].image == image )
+        {
+        ivk_barrier_flush( batch );
+        break;
+        }
+    }
+if( batch->image_count == IVK_BARRIER_MAX_IMAGES )
+    {
+    ivk_barrier_flush( batch );
+    }
+
+_barrier = &batch->images[ batch->image_count++ ];
+memset( _barrier, 0, sizeof( *_barrier ) );
+_barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+_barrier->srcStageMask = _src_stages;
+_barrier->srcAccessMask = _src_access;
+_barrier->dstStageMask = stages;
+_barrier->dstAccessMask = access;
+_barrier->oldLayout = _old_layout;
+_barrier->newLayout = layout;
+_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+_barrier->image = image;
+_barrier->subresourceRange.aspectMask = aspect_mask;
+_barrier->subresourceRange.baseMipLevel = 0;
+_barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+_barrier->subresourceRange.baseArrayLayer = 0;
+_barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+}
+
+
+/*
+ * Records the gathered barriers, if there are any
+ */
+void ivk_barrier_flush
+    (
+    IVK_barrier_batch_type* batch
+    )
+{
+/* Local variables */
+VkDependencyInfo    _dependency_info = { 0 };
+
+if( batch->buffer_count == 0 && batch->image_count == 0 )
+    {
+    return;
+    }
+
+if( !batch->use_sync2 )
+    {
+    flush_legacy( batch );
+    }
+else
+    {
+    _dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    _dependency_info.bufferMemoryBarrierCount = batch->buffer_count;
+    _dependency_info.pBufferMemoryBarriers = &batch->buffers[ 0 ];
+    _dependency_info.imageMemoryBarrierCount = batch->image_count;
+    _dependency_info.pImageMemoryBarriers = &batch->images[ 0 ];
+    batch->funcs->vkCmdPipelineBarrier2( batch->command_buffer, &_dependency_info );
+    }
+
+batch->buffer_count = 0;
+batch->image_count = 0;
+
+}
+
+
+/*
+ * Works out whether an access needs a barrier after the
+ * last one, with which source masks, and records it as
+ * the last access
+ */
+static bool resolve
+    (
+    VkPipelineStageFlags2   stages,
+    VkAccessFlags2          access,
+    VkImageLayout           layout,
+    IVK_barrier_state_type* state,
+    VkPipelineStageFlags2*  src_stages,
+    VkAccessFlags2*         src_access
+    )
+{
+/* Local variables */
+bool    _is_write = ( access & WRITE_ACCESS ) != 0;
+bool    _is_transition = ( layout != state->layout );
+
+/* Reads only wait for the last write, and only once per stage and
+access; reads after reads need nothing */
+if( !_is_write && !_is_transition )
+    {
+    if( state->write_stages == VK_PIPELINE_STAGE_2_NONE
+     || ( ( stages & ~state->read_stages ) == 0 && ( access & ~state->read_access ) == 0 ) )
+        {
+        state->read_stages |= stages;
+        state->read_access |= access;
+        return false;
+        }
+
+    *src_stages = state->write_stages;
+    *src_access = state->write_access;
+    state->read_stages |= stages;
+    state->read_access |= access;
+    return true;
+    }
+
+/* Writes and transitions wait for everything since the last write.
+Only that write needs flushing, earlier reads just have to be done. */
+*src_stages = state->write_stages | state->read_stages;
+*src_access = state->write_access;
+
+state->write_stages = stages;
+state->write_access = access & WRITE_ACCESS;
+state->read_access = access & ~WRITE_ACCESS;
+state->read_stages = state->read_access ? stages : VK_PIPELINE_STAGE_2_NONE;
+state->layout = layout;
+
+/* The first use of a buffer, or of an image staying in its layout */
+return( *src_stages != VK_PIPELINE_STAGE_2_NONE || _is_transition );
+
+}
+
+
+/*
+ * Records the batch with the Vulkan 1.0 barrier
+ */
+static void flush_legacy
+    (
+    IVK_barrier_batch_type* batch
+    )
+{
+/* Local variables */
+VkBufferMemoryBarrier   _buffers[ IVK_BARRIER_MAX_BUFFERS ];
+VkImageMemoryBarrier    _images[ IVK_BARRIER_MAX_IMAGES ];
+VkPipelineStageFlags2   _src_stages = VK_PIPELINE_STAGE_2_NONE;
+VkPipelineStageFlags2   _dst_stages = VK_PIPELINE_STAGE_2_NONE;
+
+/* Vulkan 1.0 has one pair of stage masks for the whole call */
+for( uint32_t i = 0; i < batch->buffer_count; i++ )
+    {
+    memset( &_buffers[ i ], 0, sizeof( _buffers[ i ] ) );
+    _buffers[ i ].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    _buffers[ i ].srcAccessMask = to_legacy_access( batch->buffers[ i ].srcAccessMask );
+    _buffers[ i ].dstAccessMask = to_legacy_access( batch->buffers[ i ].dstAccessMask );
+    _buffers[ i ].srcQueueFamilyIndex = batch->buffers[ i ].srcQueueFamilyIndex;
+    _buffers[ i ].dstQueueFamilyIndex = batch->buffers[ i ].dstQueueFamilyIndex;
+    _buffers[ i ].buffer = batch->buffers[ i ].buffer;
+    _buffers[ i ].offset = batch->buffers[ i ].offset;
+    _buffers[ i ].size = batch->buffers[ i ].size;
+    _src_stages |= batch->buffers[ i ].srcStageMask;
+    _dst_stages |= batch->buffers[ i ].dstStageMask;
+    }
+for( uint32_t i = 0; i < batch->image_count; i++ )
+    {
+    memset( &_images[ i ], 0, sizeof( _images[ i ] ) );
+    _images[ i ].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    _images[ i ].srcAccessMask = to_legacy_access( batch->images[ i ].srcAccessMask );
+    _images[ i ].dstAccessMask = to_legacy_access( batch->images[ i ].dstAccessMask );
+    _images[ i ].oldLayout = batch->images[ i ].oldLayout;
+    _images[ i ].newLayout = batch->images[ i ].newLayout;
+    _images[ i ].srcQueueFamilyIndex = batch->images[ i ].srcQueueFamilyIndex;
+    _images[ i ].dstQueueFamilyIndex = batch->images[ i ].dstQueueFamilyIndex;
+    _images[ i ].image = batch->images[ i ].image;
+    _images[ i ].subresourceRange = batch->images[ i ].subresourceRange;
+    _src_stages |= batch->images[ i ].srcStageMask;
+    _dst_stages |= batch->images[ i ].dstStageMask;
+    }
+
+batch->funcs->vkCmdPipelineBarrier
+    (
+    batch->command_buffer,
+    to_legacy_stages( _src_stages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT ),
+    to_legacy_stages( _dst_stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT ),
+    0,
+    0, NULL,
+    batch->buffer_count, &_buffers[ 0 ],
+    batch->image_count, &_images[ 0 ]
+    );
+
+}
+
+
+/*
+ * Narrows synchronization2 stages to Vulkan 1.0 ones, none
+ * becoming empty_stage
+ */
+static VkPipelineStageFlags to_legacy_stages
+    (
+    VkPipelineStageFlags2   stages,
+    VkPipelineStageFlags    empty_stage
+    )
+{
+if( stages == VK_PIPELINE_STAGE_2_NONE )
+    {
+    return empty_stage;
+    }
+
+/* The split stages ( copy, blit, index input... ) have no 1.0 bit of
+their own */
+if( stages & ~LEGACY_BITS )
+    {
+    return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+return( ( VkPipelineStageFlags )stages );
+
+}
+
+
+/*
+ * Narrows synchronization2 accesses to Vulkan 1.0 ones
+ */
+static VkAccessFlags to_legacy_access
+    (
+    VkAccessFlags2          access
+    )
+{
+/* Local variables */
+VkAccessFlags   _access = ( VkAccessFlags )( access & LEGACY_BITS );
+
+if( access & ~LEGACY_BITS & WRITE_ACCESS )
+    {
+    _access |= VK_ACCESS_MEMORY_WRITE_BIT;
+    }
+if( access & ~LEGACY_BITS & ~WRITE_ACCESS )
+    {
+    _access |= VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+return _access;
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+#include "ivk_dispatch.h"
+
+/*
+ * Barriers of each kind a batch holds before it flushes
+ * itself
+ */
+#define IVK_BARRIER_MAX_BUFFERS         16
+#define IVK_BARRIER_MAX_IMAGES          16
+
+/*
+ * Types
+ */
+
+/*
+ * Last access to a buffer or image, kept next to it. The
+ * reads since the last write are the ones already made to
+ * wait for it.
+ */
+typedef struct
+    {
+    VkPipelineStageFlags2
+                        write_stages;       /* Of the last write or layout transition */
+    VkAccessFlags2      write_access;
+    VkPipelineStageFlags2
+                        read_stages;
+    VkAccessFlags2      read_access;
+    VkImageLayout       layout;             /* Images only */
+    } IVK_barrier_state_type;
+
+/*
+ * Barriers gathered while recording, issued together by
+ * ivk_barrier_flush as one vkCmdPipelineBarrier2, or as one
+ * vkCmdPipelineBarrier without synchronization2
+ */
+typedef struct
+    {
+    const IVK_device_funcs_type*
+                        funcs;
+    VkCommandBuffer     command_buffer;
+    bool                use_sync2;
+    uint32_t            buffer_count;
+    uint32_t            image_count;
+    VkBufferMemoryBarrier2
+                        buffers[ IVK_BARRIER_MAX_BUFFERS ];
+    VkImageMemoryBarrier2
+                        images[ IVK_BARRIER_MAX_IMAGES ];
+    } IVK_barrier_batch_type;
+
+
+/*
+ * Starts gathering barriers for a command buffer
+ */
+void ivk_barrier_begin
+    (
+    const IVK_device_funcs_type*    funcs,
+    bool                            use_sync2,
+    VkCommandBuffer                 command_buffer,
+    IVK_barrier_batch_type*         batch
+    );
+
+/*
+ * Forgets the accesses of a resource, e.g. once a semaphore
+ * wait at stages orders it after them. The next access only
+ * waits for stages.
+ */
+void ivk_barrier_reset
+    (
+    VkPipelineStageFlags2   stages,
+    VkImageLayout           layout,
+    IVK_barrier_state_type* state
+    );
+
+/*
+ * Adds the barrier, if any, that an access to the whole
+ * buffer needs after its last one
+ */
+void ivk_barrier_buffer
+    (
+    IVK_barrier_batch_type* batch,
+    VkBuffer                buffer,
+    VkPipelineStageFlags2   stages,
+    VkAccessFlags2          access,
+    IVK_barrier_state_type* state
+    );
+
+/*
+ * Adds the barrier, if any, that an access to the image in
+ * layout needs after its last one. A change of layout always
+ * takes one.
+ */
+void ivk_barrier_image
+    (
+    IVK_barrier_batch_type* batch,
+    VkImage                 image,
+    VkImageAspectFlags      aspect_mask,
+    VkPipelineStageFlags2   stages,
+    VkAccessFlags2          access,
+    VkImageLayout           layout,
+    IVK_barrier_state_type* state
+    );
+
+/*
+ * Records the gathered barriers, if there are any
+ */
+void ivk_barrier_flush
+    (
+    IVK_barrier_batch_type* batch
+    );
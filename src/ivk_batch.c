@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk.h"
+#include "ivk_batch.h"
+#include "ivk_thread.h"
+#include "ivk_timer.h"
+#include "ivk_trace.h"
+
+/* Longest output file name */
+#define MAX_PATH_LENGTH     512
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    IVK_byte_buffer_type
+                        pixels;
+    unsigned int        frame_index;
+    unsigned int        width;
+    unsigned int        height;
+    unsigned int        row_pitch;
+    VkFormat            format;
+    } batch_job_type;
+
+typedef struct batch_state_type batch_state_type;
+
+typedef struct
+    {
+    batch_state_type*   state;
+    IVK_thread_type     thread;
+    IVK_byte_buffer_type
+                        encoded;
+    uint64_t            busy_ns;
+    } batch_worker_type;
+
+/*
+ * Jobs cycle between the free list and the work queue. The
+ * render thread only blocks when no job is free, i.e. when
+ * the encoders fall behind.
+ */
+struct batch_state_type
+    {
+    const IVK_batch_config_type*
+                        config;
+    IVK_mutex_type      lock;
+    IVK_cond_type       job_queued;
+    IVK_cond_type       job_freed;
+    batch_job_type*     jobs;
+    unsigned int        job_count;
+    unsigned int*       free_jobs;
+    unsigned int        free_count;
+    unsigned int*       queue;
+    unsigned int        queue_head;
+    unsigned int        queue_count;
+    bool                is_done;
+    unsigned int        frames_written;
+
+    /* Render thread only */
+    uint64_t            first_frame_value;
+    uint64_t            readback_ns;
+    uint64_t            stall_ns;
+
+    batch_worker_type   workers[ IVK_BATCH_MAX_WORKERS ];
+    unsigned int        worker_count;
+    };
+
+/*** Static functions ***/
+/*
+ * Receives the frames from the readback ring and queues
+ * them for encoding
+ */
+static void on_frame_read_back
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    );
+
+/*
+ * Encoder thread
+ */
+static void encode_worker
+    (
+    void*   arg
+    );
+
+/*
+ * Encodes a job and writes it out
+ */
+static bool encode_job
+    (
+    batch_worker_type*  worker,
+    batch_job_type*     job
+    );
+
+
+/*
+ * Renders config->frame_count frames as fast as possible.
+ * The GPU rendering, the readback and the encoding overlap:
+ * frames are read back asynchronously and encoded by a pool
+ * of worker threads. The context must be initialized,
+ * preferably headless, with neither the readback nor the
+ * shared memory output on: the batch takes the readback
+ * over, and leaves it off.
+ */
+bool ivk_batch_run
+    (
+    IVK_Context*                    context,
+    const IVK_batch_config_type*    config,
+    IVK_batch_stats_type*           stats
+    )
+{
+/* Local variables */
+batch_state_type*   _state = NULL;
+IVK_stats_type      _ivk_stats = { 0 };
+unsigned int        _dropped_before = 0;
+uint64_t            _start_ns = 0;
+uint64_t            _render_ns = 0;
+uint64_t            _flush_start_ns = 0;
+uint64_t            _elapsed_ns = 0;
+uint64_t            _encode_ns = 0;
+bool                _is_ok = true;
+
+memset( stats, 0, sizeof( *stats ) );
+
+/* The caller's readback would be lost, its callback replaced by ours */
+ivk_get_stats( context, &_ivk_stats );
+if( _ivk_stats.is_readback_enabled )
+    {
+    printf( "Batch rendering needs the readback, disable it first.\n" );
+    return false;
+    }
+
+_state = ( batch_state_type* )calloc( 1, sizeof( batch_state_type ) );
+if( !_state )
+    {
+    printf( "Failed to allocate the batch state.\n" );
+    return false;
+    }
+_state->config = config;
+
+/* Leave a hardware thread to the render loop */
+_state->worker_count = config->worker_count;
+if( _state->worker_count == 0 )
+    {
+    _state->worker_count = ivk_thread_hardware_count() - 1;
+    }
+if( _state->worker_count < 1 )
+    {
+    _state->worker_count = 1;
+    }
+else if( _state->worker_count > IVK_BATCH_MAX_WORKERS )
+    {
+    _state->worker_count = IVK_BATCH_MAX_WORKERS;
+    }
+
+/* Enough jobs to keep every worker busy with one queued behind it,
+plus what the readback can deliver in one go */
+_state->job_count = _state->worker_count * 2 + IVK_READBACK_MAX_SLOTS;
+_state->jobs = ( batch_job_type* )calloc( _state->job_count, sizeof( batch_job_type ) );
+_state->free_jobs = ( unsigned int* )calloc( _state->job_count, sizeof( unsigned int ) );
+_state->queue = ( unsigned int* )calloc( _state->job_count, sizeof( unsigned int ) );
+if( !_state->jobs || !_state->free_jobs || !_state->queue )
+    {
+    printf( "Failed to allocate the batch jobs.\n" );
+    free( _state->jobs );
+    free( _state->free_jobs );
+    free( _state->queue );
+    free( _state );
+    return false;
+    }
+for( unsigned int i = 0; i < _state->job_count; i++ )
+    {
+    _state->free_jobs[ _state->free_count++ ] = i;
+    }
+
+ivk_mutex_init( &_state->lock );
+ivk_cond_init( &_state->job_queued );
+ivk_cond_init( &_state->job_freed );
+
+for( unsigned int i = 0; i < _state->worker_count; i++ )
+    {
+    _state->workers[ i ].state = _state;
+    if( !ivk_thread_create( &_state->workers[ i ].thread, encode_worker, &_state->workers[ i ] ) )
+        {
+        printf( "Failed to start encoder thread %u.\n", i );
+        _state->worker_count = i;
+        _is_ok = false;
+        break;
+        }
+    }
+
+/* The readback tags the frames with their timeline value, which
+maps back to the batch frame index. With at least as many slots as
+frames in flight, no frame is ever dropped. */
+_state->first_frame_value = _ivk_stats.frame_count + 1;
+_dropped_before = _ivk_stats.readback_dropped_count;
+if( _is_ok && !ivk_enable_readback( context, IVK_READBACK_MAX_SLOTS, on_frame_read_back, _state ) )
+    {
+    _is_ok = false;
+    }
+
+_start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; _is_ok && i < config->frame_count; i++ )
+    {
+    uint64_t    _frame_start_ns = 0;
+
+    if( config->prepare_frame )
+        {
+        config->prepare_frame( context, i, config->user_data );
+        }
+
+    _frame_start_ns = ivk_timer_now_ns();
+    ivk_render( context, config->draws, config->draw_count );
+    _render_ns += ivk_timer_now_ns() - _frame_start_ns;
+    stats->frames_rendered++;
+    }
+
+/* Deliver the frames still in flight, then let the workers drain
+the queue */
+_flush_start_ns = ivk_timer_now_ns();
+ivk_disable_readback( context );
+_render_ns += ivk_timer_now_ns() - _flush_start_ns;
+
+ivk_mutex_lock( &_state->lock );
+_state->is_done = true;
+ivk_cond_broadcast( &_state->job_queued );
+ivk_mutex_unlock( &_state->lock );
+
+for( unsigned int i = 0; i < _state->worker_count; i++ )
+    {
+    ivk_thread_join( &_state->workers[ i ].thread );
+    _encode_ns += _state->workers[ i ].busy_ns;
+    ivk_byte_buffer_free( &_state->workers[ i ].encoded );
+    }
+_elapsed_ns = ivk_timer_now_ns() - _start_ns;
+
+/* Report. The readback and stalls happen inside ivk_render. */
+ivk_get_stats( context, &_ivk_stats );
+stats->frames_written = _state->frames_written;
+stats->frames_dropped = _ivk_stats.readback_dropped_count - _dropped_before;
+stats->worker_count = _state->worker_count;
+stats->elapsed_ms = IVK_NS_TO_MS( _elapsed_ns );
+if( _elapsed_ns > 0 )
+    {
+    stats->fps = stats->frames_written * 1000.0 / stats->elapsed_ms;
+    stats->render_occupancy = ( double )( _render_ns - _state->readback_ns - _state->stall_ns ) / _elapsed_ns;
+    stats->readback_occupancy = ( double )_state->readback_ns / _elapsed_ns;
+    stats->stall_occupancy = ( double )_state->stall_ns / _elapsed_ns;
+    stats->encode_occupancy = ( _state->worker_count > 0 ) ? ( double )_encode_ns / ( ( double )_elapsed_ns * _state->worker_count ) : 0.0;
+    }
+
+/* Cleanup */
+ivk_cond_destroy( &_state->job_freed );
+ivk_cond_destroy( &_state->job_queued );
+ivk_mutex_destroy( &_state->lock );
+for( unsigned int i = 0; i < _state->job_count; i++ )
+    {
+    ivk_byte_buffer_free( &_state->jobs[ i ].pixels );
+    }
+free( _state->jobs );
+free( _state->free_jobs );
+free( _state->queue );
+free( _state );
+
+return _is_ok;
+
+}
+
+
+/*
+ * Receives the frames from the readback ring and queues
+ * them for encoding
+ */
+static void on_frame_read_back
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    )
+{
+/* Local variables */
+batch_state_type*   _state = ( batch_state_type* )user_data;
+batch_job_type*     _job = NULL;
+unsigned int        _job_index = 0;
+uint64_t            _start_ns = 0;
+uint64_t            _copied_ns = 0;
+
+/* Wait for a free job if the encoders are behind */
+_start_ns = ivk_timer_now_ns();
+ivk_mutex_lock( &_state->lock );
+while( _state->free_count == 0 )
+    {
+    ivk_cond_wait( &_state->job_freed, &_state->lock );
+    }
+_job_index = _state->free_jobs[ --_state->free_count ];
+ivk_mutex_unlock( &_state->lock );
+_copied_ns = ivk_timer_now_ns();
+_state->stall_ns += _copied_ns - _start_ns;
+
+/* The readback slot is reused right after, so the pixels are copied
+out; the job buffers stop allocating after the first round */
+_job = &_state->jobs[ _job_index ];
+if( !ivk_byte_buffer_reserve( &_job->pixels, frame->size ) )
+    {
+    ivk_mutex_lock( &_state->lock );
+    _state->free_jobs[ _state->free_count++ ] = _job_index;
+    ivk_mutex_unlock( &_state->lock );
+    return;
+    }
+memcpy( _job->pixels.data, frame->pixels, frame->size );
+_job->pixels.size = frame->size;
+_job->frame_index = ( unsigned int )( frame->frame_number - _state->first_frame_value );
+_job->width = frame->width;
+_job->height = frame->height;
+_job->row_pitch = frame->row_pitch;
+_job->format = frame->format;
+
+ivk_mutex_lock( &_state->lock );
+_state->queue[ ( _state->queue_head + _state->queue_count ) % _state->job_count ] = _job_index;
+_state->queue_count++;
+ivk_cond_signal( &_state->job_queued );
+ivk_mutex_unlock( &_state->lock );
+
+_state->readback_ns += ivk_timer_now_ns() - _copied_ns;
+
+}
+
+
+/*
+ * Encoder thread
+ */
+static void encode_worker
+    (
+    void*   arg
+    )
+{
+/* Local variables */
+batch_worker_type*  _worker = ( batch_worker_type* )arg;
+batch_state_type*   _state = _worker->state;
+unsigned int        _job_index = 0;
+uint64_t            _start_ns = 0;
+bool                _is_written = false;
+
+ivk_trace_set_thread_name( "encoder" );
+
+while( true )
+    {
+    ivk_mutex_lock( &_state->lock );
+    while( _state->queue_count == 0 && !_state->is_done )
+        {
+        ivk_cond_wait( &_state->job_queued, &_state->lock );
+        }
+    if( _state->queue_count == 0 )
+        {
+        ivk_mutex_unlock( &_state->lock );
+        break;
+        }
+    _job_index = _state->queue[ _state->queue_head ];
+    _state->queue_head = ( _state->queue_head + 1 ) % _state->job_count;
+    _state->queue_count--;
+    ivk_mutex_unlock( &_state->lock );
+
+    _start_ns = ivk_timer_now_ns();
+    IVK_TRACE_BEGIN( "encode" );
+    _is_written = encode_job( _worker, &_state->jobs[ _job_index ] );
+    IVK_TRACE_END( "encode" );
+    _worker->busy_ns += ivk_timer_now_ns() - _start_ns;
+
+    ivk_mutex_lock( &_state->lock );
+    _state->free_jobs[ _state->free_count++ ] = _job_index;
+    _state->frames_written += _is_written ? 1 : 0;
+    ivk_cond_signal( &_state->job_freed );
+    ivk_mutex_unlock( &_state->lock );
+    }
+
+}
+
+
+/*
+ * Encodes a job and writes it out
+ */
+static bool encode_job
+    (
+    batch_worker_type*  worker,
+    batch_job_type*     job
+    )
+{
+/* Local variables */
+const IVK_batch_config_type*
+                _config = worker->state->config;
+char            _path[ MAX_PATH_LENGTH ];
+FILE*           _file = NULL;
+
+if( !ivk_image_encode
+        (
+        _config->file_type,
+        job->pixels.data,
+        job->width,
+        job->height,
+        job->row_pitch,
+        job->format,
+        &worker->encoded
+        ) )
+    {
+    return false;
+    }
+
+if( !_config->output_pattern )
+    {
+    return true;
+    }
+
+snprintf( _path, sizeof( _path ), _config->output_pattern, job->frame_index, ivk_image_file_extension( _config->file_type ) );
+_file = fopen( _path, "wb" );
+if( !_file )
+    {
+    printf( "Failed to open %s.\n", _path );
+    return false;
+    }
+fwrite( worker->encoded.data, 1, worker->encoded.size, _file );
+fclose( _file );
+
+return true;
+
+}
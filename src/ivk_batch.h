@@ -0,0 +1,74 @@
+#pragma once
+#include <stdbool.h>
+
+#include "ivk.h"
+#include "ivk_draw.h"
+#include "ivk_image.h"
+
+/*
+ * Upper bound on the encoder threads
+ */
+#define IVK_BATCH_MAX_WORKERS           16
+
+/*
+ * Called before each frame is rendered to set up its scene
+ * state, e.g. a camera path or a list of pipeline states
+ */
+typedef void ( *IVK_batch_frame_func_type )
+    (
+    IVK_Context*    context,
+    unsigned int    frame_index,
+    void*           user_data
+    );
+
+typedef struct
+    {
+    unsigned int        frame_count;
+    unsigned int        worker_count;       /* 0 for one per spare hardware thread */
+    IVK_image_file_type file_type;
+    const char*         output_pattern;     /* printf pattern taking the frame index and
+                                               the extension, e.g. "frame_%05u.%s".
+                                               NULL encodes without writing. */
+    IVK_batch_frame_func_type
+                        prepare_frame;      /* May be NULL */
+    void*               user_data;
+    const IVK_draw_type*
+                        draws;              /* Drawn every frame, prepare_frame may
+                                               change them */
+    uint32_t            draw_count;
+    } IVK_batch_config_type;
+
+/*
+ * Results of a batch run. The occupancies are the fraction
+ * of the wall time each stage was busy.
+ */
+typedef struct
+    {
+    unsigned int        frames_rendered;
+    unsigned int        frames_written;
+    unsigned int        frames_dropped;     /* Lost by the readback */
+    unsigned int        worker_count;
+    double              elapsed_ms;
+    double              fps;
+    double              render_occupancy;   /* Recording, submitting and frame pacing */
+    double              readback_occupancy; /* Copying frames out of the readback ring */
+    double              stall_occupancy;    /* Render thread waiting on the encoders */
+    double              encode_occupancy;   /* Averaged over the workers */
+    } IVK_batch_stats_type;
+
+
+/*
+ * Renders config->frame_count frames as fast as possible.
+ * The GPU rendering, the readback and the encoding overlap:
+ * frames are read back asynchronously and encoded by a pool
+ * of worker threads. The context must be initialized,
+ * preferably headless, with neither the readback nor the
+ * shared memory output on: the batch takes the readback
+ * over, and leaves it off.
+ */
+bool ivk_batch_run
+    (
+    IVK_Context*                    context,
+    const IVK_batch_config_type*    config,
+    IVK_batch_stats_type*           stats
+    );
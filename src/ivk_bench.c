@@ -0,0 +1,1197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "ivk.h"
+#include "ivk_job.h"
+#include "ivk_render_thread.h"
+#include "ivk_thread.h"
+#include "ivk_timer.h"
+
+/*
+ * Benchmark constants
+ */
+#define BENCH_WIDTH             1280
+#define BENCH_HEIGHT            720
+#define MAX_RESULTS             96
+#define RESULT_NAME_LENGTH      64
+#define DEFAULT_THRESHOLD       10.0    /* Percent */
+#define WARMUP_FRAMES           3
+#define UPLOAD_REPEATS          3       /* Best of */
+#define RESIZE_CYCLES           10
+#define STEADY_FRAMES           500
+#define STEADY_SCRATCH_BYTES    ( 96 * 1024 )
+                                        /* Per frame, more than a frame slot
+                                           starts with */
+#define STREAMING_FRAMES        200
+#define MAX_DRAWS               100000
+#define SIM_FRAMES              200
+#define SIM_DRAWS               1000
+#define SIM_ITERATIONS          200     /* Per draw and frame, a stand-in for
+                                           the simulation's CPU work */
+#define JOB_FRAMES              50
+#define JOB_DRAWS               ( SIM_DRAWS * 10 )
+#define JOB_BATCH_SIZE          256     /* Draws simulated per job */
+#define JOB_EMPTY_COUNT         100000
+#define DISPATCH_FRAMES         100
+#define DISPATCH_DRAWS          10000   /* Each a draw call of its own */
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    char            name[ RESULT_NAME_LENGTH ];
+    double          value;
+    bool            is_lower_better;
+    } bench_result_type;
+
+typedef struct
+    {
+    unsigned int    frame;
+    IVK_draw_type*  out;
+    } sim_job_type;
+
+/*
+ * Global data
+ */
+bench_result_type   results[ MAX_RESULTS ];
+unsigned int        result_count = 0;
+bool                is_quick = false;
+IVK_Context         ivk_context;        /* Created by each benchmark */
+IVK_mesh_handle_type
+                    mesh = IVK_INVALID_HANDLE;
+                                        /* The one drawn */
+IVK_draw_type       draws[ MAX_DRAWS ];
+uint32_t            draw_count = 0;
+
+ivk_2p3c_type quad_data[] =
+    {
+    { { -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+    { {  0.5f, -0.5f }, { 0.0f, 1.0f, 0.0f } },
+    { {  0.5f,  0.5f }, { 0.0f, 0.0f, 1.0f } },
+    { { -0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } }
+    };
+unsigned int quad_indices[] =
+    {
+    0, 1, 2,
+    2, 3, 0
+    };
+
+/*
+ * Records a result
+ */
+void add_result
+    (
+    const char* name,
+    double      value,
+    bool        is_lower_better
+    );
+
+/*
+ * Draws the mesh count times per frame, all in one batch
+ * or each in its own layer, so its own draw call
+ */
+void set_draws
+    (
+    uint32_t        count,
+    bool            is_batched
+    );
+
+/*
+ * Renders frame_count frames and waits for the GPU to
+ * finish them. Returns the milliseconds per frame.
+ */
+double time_frames
+    (
+    unsigned int frame_count
+    );
+
+/*
+ * Renders frame_count frames, each once the GPU is idle, so
+ * no frame waits on another. Returns the CPU milliseconds
+ * per ivk_render call.
+ */
+double time_render_cpu
+    (
+    unsigned int frame_count
+    );
+
+/*
+ * Startup time of ivk_init, per phase
+ */
+void bench_startup
+    (
+    void
+    );
+
+/*
+ * Upload bandwidth of the staged vertex uploads, at
+ * several payload sizes
+ */
+void bench_upload
+    (
+    void
+    );
+
+/*
+ * Triangle throughput with one draw of a growing grid
+ */
+void bench_triangles
+    (
+    void
+    );
+
+/*
+ * Cost of a draw call, from 1 to 100k draws per frame, and
+ * of the same draws merged into one instanced draw
+ */
+void bench_draw_calls
+    (
+    void
+    );
+
+/*
+ * Host allocations of a frame once the run has settled.
+ * Both figures should be 0.
+ */
+void bench_steady_state
+    (
+    void
+    );
+
+/*
+ * Frames that replace their mesh, destroying the old one
+ * while the GPU may still draw it
+ */
+void bench_streaming
+    (
+    void
+    );
+
+/*
+ * Frames of a CPU-heavy simulation rendered in series with
+ * it, then from the render thread while the next frame is
+ * simulated
+ */
+void bench_render_thread
+    (
+    void
+    );
+
+/*
+ * Synthetic simulation step, fills in draws first to
+ * first + count of the mesh for the frame
+ */
+void simulate
+    (
+    unsigned int    frame,
+    IVK_draw_type*  out,
+    uint32_t        first,
+    uint32_t        count
+    );
+
+/*
+ * Scaling of a parallel simulation and of the renderer's
+ * per-draw work over 1 to N threads of a job system
+ */
+void bench_jobs
+    (
+    void
+    );
+
+/*
+ * IVK_job_func_type, simulates a range of draws
+ */
+void simulate_job
+    (
+    void*       data,
+    uint32_t    first,
+    uint32_t    count
+    );
+
+/*
+ * IVK_job_func_type, does nothing
+ */
+void empty_job
+    (
+    void*       data,
+    uint32_t    first,
+    uint32_t    count
+    );
+
+/*
+ * CPU cost of recording many draw calls with the device
+ * commands called through the loader, then directly
+ */
+void bench_dispatch
+    (
+    void
+    );
+
+/*
+ * Cost of rebuilding the offscreen targets
+ */
+void bench_resize
+    (
+    void
+    );
+
+/*
+ * Builds a grid of side x side quads over most of the
+ * target. The arrays must be freed by the caller.
+ */
+bool make_grid
+    (
+    unsigned int    side,
+    ivk_2p3c_type** vertices,
+    unsigned int*   vertex_count,
+    unsigned int**  indices,
+    unsigned int*   index_count
+    );
+
+/*
+ * Writes the results as JSON
+ */
+bool write_results
+    (
+    const char* path,
+    const char* device_name
+    );
+
+/*
+ * Compares the results against a baseline written by an
+ * earlier run. Returns the number of regressions.
+ */
+unsigned int compare_baseline
+    (
+    const char* path,
+    double      threshold
+    );
+
+
+/*
+ * Headless benchmarks of the IVK library. Runs on any
+ * Vulkan 1.2 device, lavapipe included ( select it with
+ * VK_ICD_FILENAMES ).
+ *
+ * --out file.json writes the results, --baseline file.json
+ * compares them against an earlier run and fails if one
+ * got worse by more than --threshold percent ( 10 by
+ * default ). --quick stops the scaling runs 10x earlier.
+ */
+int main
+    (
+    int     argc,
+    char**  argv
+    )
+{
+/* Local variables */
+IVK_config_type ivk_config = { 0 };
+IVK_stats_type  ivk_stats = { 0 };
+const char*     out_path = NULL;
+const char*     baseline_path = NULL;
+double          threshold = DEFAULT_THRESHOLD;
+unsigned int    regression_count = 0;
+
+/* Parse the command line */
+for( int i = 1; i < argc; i++ )
+    {
+    if( strcmp( argv[ i ], "--out" ) == 0 && i + 1 < argc )
+        {
+        out_path = argv[ ++i ];
+        }
+    else if( strcmp( argv[ i ], "--baseline" ) == 0 && i + 1 < argc )
+        {
+        baseline_path = argv[ ++i ];
+        }
+    else if( strcmp( argv[ i ], "--threshold" ) == 0 && i + 1 < argc )
+        {
+        threshold = atof( argv[ ++i ] );
+        }
+    else if( strcmp( argv[ i ], "--quick" ) == 0 )
+        {
+        is_quick = true;
+        }
+    }
+
+ivk_config.dynamic_rendering = true;
+ivk_config.extended_dynamic_state = true;
+ivk_config.headless = true;
+ivk_config.offscreen_extent.width = BENCH_WIDTH;
+ivk_config.offscreen_extent.height = BENCH_HEIGHT;
+ivk_config.track_host_memory = true;
+if( !ivk_init( &ivk_context, 0, NULL, NULL, &ivk_config ) )
+    {
+    return 1;
+    }
+mesh = ivk_create_mesh( &ivk_context, &quad_data[ 0 ], 4, &quad_indices[ 0 ], 6 );
+set_draws( 1, true );
+
+ivk_get_stats( &ivk_context, &ivk_stats );
+printf( "Benchmarking on %s\n", ivk_stats.device_name );
+
+bench_startup();
+bench_upload();
+bench_triangles();
+bench_draw_calls();
+bench_steady_state();
+bench_streaming();
+bench_render_thread();
+bench_jobs();
+bench_dispatch();
+bench_resize();
+
+ivk_teardown( &ivk_context );
+
+if( out_path && !write_results( out_path, ivk_stats.device_name ) )
+    {
+    return 1;
+    }
+
+if( baseline_path )
+    {
+    regression_count = compare_baseline( baseline_path, threshold );
+    if( regression_count > 0 )
+        {
+        printf( "%u regression(s) above %.1f%%.\n", regression_count, threshold );
+        return 1;
+        }
+    }
+
+return 0;
+
+}
+
+
+/*
+ * Records a result
+ */
+void add_result
+    (
+    const char* name,
+    double      value,
+    bool        is_lower_better
+    )
+{
+if( result_count == MAX_RESULTS )
+    {
+    return;
+    }
+
+snprintf( results[ result_count ].name, RESULT_NAME_LENGTH, "%s", name );
+results[ result_count ].value = value;
+results[ result_count ].is_lower_better = is_lower_better;
+result_count++;
+
+printf( "  %-36s %14.3f\n", name, value );
+
+}
+
+
+/*
+ * Draws the mesh count times per frame, all in one batch
+ * or each in its own layer, so its own draw call
+ */
+void set_draws
+    (
+    uint32_t        count,
+    bool            is_batched
+    )
+{
+for( uint32_t i = 0; i < count; i++ )
+    {
+    glm_mat4_identity( draws[ i ].transform );
+    draws[ i ].mesh = mesh;
+    draws[ i ].material = 0;
+    draws[ i ].layer = is_batched ? 0 : i;
+    }
+draw_count = count;
+
+}
+
+
+/*
+ * Renders frame_count frames and waits for the GPU to
+ * finish them. Returns the milliseconds per frame.
+ */
+double time_frames
+    (
+    unsigned int frame_count
+    )
+{
+/* Local variables */
+uint64_t    start_ns = 0;
+
+for( unsigned int i = 0; i < WARMUP_FRAMES; i++ )
+    {
+    ivk_render( &ivk_context, draws, draw_count );
+    }
+ivk_wait_idle( &ivk_context );
+
+start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    ivk_render( &ivk_context, draws, draw_count );
+    }
+ivk_wait_idle( &ivk_context );
+
+return( IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns ) / frame_count );
+
+}
+
+
+/*
+ * Renders frame_count frames, each once the GPU is idle, so
+ * no frame waits on another. Returns the CPU milliseconds
+ * per ivk_render call.
+ */
+double time_render_cpu
+    (
+    unsigned int frame_count
+    )
+{
+/* Local variables */
+uint64_t    start_ns = 0;
+uint64_t    render_ns = 0;
+
+for( unsigned int i = 0; i < WARMUP_FRAMES; i++ )
+    {
+    ivk_render( &ivk_context, draws, draw_count );
+    }
+
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    ivk_wait_idle( &ivk_context );
+    start_ns = ivk_timer_now_ns();
+    ivk_render( &ivk_context, draws, draw_count );
+    render_ns += ivk_timer_now_ns() - start_ns;
+    }
+ivk_wait_idle( &ivk_context );
+
+return( IVK_NS_TO_MS( render_ns ) / frame_count );
+
+}
+
+
+/*
+ * Startup time of ivk_init, per phase
+ */
+void bench_startup
+    (
+    void
+    )
+{
+/* Local variables */
+IVK_stats_type  ivk_stats = { 0 };
+
+printf( "Startup\n" );
+ivk_get_stats( &ivk_context, &ivk_stats );
+add_result( "startup.instance_ms", ivk_stats.init_instance_ms, true );
+add_result( "startup.device_ms", ivk_stats.init_device_ms, true );
+add_result( "startup.pipeline_ms", ivk_stats.init_pipeline_ms, true );
+add_result( "startup.total_ms", ivk_stats.init_total_ms, true );
+
+}
+
+
+/*
+ * Upload bandwidth of the staged vertex uploads, at
+ * several payload sizes
+ */
+void bench_upload
+    (
+    void
+    )
+{
+/* Local variables */
+const unsigned int  sizes_kb[] = { 64, 1024, 16384, 65536 };
+unsigned int        size_count = is_quick ? 3 : 4;
+ivk_2p3c_type*      vertices = NULL;
+unsigned int        vertex_count = 0;
+uint64_t            start_ns = 0;
+double              best_ms = 0.0;
+double              elapsed_ms = 0.0;
+char                name[ RESULT_NAME_LENGTH ];
+
+printf( "Upload\n" );
+for( unsigned int i = 0; i < size_count; i++ )
+    {
+    /* The indices are a single triangle, the vertices are the payload */
+    vertex_count = ( unsigned int )( sizes_kb[ i ] * 1024ull / sizeof( ivk_2p3c_type ) );
+    vertices = ( ivk_2p3c_type* )calloc( vertex_count, sizeof( ivk_2p3c_type ) );
+    if( !vertices )
+        {
+        printf( "Out of memory for a %u KB upload.\n", sizes_kb[ i ] );
+        break;
+        }
+
+    best_ms = 0.0;
+    for( unsigned int j = 0; j < UPLOAD_REPEATS; j++ )
+        {
+        /* Only the upload itself is timed, not destroying the old mesh */
+        ivk_destroy_mesh( &ivk_context, mesh );
+        start_ns = ivk_timer_now_ns();
+        mesh = ivk_create_mesh( &ivk_context, vertices, vertex_count, &quad_indices[ 0 ], 3 );
+        elapsed_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns );
+        if( j == 0 || elapsed_ms < best_ms )
+            {
+            best_ms = elapsed_ms;
+            }
+        }
+    free( vertices );
+    set_draws( 1, true );
+
+    snprintf( name, sizeof( name ), "upload.%ukb_mb_per_s", sizes_kb[ i ] );
+    add_result( name, ( sizes_kb[ i ] / 1024.0 ) / ( best_ms / 1000.0 ), false );
+    }
+
+ivk_destroy_mesh( &ivk_context, mesh );
+mesh = ivk_create_mesh( &ivk_context, &quad_data[ 0 ], 4, &quad_indices[ 0 ], 6 );
+set_draws( 1, true );
+
+}
+
+
+/*
+ * Triangle throughput with one draw of a growing grid
+ */
+void bench_triangles
+    (
+    void
+    )
+{
+/* Local variables */
+const unsigned int  sides[] = { 22, 224, 708 };
+const char*         labels[] = { "1k", "100k", "1m" };
+unsigned int        side_count = is_quick ? 2 : 3;
+ivk_2p3c_type*      vertices = NULL;
+unsigned int*       indices = NULL;
+unsigned int        vertex_count = 0;
+unsigned int        index_count = 0;
+unsigned int        frame_count = 0;
+double              ms_per_frame = 0.0;
+char                name[ RESULT_NAME_LENGTH ];
+
+printf( "Triangles\n" );
+for( unsigned int i = 0; i < side_count; i++ )
+    {
+    if( !make_grid( sides[ i ], &vertices, &vertex_count, &indices, &index_count ) )
+        {
+        printf( "Out of memory for a %u x %u grid.\n", sides[ i ], sides[ i ] );
+        break;
+        }
+    ivk_destroy_mesh( &ivk_context, mesh );
+    mesh = ivk_create_mesh( &ivk_context, vertices, vertex_count, indices, index_count );
+    set_draws( 1, true );
+    free( vertices );
+    free( indices );
+
+    frame_count = ( sides[ i ] > 500 ) ? 10 : 50;
+    ms_per_frame = time_frames( frame_count );
+
+    snprintf( name, sizeof( name ), "triangles.%s_ms_per_frame", labels[ i ] );
+    add_result( name, ms_per_frame, true );
+    snprintf( name, sizeof( name ), "triangles.%s_mtris_per_s", labels[ i ] );
+    add_result( name, ( index_count / 3 ) / ( ms_per_frame * 1000.0 ), false );
+    }
+
+ivk_destroy_mesh( &ivk_context, mesh );
+mesh = ivk_create_mesh( &ivk_context, &quad_data[ 0 ], 4, &quad_indices[ 0 ], 6 );
+set_draws( 1, true );
+
+}
+
+
+/*
+ * Cost of a draw call, from 1 to 100k draws per frame, and
+ * of the same draws merged into one instanced draw
+ */
+void bench_draw_calls
+    (
+    void
+    )
+{
+/* Local variables */
+unsigned int    max_count = is_quick ? MAX_DRAWS / 10 : MAX_DRAWS;
+unsigned int    frame_count = 0;
+double          ms_per_frame = 0.0;
+char            name[ RESULT_NAME_LENGTH ];
+
+printf( "Draw calls\n" );
+for( unsigned int count = 1; count <= max_count; count *= 10 )
+    {
+    /* Enough frames for a stable figure, without taking minutes on
+    a software rasterizer */
+    frame_count = 1000000 / count;
+    frame_count = ( frame_count > 200 ) ? 200 : ( frame_count < 5 ) ? 5 : frame_count;
+
+    set_draws( count, false );
+    ms_per_frame = time_frames( frame_count );
+    snprintf( name, sizeof( name ), "draw_calls.%u_ms_per_frame", count );
+    add_result( name, ms_per_frame, true );
+    snprintf( name, sizeof( name ), "draw_calls.%u_us_per_draw", count );
+    add_result( name, ms_per_frame * 1000.0 / count, true );
+
+    set_draws( count, true );
+    ms_per_frame = time_frames( frame_count );
+    snprintf( name, sizeof( name ), "instancing.%u_ms_per_frame", count );
+    add_result( name, ms_per_frame, true );
+    }
+
+set_draws( 1, true );
+
+}
+
+
+/*
+ * Host allocations of a frame once the run has settled.
+ * Both figures should be 0.
+ */
+void bench_steady_state
+    (
+    void
+    )
+{
+/* Local variables */
+unsigned int    frame_count = is_quick ? STEADY_FRAMES / 10 : STEADY_FRAMES;
+IVK_stats_type  start_stats = { 0 };
+IVK_stats_type  end_stats = { 0 };
+void*           scratch = NULL;
+
+printf( "Steady state\n" );
+
+/* Each frame takes scratch memory the way a renderer builds its
+draw lists; the first frames grow the frame slots to fit */
+for( unsigned int i = 0; i < frame_count + WARMUP_FRAMES; i++ )
+    {
+    if( i == WARMUP_FRAMES )
+        {
+        ivk_get_stats( &ivk_context, &start_stats );
+        }
+    scratch = ivk_frame_alloc( &ivk_context, STEADY_SCRATCH_BYTES, 0 );
+    if( scratch )
+        {
+        memset( scratch, 0, STEADY_SCRATCH_BYTES );
+        }
+    ivk_render( &ivk_context, draws, draw_count );
+    }
+ivk_wait_idle( &ivk_context );
+ivk_get_stats( &ivk_context, &end_stats );
+
+add_result( "steady.host_allocations_per_frame", ( double )( end_stats.host_allocation_count - start_stats.host_allocation_count ) / frame_count, true );
+add_result( "steady.frame_heap_allocations", end_stats.frame_memory_overflow_count - start_stats.frame_memory_overflow_count, true );
+add_result( "steady.frame_memory_kb", end_stats.frame_memory_high_water / 1024.0, true );
+
+}
+
+
+/*
+ * Frames that replace their mesh, destroying the old one
+ * while the GPU may still draw it
+ */
+void bench_streaming
+    (
+    void
+    )
+{
+/* Local variables */
+unsigned int    frame_count = is_quick ? STREAMING_FRAMES / 10 : STREAMING_FRAMES;
+IVK_stats_type  stats = { 0 };
+uint64_t        start_ns = 0;
+double          ms_per_frame = 0.0;
+
+printf( "Streaming\n" );
+
+ivk_wait_idle( &ivk_context );
+start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    ivk_destroy_mesh( &ivk_context, mesh );
+    mesh = ivk_create_mesh( &ivk_context, &quad_data[ 0 ], 4, &quad_indices[ 0 ], 6 );
+    draws[ 0 ].mesh = mesh;
+    ivk_render( &ivk_context, draws, draw_count );
+    }
+ms_per_frame = IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns ) / frame_count;
+
+/* Only the last frames' buffers may still be waiting */
+ivk_get_stats( &ivk_context, &stats );
+ivk_wait_idle( &ivk_context );
+
+add_result( "streaming.ms_per_frame", ms_per_frame, true );
+add_result( "streaming.pending_destroys", stats.deferred_destroy_count, true );
+
+}
+
+
+/*
+ * Frames of a CPU-heavy simulation rendered in series with
+ * it, then from the render thread while the next frame is
+ * simulated
+ */
+void bench_render_thread
+    (
+    void
+    )
+{
+/* Local variables */
+unsigned int            frame_count = is_quick ? SIM_FRAMES / 10 : SIM_FRAMES;
+IVK_render_thread_type  render_thread;
+IVK_draw_type*          snapshot = NULL;
+uint64_t                start_ns = 0;
+double                  elapsed_ms = 0.0;
+
+printf( "Render thread\n" );
+
+/* Simulate, then render, on the one thread */
+ivk_wait_idle( &ivk_context );
+start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    simulate( i, draws, 0, SIM_DRAWS );
+    ivk_render( &ivk_context, draws, SIM_DRAWS );
+    }
+ivk_wait_idle( &ivk_context );
+add_result( "render_thread.serial_ms_per_frame", IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns ) / frame_count, true );
+
+/* Simulate straight into the snapshots, the render thread takes the
+newest one whenever it is done with the last */
+if( !ivk_render_thread_start( &ivk_context, SIM_DRAWS, &render_thread ) )
+    {
+    return;
+    }
+start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    snapshot = ivk_render_thread_begin( &render_thread, SIM_DRAWS );
+    simulate( i, snapshot, 0, SIM_DRAWS );
+    ivk_render_thread_publish( &render_thread );
+    }
+ivk_render_thread_stop( &render_thread );
+elapsed_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns );
+
+add_result( "render_thread.threaded_ms_per_frame", elapsed_ms / frame_count, true );
+add_result( "render_thread.rendered_fraction", ( double )render_thread.rendered_count / frame_count, false );
+set_draws( 1, true );
+
+}
+
+
+/*
+ * Synthetic simulation step, fills in draws first to
+ * first + count of the mesh for the frame
+ */
+void simulate
+    (
+    unsigned int    frame,
+    IVK_draw_type*  out,
+    uint32_t        first,
+    uint32_t        count
+    )
+{
+/* Local variables */
+float           angle = 0.0f;
+float           scale = 0.0f;
+
+for( uint32_t i = first; i < first + count; i++ )
+    {
+    /* Work the compiler cannot drop, every draw ends up with a
+    slightly different size */
+    angle = frame * 0.01f + i;
+    scale = 0.0f;
+    for( unsigned int j = 0; j < SIM_ITERATIONS; j++ )
+        {
+        scale += sinf( angle + j ) * cosf( angle - j );
+        }
+    scale = 0.02f + 0.001f * fabsf( scale ) / SIM_ITERATIONS;
+
+    glm_mat4_identity( out[ i ].transform );
+    glm_translate( out[ i ].transform, ( vec3 ){ cosf( angle ) * 0.8f, sinf( angle ) * 0.8f, 0.0f } );
+    glm_rotate_z( out[ i ].transform, angle, out[ i ].transform );
+    glm_scale_uni( out[ i ].transform, scale );
+    out[ i ].mesh = mesh;
+    out[ i ].material = 0;
+    out[ i ].layer = 0;
+    }
+
+}
+
+
+/*
+ * Scaling of a parallel simulation and of the renderer's
+ * per-draw work over 1 to N threads of a job system
+ */
+void bench_jobs
+    (
+    void
+    )
+{
+/* Local variables */
+unsigned int            frame_count = is_quick ? JOB_FRAMES / 10 : JOB_FRAMES;
+unsigned int            max_threads = ivk_thread_hardware_count();
+unsigned int            thread_count = 1;
+IVK_job_system_type     jobs;
+IVK_job_counter_type    counter = { 0 };
+sim_job_type            sim = { 0 };
+uint64_t                start_ns = 0;
+double                  ms_per_frame = 0.0;
+double                  single_ms_per_frame = 0.0;
+char                    name[ RESULT_NAME_LENGTH ];
+
+printf( "Jobs\n" );
+max_threads = ( max_threads > IVK_JOB_MAX_THREADS ) ? IVK_JOB_MAX_THREADS : max_threads;
+sim.out = draws;
+
+/* Powers of 2, then all the hardware threads */
+for( ;; )
+    {
+    if( !ivk_job_system_create( thread_count, &jobs ) )
+        {
+        break;
+        }
+
+    start_ns = ivk_timer_now_ns();
+    for( unsigned int i = 0; i < frame_count; i++ )
+        {
+        sim.frame = i;
+        ivk_job_parallel_for( &jobs, simulate_job, &sim, JOB_DRAWS, JOB_BATCH_SIZE, &counter );
+        ivk_job_wait( &jobs, &counter );
+        }
+    ms_per_frame = IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns ) / frame_count;
+    single_ms_per_frame = ( thread_count == 1 ) ? ms_per_frame : single_ms_per_frame;
+
+    snprintf( name, sizeof( name ), "jobs.%u_threads_sim_ms", thread_count );
+    add_result( name, ms_per_frame, true );
+    snprintf( name, sizeof( name ), "jobs.%u_threads_speedup", thread_count );
+    add_result( name, single_ms_per_frame / ms_per_frame, false );
+
+    /* The renderer gathers the instance transforms on the jobs */
+    ivk_set_job_system( &ivk_context, &jobs );
+    set_draws( is_quick ? MAX_DRAWS / 10 : MAX_DRAWS, true );
+    snprintf( name, sizeof( name ), "jobs.%u_threads_render_ms", thread_count );
+    add_result( name, time_frames( frame_count ), true );
+    ivk_set_job_system( &ivk_context, NULL );
+
+    /* What a job costs to queue, run and count down */
+    if( thread_count == max_threads )
+        {
+        start_ns = ivk_timer_now_ns();
+        ivk_job_parallel_for( &jobs, empty_job, NULL, JOB_EMPTY_COUNT, 1, &counter );
+        ivk_job_wait( &jobs, &counter );
+        add_result( "jobs.us_per_empty_job", IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns ) * 1000.0 / JOB_EMPTY_COUNT, true );
+        }
+
+    ivk_job_system_destroy( &jobs );
+    if( thread_count == max_threads )
+        {
+        break;
+        }
+    thread_count = ( thread_count * 2 < max_threads ) ? thread_count * 2 : max_threads;
+    }
+
+set_draws( 1, true );
+
+}
+
+
+/*
+ * IVK_job_func_type, simulates a range of draws
+ */
+void simulate_job
+    (
+    void*       data,
+    uint32_t    first,
+    uint32_t    count
+    )
+{
+/* Local variables */
+const sim_job_type* sim = ( const sim_job_type* )data;
+
+simulate( sim->frame, sim->out, first, count );
+
+}
+
+
+/*
+ * IVK_job_func_type, does nothing
+ */
+void empty_job
+    (
+    void*       data,
+    uint32_t    first,
+    uint32_t    count
+    )
+{
+( void )data;
+( void )first;
+( void )count;
+
+}
+
+
+/*
+ * CPU cost of recording many draw calls with the device
+ * commands called through the loader, then directly
+ */
+void bench_dispatch
+    (
+    void
+    )
+{
+/* Local variables */
+unsigned int    frame_count = is_quick ? DISPATCH_FRAMES / 10 : DISPATCH_FRAMES;
+double          loader_ms = 0.0;
+double          direct_ms = 0.0;
+
+printf( "Dispatch\n" );
+set_draws( DISPATCH_DRAWS, false );
+
+/* The CPU side of ivk_render only, the GPU would hide the difference.
+Each run is timed on its own, the rolling average in the statistics
+would carry the loader's frames into the direct ones. */
+ivk_set_direct_dispatch( &ivk_context, false );
+loader_ms = time_render_cpu( frame_count );
+
+ivk_set_direct_dispatch( &ivk_context, true );
+direct_ms = time_render_cpu( frame_count );
+
+add_result( "dispatch.loader_cpu_ms_per_frame", loader_ms, true );
+add_result( "dispatch.direct_cpu_ms_per_frame", direct_ms, true );
+add_result( "dispatch.ns_saved_per_draw", ( loader_ms - direct_ms ) * 1000000.0 / DISPATCH_DRAWS, false );
+
+set_draws( 1, true );
+
+}
+
+
+/*
+ * Cost of rebuilding the offscreen targets
+ */
+void bench_resize
+    (
+    void
+    )
+{
+/* Local variables */
+const VkExtent2D    extents[] = { { 640, 480 }, { 1920, 1080 }, { BENCH_WIDTH, BENCH_HEIGHT } };
+IVK_stats_type      ivk_stats = { 0 };
+unsigned int        resize_count = 0;
+double              total_ms = 0.0;
+double              max_ms = 0.0;
+
+printf( "Resize\n" );
+for( unsigned int i = 0; i < RESIZE_CYCLES; i++ )
+    {
+    for( unsigned int j = 0; j < sizeof( extents ) / sizeof( extents[ 0 ] ); j++ )
+        {
+        /* The targets are rebuilt at the start of the next frame */
+        ivk_set_offscreen_extent( &ivk_context, extents[ j ].width, extents[ j ].height );
+        ivk_render( &ivk_context, draws, draw_count );
+        ivk_get_stats( &ivk_context, &ivk_stats );
+        total_ms += ivk_stats.last_resize_ms;
+        max_ms = ( ivk_stats.last_resize_ms > max_ms ) ? ivk_stats.last_resize_ms : max_ms;
+        resize_count++;
+        }
+    }
+ivk_wait_idle( &ivk_context );
+
+add_result( "resize.avg_ms", total_ms / resize_count, true );
+add_result( "resize.max_ms", max_ms, true );
+
+}
+
+
+/*
+ * Builds a grid of side x side quads over most of the
+ * target. The arrays must be freed by the caller.
+ */
+bool make_grid
+    (
+    unsigned int    side,
+    ivk_2p3c_type** vertices,
+    unsigned int*   vertex_count,
+    unsigned int**  indices,
+    unsigned int*   index_count
+    )
+{
+/* Local variables */
+unsigned int    row = side + 1;
+unsigned int    index = 0;
+
+*vertex_count = row * row;
+*index_count = side * side * 6;
+*vertices = ( ivk_2p3c_type* )malloc( *vertex_count * sizeof( ivk_2p3c_type ) );
+*indices = ( unsigned int* )malloc( *index_count * sizeof( unsigned int ) );
+if( !*vertices || !*indices )
+    {
+    free( *vertices );
+    free( *indices );
+    return false;
+    }
+
+for( unsigned int y = 0; y < row; y++ )
+    {
+    for( unsigned int x = 0; x < row; x++ )
+        {
+        ( *vertices )[ y * row + x ].pos[ 0 ] = -0.9f + 1.8f * x / side;
+        ( *vertices )[ y * row + x ].pos[ 1 ] = -0.9f + 1.8f * y / side;
+        ( *vertices )[ y * row + x ].clr[ 0 ] = ( float )x / side;
+        ( *vertices )[ y * row + x ].clr[ 1 ] = ( float )y / side;
+        ( *vertices )[ y * row + x ].clr[ 2 ] = 0.5f;
+        }
+    }
+
+for( unsigned int y = 0; y < side; y++ )
+    {
+    for( unsigned int x = 0; x < side; x++ )
+        {
+        ( *indices )[ index++ ] = y * row + x;
+        ( *indices )[ index++ ] = y * row + x + 1;
+        ( *indices )[ index++ ] = ( y + 1 ) * row + x + 1;
+        ( *indices )[ index++ ] = ( y + 1 ) * row + x + 1;
+        ( *indices )[ index++ ] = ( y + 1 ) * row + x;
+        ( *indices )[ index++ ] = y * row + x;
+        }
+    }
+
+return true;
+
+}
+
+
+/*
+ * Writes the results as JSON
+ */
+bool write_results
+    (
+    const char* path,
+    const char* device_name
+    )
+{
+/* Local variables */
+FILE*   file = NULL;
+
+file = fopen( path, "w" );
+if( !file )
+    {
+    printf( "Could not open %s.\n", path );
+    return false;
+    }
+
+fprintf( file, "{\n\"device\": \"" );
+for( const char* c = device_name; *c; c++ )
+    {
+    fputc( ( *c == '"' || *c == '\\' ) ? '_' : *c, file );
+    }
+fprintf( file, "\",\n\"results\": [\n" );
+for( unsigned int i = 0; i < result_count; i++ )
+    {
+    fprintf
+        (
+        file,
+        "  { \"name\": \"%s\", \"value\": %.6f, \"better\": \"%s\" }%s\n",
+        results[ i ].name,
+        results[ i ].value,
+        results[ i ].is_lower_better ? "lower" : "higher",
+        ( i + 1 < result_count ) ? "," : ""
+        );
+    }
+fprintf( file, "]\n}\n" );
+
+fclose( file );
+
+return true;
+
+}
+
+
+/*
+ * Compares the results against a baseline written by an
+ * earlier run. Returns the number of regressions.
+ */
+unsigned int compare_baseline
+    (
+    const char* path,
+    double      threshold
+    )
+{
+/* Local variables */
+FILE*           file = NULL;
+char*           text = NULL;
+long            size = 0;
+const char*     cursor = NULL;
+char            name[ RESULT_NAME_LENGTH ];
+double          value = 0.0;
+double          change = 0.0;
+unsigned int    regression_count = 0;
+
+file = fopen( path, "rb" );
+if( !file )
+    {
+    printf( "Could not open the baseline %s.\n", path );
+    return 0;
+    }
+fseek( file, 0, SEEK_END );
+size = ftell( file );
+fseek( file, 0, SEEK_SET );
+text = ( char* )calloc( 1, size + 1 );
+if( !text || fread( text, 1, size, file ) != ( size_t )size )
+    {
+    printf( "Could not read the baseline %s.\n", path );
+    free( text );
+    fclose( file );
+    return 0;
+    }
+fclose( file );
+
+/* Only our own output is read, one result per line */
+printf( "Against %s, threshold %.1f%%\n", path, threshold );
+for( cursor = strstr( text, "\"name\": \"" ); cursor; cursor = strstr( cursor + 1, "\"name\": \"" ) )
+    {
+    if( sscanf( cursor, "\"name\": \"%63[^\"]\", \"value\": %lf", name, &value ) != 2 || value < 0.0 )
+        {
+        continue;
+        }
+
+    for( unsigned int i = 0; i < result_count; i++ )
+        {
+        if( strcmp( results[ i ].name, name ) != 0 )
+            {
+            continue;
+            }
+
+        /* Positive is worse, either way round. From a baseline of 0,
+        as the steady state allocations should be, any rise counts. */
+        if( value == 0.0 )
+            {
+            change = ( results[ i ].is_lower_better && results[ i ].value > 0.0 ) ? 100.0 : 0.0;
+            }
+        else
+            {
+            change = 100.0 * ( results[ i ].value - value ) / value;
+            if( !results[ i ].is_lower_better )
+                {
+                change = -change;
+                }
+            }
+        printf
+            (
+            "  %-36s %14.3f -> %14.3f %+7.1f%%%s\n",
+            name,
+            value,
+            results[ i ].value,
+            change,
+            ( change > threshold ) ? "  REGRESSION" : ""
+            );
+        regression_count += ( change > threshold ) ? 1 : 0;
+        break;
+        }
+    }
+
+free( text );
+
+return regression_count;
+
+}
@@ -1,4 +1,6 @@
 #include "ivk_buffers.h"
+#include "ivk_trace.h"
+#include "ivk_memory.h"
 #include "ivk_util.h"
 
 #include <string.h>
@@ -25,6 +27,48 @@ static VkVertexInputAttributeDescription vert_2p3c_attr_desc[ IVK_2P3C_ATTR_CNT
 	[ 1 ].offset = offsetof( ivk_2p3c_type, clr ),
 	};
 
+/********* 2p3c, then a mat4 per instance ***********/
+static VkVertexInputBindingDescription vert_2p3c_inst_bind_desc[ IVK_2P3C_INST_BIND_CNT ] =
+	{
+	[ 0 ].binding = 0,
+	[ 0 ].stride = sizeof( ivk_2p3c_type ),
+	[ 0 ].inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	[ 1 ].binding = 1,
+	[ 1 ].stride = sizeof( mat4 ),
+	[ 1 ].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
+	};
+
+static VkVertexInputAttributeDescription vert_2p3c_inst_attr_desc[ IVK_2P3C_INST_ATTR_CNT ] = 
+	{
+	/* Position data */
+	[ 0 ].binding = 0,
+	[ 0 ].location = 0,
+	[ 0 ].format = VK_FORMAT_R32G32_SFLOAT,
+	[ 0 ].offset = offsetof( ivk_2p3c_type, pos ),
+	/* Color data */
+	[ 1 ].binding = 0,
+	[ 1 ].location = 1,
+	[ 1 ].format = VK_FORMAT_R32G32B32_SFLOAT,
+	[ 1 ].offset = offsetof( ivk_2p3c_type, clr ),
+	/* Transform, a column per location */
+	[ 2 ].binding = 1,
+	[ 2 ].location = 2,
+	[ 2 ].format = VK_FORMAT_R32G32B32A32_SFLOAT,
+	[ 2 ].offset = 0,
+	[ 3 ].binding = 1,
+	[ 3 ].location = 3,
+	[ 3 ].format = VK_FORMAT_R32G32B32A32_SFLOAT,
+	[ 3 ].offset = sizeof( vec4 ),
+	[ 4 ].binding = 1,
+	[ 4 ].location = 4,
+	[ 4 ].format = VK_FORMAT_R32G32B32A32_SFLOAT,
+	[ 4 ].offset = 2 * sizeof( vec4 ),
+	[ 5 ].binding = 1,
+	[ 5 ].location = 5,
+	[ 5 ].format = VK_FORMAT_R32G32B32A32_SFLOAT,
+	[ 5 ].offset = 3 * sizeof( vec4 )
+	};
+
 VkVertexInputBindingDescription* ivk_2p3c_get_bind_desc
 	(
 	void
@@ -41,8 +85,26 @@ VkVertexInputAttributeDescription* ivk_2p3c_get_attr_desc
 return &vert_2p3c_attr_desc[ 0 ];
 }
 
+VkVertexInputBindingDescription* ivk_2p3c_inst_get_bind_desc
+	(
+	void
+	)
+{
+return &vert_2p3c_inst_bind_desc[ 0 ];
+}
+
+VkVertexInputAttributeDescription* ivk_2p3c_inst_get_attr_desc
+	(
+	void
+	)
+{
+return &vert_2p3c_inst_attr_desc[ 0 ];
+}
+
 /*
- * Creates a buffer based on the parameters provided.
+ * Creates a buffer based on the parameters provided. It is
+ * shared by the two queue families when they differ, so it
+ * needs no ownership transfer between them.
  */
 static void create_buffer
 	(
@@ -51,6 +113,8 @@ static void create_buffer
 	VkDeviceSize			size,
 	VkBufferUsageFlags		usage,
 	VkMemoryPropertyFlags	properties,
+	uint32_t				transfer_family,
+	uint32_t				use_family,
 	VkBuffer*				buffer,
 	VkDeviceMemory*			buffer_memory
 	);
@@ -60,6 +124,8 @@ static void create_buffer
  */
 static void copy_buffer
 	(
+	const IVK_device_funcs_type*
+					funcs,
 	VkDevice		device,
 	VkCommandPool	pool,
 	VkQueue			queue,
@@ -68,16 +134,6 @@ static void copy_buffer
 	VkDeviceSize	size
 	);
 
-/*
- * Returns the appropriate memory type from the GPU.
- */
-static unsigned int find_memory_type
-	(
-	VkPhysicalDevice		gpu,
-	unsigned int			type_filter,
-	VkMemoryPropertyFlags	properties
-	);
-
 
 /* Vertex buffer create functions */
 /* 
@@ -87,10 +143,14 @@ static unsigned int find_memory_type
  */
 void ivk_buffer_create_vbo
 	(
+	const IVK_device_funcs_type*
+						funcs,
 	VkDevice			device,
 	VkPhysicalDevice	gpu,
 	VkCommandPool		pool,
 	VkQueue				queue,
+	uint32_t			transfer_family,
+	uint32_t			graphics_family,
 	ivk_2p3c_type*		data,
 	unsigned int		vert_cnt,
 	VkBuffer*			buffer,
@@ -103,6 +163,8 @@ VkDeviceMemory	_staging_buffer_mem = { 0 };
 VkDeviceSize	_size = 0;
 void*			_data = NULL;
 
+IVK_TRACE_BEGIN( "upload vertices" );
+
 _size = vert_cnt * sizeof( data[ 0 ] );
 
 /* Create the staging buffer */
@@ -113,6 +175,8 @@ create_buffer
 	_size, 
 	VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
 	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	transfer_family,
+	transfer_family,
 	&_staging_buffer, 
 	&_staging_buffer_mem 
 	);
@@ -130,6 +194,8 @@ create_buffer
 	_size, 
 	VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
 	VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	transfer_family,
+	graphics_family,
 	buffer, 
 	buffer_memory 
 	);
@@ -137,6 +203,7 @@ create_buffer
 /* Copy the data from the staging buffer to the actual vertex buffer */
 copy_buffer
 	(
+	funcs,
 	device,
 	pool,
 	queue,
@@ -146,9 +213,10 @@ copy_buffer
 	);
 
 /* Cleanup */
-vkDestroyBuffer( device, _staging_buffer, NULL );
-vkFreeMemory( device, _staging_buffer_mem, NULL );
+vkDestroyBuffer( device, _staging_buffer, g_ivk_host_allocator );
+vkFreeMemory( device, _staging_buffer_mem, g_ivk_host_allocator );
 
+IVK_TRACE_END( "upload vertices" );
 }
 
 
@@ -157,10 +225,14 @@ vkFreeMemory( device, _staging_buffer_mem, NULL );
  */
 void ivk_buffer_create_ibo
 	(
+	const IVK_device_funcs_type*
+						funcs,
 	VkDevice            device,
 	VkPhysicalDevice	gpu,
 	VkCommandPool		pool,
 	VkQueue				queue,
+	uint32_t			transfer_family,
+	uint32_t			graphics_family,
 	unsigned int*       data,
 	unsigned int        idx_cnt,
 	VkBuffer*           buffer,
@@ -173,6 +245,8 @@ VkDeviceMemory	_staging_buffer_mem = { 0 };
 VkDeviceSize	_size = 0;
 void*			_data = NULL;
 
+IVK_TRACE_BEGIN( "upload indices" );
+
 _size = idx_cnt * sizeof( data[ 0 ] );
 
 /* Create the staging buffer */
@@ -183,6 +257,8 @@ create_buffer
 	_size, 
 	VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
 	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	transfer_family,
+	transfer_family,
 	&_staging_buffer, 
 	&_staging_buffer_mem 
 	);
@@ -200,6 +276,8 @@ create_buffer
 	_size, 
 	VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, 
 	VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	transfer_family,
+	graphics_family,
 	buffer, 
 	buffer_memory 
 	);
@@ -207,6 +285,7 @@ create_buffer
 /* Copy the data from the staging buffer to the actual vertex buffer */
 copy_buffer
 	(
+	funcs,
 	device,
 	pool,
 	queue,
@@ -216,13 +295,17 @@ copy_buffer
 	);
 
 /* Cleanup */
-vkDestroyBuffer( device, _staging_buffer, NULL );
-vkFreeMemory( device, _staging_buffer_mem, NULL );
+vkDestroyBuffer( device, _staging_buffer, g_ivk_host_allocator );
+vkFreeMemory( device, _staging_buffer_mem, g_ivk_host_allocator );
+
+IVK_TRACE_END( "upload indices" );
 }
 
 
 /*
- * Creates a buffer based on the parameters provided.
+ * Creates a buffer based on the parameters provided. It is
+ * shared by the two queue families when they differ, so it
+ * needs no ownership transfer between them.
  */
 static void create_buffer
 	(
@@ -231,6 +314,8 @@ static void create_buffer
 	VkDeviceSize			size,
 	VkBufferUsageFlags		usage,
 	VkMemoryPropertyFlags	properties,
+	uint32_t				transfer_family,
+	uint32_t				use_family,
 	VkBuffer*				buffer,
 	VkDeviceMemory*			buffer_memory
 	)
@@ -239,13 +324,24 @@ static void create_buffer
 VkBufferCreateInfo		_buffer_create_info = { 0 };
 VkMemoryRequirements	_buffer_mem_requirements = { 0 };
 VkMemoryAllocateInfo	_alloc_info = { 0 };
+uint32_t				_families[ 2 ];
 void*					_data = NULL;
 
 _buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 _buffer_create_info.size = size;
 _buffer_create_info.usage = usage;
 _buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-__vk( vkCreateBuffer( device, &_buffer_create_info, NULL, buffer ) );
+
+/* Filled on a dedicated transfer family, read by the graphics one */
+if( transfer_family != use_family )
+	{
+	_families[ 0 ] = transfer_family;
+	_families[ 1 ] = use_family;
+	_buffer_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+	_buffer_create_info.queueFamilyIndexCount = 2;
+	_buffer_create_info.pQueueFamilyIndices = &_families[ 0 ];
+	}
+__vk( vkCreateBuffer( device, &_buffer_create_info, g_ivk_host_allocator, buffer ) );
 
 /* Get the memory requirements */
 vkGetBufferMemoryRequirements( device, *buffer, &_buffer_mem_requirements );
@@ -253,7 +349,7 @@ vkGetBufferMemoryRequirements( device, *buffer, &_buffer_mem_requirements );
 /* Allocate the memory */
 _alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 _alloc_info.allocationSize = _buffer_mem_requirements.size;
-_alloc_info.memoryTypeIndex = find_memory_type
+_alloc_info.memoryTypeIndex = ivk_buffer_find_memory_type
 								( 
 								gpu, 
 								_buffer_mem_requirements.memoryTypeBits, 
@@ -263,7 +359,7 @@ __vk( vkAllocateMemory
 		( 
 		device,
 		&_alloc_info,
-		NULL,
+		g_ivk_host_allocator,
 		buffer_memory
 		) );
 
@@ -278,6 +374,8 @@ __vk( vkBindBufferMemory( device, *buffer, *buffer_memory, 0 ) );
  */
 static void copy_buffer
 	(
+	const IVK_device_funcs_type*
+					funcs,
 	VkDevice		device,
 	VkCommandPool	pool,
 	VkQueue			queue,
@@ -298,7 +396,7 @@ _alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 _alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 _alloc_info.commandPool = pool;
 _alloc_info.commandBufferCount = 1;
-__vk( vkAllocateCommandBuffers( device, &_alloc_info, &_transfer_command_buffer ) );
+__vk( funcs->vkAllocateCommandBuffers( device, &_alloc_info, &_transfer_command_buffer ) );
 
 /* Initialize the command buffer */
 _begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -311,24 +409,25 @@ _submit_info.commandBufferCount = 1;
 _submit_info.pCommandBuffers = &_transfer_command_buffer;
 
 /* Record the commands */
-vkBeginCommandBuffer( _transfer_command_buffer, &_begin_info );
-vkCmdCopyBuffer( _transfer_command_buffer, src, dest, 1, &_copy_region );
-vkEndCommandBuffer( _transfer_command_buffer );
+funcs->vkBeginCommandBuffer( _transfer_command_buffer, &_begin_info );
+funcs->vkCmdCopyBuffer( _transfer_command_buffer, src, dest, 1, &_copy_region );
+funcs->vkEndCommandBuffer( _transfer_command_buffer );
 
 /* Submit the command buffer */
-vkQueueSubmit( queue, 1, &_submit_info, VK_NULL_HANDLE );
-vkQueueWaitIdle( queue );
+funcs->vkQueueSubmit( queue, 1, &_submit_info, VK_NULL_HANDLE );
+funcs->vkQueueWaitIdle( queue );
 
 /* Cleanup */
-vkFreeCommandBuffers( device, pool, 1, &_transfer_command_buffer );
+funcs->vkFreeCommandBuffers( device, pool, 1, &_transfer_command_buffer );
 
 }
 
 
 /*
  * Returns the appropriate memory type from the GPU.
+ * UINT32_MAX if none of them matches.
  */
-static unsigned int find_memory_type
+unsigned int ivk_buffer_find_memory_type
 	(
 	VkPhysicalDevice		gpu,
 	unsigned int			type_filter,
@@ -347,4 +446,6 @@ for( unsigned int i = 0; i < _mem_properties.memoryTypeCount; i++ )
 		return i;
 		}
 	}
+
+return UINT32_MAX;
 }
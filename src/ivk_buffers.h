@@ -2,11 +2,15 @@
 #include "vulkan/vulkan.h"
 #include "cglm/cglm.h"
 
+#include "ivk_dispatch.h"
+
 /* 
  * Vertex format bind / attribute counts
  */
 #define IVK_2P3C_BIND_CNT   1
 #define IVK_2P3C_ATTR_CNT   2
+#define IVK_2P3C_INST_BIND_CNT  2
+#define IVK_2P3C_INST_ATTR_CNT  6
 
 /*
  * Types
@@ -29,6 +33,20 @@ VkVertexInputAttributeDescription* ivk_2p3c_get_attr_desc
     void
     );
 
+/*
+ * The same vertices, plus a mat4 transform per instance at
+ * binding 1, locations 2 to 5
+ */
+VkVertexInputBindingDescription* ivk_2p3c_inst_get_bind_desc
+    (
+    void
+    );
+
+VkVertexInputAttributeDescription* ivk_2p3c_inst_get_attr_desc
+    (
+    void
+    );
+
 
 /* Buffer creation functions */
 /* 
@@ -38,10 +56,14 @@ VkVertexInputAttributeDescription* ivk_2p3c_get_attr_desc
  */
 void ivk_buffer_create_vbo
     (
+    const IVK_device_funcs_type*
+                        funcs,
     VkDevice            device,
     VkPhysicalDevice	gpu,
     VkCommandPool		pool,
 	VkQueue				queue,
+    uint32_t            transfer_family,
+    uint32_t            graphics_family,
     ivk_2p3c_type*      data,
     unsigned int        vert_cnt,
     VkBuffer*           buffer,
@@ -53,12 +75,27 @@ void ivk_buffer_create_vbo
  */
 void ivk_buffer_create_ibo
     (
+    const IVK_device_funcs_type*
+                        funcs,
     VkDevice            device,
     VkPhysicalDevice	gpu,
     VkCommandPool		pool,
 	VkQueue				queue,
+    uint32_t            transfer_family,
+    uint32_t            graphics_family,
     unsigned int*       data,
     unsigned int        idx_cnt,
     VkBuffer*           buffer,
     VkDeviceMemory*		buffer_memory
     );
+
+/*
+ * Returns the appropriate memory type from the GPU.
+ * UINT32_MAX if none of them matches.
+ */
+unsigned int ivk_buffer_find_memory_type
+    (
+    VkPhysicalDevice        gpu,
+    unsigned int            type_filter,
+    VkMemoryPropertyFlags   properties
+    );
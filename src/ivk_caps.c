@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ivk_caps.h"
+
+/*
+ * Device scores. The type outweighs every feature together,
+ * the features outweigh the memory.
+ */
+#define SCORE_DISCRETE          4000
+#define SCORE_INTEGRATED        3000
+#define SCORE_VIRTUAL           2000
+#define SCORE_CPU               1000
+#define SCORE_FEATURE           100
+#define SCORE_MAX_HEAP_GIB      99
+
+#define BYTES_PER_MIB           ( 1024 * 1024 )
+#define BYTES_PER_GIB           ( 1024 * 1024 * 1024 )
+
+
+/*
+ * Queries what the physical device supports, capped at the
+ * instance's API version
+ */
+void ivk_caps_query
+    (
+    const IVK_instance_funcs_type*
+                        funcs,
+    VkPhysicalDevice    physical_device,
+    uint32_t            instance_version,
+    IVK_caps_type*      caps
+    )
+{
+/* Local variables */
+VkPhysicalDeviceProperties          _properties = { 0 };
+VkPhysicalDeviceMemoryProperties    _memory_properties = { 0 };
+VkPhysicalDeviceVulkan11Features    _features_11 = { 0 };
+VkPhysicalDeviceVulkan12Features    _features_12 = { 0 };
+VkPhysicalDeviceVulkan13Features    _features_13 = { 0 };
+VkPhysicalDeviceFeatures2           _features = { 0 };
+
+memset( caps, 0, sizeof( *caps ) );
+
+funcs->vkGetPhysicalDeviceProperties( physical_device, &_properties );
+caps->api_version = ( _properties.apiVersion < instance_version ) ? _properties.apiVersion : instance_version;
+caps->device_type = _properties.deviceType;
+
+funcs->vkGetPhysicalDeviceMemoryProperties( physical_device, &_memory_properties );
+for( uint32_t i = 0; i < _memory_properties.memoryHeapCount; i++ )
+    {
+    if( ( _memory_properties.memoryHeaps[ i ].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT )
+     && _memory_properties.memoryHeaps[ i ].size > caps->device_local_bytes )
+        {
+        caps->device_local_bytes = _memory_properties.memoryHeaps[ i ].size;
+        }
+    }
+
+/* The per-version feature structures are only valid to query from
+the version that introduced them */
+if( caps->api_version < VK_API_VERSION_1_2 )
+    {
+    return;
+    }
+
+_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+_features_11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+_features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+_features_13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+_features.pNext = &_features_11;
+_features_11.pNext = &_features_12;
+if( caps->api_version >= VK_API_VERSION_1_3 )
+    {
+    _features_12.pNext = &_features_13;
+    }
+funcs->vkGetPhysicalDeviceFeatures2( physical_device, &_features );
+
+caps->timeline_semaphore = ( _features_12.timelineSemaphore == VK_TRUE );
+caps->synchronization2 = ( _features_13.synchronization2 == VK_TRUE );
+caps->dynamic_rendering = ( _features_13.dynamicRendering == VK_TRUE );
+caps->descriptor_indexing = _features_12.descriptorIndexing
+                         && _features_12.runtimeDescriptorArray
+                         && _features_12.descriptorBindingPartiallyBound
+                         && _features_12.shaderSampledImageArrayNonUniformIndexing;
+caps->buffer_device_address = ( _features_12.bufferDeviceAddress == VK_TRUE );
+caps->storage_8bit = ( _features_12.storageBuffer8BitAccess == VK_TRUE );
+caps->storage_16bit = ( _features_11.storageBuffer16BitAccess == VK_TRUE );
+caps->pipeline_statistics = ( _features.features.pipelineStatisticsQuery == VK_TRUE );
+caps->fill_mode_non_solid = ( _features.features.fillModeNonSolid == VK_TRUE );
+
+}
+
+
+/*
+ * Ranks a device, the higher the better: its type first,
+ * then the fast paths it supports, then its memory. 0 if
+ * IVK cannot run on it.
+ */
+uint32_t ivk_caps_score
+    (
+    const IVK_caps_type*    caps
+    )
+{
+/* Local variables */
+uint32_t    _score = 0;
+VkDeviceSize
+            _heap_gib = caps->device_local_bytes / BYTES_PER_GIB;
+
+if( !caps->timeline_semaphore )
+    {
+    return 0;
+    }
+
+switch( caps->device_type )
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        _score = SCORE_DISCRETE;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        _score = SCORE_INTEGRATED;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        _score = SCORE_VIRTUAL;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        _score = SCORE_CPU;
+        break;
+    default:
+        _score = 1;
+        break;
+    }
+
+_score += caps->synchronization2 ? SCORE_FEATURE : 0;
+_score += caps->dynamic_rendering ? SCORE_FEATURE : 0;
+_score += caps->descriptor_indexing ? SCORE_FEATURE : 0;
+_score += caps->buffer_device_address ? SCORE_FEATURE : 0;
+_score += caps->storage_8bit ? SCORE_FEATURE : 0;
+_score += caps->storage_16bit ? SCORE_FEATURE : 0;
+_score += ( uint32_t )( ( _heap_gib > SCORE_MAX_HEAP_GIB ) ? SCORE_MAX_HEAP_GIB : _heap_gib );
+
+return _score;
+
+}
+
+
+/*
+ * Fills the feature structures enabling every feature of
+ * caps, and returns the chain to hang off the device create
+ * info. The features are left out of it, they go to
+ * pEnabledFeatures.
+ */
+void* ivk_caps_get_features
+    (
+    const IVK_caps_type*    caps,
+    void*                   chain,
+    IVK_caps_features_type* features
+    )
+{
+memset( features, 0, sizeof( *features ) );
+
+features->features.pipelineStatisticsQuery = caps->pipeline_statistics ? VK_TRUE : VK_FALSE;
+features->features.fillModeNonSolid = caps->fill_mode_non_solid ? VK_TRUE : VK_FALSE;
+
+features->features_11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+features->features_11.storageBuffer16BitAccess = caps->storage_16bit ? VK_TRUE : VK_FALSE;
+features->features_11.pNext = chain;
+chain = &features->features_11;
+
+features->features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+features->features_12.timelineSemaphore = caps->timeline_semaphore ? VK_TRUE : VK_FALSE;
+features->features_12.bufferDeviceAddress = caps->buffer_device_address ? VK_TRUE : VK_FALSE;
+features->features_12.storageBuffer8BitAccess = caps->storage_8bit ? VK_TRUE : VK_FALSE;
+if( caps->descriptor_indexing )
+    {
+    features->features_12.descriptorIndexing = VK_TRUE;
+    features->features_12.runtimeDescriptorArray = VK_TRUE;
+    features->features_12.descriptorBindingPartiallyBound = VK_TRUE;
+    features->features_12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    }
+features->features_12.pNext = chain;
+chain = &features->features_12;
+
+/* Chaining the 1.3 structure at all needs a 1.3 device */
+if( caps->api_version >= VK_API_VERSION_1_3 )
+    {
+    features->features_13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features->features_13.synchronization2 = caps->synchronization2 ? VK_TRUE : VK_FALSE;
+    features->features_13.dynamicRendering = caps->dynamic_rendering ? VK_TRUE : VK_FALSE;
+    features->features_13.pNext = chain;
+    chain = &features->features_13;
+    }
+
+return chain;
+
+}
+
+
+/*
+ * Prints the capabilities, for the startup log
+ */
+void ivk_caps_print
+    (
+    const char*             device_name,
+    const IVK_caps_type*    caps
+    )
+{
+printf
+    (
+    "Device: %s, Vulkan %u.%u, %llu MiB device local%s%s%s%s%s%s\n",
+    device_name,
+    VK_API_VERSION_MAJOR( caps->api_version ),
+    VK_API_VERSION_MINOR( caps->api_version ),
+    ( unsigned long long )( caps->device_local_bytes / BYTES_PER_MIB ),
+    caps->synchronization2 ? ", sync2" : "",
+    caps->dynamic_rendering ? ", dynamic rendering" : "",
+    caps->descriptor_indexing ? ", descriptor indexing" : "",
+    caps->buffer_device_address ? ", buffer device address" : "",
+    caps->storage_8bit ? ", 8-bit storage" : "",
+    caps->storage_16bit ? ", 16-bit storage" : ""
+    );
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+#include "ivk_dispatch.h"
+
+/*
+ * Newest API version IVK asks for
+ */
+#define IVK_MAX_API_VERSION             VK_API_VERSION_1_3
+
+/*
+ * Types
+ */
+
+/*
+ * What a physical device offers, at the API version both it
+ * and the instance support. The features are the ones IVK
+ * knows how to use; each is enabled on the device when set.
+ */
+typedef struct
+    {
+    uint32_t            api_version;        /* Lower of the device's and the instance's */
+    VkPhysicalDeviceType
+                        device_type;
+    VkDeviceSize        device_local_bytes; /* Largest device local heap */
+    bool                timeline_semaphore; /* Required, the frame pacing relies on it */
+    bool                synchronization2;
+    bool                dynamic_rendering;
+    bool                descriptor_indexing;
+                                            /* Runtime sized, partially bound, non-uniformly
+                                               indexed sampled image arrays */
+    bool                buffer_device_address;
+    bool                storage_8bit;       /* 8-bit integers in storage buffers */
+    bool                storage_16bit;      /* 16-bit values in storage buffers */
+    bool                pipeline_statistics;
+    bool                fill_mode_non_solid;
+                                            /* Line and point polygon modes */
+    } IVK_caps_type;
+
+/*
+ * Feature structures to chain into the device create info
+ */
+typedef struct
+    {
+    VkPhysicalDeviceFeatures            features;
+    VkPhysicalDeviceVulkan11Features    features_11;
+    VkPhysicalDeviceVulkan12Features    features_12;
+    VkPhysicalDeviceVulkan13Features    features_13;
+    } IVK_caps_features_type;
+
+
+/*
+ * Queries what the physical device supports, capped at the
+ * instance's API version
+ */
+void ivk_caps_query
+    (
+    const IVK_instance_funcs_type*
+                        funcs,
+    VkPhysicalDevice    physical_device,
+    uint32_t            instance_version,
+    IVK_caps_type*      caps
+    );
+
+/*
+ * Ranks a device, the higher the better: its type first,
+ * then the fast paths it supports, then its memory. 0 if
+ * IVK cannot run on it.
+ */
+uint32_t ivk_caps_score
+    (
+    const IVK_caps_type*    caps
+    );
+
+/*
+ * Fills the feature structures enabling every feature of
+ * caps, and returns the chain to hang off the device create
+ * info. The features are left out of it, they go to
+ * pEnabledFeatures.
+ */
+void* ivk_caps_get_features
+    (
+    const IVK_caps_type*    caps,
+    void*                   chain,
+    IVK_caps_features_type* features
+    );
+
+/*
+ * Prints the capabilities, for the startup log
+ */
+void ivk_caps_print
+    (
+    const char*             device_name,
+    const IVK_caps_type*    caps
+    );
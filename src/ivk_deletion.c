@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_deletion.h"
+#include "ivk_memory.h"
+
+/*** Static functions ***/
+/*
+ * Destroys one object
+ */
+static void destroy_object
+    (
+    const IVK_device_funcs_type*
+                                funcs,
+    VkDevice                    device,
+    const IVK_deletion_type*    deletion
+    );
+
+/*
+ * Doubles the ring, unwrapping it
+ */
+static bool grow
+    (
+    IVK_deletion_queue_type*    queue
+    );
+
+
+/*
+ * Allocates the ring
+ */
+bool ivk_deletion_queue_create
+    (
+    IVK_deletion_queue_type*    queue
+    )
+{
+memset( queue, 0, sizeof( *queue ) );
+
+queue->entries = ( IVK_deletion_type* )calloc( IVK_DELETION_QUEUE_INITIAL_CAPACITY, sizeof( IVK_deletion_type ) );
+if( !queue->entries )
+    {
+    printf( "Failed to allocate the deletion queue.\n" );
+    return false;
+    }
+queue->capacity = IVK_DELETION_QUEUE_INITIAL_CAPACITY;
+
+return true;
+
+}
+
+
+/*
+ * Destroys everything still queued, through funcs, then
+ * frees the ring. The GPU must be idle.
+ */
+void ivk_deletion_queue_destroy
+    (
+    const IVK_device_funcs_type*
+                                funcs,
+    VkDevice                    device,
+    IVK_deletion_queue_type*    queue
+    )
+{
+ivk_deletion_queue_flush( funcs, device, queue, UINT64_MAX );
+
+free( queue->entries );
+memset( queue, 0, sizeof( *queue ) );
+
+}
+
+
+/*
+ * Queues an object for destruction once the frame timeline
+ * reaches its retire_value, which must not be below the
+ * last one queued. Returns false if the ring could not
+ * grow, the object is then left alone.
+ */
+bool ivk_deletion_queue_push
+    (
+    IVK_deletion_queue_type*    queue,
+    const IVK_deletion_type*    deletion
+    )
+{
+if( queue->count == queue->capacity && !grow( queue ) )
+    {
+    return false;
+    }
+
+queue->entries[ ( queue->head + queue->count ) % queue->capacity ] = *deletion;
+queue->count++;
+
+return true;
+
+}
+
+
+/*
+ * Destroys the objects the GPU is done with, those at or
+ * below completed_value, through funcs. Returns how many.
+ */
+uint32_t ivk_deletion_queue_flush
+    (
+    const IVK_device_funcs_type*
+                                funcs,
+    VkDevice                    device,
+    IVK_deletion_queue_type*    queue,
+    uint64_t                    completed_value
+    )
+{
+/* Local variables */
+uint32_t    _destroyed_count = 0;
+
+while( queue->count > 0 && queue->entries[ queue->head ].retire_value <= completed_value )
+    {
+    destroy_object( funcs, device, &queue->entries[ queue->head ] );
+    queue->head = ( queue->head + 1 ) % queue->capacity;
+    queue->count--;
+    _destroyed_count++;
+    }
+queue->destroyed_count += _destroyed_count;
+
+return _destroyed_count;
+
+}
+
+
+/*
+ * Destroys one object
+ */
+static void destroy_object
+    (
+    const IVK_device_funcs_type*
+                                funcs,
+    VkDevice                    device,
+    const IVK_deletion_type*    deletion
+    )
+{
+switch( deletion->kind )
+    {
+    case IVK_DELETION_BUFFER:
+        funcs->vkDestroyBuffer( device, deletion->object.buffer, g_ivk_host_allocator );
+        break;
+    case IVK_DELETION_IMAGE:
+        funcs->vkDestroyImage( device, deletion->object.image, g_ivk_host_allocator );
+        break;
+    case IVK_DELETION_IMAGE_VIEW:
+        funcs->vkDestroyImageView( device, deletion->object.image_view, g_ivk_host_allocator );
+        break;
+    case IVK_DELETION_PIPELINE:
+        funcs->vkDestroyPipeline( device, deletion->object.pipeline, g_ivk_host_allocator );
+        break;
+    case IVK_DELETION_MEMORY:
+        funcs->vkFreeMemory( device, deletion->object.memory, g_ivk_host_allocator );
+        break;
+    }
+
+}
+
+
+/*
+ * Doubles the ring, unwrapping it
+ */
+static bool grow
+    (
+    IVK_deletion_queue_type*    queue
+    )
+{
+/* Local variables */
+IVK_deletion_type*  _entries = NULL;
+uint32_t            _first_count = queue->capacity - queue->head;
+
+_entries = ( IVK_deletion_type* )calloc( queue->capacity * 2, sizeof( IVK_deletion_type ) );
+if( !_entries )
+    {
+    printf( "Failed to grow the deletion queue past %u entries.\n", queue->capacity );
+    return false;
+    }
+
+/* The ring is full here, so it wraps unless head is 0 */
+memcpy( _entries, &queue->entries[ queue->head ], _first_count * sizeof( IVK_deletion_type ) );
+memcpy( &_entries[ _first_count ], queue->entries, queue->head * sizeof( IVK_deletion_type ) );
+
+free( queue->entries );
+queue->entries = _entries;
+queue->capacity *= 2;
+queue->head = 0;
+
+return true;
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+#include "ivk_dispatch.h"
+
+/*
+ * Entries the queue starts with, it doubles when full
+ */
+#define IVK_DELETION_QUEUE_INITIAL_CAPACITY 256
+
+/*
+ * Types
+ */
+typedef enum
+    {
+    IVK_DELETION_BUFFER,
+    IVK_DELETION_IMAGE,
+    IVK_DELETION_IMAGE_VIEW,
+    IVK_DELETION_PIPELINE,
+    IVK_DELETION_MEMORY
+    } IVK_deletion_kind_type;
+
+typedef struct
+    {
+    IVK_deletion_kind_type
+                        kind;
+    union
+        {
+        VkBuffer        buffer;
+        VkImage         image;
+        VkImageView     image_view;
+        VkPipeline      pipeline;
+        VkDeviceMemory  memory;
+        } object;
+    uint64_t            retire_value;       /* Frame timeline value after which
+                                               the GPU no longer uses it */
+    } IVK_deletion_type;
+
+/*
+ * Objects waiting for the GPU to be done with them. They
+ * are queued in timeline order, so the ring is drained from
+ * the oldest end and stops at the first one still in use.
+ */
+typedef struct
+    {
+    IVK_deletion_type*  entries;
+    uint32_t            capacity;
+    uint32_t            head;               /* Oldest */
+    uint32_t            count;
+    uint64_t            destroyed_count;    /* So far */
+    } IVK_deletion_queue_type;
+
+
+/*
+ * Allocates the ring
+ */
+bool ivk_deletion_queue_create
+    (
+    IVK_deletion_queue_type*    queue
+    );
+
+/*
+ * Destroys everything still queued, through funcs, then
+ * frees the ring. The GPU must be idle.
+ */
+void ivk_deletion_queue_destroy
+    (
+    const IVK_device_funcs_type*
+                                funcs,
+    VkDevice                    device,
+    IVK_deletion_queue_type*    queue
+    );
+
+/*
+ * Queues an object for destruction once the frame timeline
+ * reaches its retire_value, which must not be below the
+ * last one queued. Returns false if the ring could not
+ * grow, the object is then left alone.
+ */
+bool ivk_deletion_queue_push
+    (
+    IVK_deletion_queue_type*    queue,
+    const IVK_deletion_type*    deletion
+    );
+
+/*
+ * Destroys the objects the GPU is done with, those at or
+ * below completed_value, through funcs. Returns how many.
+ */
+uint32_t ivk_deletion_queue_flush
+    (
+    const IVK_device_funcs_type*
+                                funcs,
+    VkDevice                    device,
+    IVK_deletion_queue_type*    queue,
+    uint64_t                    completed_value
+    );
@@ -0,0 +1,48 @@
+#include <string.h>
+
+#include "ivk_dispatch.h"
+
+/*
+ * Loads the instance level entry points
+ */
+void ivk_dispatch_load_instance
+    (
+    VkInstance                  instance,
+    IVK_instance_funcs_type*    funcs
+    )
+{
+#define LOAD_INSTANCE( name )   funcs->name = ( PFN_##name )vkGetInstanceProcAddr( instance, #name );
+IVK_INSTANCE_FUNCS( LOAD_INSTANCE )
+#undef LOAD_INSTANCE
+
+}
+
+
+/*
+ * Loads the device level entry points, the driver's own
+ * when is_direct, else the loader's exports
+ */
+void ivk_dispatch_load_device
+    (
+    VkDevice                    device,
+    PFN_vkGetDeviceProcAddr     get_device_proc_addr,
+    bool                        is_direct,
+    IVK_device_funcs_type*      funcs
+    )
+{
+memset( funcs, 0, sizeof( *funcs ) );
+
+if( is_direct )
+    {
+    #define LOAD_DEVICE( name ) funcs->name = ( PFN_##name )get_device_proc_addr( device, #name );
+    IVK_DEVICE_FUNCS( LOAD_DEVICE )
+    #undef LOAD_DEVICE
+    }
+else
+    {
+    #define LOAD_EXPORT( name ) funcs->name = name;
+    IVK_DEVICE_FUNCS( LOAD_EXPORT )
+    #undef LOAD_EXPORT
+    }
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <stdbool.h>
+#include "vulkan/vulkan.h"
+
+/*
+ * Instance level entry points IVK calls, as X( name )
+ */
+#define IVK_INSTANCE_FUNCS( X )                             \
+    X( vkDestroyInstance )                                  \
+    X( vkEnumeratePhysicalDevices )                         \
+    X( vkEnumerateDeviceExtensionProperties )               \
+    X( vkGetPhysicalDeviceProperties )                      \
+    X( vkGetPhysicalDeviceProperties2 )                     \
+    X( vkGetPhysicalDeviceMemoryProperties )                \
+    X( vkGetPhysicalDeviceFeatures2 )                       \
+    X( vkGetPhysicalDeviceMemoryProperties2 )               \
+    X( vkGetPhysicalDeviceQueueFamilyProperties )           \
+    X( vkGetPhysicalDeviceSurfaceSupportKHR )               \
+    X( vkGetPhysicalDeviceSurfaceCapabilitiesKHR )          \
+    X( vkDestroySurfaceKHR )                                \
+    X( vkCreateDevice )                                     \
+    X( vkGetDeviceProcAddr )
+
+/*
+ * Device level entry points IVK calls, as X( name ). Those
+ * of extensions the device lacks load as NULL.
+ */
+#define IVK_DEVICE_FUNCS( X )                               \
+    X( vkDestroyDevice )                                    \
+    X( vkDeviceWaitIdle )                                   \
+    X( vkCreateCommandPool )                                \
+    X( vkDestroyCommandPool )                               \
+    X( vkDestroyBuffer )                                    \
+    X( vkDestroyImage )                                     \
+    X( vkDestroyImageView )                                 \
+    X( vkDestroyPipeline )                                  \
+    X( vkFreeMemory )                                       \
+    X( vkInvalidateMappedMemoryRanges )                     \
+    X( vkAllocateCommandBuffers )                           \
+    X( vkFreeCommandBuffers )                               \
+    X( vkResetCommandBuffer )                               \
+    X( vkBeginCommandBuffer )                               \
+    X( vkEndCommandBuffer )                                 \
+    X( vkCreateSemaphore )                                  \
+    X( vkDestroySemaphore )                                 \
+    X( vkGetSemaphoreCounterValue )                         \
+    X( vkWaitSemaphores )                                   \
+    X( vkCreateRenderPass )                                 \
+    X( vkDestroyRenderPass )                                \
+    X( vkCreateFramebuffer )                                \
+    X( vkDestroyPipelineLayout )                            \
+    X( vkGetQueryPoolResults )                              \
+    X( vkQueueSubmit )                                      \
+    X( vkQueueWaitIdle )                                    \
+    X( vkAcquireNextImageKHR )                              \
+    X( vkQueuePresentKHR )                                  \
+    X( vkCmdBeginRenderPass )                               \
+    X( vkCmdEndRenderPass )                                 \
+    X( vkCmdBeginRendering )                                \
+    X( vkCmdEndRendering )                                  \
+    X( vkCmdBindPipeline )                                  \
+    X( vkCmdBindVertexBuffers )                             \
+    X( vkCmdBindIndexBuffer )                               \
+    X( vkCmdDrawIndexed )                                   \
+    X( vkCmdPipelineBarrier )                               \
+    X( vkCmdPipelineBarrier2 )                              \
+    X( vkCmdSetViewport )                                   \
+    X( vkCmdSetScissor )                                    \
+    X( vkCmdPushConstants )                                 \
+    X( vkCmdCopyBuffer )                                    \
+    X( vkCmdCopyImageToBuffer )                             \
+    X( vkCmdResetQueryPool )                                \
+    X( vkCmdWriteTimestamp )                                \
+    X( vkCmdBeginQuery )                                    \
+    X( vkCmdEndQuery )
+
+#define IVK_DISPATCH_MEMBER( name )     PFN_##name name;
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    IVK_INSTANCE_FUNCS( IVK_DISPATCH_MEMBER )
+    } IVK_instance_funcs_type;
+
+/*
+ * Device commands, called straight into the driver rather
+ * than through the loader's trampoline, which looks the
+ * device's table up again on every call
+ */
+typedef struct
+    {
+    IVK_DEVICE_FUNCS( IVK_DISPATCH_MEMBER )
+    } IVK_device_funcs_type;
+
+
+/*
+ * Loads the instance level entry points
+ */
+void ivk_dispatch_load_instance
+    (
+    VkInstance                  instance,
+    IVK_instance_funcs_type*    funcs
+    );
+
+/*
+ * Loads the device level entry points, the driver's own
+ * when is_direct, else the loader's exports
+ */
+void ivk_dispatch_load_device
+    (
+    VkDevice                    device,
+    PFN_vkGetDeviceProcAddr     get_device_proc_addr,
+    bool                        is_direct,
+    IVK_device_funcs_type*      funcs
+    );
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_draw.h"
+#include "ivk_buffers.h"
+#include "ivk_trace.h"
+#include "ivk_memory.h"
+#include "ivk_util.h"
+
+/*
+ * Bits of the sort key
+ */
+#define KEY_MATERIAL_SHIFT  32
+#define KEY_LAYER_SHIFT     40
+#define KEY_MESH_MASK       0xFFFFFFFFull
+#define KEY_MATERIAL_MASK   0xFFull
+
+/*
+ * Transforms each job gathers, fewer draws than that are
+ * gathered inline
+ */
+#define GATHER_BATCH_SIZE   4096
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    uint64_t            key;
+    uint32_t            draw;               /* Index into the caller's draws */
+    } draw_key_type;
+
+typedef struct
+    {
+    const draw_key_type*
+                        keys;
+    const IVK_draw_type*
+                        draws;
+    mat4*               transforms;
+    } gather_job_type;
+
+/*** Static functions ***/
+/*
+ * Sorts the keys with a stable radix sort, a byte per pass.
+ * Bytes that are the same in every key are skipped, so the
+ * usual handful of layers and materials costs a few passes.
+ */
+static void sort_keys
+    (
+    draw_key_type*      keys,
+    draw_key_type*      temp,
+    uint32_t            count
+    );
+
+/*
+ * IVK_job_func_type, copies the transforms of a range of
+ * sorted keys
+ */
+static void gather_transforms
+    (
+    void*               data,
+    uint32_t            first,
+    uint32_t            count
+    );
+
+
+/*
+ * Creates a persistently mapped buffer of capacity
+ * transforms. Memory the GPU reads directly is preferred.
+ */
+bool ivk_draw_create_instance_buffer
+    (
+    VkDevice                    device,
+    VkPhysicalDevice            gpu,
+    uint32_t                    capacity,
+    IVK_instance_buffer_type*   instances
+    )
+{
+/* Local variables */
+VkBufferCreateInfo      _buffer_create_info = { 0 };
+VkMemoryRequirements    _mem_requirements = { 0 };
+VkMemoryAllocateInfo    _alloc_info = { 0 };
+unsigned int            _memory_type = 0;
+void*                   _mapped = NULL;
+
+memset( instances, 0, sizeof( *instances ) );
+
+_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+_buffer_create_info.size = capacity * sizeof( mat4 );
+_buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+__vk( vkCreateBuffer( device, &_buffer_create_info, g_ivk_host_allocator, &instances->buffer ) );
+
+vkGetBufferMemoryRequirements( device, instances->buffer, &_mem_requirements );
+
+/* Coherent, so the writes need no flush */
+_memory_type = ivk_buffer_find_memory_type
+    (
+    gpu,
+    _mem_requirements.memoryTypeBits,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+if( _memory_type == UINT32_MAX )
+    {
+    _memory_type = ivk_buffer_find_memory_type
+        (
+        gpu,
+        _mem_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        );
+    }
+if( _memory_type == UINT32_MAX )
+    {
+    printf( "No host visible memory for the instance transforms.\n" );
+    vkDestroyBuffer( device, instances->buffer, g_ivk_host_allocator );
+    instances->buffer = VK_NULL_HANDLE;
+    return false;
+    }
+
+_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+_alloc_info.allocationSize = _mem_requirements.size;
+_alloc_info.memoryTypeIndex = _memory_type;
+__vk( vkAllocateMemory( device, &_alloc_info, g_ivk_host_allocator, &instances->memory ) );
+__vk( vkBindBufferMemory( device, instances->buffer, instances->memory, 0 ) );
+
+/* Mapped once for the lifetime of the buffer */
+__vk( vkMapMemory( device, instances->memory, 0, VK_WHOLE_SIZE, 0, &_mapped ) );
+instances->transforms = ( mat4* )_mapped;
+instances->capacity = capacity;
+
+return true;
+
+}
+
+
+/*
+ * Destroys an instance buffer
+ */
+void ivk_draw_destroy_instance_buffer
+    (
+    VkDevice                    device,
+    IVK_instance_buffer_type*   instances
+    )
+{
+vkDestroyBuffer( device, instances->buffer, g_ivk_host_allocator );
+vkFreeMemory( device, instances->memory, g_ivk_host_allocator );
+memset( instances, 0, sizeof( *instances ) );
+
+}
+
+
+/*
+ * Sorts the draws and merges them into batches, writing
+ * their transforms to transforms in the batches' order.
+ * transforms must hold draw_count of them. The batches are
+ * allocated from arena. Returns the batch count. With
+ * jobs, the transforms are gathered in parallel.
+ */
+uint32_t ivk_draw_build_batches
+    (
+    const IVK_mesh_pool_type*   meshes,
+    const IVK_draw_type*        draws,
+    uint32_t                    draw_count,
+    IVK_arena_type*             arena,
+    IVK_job_system_type*        jobs,
+    mat4*                       transforms,
+    IVK_draw_batch_type**       batches
+    )
+{
+/* Local variables */
+draw_key_type*          _keys = NULL;
+draw_key_type*          _temp = NULL;
+IVK_draw_batch_type*    _batches = NULL;
+uint32_t                _key_count = 0;
+uint32_t                _batch_count = 0;
+uint64_t                _run_key = 0;
+const IVK_draw_type*    _draw = NULL;
+gather_job_type         _gather = { 0 };
+IVK_job_counter_type    _gather_counter = { 0 };
+bool                    _is_parallel = false;
+
+*batches = NULL;
+if( draw_count == 0 )
+    {
+    return 0;
+    }
+
+IVK_TRACE_BEGIN( "build batches" );
+
+_keys = ( draw_key_type* )ivk_arena_alloc( arena, draw_count * sizeof( draw_key_type ), 0 );
+_temp = ( draw_key_type* )ivk_arena_alloc( arena, draw_count * sizeof( draw_key_type ), 0 );
+_batches = ( IVK_draw_batch_type* )ivk_arena_alloc( arena, draw_count * sizeof( IVK_draw_batch_type ), 0 );
+if( !_keys || !_temp || !_batches )
+    {
+    printf( "Out of frame memory for %u draws.\n", draw_count );
+    IVK_TRACE_END( "build batches" );
+    return 0;
+    }
+
+/* Resolve the handles once, the sort and the recording then work on
+packed indices */
+for( uint32_t i = 0; i < draw_count; i++ )
+    {
+    _draw = &draws[ i ];
+    if( _draw->mesh == IVK_INVALID_HANDLE )
+        {
+        continue;
+        }
+    _keys[ _key_count ].key = ( ( uint64_t )( _draw->layer & IVK_DRAW_MAX_LAYER ) << KEY_LAYER_SHIFT )
+                            | ( ( uint64_t )( _draw->material & KEY_MATERIAL_MASK ) << KEY_MATERIAL_SHIFT )
+                            | IVK_SLOT_MAP_DENSE( &meshes->map, _draw->mesh );
+    _keys[ _key_count ].draw = i;
+    _key_count++;
+    }
+
+sort_keys( _keys, _temp, _key_count );
+
+/* The gather is a scattered read of the whole draw list, it runs on
+the workers while the batches are merged */
+_is_parallel = ( jobs != NULL && _key_count > GATHER_BATCH_SIZE );
+if( _is_parallel )
+    {
+    _gather.keys = _keys;
+    _gather.draws = draws;
+    _gather.transforms = transforms;
+    ivk_job_parallel_for( jobs, gather_transforms, &_gather, _key_count, GATHER_BATCH_SIZE, &_gather_counter );
+    }
+
+/* Equal keys are neighbours now, each run is one instanced draw */
+for( uint32_t i = 0; i < _key_count; i++ )
+    {
+    if( !_is_parallel )
+        {
+        memcpy( transforms[ i ], draws[ _keys[ i ].draw ].transform, sizeof( mat4 ) );
+        }
+    if( _batch_count > 0 && _keys[ i ].key == _run_key )
+        {
+        _batches[ _batch_count - 1 ].instance_count++;
+        continue;
+        }
+
+    _run_key = _keys[ i ].key;
+    _batches[ _batch_count ].material = ( uint32_t )( ( _run_key >> KEY_MATERIAL_SHIFT ) & KEY_MATERIAL_MASK );
+    _batches[ _batch_count ].mesh_index = ( uint32_t )( _run_key & KEY_MESH_MASK );
+    _batches[ _batch_count ].first_instance = i;
+    _batches[ _batch_count ].instance_count = 1;
+    _batch_count++;
+    }
+
+if( _is_parallel )
+    {
+    ivk_job_wait( jobs, &_gather_counter );
+    }
+*batches = _batches;
+
+IVK_TRACE_END( "build batches" );
+
+return _batch_count;
+
+}
+
+
+/*
+ * Sorts the keys with a stable radix sort, a byte per pass.
+ * Bytes that are the same in every key are skipped, so the
+ * usual handful of layers and materials costs a few passes.
+ */
+static void sort_keys
+    (
+    draw_key_type*      keys,
+    draw_key_type*      temp,
+    uint32_t            count
+    )
+{
+/* Local variables */
+uint32_t        _offsets[ 256 ];
+draw_key_type*  _src = keys;
+draw_key_type*  _dst = temp;
+draw_key_type*  _swap = NULL;
+uint32_t        _digit = 0;
+uint32_t        _sum = 0;
+bool            _is_sorted = true;
+
+/* Scenes are often submitted in order already */
+for( uint32_t i = 1; i < count && _is_sorted; i++ )
+    {
+    _is_sorted = ( keys[ i - 1 ].key <= keys[ i ].key );
+    }
+if( _is_sorted )
+    {
+    return;
+    }
+
+for( unsigned int shift = 0; shift < 64; shift += 8 )
+    {
+    memset( _offsets, 0, sizeof( _offsets ) );
+    for( uint32_t i = 0; i < count; i++ )
+        {
+        _offsets[ ( _src[ i ].key >> shift ) & 0xFF ]++;
+        }
+    if( _offsets[ ( _src[ 0 ].key >> shift ) & 0xFF ] == count )
+        {
+        continue;
+        }
+
+    _sum = 0;
+    for( unsigned int i = 0; i < 256; i++ )
+        {
+        _digit = _offsets[ i ];
+        _offsets[ i ] = _sum;
+        _sum += _digit;
+        }
+    for( uint32_t i = 0; i < count; i++ )
+        {
+        _dst[ _offsets[ ( _src[ i ].key >> shift ) & 0xFF ]++ ] = _src[ i ];
+        }
+
+    _swap = _src;
+    _src = _dst;
+    _dst = _swap;
+    }
+
+if( _src != keys )
+    {
+    memcpy( keys, _src, count * sizeof( draw_key_type ) );
+    }
+
+}
+
+
+/*
+ * IVK_job_func_type, copies the transforms of a range of
+ * sorted keys
+ */
+static void gather_transforms
+    (
+    void*               data,
+    uint32_t            first,
+    uint32_t            count
+    )
+{
+/* Local variables */
+const gather_job_type*  _gather = ( const gather_job_type* )data;
+
+for( uint32_t i = first; i < first + count; i++ )
+    {
+    memcpy( _gather->transforms[ i ], _gather->draws[ _gather->keys[ i ].draw ].transform, sizeof( mat4 ) );
+    }
+
+}
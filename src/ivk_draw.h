@@ -0,0 +1,102 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+#include "cglm/cglm.h"
+
+#include "ivk_job.h"
+#include "ivk_memory.h"
+#include "ivk_resource.h"
+
+/*
+ * Sort keys: the layer, the material, then the mesh's
+ * packed index in the pool, high bits to low
+ */
+#define IVK_DRAW_LAYER_BITS             24
+#define IVK_DRAW_MAX_LAYER              ( ( 1u << IVK_DRAW_LAYER_BITS ) - 1 )
+#define IVK_DRAW_MAX_MATERIALS          64      /* Fits the 8 bits left */
+
+/*
+ * Transforms an instance buffer starts with
+ */
+#define IVK_DRAW_INITIAL_INSTANCES      1024
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    mat4                transform;          /* Model to clip space */
+    IVK_mesh_handle_type
+                        mesh;               /* Draws with IVK_INVALID_HANDLE are skipped */
+    uint32_t            material;           /* From ivk_create_material, 0 for the
+                                               default state */
+    uint32_t            layer;              /* Lower layers are drawn first, up to
+                                               IVK_DRAW_MAX_LAYER */
+    } IVK_draw_type;
+
+/*
+ * A run of sorted draws sharing layer, material and mesh,
+ * recorded as one instanced vkCmdDrawIndexed. Indirect draws
+ * are out of scope, the batch is not laid out as a
+ * VkDrawIndexedIndirectCommand.
+ */
+typedef struct
+    {
+    uint32_t            material;
+    uint32_t            mesh_index;         /* Packed index in the mesh pool */
+    uint32_t            first_instance;
+    uint32_t            instance_count;
+    } IVK_draw_batch_type;
+
+/*
+ * Per-instance transforms of a frame slot, read by the
+ * vertex shader at binding 1
+ */
+typedef struct
+    {
+    VkBuffer            buffer;
+    VkDeviceMemory      memory;
+    mat4*               transforms;         /* Persistently mapped */
+    uint32_t            capacity;           /* Transforms */
+    } IVK_instance_buffer_type;
+
+
+/*
+ * Creates a persistently mapped buffer of capacity
+ * transforms. Memory the GPU reads directly is preferred.
+ */
+bool ivk_draw_create_instance_buffer
+    (
+    VkDevice                    device,
+    VkPhysicalDevice            gpu,
+    uint32_t                    capacity,
+    IVK_instance_buffer_type*   instances
+    );
+
+/*
+ * Destroys an instance buffer
+ */
+void ivk_draw_destroy_instance_buffer
+    (
+    VkDevice                    device,
+    IVK_instance_buffer_type*   instances
+    );
+
+/*
+ * Sorts the draws and merges them into batches, writing
+ * their transforms to transforms in the batches' order.
+ * transforms must hold draw_count of them. The batches are
+ * allocated from arena. Returns the batch count. With
+ * jobs, the transforms are gathered in parallel.
+ */
+uint32_t ivk_draw_build_batches
+    (
+    const IVK_mesh_pool_type*   meshes,
+    const IVK_draw_type*        draws,
+    uint32_t                    draw_count,
+    IVK_arena_type*             arena,
+    IVK_job_system_type*        jobs,
+    mat4*                       transforms,
+    IVK_draw_batch_type**       batches
+    );
@@ -0,0 +1,717 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_gpu_profiler.h"
+#include "ivk_memory.h"
+#include "ivk_util.h"
+
+/* Timestamp queries of the whole frame, the zones follow */
+#define FRAME_QUERY_COUNT       2
+
+/* Weight of a new sample in the rolling averages */
+#define AVERAGE_SMOOTHING       0.05
+
+/*** Static functions ***/
+/*
+ * Returns the index of the zone name, adding it if new.
+ * Returns UINT32_MAX when there is no room left.
+ */
+static unsigned int find_zone_name
+    (
+    IVK_gpu_profiler_type*  profiler,
+    const char*             name
+    );
+
+/*
+ * Reads the results of one completed frame. Returns false
+ * if they are not available.
+ */
+static bool collect_frame
+    (
+    IVK_gpu_profiler_type*          profiler,
+    VkDevice                        device,
+    IVK_gpu_profiler_frame_type*    frame
+    );
+
+/*
+ * Folds a timing sample into the statistics of a zone
+ */
+static void add_sample
+    (
+    IVK_gpu_zone_stats_type*    zone,
+    double                      sample_ms
+    );
+
+/*
+ * Fills in the summary of a zone
+ */
+static void summarize_zone
+    (
+    const IVK_gpu_zone_stats_type*  zone,
+    IVK_gpu_zone_report_type*       report
+    );
+
+/*
+ * qsort comparison of two doubles
+ */
+static int compare_doubles
+    (
+    const void* a,
+    const void* b
+    );
+
+
+/*
+ * Creates the query pools of frame_count frames. The
+ * queries are recorded and read through funcs, which must
+ * outlive the profiler. Pipeline statistics need the
+ * pipelineStatisticsQuery feature. Returns false if the
+ * queue family cannot write timestamps.
+ */
+bool ivk_gpu_profiler_create
+    (
+    const IVK_device_funcs_type*
+                            funcs,
+    VkDevice                device,
+    VkPhysicalDevice        gpu,
+    unsigned int            queue_family,
+    unsigned int            frame_count,
+    bool                    use_statistics,
+    IVK_gpu_profiler_type*  profiler
+    )
+{
+/* Local variables */
+VkPhysicalDeviceProperties  _properties = { 0 };
+VkQueueFamilyProperties*    _families = NULL;
+unsigned int                _family_count = 0;
+unsigned int                _valid_bits = 0;
+VkQueryPoolCreateInfo       _pool_create_info = { 0 };
+
+memset( profiler, 0, sizeof( *profiler ) );
+profiler->funcs = funcs;
+
+/* Timestamps are optional per queue family */
+vkGetPhysicalDeviceQueueFamilyProperties( gpu, &_family_count, NULL );
+_families = ( VkQueueFamilyProperties* )malloc( _family_count * sizeof( VkQueueFamilyProperties ) );
+if( !_families )
+    {
+    return false;
+    }
+vkGetPhysicalDeviceQueueFamilyProperties( gpu, &_family_count, _families );
+if( queue_family < _family_count )
+    {
+    _valid_bits = _families[ queue_family ].timestampValidBits;
+    }
+free( _families );
+
+if( _valid_bits == 0 )
+    {
+    printf( "Queue family %u cannot write timestamps.\n", queue_family );
+    return false;
+    }
+
+vkGetPhysicalDeviceProperties( gpu, &_properties );
+profiler->timestamp_period = _properties.limits.timestampPeriod;
+profiler->timestamp_mask = ( _valid_bits >= 64 ) ? UINT64_MAX : ( ( ( uint64_t )1 << _valid_bits ) - 1 );
+profiler->use_statistics = use_statistics;
+
+if( frame_count > IVK_GPU_PROFILER_MAX_FRAMES )
+    {
+    frame_count = IVK_GPU_PROFILER_MAX_FRAMES;
+    }
+profiler->frame_count = frame_count;
+
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    _pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    _pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    _pool_create_info.queryCount = FRAME_QUERY_COUNT + 2 * IVK_GPU_PROFILER_MAX_ZONES;
+    _pool_create_info.pipelineStatistics = 0;
+    __vk( vkCreateQueryPool( device, &_pool_create_info, g_ivk_host_allocator, &profiler->frames[ i ].timestamp_pool ) );
+
+    if( use_statistics )
+        {
+        _pool_create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        _pool_create_info.queryCount = IVK_GPU_PROFILER_MAX_ZONES;
+        _pool_create_info.pipelineStatistics = IVK_GPU_PROFILER_STATISTICS;
+        __vk( vkCreateQueryPool( device, &_pool_create_info, g_ivk_host_allocator, &profiler->frames[ i ].statistics_pool ) );
+        }
+    }
+
+/* The whole frame comes first */
+find_zone_name( profiler, "frame" );
+
+return true;
+
+}
+
+
+/*
+ * Destroys the query pools
+ */
+void ivk_gpu_profiler_destroy
+    (
+    VkDevice                device,
+    IVK_gpu_profiler_type*  profiler
+    )
+{
+for( unsigned int i = 0; i < profiler->frame_count; i++ )
+    {
+    vkDestroyQueryPool( device, profiler->frames[ i ].timestamp_pool, g_ivk_host_allocator );
+    if( profiler->frames[ i ].statistics_pool != VK_NULL_HANDLE )
+        {
+        vkDestroyQueryPool( device, profiler->frames[ i ].statistics_pool, g_ivk_host_allocator );
+        }
+    }
+
+profiler->frame_count = 0;
+profiler->current = NULL;
+
+}
+
+
+/*
+ * Starts recording frame_index, outside of any render pass.
+ * The previous results of the frame must have been
+ * collected, or they are lost.
+ */
+void ivk_gpu_profiler_begin_frame
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer,
+    unsigned int            frame_index,
+    uint64_t                frame_value
+    )
+{
+/* Local variables */
+IVK_gpu_profiler_frame_type*    _frame = NULL;
+
+if( frame_index >= profiler->frame_count )
+    {
+    profiler->current = NULL;
+    return;
+    }
+
+_frame = &profiler->frames[ frame_index ];
+if( _frame->frame_value != 0 )
+    {
+    profiler->lost_count++;
+    }
+
+_frame->zone_count = 0;
+_frame->open_count = 0;
+_frame->ignored_count = 0;
+_frame->open_statistics = UINT32_MAX;
+_frame->frame_value = frame_value;
+profiler->current = _frame;
+
+/* Queries have to be reset before every use */
+profiler->funcs->vkCmdResetQueryPool( command_buffer, _frame->timestamp_pool, 0, FRAME_QUERY_COUNT + 2 * IVK_GPU_PROFILER_MAX_ZONES );
+if( _frame->statistics_pool != VK_NULL_HANDLE )
+    {
+    profiler->funcs->vkCmdResetQueryPool( command_buffer, _frame->statistics_pool, 0, IVK_GPU_PROFILER_MAX_ZONES );
+    }
+
+profiler->funcs->vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _frame->timestamp_pool, 0 );
+
+}
+
+
+/*
+ * Ends the frame, closing the zones left open
+ */
+void ivk_gpu_profiler_end_frame
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer
+    )
+{
+if( !profiler->current )
+    {
+    return;
+    }
+
+while( profiler->current->open_count > 0 || profiler->current->ignored_count > 0 )
+    {
+    ivk_gpu_profiler_end_zone( profiler, command_buffer );
+    }
+
+profiler->funcs->vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->current->timestamp_pool, 1 );
+profiler->current = NULL;
+
+}
+
+
+/*
+ * Opens a named zone. Zones nest; pipeline statistics are
+ * only gathered for the outermost one, as Vulkan cannot
+ * nest them. A zone must not straddle a render pass
+ * boundary.
+ */
+void ivk_gpu_profiler_begin_zone
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer,
+    const char*             name
+    )
+{
+/* Local variables */
+IVK_gpu_profiler_frame_type*    _frame = profiler->current;
+unsigned int                    _name = 0;
+unsigned int                    _zone = 0;
+
+if( !_frame )
+    {
+    return;
+    }
+
+/* Past the limits the zone is only counted, so the ends still pair
+up with the right begins */
+_name = find_zone_name( profiler, name );
+if( _name == UINT32_MAX ||
+    _frame->ignored_count > 0 ||
+    _frame->zone_count == IVK_GPU_PROFILER_MAX_ZONES ||
+    _frame->open_count == IVK_GPU_PROFILER_MAX_DEPTH )
+    {
+    _frame->ignored_count++;
+    return;
+    }
+
+_zone = _frame->zone_count++;
+_frame->zone_names[ _zone ] = _name;
+_frame->zone_has_statistics[ _zone ] = false;
+_frame->open_zones[ _frame->open_count++ ] = _zone;
+
+profiler->funcs->vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _frame->timestamp_pool, FRAME_QUERY_COUNT + 2 * _zone );
+
+if( _frame->statistics_pool != VK_NULL_HANDLE && _frame->open_statistics == UINT32_MAX )
+    {
+    profiler->funcs->vkCmdBeginQuery( command_buffer, _frame->statistics_pool, _zone, 0 );
+    _frame->open_statistics = _zone;
+    _frame->zone_has_statistics[ _zone ] = true;
+    }
+
+}
+
+
+/*
+ * Closes the innermost open zone
+ */
+void ivk_gpu_profiler_end_zone
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer
+    )
+{
+/* Local variables */
+IVK_gpu_profiler_frame_type*    _frame = profiler->current;
+unsigned int                    _zone = 0;
+
+if( !_frame )
+    {
+    return;
+    }
+
+if( _frame->ignored_count > 0 )
+    {
+    _frame->ignored_count--;
+    return;
+    }
+if( _frame->open_count == 0 )
+    {
+    return;
+    }
+
+_zone = _frame->open_zones[ --_frame->open_count ];
+if( _frame->open_statistics == _zone )
+    {
+    profiler->funcs->vkCmdEndQuery( command_buffer, _frame->statistics_pool, _zone );
+    _frame->open_statistics = UINT32_MAX;
+    }
+
+profiler->funcs->vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _frame->timestamp_pool, FRAME_QUERY_COUNT + 2 * _zone + 1 );
+
+}
+
+
+/*
+ * Reads back the frames that reached completed_value on the
+ * frame timeline. Never blocks.
+ */
+void ivk_gpu_profiler_collect
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkDevice                device,
+    uint64_t                completed_value
+    )
+{
+/* Local variables */
+IVK_gpu_profiler_frame_type*    _frame = NULL;
+
+for( unsigned int i = 0; i < profiler->frame_count; i++ )
+    {
+    _frame = &profiler->frames[ i ];
+    if( _frame->frame_value == 0 ||
+        _frame->frame_value > completed_value ||
+        _frame == profiler->current )
+        {
+        continue;
+        }
+
+    if( collect_frame( profiler, device, _frame ) )
+        {
+        profiler->collected_count++;
+        }
+    else
+        {
+        profiler->lost_count++;
+        }
+    _frame->frame_value = 0;
+    }
+
+}
+
+
+/*
+ * Fills in up to max_count zone summaries, returns the
+ * number of zones
+ */
+unsigned int ivk_gpu_profiler_report
+    (
+    const IVK_gpu_profiler_type*    profiler,
+    IVK_gpu_zone_report_type*       reports,
+    unsigned int                    max_count
+    )
+{
+for( unsigned int i = 0; i < profiler->name_count && i < max_count; i++ )
+    {
+    summarize_zone( &profiler->zones[ i ], &reports[ i ] );
+    }
+
+return profiler->name_count;
+
+}
+
+
+/*
+ * Writes the zone summaries to path, as CSV if the name
+ * ends in .csv and as JSON otherwise. The JSON also holds
+ * the recent samples.
+ */
+bool ivk_gpu_profiler_dump
+    (
+    const IVK_gpu_profiler_type*    profiler,
+    const char*                     path
+    )
+{
+/* Local variables */
+FILE*                           _file = NULL;
+size_t                          _length = strlen( path );
+bool                            _is_csv = false;
+IVK_gpu_zone_report_type        _report;
+const IVK_gpu_zone_stats_type*  _zone = NULL;
+unsigned int                    _count = 0;
+unsigned int                    _first = 0;
+
+_is_csv = ( _length >= 4 && strcmp( path + _length - 4, ".csv" ) == 0 );
+
+_file = fopen( path, "w" );
+if( !_file )
+    {
+    printf( "Could not open %s.\n", path );
+    return false;
+    }
+
+if( _is_csv )
+    {
+    fprintf( _file, "zone,samples,average_ms,p50_ms,p95_ms,p99_ms,max_ms,vertex_invocations,clipping_invocations,clipping_primitives,fragment_invocations\n" );
+    for( unsigned int i = 0; i < profiler->name_count; i++ )
+        {
+        summarize_zone( &profiler->zones[ i ], &_report );
+        fprintf
+            (
+            _file,
+            "%s,%u,%.6f,%.6f,%.6f,%.6f,%.6f",
+            _report.name,
+            _report.sample_count,
+            _report.average_ms,
+            _report.p50_ms,
+            _report.p95_ms,
+            _report.p99_ms,
+            _report.max_ms
+            );
+        for( unsigned int j = 0; j < IVK_GPU_STATISTIC_COUNT; j++ )
+            {
+            /* Empty cells for zones without statistics */
+            if( _report.has_statistics )
+                {
+                fprintf( _file, ",%.1f", _report.statistics[ j ] );
+                }
+            else
+                {
+                fprintf( _file, "," );
+                }
+            }
+        fprintf( _file, "\n" );
+        }
+    fclose( _file );
+    return true;
+    }
+
+fprintf( _file, "{\n" );
+fprintf( _file, "  \"timestamp_period_ns\": %.6f,\n", profiler->timestamp_period );
+fprintf( _file, "  \"frames_collected\": %u,\n", profiler->collected_count );
+fprintf( _file, "  \"frames_lost\": %u,\n", profiler->lost_count );
+fprintf( _file, "  \"zones\": [\n" );
+for( unsigned int i = 0; i < profiler->name_count; i++ )
+    {
+    _zone = &profiler->zones[ i ];
+    summarize_zone( _zone, &_report );
+    fprintf( _file, "    {\n" );
+    fprintf( _file, "      \"name\": \"%s\",\n", _report.name );
+    fprintf( _file, "      \"samples\": %u,\n", _report.sample_count );
+    fprintf( _file, "      \"average_ms\": %.6f,\n", _report.average_ms );
+    fprintf( _file, "      \"p50_ms\": %.6f,\n", _report.p50_ms );
+    fprintf( _file, "      \"p95_ms\": %.6f,\n", _report.p95_ms );
+    fprintf( _file, "      \"p99_ms\": %.6f,\n", _report.p99_ms );
+    fprintf( _file, "      \"max_ms\": %.6f,\n", _report.max_ms );
+    if( _report.has_statistics )
+        {
+        fprintf
+            (
+            _file,
+            "      \"statistics\": { \"vertex_invocations\": %.1f, \"clipping_invocations\": %.1f, \"clipping_primitives\": %.1f, \"fragment_invocations\": %.1f },\n",
+            _report.statistics[ IVK_GPU_STATISTIC_VERTEX_INVOCATIONS ],
+            _report.statistics[ IVK_GPU_STATISTIC_CLIPPING_INVOCATIONS ],
+            _report.statistics[ IVK_GPU_STATISTIC_CLIPPING_PRIMITIVES ],
+            _report.statistics[ IVK_GPU_STATISTIC_FRAGMENT_INVOCATIONS ]
+            );
+        }
+
+    /* Oldest sample first */
+    _count = ( _zone->sample_count < IVK_GPU_PROFILER_HISTORY ) ? _zone->sample_count : IVK_GPU_PROFILER_HISTORY;
+    _first = ( _zone->sample_count < IVK_GPU_PROFILER_HISTORY ) ? 0 : _zone->history_next;
+    fprintf( _file, "      \"recent_ms\": [" );
+    for( unsigned int j = 0; j < _count; j++ )
+        {
+        fprintf( _file, "%s%.6f", j ? ", " : " ", _zone->history_ms[ ( _first + j ) % IVK_GPU_PROFILER_HISTORY ] );
+        }
+    fprintf( _file, " ]\n" );
+    fprintf( _file, "    }%s\n", ( i + 1 < profiler->name_count ) ? "," : "" );
+    }
+fprintf( _file, "  ]\n" );
+fprintf( _file, "}\n" );
+
+fclose( _file );
+
+return true;
+
+}
+
+
+/*
+ * Returns the index of the zone name, adding it if new.
+ * Returns UINT32_MAX when there is no room left.
+ */
+static unsigned int find_zone_name
+    (
+    IVK_gpu_profiler_type*  profiler,
+    const char*             name
+    )
+{
+/* Local variables */
+IVK_gpu_zone_stats_type*    _zone = NULL;
+
+for( unsigned int i = 0; i < profiler->name_count; i++ )
+    {
+    if( strncmp( profiler->zones[ i ].name, name, IVK_GPU_PROFILER_NAME_LENGTH - 1 ) == 0 )
+        {
+        return i;
+        }
+    }
+
+if( profiler->name_count == IVK_GPU_PROFILER_MAX_NAMES )
+    {
+    return UINT32_MAX;
+    }
+
+_zone = &profiler->zones[ profiler->name_count ];
+memset( _zone, 0, sizeof( *_zone ) );
+strncpy( _zone->name, name, IVK_GPU_PROFILER_NAME_LENGTH - 1 );
+
+return profiler->name_count++;
+
+}
+
+
+/*
+ * Reads the results of one completed frame. Returns false
+ * if they are not available.
+ */
+static bool collect_frame
+    (
+    IVK_gpu_profiler_type*          profiler,
+    VkDevice                        device,
+    IVK_gpu_profiler_frame_type*    frame
+    )
+{
+/* Local variables */
+uint64_t                    _timestamps[ FRAME_QUERY_COUNT + 2 * IVK_GPU_PROFILER_MAX_ZONES ];
+uint64_t                    _statistics[ IVK_GPU_PROFILER_MAX_ZONES ][ IVK_GPU_STATISTIC_COUNT ];
+unsigned int                _query_count = FRAME_QUERY_COUNT + 2 * frame->zone_count;
+IVK_gpu_zone_stats_type*    _zone = NULL;
+uint64_t                    _ticks = 0;
+
+/* The frame is complete, so this does not wait */
+if( profiler->funcs->vkGetQueryPoolResults
+        (
+        device,
+        frame->timestamp_pool,
+        0,
+        _query_count,
+        sizeof( _timestamps ),
+        _timestamps,
+        sizeof( uint64_t ),
+        VK_QUERY_RESULT_64_BIT
+        ) != VK_SUCCESS )
+    {
+    return false;
+    }
+
+/* Only the outermost zones began a statistics query, the
+others stay unavailable */
+for( unsigned int i = 0; i < frame->zone_count; i++ )
+    {
+    if( !frame->zone_has_statistics[ i ] )
+        {
+        continue;
+        }
+    if( profiler->funcs->vkGetQueryPoolResults
+            (
+            device,
+            frame->statistics_pool,
+            i,
+            1,
+            sizeof( _statistics[ i ] ),
+            _statistics[ i ],
+            sizeof( _statistics[ i ] ),
+            VK_QUERY_RESULT_64_BIT
+            ) != VK_SUCCESS )
+        {
+        return false;
+        }
+    }
+
+/* The counter may wrap within the valid bits */
+_ticks = ( _timestamps[ 1 ] - _timestamps[ 0 ] ) & profiler->timestamp_mask;
+add_sample( &profiler->zones[ 0 ], _ticks * profiler->timestamp_period / 1000000.0 );
+
+for( unsigned int i = 0; i < frame->zone_count; i++ )
+    {
+    _zone = &profiler->zones[ frame->zone_names[ i ] ];
+    _ticks = ( _timestamps[ FRAME_QUERY_COUNT + 2 * i + 1 ] - _timestamps[ FRAME_QUERY_COUNT + 2 * i ] ) & profiler->timestamp_mask;
+    add_sample( _zone, _ticks * profiler->timestamp_period / 1000000.0 );
+
+    if( !frame->zone_has_statistics[ i ] )
+        {
+        continue;
+        }
+    for( unsigned int j = 0; j < IVK_GPU_STATISTIC_COUNT; j++ )
+        {
+        if( _zone->has_statistics )
+            {
+            _zone->statistics[ j ] += AVERAGE_SMOOTHING * ( ( double )_statistics[ i ][ j ] - _zone->statistics[ j ] );
+            }
+        else
+            {
+            _zone->statistics[ j ] = ( double )_statistics[ i ][ j ];
+            }
+        }
+    _zone->has_statistics = true;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Folds a timing sample into the statistics of a zone
+ */
+static void add_sample
+    (
+    IVK_gpu_zone_stats_type*    zone,
+    double                      sample_ms
+    )
+{
+/* Start the average at the first sample rather than at 0 */
+if( zone->sample_count == 0 )
+    {
+    zone->average_ms = sample_ms;
+    }
+else
+    {
+    zone->average_ms += AVERAGE_SMOOTHING * ( sample_ms - zone->average_ms );
+    }
+
+zone->history_ms[ zone->history_next ] = sample_ms;
+zone->history_next = ( zone->history_next + 1 ) % IVK_GPU_PROFILER_HISTORY;
+zone->sample_count++;
+
+}
+
+
+/*
+ * Fills in the summary of a zone
+ */
+static void summarize_zone
+    (
+    const IVK_gpu_zone_stats_type*  zone,
+    IVK_gpu_zone_report_type*       report
+    )
+{
+/* Local variables */
+double          _sorted[ IVK_GPU_PROFILER_HISTORY ];
+unsigned int    _count = 0;
+
+memset( report, 0, sizeof( *report ) );
+report->name = zone->name;
+report->sample_count = zone->sample_count;
+report->average_ms = zone->average_ms;
+report->has_statistics = zone->has_statistics;
+memcpy( report->statistics, zone->statistics, sizeof( report->statistics ) );
+
+_count = ( zone->sample_count < IVK_GPU_PROFILER_HISTORY ) ? zone->sample_count : IVK_GPU_PROFILER_HISTORY;
+if( _count == 0 )
+    {
+    return;
+    }
+
+/* Nearest rank percentiles */
+memcpy( _sorted, zone->history_ms, _count * sizeof( double ) );
+qsort( _sorted, _count, sizeof( double ), compare_doubles );
+report->p50_ms = _sorted[ ( _count * 50 + 99 ) / 100 - 1 ];
+report->p95_ms = _sorted[ ( _count * 95 + 99 ) / 100 - 1 ];
+report->p99_ms = _sorted[ ( _count * 99 + 99 ) / 100 - 1 ];
+report->max_ms = _sorted[ _count - 1 ];
+
+}
+
+
+/*
+ * qsort comparison of two doubles
+ */
+static int compare_doubles
+    (
+    const void* a,
+    const void* b
+    )
+{
+/* Local variables */
+double  _a = *( const double* )a;
+double  _b = *( const double* )b;
+
+return( ( _a > _b ) - ( _a < _b ) );
+
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+#include "ivk_dispatch.h"
+
+/*
+ * Profiler limits
+ */
+#define IVK_GPU_PROFILER_MAX_FRAMES     8       /* Frames in flight */
+#define IVK_GPU_PROFILER_MAX_ZONES      32      /* Zones recorded per frame */
+#define IVK_GPU_PROFILER_MAX_NAMES      32      /* Distinct zone names */
+#define IVK_GPU_PROFILER_MAX_DEPTH      8       /* Zone nesting */
+#define IVK_GPU_PROFILER_HISTORY        512     /* Samples kept per zone for the percentiles */
+#define IVK_GPU_PROFILER_NAME_LENGTH    32
+
+/*
+ * Pipeline statistics gathered per zone, in the order
+ * Vulkan writes them
+ */
+#define IVK_GPU_PROFILER_STATISTICS \
+    ( VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | \
+      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT )
+
+typedef enum
+    {
+    IVK_GPU_STATISTIC_VERTEX_INVOCATIONS,
+    IVK_GPU_STATISTIC_CLIPPING_INVOCATIONS,
+    IVK_GPU_STATISTIC_CLIPPING_PRIMITIVES,
+    IVK_GPU_STATISTIC_FRAGMENT_INVOCATIONS,
+
+    IVK_GPU_STATISTIC_COUNT
+    } IVK_gpu_statistic_type;
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    VkQueryPool         timestamp_pool;     /* Frame begin and end, then two per zone */
+    VkQueryPool         statistics_pool;    /* One per zone, VK_NULL_HANDLE if disabled */
+    unsigned int        zone_count;
+    unsigned int        zone_names[ IVK_GPU_PROFILER_MAX_ZONES ];
+    bool                zone_has_statistics[ IVK_GPU_PROFILER_MAX_ZONES ];
+    unsigned int        open_zones[ IVK_GPU_PROFILER_MAX_DEPTH ];
+    unsigned int        open_count;
+    unsigned int        ignored_count;      /* Open zones past the limits, innermost */
+    unsigned int        open_statistics;    /* Zone whose statistics query is active,
+                                               UINT32_MAX if none */
+    uint64_t            frame_value;        /* Timeline value, 0 once collected */
+    } IVK_gpu_profiler_frame_type;
+
+typedef struct
+    {
+    char                name[ IVK_GPU_PROFILER_NAME_LENGTH ];
+    double              average_ms;         /* Rolling */
+    double              history_ms[ IVK_GPU_PROFILER_HISTORY ];
+    unsigned int        history_next;
+    unsigned int        sample_count;       /* Since the start of the run */
+    bool                has_statistics;
+    double              statistics[ IVK_GPU_STATISTIC_COUNT ];
+                                            /* Rolling averages */
+    } IVK_gpu_zone_stats_type;
+
+/*
+ * Timestamps around named zones of the frame, optionally
+ * with pipeline statistics, in one query pool per frame in
+ * flight. Results are read once the frame timeline shows
+ * the frame complete, so reading never waits on the GPU.
+ * Zone 0 is the whole frame.
+ */
+typedef struct
+    {
+    const IVK_device_funcs_type*
+                        funcs;              /* Records and reads the queries */
+    IVK_gpu_profiler_frame_type
+                        frames[ IVK_GPU_PROFILER_MAX_FRAMES ];
+    unsigned int        frame_count;
+    IVK_gpu_profiler_frame_type*
+                        current;            /* Frame being recorded */
+    IVK_gpu_zone_stats_type
+                        zones[ IVK_GPU_PROFILER_MAX_NAMES ];
+    unsigned int        name_count;
+    double              timestamp_period;   /* Nanoseconds per tick */
+    uint64_t            timestamp_mask;     /* Of the valid bits */
+    bool                use_statistics;
+    unsigned int        collected_count;
+    unsigned int        lost_count;         /* Frames whose results were not available */
+    } IVK_gpu_profiler_type;
+
+/*
+ * Summary of a zone over the run
+ */
+typedef struct
+    {
+    const char*         name;
+    unsigned int        sample_count;
+    double              average_ms;         /* Rolling */
+    double              p50_ms;             /* Over the last IVK_GPU_PROFILER_HISTORY samples */
+    double              p95_ms;
+    double              p99_ms;
+    double              max_ms;
+    bool                has_statistics;
+    double              statistics[ IVK_GPU_STATISTIC_COUNT ];
+    } IVK_gpu_zone_report_type;
+
+
+/*
+ * Creates the query pools of frame_count frames. The
+ * queries are recorded and read through funcs, which must
+ * outlive the profiler. Pipeline statistics need the
+ * pipelineStatisticsQuery feature. Returns false if the
+ * queue family cannot write timestamps.
+ */
+bool ivk_gpu_profiler_create
+    (
+    const IVK_device_funcs_type*
+                            funcs,
+    VkDevice                device,
+    VkPhysicalDevice        gpu,
+    unsigned int            queue_family,
+    unsigned int            frame_count,
+    bool                    use_statistics,
+    IVK_gpu_profiler_type*  profiler
+    );
+
+/*
+ * Destroys the query pools
+ */
+void ivk_gpu_profiler_destroy
+    (
+    VkDevice                device,
+    IVK_gpu_profiler_type*  profiler
+    );
+
+/*
+ * Starts recording frame_index, outside of any render pass.
+ * The previous results of the frame must have been
+ * collected, or they are lost.
+ */
+void ivk_gpu_profiler_begin_frame
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer,
+    unsigned int            frame_index,
+    uint64_t                frame_value
+    );
+
+/*
+ * Ends the frame, closing the zones left open
+ */
+void ivk_gpu_profiler_end_frame
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer
+    );
+
+/*
+ * Opens a named zone. Zones nest; pipeline statistics are
+ * only gathered for the outermost one, as Vulkan cannot
+ * nest them. A zone must not straddle a render pass
+ * boundary.
+ */
+void ivk_gpu_profiler_begin_zone
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer,
+    const char*             name
+    );
+
+/*
+ * Closes the innermost open zone
+ */
+void ivk_gpu_profiler_end_zone
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkCommandBuffer         command_buffer
+    );
+
+/*
+ * Reads back the frames that reached completed_value on the
+ * frame timeline. Never blocks.
+ */
+void ivk_gpu_profiler_collect
+    (
+    IVK_gpu_profiler_type*  profiler,
+    VkDevice                device,
+    uint64_t                completed_value
+    );
+
+/*
+ * Fills in up to max_count zone summaries, returns the
+ * number of zones
+ */
+unsigned int ivk_gpu_profiler_report
+    (
+    const IVK_gpu_profiler_type*    profiler,
+    IVK_gpu_zone_report_type*       reports,
+    unsigned int                    max_count
+    );
+
+/*
+ * Writes the zone summaries to path, as CSV if the name
+ * ends in .csv and as JSON otherwise. The JSON also holds
+ * the recent samples.
+ */
+bool ivk_gpu_profiler_dump
+    (
+    const IVK_gpu_profiler_type*    profiler,
+    const char*                     path
+    );
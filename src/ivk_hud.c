@@ -0,0 +1,637 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_hud.h"
+#include "ivk_buffers.h"
+#include "ivk_pipeline.h"
+#include "ivk_timer.h"
+#include "ivk_trace.h"
+#include "ivk_memory.h"
+#include "ivk_util.h"
+
+/*
+ * Layout, in pixels. Glyphs are drawn at twice their size.
+ */
+#define GLYPH_SCALE         2.0f
+#define GLYPH_WIDTH         ( 5.0f * GLYPH_SCALE )
+#define GLYPH_HEIGHT        ( 7.0f * GLYPH_SCALE )
+#define GLYPH_ADVANCE       ( 6.0f * GLYPH_SCALE )
+#define LINE_HEIGHT         ( 9.0f * GLYPH_SCALE )
+#define MARGIN              8.0f
+#define PADDING             6.0f
+#define GRAPH_BAR_WIDTH     2.0f
+#define GRAPH_HEIGHT        60.0f
+#define GRAPH_MAX_MS        ( 2000.0f / 60.0f )     /* Top of the graph, two 60 Hz frames */
+#define GRAPH_TARGET_MS     ( 1000.0f / 60.0f )
+
+/*
+ * Colors, RGBA8 in memory order
+ */
+#define RGBA( r, g, b, a )  ( ( uint32_t )( r ) | ( ( uint32_t )( g ) << 8 ) | ( ( uint32_t )( b ) << 16 ) | ( ( uint32_t )( a ) << 24 ) )
+#define COLOR_PANEL         RGBA(   0,   0,   0, 160 )
+#define COLOR_TEXT          RGBA( 230, 230, 230, 255 )
+#define COLOR_GOOD          RGBA(  80, 220,  80, 255 )
+#define COLOR_SLOW          RGBA( 240, 200,  40, 255 )
+#define COLOR_MISSED        RGBA( 240,  60,  60, 255 )
+#define COLOR_TARGET        RGBA( 255, 255, 255,  90 )
+
+#define FONT_FIRST          ' '
+#define FONT_LAST           'Z'
+
+/*
+ * 5 x 7 font from space to Z, lowercase is drawn as
+ * uppercase. One byte per column, bit 0 at the top.
+ */
+static const uint8_t s_font[ FONT_LAST - FONT_FIRST + 1 ][ 5 ] =
+    {
+    { 0x00, 0x00, 0x00, 0x00, 0x00 },   /*   */
+    { 0x00, 0x00, 0x5F, 0x00, 0x00 },   /* ! */
+    { 0x00, 0x07, 0x00, 0x07, 0x00 },   /* " */
+    { 0x14, 0x7F, 0x14, 0x7F, 0x14 },   /* # */
+    { 0x24, 0x2A, 0x7F, 0x2A, 0x12 },   /* $ */
+    { 0x23, 0x13, 0x08, 0x64, 0x62 },   /* % */
+    { 0x36, 0x49, 0x56, 0x20, 0x50 },   /* & */
+    { 0x00, 0x00, 0x07, 0x00, 0x00 },   /* ' */
+    { 0x00, 0x1C, 0x22, 0x41, 0x00 },   /* ( */
+    { 0x00, 0x41, 0x22, 0x1C, 0x00 },   /* ) */
+    { 0x2A, 0x1C, 0x7F, 0x1C, 0x2A },   /* * */
+    { 0x08, 0x08, 0x3E, 0x08, 0x08 },   /* + */
+    { 0x00, 0x50, 0x30, 0x00, 0x00 },   /* , */
+    { 0x08, 0x08, 0x08, 0x08, 0x08 },   /* - */
+    { 0x00, 0x60, 0x60, 0x00, 0x00 },   /* . */
+    { 0x20, 0x10, 0x08, 0x04, 0x02 },   /* / */
+    { 0x3E, 0x51, 0x49, 0x45, 0x3E },   /* 0 */
+    { 0x00, 0x42, 0x7F, 0x40, 0x00 },   /* 1 */
+    { 0x72, 0x49, 0x49, 0x49, 0x46 },   /* 2 */
+    { 0x21, 0x41, 0x49, 0x4D, 0x33 },   /* 3 */
+    { 0x18, 0x14, 0x12, 0x7F, 0x10 },   /* 4 */
+    { 0x27, 0x45, 0x45, 0x45, 0x39 },   /* 5 */
+    { 0x3C, 0x4A, 0x49, 0x49, 0x31 },   /* 6 */
+    { 0x41, 0x21, 0x11, 0x09, 0x07 },   /* 7 */
+    { 0x36, 0x49, 0x49, 0x49, 0x36 },   /* 8 */
+    { 0x46, 0x49, 0x49, 0x29, 0x1E },   /* 9 */
+    { 0x00, 0x36, 0x36, 0x00, 0x00 },   /* : */
+    { 0x00, 0x56, 0x36, 0x00, 0x00 },   /* ; */
+    { 0x08, 0x14, 0x22, 0x41, 0x00 },   /* < */
+    { 0x14, 0x14, 0x14, 0x14, 0x14 },   /* = */
+    { 0x00, 0x41, 0x22, 0x14, 0x08 },   /* > */
+    { 0x02, 0x01, 0x59, 0x09, 0x06 },   /* ? */
+    { 0x3E, 0x41, 0x5D, 0x59, 0x4E },   /* @ */
+    { 0x7C, 0x12, 0x11, 0x12, 0x7C },   /* A */
+    { 0x7F, 0x49, 0x49, 0x49, 0x36 },   /* B */
+    { 0x3E, 0x41, 0x41, 0x41, 0x22 },   /* C */
+    { 0x7F, 0x41, 0x41, 0x41, 0x3E },   /* D */
+    { 0x7F, 0x49, 0x49, 0x49, 0x41 },   /* E */
+    { 0x7F, 0x09, 0x09, 0x09, 0x01 },   /* F */
+    { 0x3E, 0x41, 0x41, 0x51, 0x73 },   /* G */
+    { 0x7F, 0x08, 0x08, 0x08, 0x7F },   /* H */
+    { 0x00, 0x41, 0x7F, 0x41, 0x00 },   /* I */
+    { 0x20, 0x40, 0x41, 0x3F, 0x01 },   /* J */
+    { 0x7F, 0x08, 0x14, 0x22, 0x41 },   /* K */
+    { 0x7F, 0x40, 0x40, 0x40, 0x40 },   /* L */
+    { 0x7F, 0x02, 0x1C, 0x02, 0x7F },   /* M */
+    { 0x7F, 0x04, 0x08, 0x10, 0x7F },   /* N */
+    { 0x3E, 0x41, 0x41, 0x41, 0x3E },   /* O */
+    { 0x7F, 0x09, 0x09, 0x09, 0x06 },   /* P */
+    { 0x3E, 0x41, 0x51, 0x21, 0x5E },   /* Q */
+    { 0x7F, 0x09, 0x19, 0x29, 0x46 },   /* R */
+    { 0x26, 0x49, 0x49, 0x49, 0x32 },   /* S */
+    { 0x03, 0x01, 0x7F, 0x01, 0x03 },   /* T */
+    { 0x3F, 0x40, 0x40, 0x40, 0x3F },   /* U */
+    { 0x1F, 0x20, 0x40, 0x20, 0x1F },   /* V */
+    { 0x3F, 0x40, 0x38, 0x40, 0x3F },   /* W */
+    { 0x63, 0x14, 0x08, 0x14, 0x63 },   /* X */
+    { 0x03, 0x04, 0x78, 0x04, 0x03 },   /* Y */
+    { 0x61, 0x59, 0x49, 0x4D, 0x43 }    /* Z */
+    };
+
+/*** Static functions ***/
+/*
+ * Creates the persistently mapped vertex ring. Memory the
+ * GPU reads directly is preferred.
+ */
+static bool create_vertex_ring
+    (
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    VkDeviceSize        size,
+    IVK_hud_type*       hud
+    );
+
+/*
+ * Writes a quad, with the glyph cell stretched over it
+ */
+static void put_quad
+    (
+    IVK_hud_vertex_type*    vertices,
+    float                   x,
+    float                   y,
+    float                   width,
+    float                   height,
+    uint32_t                color,
+    const uint8_t*          glyph   /* NULL for a solid quad */
+    );
+
+/*
+ * Appends a line of text to the text quads. Returns its
+ * width in pixels.
+ */
+static float put_text
+    (
+    IVK_hud_type*   hud,
+    float           x,
+    float           y,
+    uint32_t        color,
+    const char*     text
+    );
+
+/*
+ * Rebuilds the text quads, panel included, from the stats
+ */
+static void build_text
+    (
+    IVK_hud_type*               hud,
+    const IVK_hud_stats_type*   stats,
+    uint64_t                    now_ns
+    );
+
+
+/*
+ * Creates the pipeline, the vertex ring of frame_count
+ * frames and the index buffer. The index buffer is uploaded
+ * through pool and queue, of transfer_family, and shared with
+ * graphics_family. The commands go through funcs, which must
+ * outlive the overlay.
+ */
+bool ivk_hud_create
+    (
+    const IVK_device_funcs_type*
+                        funcs,
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    VkCommandPool       pool,
+    VkQueue             queue,
+    uint32_t            transfer_family,
+    uint32_t            graphics_family,
+    VkRenderPass        renderpass,
+    VkFormat            color_format,
+    unsigned int        frame_count,
+    IVK_hud_type*       hud
+    )
+{
+/* Local variables */
+VkPushConstantRange                     _push_range = { 0 };
+VkPipelineLayoutCreateInfo              _layout_create_info = { 0 };
+VkVertexInputBindingDescription         _binding = { 0 };
+VkVertexInputAttributeDescription       _attributes[ 4 ] = { 0 };
+VkPipelineVertexInputStateCreateInfo    _vertex_input = { 0 };
+unsigned int*                           _indices = NULL;
+
+memset( hud, 0, sizeof( *hud ) );
+hud->funcs = funcs;
+hud->frame_count = ( frame_count > IVK_HUD_MAX_FRAMES ) ? IVK_HUD_MAX_FRAMES : frame_count;
+
+/* The only input besides the vertices is the pixel to clip space scale */
+_push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+_push_range.offset = 0;
+_push_range.size = 2 * sizeof( float );
+
+_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+_layout_create_info.pushConstantRangeCount = 1;
+_layout_create_info.pPushConstantRanges = &_push_range;
+__vk( vkCreatePipelineLayout( device, &_layout_create_info, g_ivk_host_allocator, &hud->layout ) );
+
+_binding.binding = 0;
+_binding.stride = sizeof( IVK_hud_vertex_type );
+_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+_attributes[ 0 ].location = 0;
+_attributes[ 0 ].format = VK_FORMAT_R32G32_SFLOAT;
+_attributes[ 0 ].offset = offsetof( IVK_hud_vertex_type, pos );
+_attributes[ 1 ].location = 1;
+_attributes[ 1 ].format = VK_FORMAT_R32G32_SFLOAT;
+_attributes[ 1 ].offset = offsetof( IVK_hud_vertex_type, cell );
+_attributes[ 2 ].location = 2;
+_attributes[ 2 ].format = VK_FORMAT_R8G8B8A8_UNORM;
+_attributes[ 2 ].offset = offsetof( IVK_hud_vertex_type, color );
+_attributes[ 3 ].location = 3;
+_attributes[ 3 ].format = VK_FORMAT_R32G32_UINT;
+_attributes[ 3 ].offset = offsetof( IVK_hud_vertex_type, glyph );
+
+_vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+_vertex_input.vertexBindingDescriptionCount = 1;
+_vertex_input.pVertexBindingDescriptions = &_binding;
+_vertex_input.vertexAttributeDescriptionCount = 4;
+_vertex_input.pVertexAttributeDescriptions = &_attributes[ 0 ];
+
+ivk_pipeline_create_overlay
+    (
+    device,
+    hud->layout,
+    renderpass,
+    color_format,
+    IVK_SHADER_DIR "hud.vert.spv",
+    IVK_SHADER_DIR "hud.frag.spv",
+    &_vertex_input,
+    &hud->pipeline
+    );
+
+if( !create_vertex_ring( device, gpu, ( VkDeviceSize )hud->frame_count * IVK_HUD_MAX_QUADS * 4 * sizeof( IVK_hud_vertex_type ), hud ) )
+    {
+    ivk_hud_destroy( device, hud );
+    return false;
+    }
+
+/* Every quad is two triangles over its four vertices */
+_indices = ( unsigned int* )malloc( IVK_HUD_MAX_QUADS * 6 * sizeof( unsigned int ) );
+if( !_indices )
+    {
+    ivk_hud_destroy( device, hud );
+    return false;
+    }
+for( unsigned int i = 0; i < IVK_HUD_MAX_QUADS; i++ )
+    {
+    _indices[ i * 6 + 0 ] = i * 4 + 0;
+    _indices[ i * 6 + 1 ] = i * 4 + 1;
+    _indices[ i * 6 + 2 ] = i * 4 + 2;
+    _indices[ i * 6 + 3 ] = i * 4 + 2;
+    _indices[ i * 6 + 4 ] = i * 4 + 3;
+    _indices[ i * 6 + 5 ] = i * 4 + 0;
+    }
+ivk_buffer_create_ibo
+    (
+    funcs,
+    device,
+    gpu,
+    pool,
+    queue,
+    transfer_family,
+    graphics_family,
+    _indices,
+    IVK_HUD_MAX_QUADS * 6,
+    &hud->index_buffer,
+    &hud->index_memory
+    );
+free( _indices );
+
+return true;
+
+}
+
+
+/*
+ * Destroys the pipeline and the buffers
+ */
+void ivk_hud_destroy
+    (
+    VkDevice            device,
+    IVK_hud_type*       hud
+    )
+{
+vkDestroyPipeline( device, hud->pipeline, g_ivk_host_allocator );
+vkDestroyPipelineLayout( device, hud->layout, g_ivk_host_allocator );
+vkDestroyBuffer( device, hud->index_buffer, g_ivk_host_allocator );
+vkFreeMemory( device, hud->index_memory, g_ivk_host_allocator );
+vkDestroyBuffer( device, hud->vertex_buffer, g_ivk_host_allocator );
+vkFreeMemory( device, hud->vertex_memory, g_ivk_host_allocator );
+memset( hud, 0, sizeof( *hud ) );
+
+}
+
+
+/*
+ * Builds this frame's quads into the ring region of
+ * frame_index and draws them. Must be recorded inside the
+ * scene pass, after the scene, with the viewport and
+ * scissor already set. The GPU must be done with the
+ * region.
+ */
+void ivk_hud_record
+    (
+    IVK_hud_type*               hud,
+    VkCommandBuffer             command_buffer,
+    unsigned int                frame_index,
+    VkExtent2D                  extent,
+    const IVK_hud_stats_type*   stats
+    )
+{
+/* Local variables */
+uint64_t                _start_ns = ivk_timer_now_ns();
+IVK_hud_vertex_type*    _vertices = NULL;
+unsigned int            _quad_count = 0;
+unsigned int            _sample = 0;
+float                   _graph_x = MARGIN + PADDING;
+float                   _graph_y = 0.0f;
+float                   _height = 0.0f;
+float                   _scale[ 2 ];
+uint32_t                _color = 0;
+VkDeviceSize            _offset = 0;
+
+IVK_TRACE_BEGIN( "hud" );
+
+hud->graph_ms[ hud->graph_next ] = ( float )stats->frame_ms;
+hud->graph_next = ( hud->graph_next + 1 ) % IVK_HUD_GRAPH_SAMPLES;
+hud->frame_ms += 0.05 * ( stats->frame_ms - hud->frame_ms );
+hud->frame_count_total++;
+
+/* Numbers changing every frame cannot be read anyway */
+if( hud->text_quad_count == 0 || _start_ns - hud->text_ns >= IVK_HUD_TEXT_INTERVAL_NS )
+    {
+    build_text( hud, stats, _start_ns );
+    }
+
+/* The ring memory is write-combined at best, only ever write it in
+order */
+frame_index %= hud->frame_count;
+_vertices = hud->vertices + ( size_t )frame_index * IVK_HUD_MAX_QUADS * 4;
+memcpy( _vertices, hud->text, hud->text_quad_count * 4 * sizeof( IVK_hud_vertex_type ) );
+_quad_count = hud->text_quad_count;
+
+/* Oldest sample on the left, with a line at the 60 Hz budget */
+_graph_y = hud->graph_y;
+for( unsigned int i = 0; i < IVK_HUD_GRAPH_SAMPLES && _quad_count < IVK_HUD_MAX_QUADS - 1; i++ )
+    {
+    _sample = ( hud->graph_next + i ) % IVK_HUD_GRAPH_SAMPLES;
+    _height = hud->graph_ms[ _sample ] / GRAPH_MAX_MS * GRAPH_HEIGHT;
+    if( _height > GRAPH_HEIGHT )
+        {
+        _height = GRAPH_HEIGHT;
+        }
+    if( _height < 1.0f )
+        {
+        continue;
+        }
+    _color = ( hud->graph_ms[ _sample ] <= GRAPH_TARGET_MS * 1.05f ) ? COLOR_GOOD :
+             ( hud->graph_ms[ _sample ] <= GRAPH_MAX_MS * 1.05f ) ? COLOR_SLOW : COLOR_MISSED;
+    put_quad( &_vertices[ _quad_count * 4 ], _graph_x + i * GRAPH_BAR_WIDTH, _graph_y + GRAPH_HEIGHT - _height, GRAPH_BAR_WIDTH, _height, _color, NULL );
+    _quad_count++;
+    }
+put_quad
+    (
+    &_vertices[ _quad_count * 4 ],
+    _graph_x,
+    _graph_y + GRAPH_HEIGHT - GRAPH_TARGET_MS / GRAPH_MAX_MS * GRAPH_HEIGHT,
+    IVK_HUD_GRAPH_SAMPLES * GRAPH_BAR_WIDTH,
+    1.0f,
+    COLOR_TARGET,
+    NULL
+    );
+_quad_count++;
+
+_scale[ 0 ] = 2.0f / ( float )extent.width;
+_scale[ 1 ] = 2.0f / ( float )extent.height;
+_offset = ( VkDeviceSize )frame_index * IVK_HUD_MAX_QUADS * 4 * sizeof( IVK_hud_vertex_type );
+
+hud->funcs->vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, hud->pipeline );
+hud->funcs->vkCmdPushConstants( command_buffer, hud->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof( _scale ), _scale );
+hud->funcs->vkCmdBindVertexBuffers( command_buffer, 0, 1, &hud->vertex_buffer, &_offset );
+hud->funcs->vkCmdBindIndexBuffer( command_buffer, hud->index_buffer, 0, VK_INDEX_TYPE_UINT32 );
+hud->funcs->vkCmdDrawIndexed( command_buffer, _quad_count * 6, 1, 0, 0, 0 );
+
+hud->last_quad_count = _quad_count;
+hud->cost_ms += 0.05 * ( IVK_NS_TO_MS( ivk_timer_now_ns() - _start_ns ) - hud->cost_ms );
+
+IVK_TRACE_END( "hud" );
+
+}
+
+
+/*
+ * Creates the persistently mapped vertex ring. Memory the
+ * GPU reads directly is preferred.
+ */
+static bool create_vertex_ring
+    (
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    VkDeviceSize        size,
+    IVK_hud_type*       hud
+    )
+{
+/* Local variables */
+VkBufferCreateInfo      _buffer_create_info = { 0 };
+VkMemoryRequirements    _mem_requirements = { 0 };
+VkMemoryAllocateInfo    _alloc_info = { 0 };
+unsigned int            _memory_type = 0;
+void*                   _mapped = NULL;
+
+_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+_buffer_create_info.size = size;
+_buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+__vk( vkCreateBuffer( device, &_buffer_create_info, g_ivk_host_allocator, &hud->vertex_buffer ) );
+
+vkGetBufferMemoryRequirements( device, hud->vertex_buffer, &_mem_requirements );
+
+/* Coherent, so the writes need no flush */
+_memory_type = ivk_buffer_find_memory_type
+    (
+    gpu,
+    _mem_requirements.memoryTypeBits,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+if( _memory_type == UINT32_MAX )
+    {
+    _memory_type = ivk_buffer_find_memory_type
+        (
+        gpu,
+        _mem_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        );
+    }
+if( _memory_type == UINT32_MAX )
+    {
+    printf( "No host visible memory for the HUD.\n" );
+    return false;
+    }
+
+_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+_alloc_info.allocationSize = _mem_requirements.size;
+_alloc_info.memoryTypeIndex = _memory_type;
+__vk( vkAllocateMemory( device, &_alloc_info, g_ivk_host_allocator, &hud->vertex_memory ) );
+__vk( vkBindBufferMemory( device, hud->vertex_buffer, hud->vertex_memory, 0 ) );
+
+/* Mapped once for the lifetime of the buffer */
+__vk( vkMapMemory( device, hud->vertex_memory, 0, VK_WHOLE_SIZE, 0, &_mapped ) );
+hud->vertices = ( IVK_hud_vertex_type* )_mapped;
+
+return true;
+
+}
+
+
+/*
+ * Writes a quad, with the glyph cell stretched over it
+ */
+static void put_quad
+    (
+    IVK_hud_vertex_type*    vertices,
+    float                   x,
+    float                   y,
+    float                   width,
+    float                   height,
+    uint32_t                color,
+    const uint8_t*          glyph
+    )
+{
+/* Local variables */
+uint32_t    _glyph[ 2 ] = { 0xFFFFFFFF, 0xFF };
+float       _cell_width = 5.0f;
+float       _cell_height = 7.0f;
+
+if( glyph )
+    {
+    _glyph[ 0 ] = ( uint32_t )glyph[ 0 ] | ( ( uint32_t )glyph[ 1 ] << 8 ) | ( ( uint32_t )glyph[ 2 ] << 16 ) | ( ( uint32_t )glyph[ 3 ] << 24 );
+    _glyph[ 1 ] = glyph[ 4 ];
+    }
+else
+    {
+    /* Solid quads stay in the first cell, which is lit */
+    _cell_width = 0.0f;
+    _cell_height = 0.0f;
+    }
+
+for( unsigned int i = 0; i < 4; i++ )
+    {
+    /* Corners clockwise from the top left */
+    vertices[ i ].pos[ 0 ] = x + ( ( i == 1 || i == 2 ) ? width : 0.0f );
+    vertices[ i ].pos[ 1 ] = y + ( ( i >= 2 ) ? height : 0.0f );
+    vertices[ i ].cell[ 0 ] = ( i == 1 || i == 2 ) ? _cell_width : 0.0f;
+    vertices[ i ].cell[ 1 ] = ( i >= 2 ) ? _cell_height : 0.0f;
+    vertices[ i ].color = color;
+    vertices[ i ].glyph[ 0 ] = _glyph[ 0 ];
+    vertices[ i ].glyph[ 1 ] = _glyph[ 1 ];
+    }
+
+}
+
+
+/*
+ * Appends a line of text to the text quads. Returns its
+ * width in pixels.
+ */
+static float put_text
+    (
+    IVK_hud_type*   hud,
+    float           x,
+    float           y,
+    uint32_t        color,
+    const char*     text
+    )
+{
+/* Local variables */
+float   _x = x;
+char    _c = 0;
+
+for( ; *text; text++, _x += GLYPH_ADVANCE )
+    {
+    _c = *text;
+    if( _c >= 'a' && _c <= 'z' )
+        {
+        _c = ( char )( _c - 'a' + 'A' );
+        }
+    if( _c == ' ' )
+        {
+        continue;
+        }
+    if( _c < FONT_FIRST || _c > FONT_LAST )
+        {
+        _c = '?';
+        }
+    if( hud->text_quad_count == IVK_HUD_MAX_TEXT_QUADS )
+        {
+        break;
+        }
+    put_quad( &hud->text[ hud->text_quad_count * 4 ], _x, y, GLYPH_WIDTH, GLYPH_HEIGHT, color, s_font[ _c - FONT_FIRST ] );
+    hud->text_quad_count++;
+    }
+
+return( _x - x );
+
+}
+
+
+/*
+ * Rebuilds the text quads, panel included, from the stats
+ */
+static void build_text
+    (
+    IVK_hud_type*               hud,
+    const IVK_hud_stats_type*   stats,
+    uint64_t                    now_ns
+    )
+{
+/* Local variables */
+char        _line[ 64 ];
+float       _x = MARGIN + PADDING;
+float       _y = MARGIN + PADDING;
+float       _width = IVK_HUD_GRAPH_SAMPLES * GRAPH_BAR_WIDTH;
+float       _line_width = 0.0f;
+uint64_t    _frames = hud->frame_count_total - hud->text_frame_count;
+double      _upload_mb = 0.0;
+
+/* Quad 0 is the panel, sized once the text is known */
+hud->text_quad_count = 1;
+
+snprintf( _line, sizeof( _line ), "FRAME %6.2f MS %6.1f FPS", hud->frame_ms, ( hud->frame_ms > 0.0 ) ? 1000.0 / hud->frame_ms : 0.0 );
+_line_width = put_text( hud, _x, _y, COLOR_TEXT, _line );
+_width = ( _line_width > _width ) ? _line_width : _width;
+_y += LINE_HEIGHT;
+
+if( stats->gpu_ms >= 0.0 )
+    {
+    snprintf( _line, sizeof( _line ), "CPU %6.2f MS GPU %6.2f MS", stats->cpu_ms, stats->gpu_ms );
+    }
+else
+    {
+    snprintf( _line, sizeof( _line ), "CPU %6.2f MS GPU   --", stats->cpu_ms );
+    }
+_line_width = put_text( hud, _x, _y, COLOR_TEXT, _line );
+_width = ( _line_width > _width ) ? _line_width : _width;
+_y += LINE_HEIGHT;
+
+snprintf( _line, sizeof( _line ), "DRAWS %u BINDS %u", stats->draw_count, stats->bind_count );
+_line_width = put_text( hud, _x, _y, COLOR_TEXT, _line );
+_width = ( _line_width > _width ) ? _line_width : _width;
+_y += LINE_HEIGHT;
+
+if( _frames > 0 )
+    {
+    _upload_mb = ( double )( stats->upload_bytes - hud->text_upload_bytes ) / ( 1024.0 * 1024.0 ) / ( double )_frames;
+    }
+snprintf( _line, sizeof( _line ), "UPLOAD %.3f MB/FRAME", _upload_mb );
+_line_width = put_text( hud, _x, _y, COLOR_TEXT, _line );
+_width = ( _line_width > _width ) ? _line_width : _width;
+_y += LINE_HEIGHT;
+
+for( unsigned int i = 0; i < stats->heap_count && i < IVK_HUD_MAX_HEAPS; i++ )
+    {
+    if( stats->has_heap_usage )
+        {
+        snprintf( _line, sizeof( _line ), "HEAP%u %.0f/%.0f MB", i, stats->heap_usage[ i ] / ( 1024.0 * 1024.0 ), stats->heap_size[ i ] / ( 1024.0 * 1024.0 ) );
+        }
+    else
+        {
+        snprintf( _line, sizeof( _line ), "HEAP%u --/%.0f MB", i, stats->heap_size[ i ] / ( 1024.0 * 1024.0 ) );
+        }
+    _line_width = put_text( hud, _x, _y, COLOR_TEXT, _line );
+    _width = ( _line_width > _width ) ? _line_width : _width;
+    _y += LINE_HEIGHT;
+    }
+
+snprintf( _line, sizeof( _line ), "HUD %.3f MS %u QUADS", hud->cost_ms, hud->last_quad_count );
+_line_width = put_text( hud, _x, _y, COLOR_TEXT, _line );
+_width = ( _line_width > _width ) ? _line_width : _width;
+_y += LINE_HEIGHT;
+
+/* The graph goes under the text, inside the panel */
+put_quad( &hud->text[ 0 ], MARGIN, MARGIN, _width + 2.0f * PADDING, _y + GRAPH_HEIGHT + PADDING - MARGIN, COLOR_PANEL, NULL );
+
+hud->graph_y = _y;
+hud->text_ns = now_ns;
+hud->text_upload_bytes = stats->upload_bytes;
+hud->text_frame_count = hud->frame_count_total;
+
+}
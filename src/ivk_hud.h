@@ -0,0 +1,135 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+#include "ivk_dispatch.h"
+
+/*
+ * HUD limits
+ */
+#define IVK_HUD_MAX_FRAMES              4       /* Frames in flight */
+#define IVK_HUD_MAX_QUADS               1024    /* Per frame, text and graph */
+#define IVK_HUD_MAX_TEXT_QUADS          768
+#define IVK_HUD_MAX_HEAPS               4       /* Heaps listed */
+#define IVK_HUD_GRAPH_SAMPLES           120     /* Frames in the frame time graph */
+#define IVK_HUD_TEXT_INTERVAL_NS        250000000
+                                                /* The text changes 4 times a second,
+                                                   the graph every frame */
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    float               pos[ 2 ];           /* Pixels, from the top left */
+    float               cell[ 2 ];          /* Position in the 5 x 7 glyph cell */
+    uint32_t            color;              /* RGBA8 */
+    uint32_t            glyph[ 2 ];         /* Columns 0-3 and 4, 7 bits each */
+    } IVK_hud_vertex_type;
+
+/*
+ * What the HUD shows, gathered by the caller every frame
+ */
+typedef struct
+    {
+    double              frame_ms;           /* Last frame, start to start */
+    double              cpu_ms;             /* CPU work of a frame, without the waits */
+    double              gpu_ms;             /* Negative if not measured */
+    unsigned int        draw_count;         /* Last frame */
+    unsigned int        bind_count;
+    uint64_t            upload_bytes;       /* Since the start, the HUD works out the rate */
+    unsigned int        heap_count;
+    VkDeviceSize        heap_usage[ IVK_HUD_MAX_HEAPS ];
+    VkDeviceSize        heap_size[ IVK_HUD_MAX_HEAPS ];
+                                            /* Budget where known */
+    bool                has_heap_usage;
+    } IVK_hud_stats_type;
+
+/*
+ * Performance overlay drawn into the scene pass. Glyphs are
+ * quads carrying their 5 x 7 bitmap as vertex data, so
+ * there are no textures or descriptors. Each frame slot has
+ * its own region of a persistently mapped vertex ring, and
+ * one static index buffer serves every quad.
+ */
+typedef struct
+    {
+    const IVK_device_funcs_type*
+                        funcs;              /* Records the draws */
+    VkPipelineLayout    layout;
+    VkPipeline          pipeline;
+    VkBuffer            vertex_buffer;
+    VkDeviceMemory      vertex_memory;
+    IVK_hud_vertex_type*
+                        vertices;           /* Persistently mapped */
+    VkBuffer            index_buffer;
+    VkDeviceMemory      index_memory;
+    unsigned int        frame_count;
+
+    /* Text, rebuilt every IVK_HUD_TEXT_INTERVAL_NS */
+    IVK_hud_vertex_type text[ IVK_HUD_MAX_TEXT_QUADS * 4 ];
+    unsigned int        text_quad_count;
+    uint64_t            text_ns;
+    uint64_t            text_upload_bytes;  /* Upload total at the last rebuild */
+    uint64_t            text_frame_count;   /* Frames recorded at the last rebuild */
+
+    /* Frame time graph */
+    float               graph_ms[ IVK_HUD_GRAPH_SAMPLES ];
+    unsigned int        graph_next;
+    float               graph_y;            /* Top of the graph, under the text */
+
+    uint64_t            frame_count_total;
+    double              frame_ms;           /* Rolling */
+    double              cost_ms;            /* CPU time of the HUD, rolling */
+    unsigned int        last_quad_count;
+    } IVK_hud_type;
+
+
+/*
+ * Creates the pipeline, the vertex ring of frame_count
+ * frames and the index buffer. The index buffer is uploaded
+ * through pool and queue, of transfer_family, and shared with
+ * graphics_family. The commands go through funcs, which must
+ * outlive the overlay.
+ */
+bool ivk_hud_create
+    (
+    const IVK_device_funcs_type*
+                        funcs,
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    VkCommandPool       pool,
+    VkQueue             queue,
+    uint32_t            transfer_family,
+    uint32_t            graphics_family,
+    VkRenderPass        renderpass,
+    VkFormat            color_format,
+    unsigned int        frame_count,
+    IVK_hud_type*       hud
+    );
+
+/*
+ * Destroys the pipeline and the buffers
+ */
+void ivk_hud_destroy
+    (
+    VkDevice            device,
+    IVK_hud_type*       hud
+    );
+
+/*
+ * Builds this frame's quads into the ring region of
+ * frame_index and draws them. Must be recorded inside the
+ * scene pass, after the scene, with the viewport and
+ * scissor already set. The GPU must be done with the
+ * region.
+ */
+void ivk_hud_record
+    (
+    IVK_hud_type*               hud,
+    VkCommandBuffer             command_buffer,
+    unsigned int                frame_index,
+    VkExtent2D                  extent,
+    const IVK_hud_stats_type*   stats
+    );
@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_image.h"
+
+/* Largest deflate block stored without compression */
+#define MAX_STORED_BLOCK    65535
+
+/*** Static functions ***/
+/*
+ * Checks for 8 bit RGBA / BGRA formats. Sets is_bgra for
+ * the latter.
+ */
+static bool is_rgba8_format
+    (
+    VkFormat    format,
+    bool*       is_bgra
+    );
+
+/*
+ * Appends a big endian 32 bit value
+ */
+static void put_u32_be
+    (
+    uint8_t*    dst,
+    uint32_t    value
+    );
+
+/*
+ * Writes a PNG chunk: length, type, data and CRC. The data
+ * must already be at dst + 8.
+ */
+static size_t finish_png_chunk
+    (
+    uint8_t*        dst,
+    const char*     type,
+    uint32_t        length,
+    const uint32_t* crc_table
+    );
+
+static bool encode_raw
+    (
+    const uint8_t*          pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    unsigned int            row_size,
+    IVK_byte_buffer_type*   out
+    );
+
+static bool encode_ppm
+    (
+    const uint8_t*          pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    bool                    is_bgra,
+    IVK_byte_buffer_type*   out
+    );
+
+static bool encode_png
+    (
+    const uint8_t*          pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    bool                    is_bgra,
+    IVK_byte_buffer_type*   out
+    );
+
+
+/*
+ * Encodes a frame into out. PPM and PNG take 8 bit RGBA or
+ * BGRA pixels, raw takes anything. Returns false if the
+ * pixel format cannot be encoded.
+ */
+bool ivk_image_encode
+    (
+    IVK_image_file_type     file_type,
+    const void*             pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    VkFormat                format,
+    IVK_byte_buffer_type*   out
+    )
+{
+/* Local variables */
+bool    _is_bgra = false;
+
+out->size = 0;
+if( file_type == IVK_IMAGE_FILE_RAW )
+    {
+    return encode_raw( ( const uint8_t* )pixels, width, height, row_pitch, row_pitch, out );
+    }
+
+if( !is_rgba8_format( format, &_is_bgra ) )
+    {
+    printf( "Cannot encode format %d.\n", ( int )format );
+    return false;
+    }
+
+switch( file_type )
+    {
+    case IVK_IMAGE_FILE_PPM:
+        return encode_ppm( ( const uint8_t* )pixels, width, height, row_pitch, _is_bgra, out );
+    case IVK_IMAGE_FILE_PNG:
+        return encode_png( ( const uint8_t* )pixels, width, height, row_pitch, _is_bgra, out );
+    default:
+        return false;
+    }
+
+}
+
+
+/*
+ * Returns the file extension for a file format, without
+ * the dot
+ */
+const char* ivk_image_file_extension
+    (
+    IVK_image_file_type     file_type
+    )
+{
+switch( file_type )
+    {
+    case IVK_IMAGE_FILE_PPM:
+        return "ppm";
+    case IVK_IMAGE_FILE_PNG:
+        return "png";
+    default:
+        return "raw";
+    }
+
+}
+
+
+/*
+ * Makes room for capacity bytes in the buffer
+ */
+bool ivk_byte_buffer_reserve
+    (
+    IVK_byte_buffer_type*   buffer,
+    size_t                  capacity
+    )
+{
+/* Local variables */
+uint8_t*    _data = NULL;
+
+if( buffer->capacity >= capacity )
+    {
+    return true;
+    }
+
+_data = ( uint8_t* )realloc( buffer->data, capacity );
+if( !_data )
+    {
+    printf( "Failed to allocate %zu bytes.\n", capacity );
+    return false;
+    }
+
+buffer->data = _data;
+buffer->capacity = capacity;
+return true;
+
+}
+
+
+/*
+ * Frees the buffer's memory
+ */
+void ivk_byte_buffer_free
+    (
+    IVK_byte_buffer_type*   buffer
+    )
+{
+free( buffer->data );
+memset( buffer, 0, sizeof( *buffer ) );
+
+}
+
+
+/*
+ * Checks for 8 bit RGBA / BGRA formats. Sets is_bgra for
+ * the latter.
+ */
+static bool is_rgba8_format
+    (
+    VkFormat    format,
+    bool*       is_bgra
+    )
+{
+switch( format )
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        *is_bgra = false;
+        return true;
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        *is_bgra = true;
+        return true;
+    default:
+        return false;
+    }
+
+}
+
+
+/*
+ * Appends a big endian 32 bit value
+ */
+static void put_u32_be
+    (
+    uint8_t*    dst,
+    uint32_t    value
+    )
+{
+dst[ 0 ] = ( uint8_t )( value >> 24 );
+dst[ 1 ] = ( uint8_t )( value >> 16 );
+dst[ 2 ] = ( uint8_t )( value >> 8 );
+dst[ 3 ] = ( uint8_t )( value );
+
+}
+
+
+/*
+ * Copies the rows out tightly packed
+ */
+static bool encode_raw
+    (
+    const uint8_t*          pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    unsigned int            row_size,
+    IVK_byte_buffer_type*   out
+    )
+{
+( void )width;
+
+if( !ivk_byte_buffer_reserve( out, ( size_t )row_size * height ) )
+    {
+    return false;
+    }
+
+for( unsigned int y = 0; y < height; y++ )
+    {
+    memcpy( &out->data[ ( size_t )y * row_size ], &pixels[ ( size_t )y * row_pitch ], row_size );
+    }
+out->size = ( size_t )row_size * height;
+
+return true;
+
+}
+
+
+/*
+ * Binary PPM, alpha is dropped
+ */
+static bool encode_ppm
+    (
+    const uint8_t*          pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    bool                    is_bgra,
+    IVK_byte_buffer_type*   out
+    )
+{
+/* Local variables */
+char            _header[ 64 ];
+int             _header_size = 0;
+uint8_t*        _dst = NULL;
+const uint8_t*  _src = NULL;
+unsigned int    _r = is_bgra ? 2 : 0;
+unsigned int    _b = is_bgra ? 0 : 2;
+
+_header_size = snprintf( _header, sizeof( _header ), "P6\n%u %u\n255\n", width, height );
+if( !ivk_byte_buffer_reserve( out, ( size_t )_header_size + ( size_t )width * height * 3 ) )
+    {
+    return false;
+    }
+
+memcpy( out->data, _header, _header_size );
+_dst = &out->data[ _header_size ];
+for( unsigned int y = 0; y < height; y++ )
+    {
+    _src = &pixels[ ( size_t )y * row_pitch ];
+    for( unsigned int x = 0; x < width; x++ )
+        {
+        _dst[ 0 ] = _src[ _r ];
+        _dst[ 1 ] = _src[ 1 ];
+        _dst[ 2 ] = _src[ _b ];
+        _dst += 3;
+        _src += 4;
+        }
+    }
+out->size = ( size_t )( _dst - out->data );
+
+return true;
+
+}
+
+
+/*
+ * Writes a PNG chunk: length, type, data and CRC. The data
+ * must already be at dst + 8.
+ */
+static size_t finish_png_chunk
+    (
+    uint8_t*        dst,
+    const char*     type,
+    uint32_t        length,
+    const uint32_t* crc_table
+    )
+{
+/* Local variables */
+uint32_t    _crc = 0xFFFFFFFFu;
+
+put_u32_be( dst, length );
+memcpy( &dst[ 4 ], type, 4 );
+
+/* The CRC covers the type and the data */
+for( size_t i = 4; i < ( size_t )length + 8; i++ )
+    {
+    _crc = crc_table[ ( _crc ^ dst[ i ] ) & 0xFF ] ^ ( _crc >> 8 );
+    }
+put_u32_be( &dst[ length + 8 ], _crc ^ 0xFFFFFFFFu );
+
+return( ( size_t )length + 12 );
+
+}
+
+
+/*
+ * RGBA PNG. The zlib stream uses stored blocks only, so the
+ * cost is dominated by the CRC and Adler checksums rather
+ * than by compression.
+ */
+static bool encode_png
+    (
+    const uint8_t*          pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    bool                    is_bgra,
+    IVK_byte_buffer_type*   out
+    )
+{
+/* Local constants */
+static const uint8_t    s_signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+/* Local variables */
+uint32_t        _crc_table[ 256 ];
+size_t          _row_size = ( size_t )width * 4 + 1;   /* Filter byte first */
+size_t          _raw_size = _row_size * height;
+size_t          _block_count = ( _raw_size + MAX_STORED_BLOCK - 1 ) / MAX_STORED_BLOCK;
+size_t          _zlib_size = 2 + _block_count * 5 + _raw_size + 4;
+size_t          _pos = 0;
+size_t          _idat = 0;
+size_t          _block_left = 0;
+size_t          _raw_left = _raw_size;
+uint32_t        _adler_a = 1;
+uint32_t        _adler_b = 0;
+unsigned int    _adler_run = 0;
+unsigned int    _r = is_bgra ? 2 : 0;
+unsigned int    _b = is_bgra ? 0 : 2;
+uint8_t*        _dst = NULL;
+
+if( _zlib_size > 0x7FFFFFFF ||
+    !ivk_byte_buffer_reserve( out, sizeof( s_signature ) + 25 + 12 + _zlib_size + 12 ) )
+    {
+    return false;
+    }
+
+/* Cheap enough to build per image, and keeps the encoder free of
+shared state across the worker threads */
+for( uint32_t i = 0; i < 256; i++ )
+    {
+    uint32_t    _c = i;
+    for( unsigned int k = 0; k < 8; k++ )
+        {
+        _c = ( _c & 1 ) ? 0xEDB88320u ^ ( _c >> 1 ) : ( _c >> 1 );
+        }
+    _crc_table[ i ] = _c;
+    }
+
+_dst = out->data;
+memcpy( _dst, s_signature, sizeof( s_signature ) );
+_pos = sizeof( s_signature );
+
+/* Header: 8 bit RGBA, no interlacing */
+put_u32_be( &_dst[ _pos + 8 ], width );
+put_u32_be( &_dst[ _pos + 12 ], height );
+_dst[ _pos + 16 ] = 8;
+_dst[ _pos + 17 ] = 6;
+_dst[ _pos + 18 ] = 0;
+_dst[ _pos + 19 ] = 0;
+_dst[ _pos + 20 ] = 0;
+_pos += finish_png_chunk( &_dst[ _pos ], "IHDR", 13, _crc_table );
+
+/* Image data, written straight into the chunk */
+_idat = _pos;
+_pos += 8;
+_dst[ _pos++ ] = 0x78;  /* Deflate, 32K window */
+_dst[ _pos++ ] = 0x01;  /* No preset dictionary, check bits */
+
+for( unsigned int y = 0; y < height; y++ )
+    {
+    const uint8_t*  _src = &pixels[ ( size_t )y * row_pitch ];
+
+    for( size_t i = 0; i < _row_size; i++ )
+        {
+        uint8_t _value = 0;
+
+        /* Start a new stored block */
+        if( _block_left == 0 )
+            {
+            _block_left = ( _raw_left < MAX_STORED_BLOCK ) ? _raw_left : MAX_STORED_BLOCK;
+            _dst[ _pos++ ] = ( _raw_left == _block_left ) ? 1 : 0;
+            _dst[ _pos++ ] = ( uint8_t )( _block_left );
+            _dst[ _pos++ ] = ( uint8_t )( _block_left >> 8 );
+            _dst[ _pos++ ] = ( uint8_t )( ~_block_left );
+            _dst[ _pos++ ] = ( uint8_t )( ~_block_left >> 8 );
+            }
+
+        /* Filter type 0, then the pixels in RGBA order */
+        if( i > 0 )
+            {
+            size_t  _channel = ( i - 1 ) & 3;
+            size_t  _pixel = ( i - 1 ) & ~( size_t )3;
+
+            if( _channel == 0 )
+                {
+                _value = _src[ _pixel + _r ];
+                }
+            else if( _channel == 2 )
+                {
+                _value = _src[ _pixel + _b ];
+                }
+            else
+                {
+                _value = _src[ _pixel + _channel ];
+                }
+            }
+
+        _dst[ _pos++ ] = _value;
+        _adler_a += _value;
+        _adler_b += _adler_a;
+
+        /* 5552 bytes is the most that cannot overflow the sums */
+        if( ++_adler_run == 5552 )
+            {
+            _adler_a %= 65521;
+            _adler_b %= 65521;
+            _adler_run = 0;
+            }
+        _block_left--;
+        _raw_left--;
+        }
+    }
+
+_adler_a %= 65521;
+_adler_b %= 65521;
+put_u32_be( &_dst[ _pos ], ( _adler_b << 16 ) | _adler_a );
+_pos += 4;
+_pos = _idat + finish_png_chunk( &_dst[ _idat ], "IDAT", ( uint32_t )_zlib_size, _crc_table );
+
+_pos += finish_png_chunk( &_dst[ _pos ], "IEND", 0, _crc_table );
+out->size = _pos;
+
+return true;
+
+}
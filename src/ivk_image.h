@@ -0,0 +1,70 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+/*
+ * Image file formats the frames can be encoded to
+ */
+typedef enum
+    {
+    IVK_IMAGE_FILE_RAW = 0,                 /* Pixels as read back, no header */
+    IVK_IMAGE_FILE_PPM,                     /* Binary RGB portable pixmap */
+    IVK_IMAGE_FILE_PNG,                     /* RGBA, stored without compression */
+    IVK_IMAGE_FILE_COUNT
+    } IVK_image_file_type;
+
+/*
+ * A growable block of bytes. Reused between encodes, so it
+ * only allocates until it reaches the largest frame size.
+ */
+typedef struct
+    {
+    uint8_t*            data;
+    size_t              size;
+    size_t              capacity;
+    } IVK_byte_buffer_type;
+
+
+/*
+ * Encodes a frame into out. PPM and PNG take 8 bit RGBA or
+ * BGRA pixels, raw takes anything. Returns false if the
+ * pixel format cannot be encoded.
+ */
+bool ivk_image_encode
+    (
+    IVK_image_file_type     file_type,
+    const void*             pixels,
+    unsigned int            width,
+    unsigned int            height,
+    unsigned int            row_pitch,
+    VkFormat                format,
+    IVK_byte_buffer_type*   out
+    );
+
+/*
+ * Returns the file extension for a file format, without
+ * the dot
+ */
+const char* ivk_image_file_extension
+    (
+    IVK_image_file_type     file_type
+    );
+
+/*
+ * Makes room for capacity bytes in the buffer
+ */
+bool ivk_byte_buffer_reserve
+    (
+    IVK_byte_buffer_type*   buffer,
+    size_t                  capacity
+    );
+
+/*
+ * Frees the buffer's memory
+ */
+void ivk_byte_buffer_free
+    (
+    IVK_byte_buffer_type*   buffer
+    );
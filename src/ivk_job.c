@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_job.h"
+#include "ivk_atomic.h"
+#include "ivk_trace.h"
+
+#define DEQUE_MASK              ( IVK_JOB_DEQUE_CAPACITY - 1 )
+
+/* Rounds of failed steals before a worker goes to sleep */
+#define IDLE_ROUNDS             64
+
+/*
+ * Global data
+ */
+/* Worker of the calling thread, NULL outside a job system */
+static IVK_THREAD_LOCAL IVK_job_worker_type* s_worker = NULL;
+
+/*** Static functions ***/
+/*
+ * Worker thread, runs jobs until the system stops
+ */
+static void worker_main
+    (
+    void*   arg
+    );
+
+/*
+ * Runs one job, the worker's own or a stolen one. Returns
+ * false if there was none.
+ */
+static bool run_one
+    (
+    IVK_job_worker_type*    worker
+    );
+
+/*
+ * Runs a job and counts it down
+ */
+static void execute
+    (
+    IVK_job_worker_type*    worker,
+    const IVK_job_type*     job
+    );
+
+/*
+ * Owner side, false if the deque is full
+ */
+static bool deque_push
+    (
+    IVK_job_deque_type*     deque,
+    const IVK_job_type*     job
+    );
+
+/*
+ * Owner side, takes the newest job. False if empty.
+ */
+static bool deque_pop
+    (
+    IVK_job_deque_type*     deque,
+    IVK_job_type*           job
+    );
+
+/*
+ * Any thread, takes the oldest job. False if empty or lost
+ * to another thief.
+ */
+static bool deque_steal
+    (
+    IVK_job_deque_type*     deque,
+    IVK_job_type*           job
+    );
+
+/*
+ * Wakes the sleeping workers, if any
+ */
+static void wake_workers
+    (
+    IVK_job_system_type*    system
+    );
+
+/*
+ * Whether any deque holds a job
+ */
+static bool has_work
+    (
+    IVK_job_system_type*    system
+    );
+
+
+/*
+ * Starts thread_count - 1 workers, the calling thread being
+ * the first of the thread_count. 0 for one per hardware
+ * thread.
+ */
+bool ivk_job_system_create
+    (
+    unsigned int            thread_count,
+    IVK_job_system_type*    system
+    )
+{
+memset( system, 0, sizeof( *system ) );
+
+if( thread_count == 0 )
+    {
+    thread_count = ivk_thread_hardware_count();
+    }
+if( thread_count > IVK_JOB_MAX_THREADS )
+    {
+    thread_count = IVK_JOB_MAX_THREADS;
+    }
+
+/* The deques are large, they live on the heap */
+system->workers = ( IVK_job_worker_type* )calloc( thread_count, sizeof( IVK_job_worker_type ) );
+if( !system->workers )
+    {
+    printf( "Failed to allocate %u job deques.\n", thread_count );
+    return false;
+    }
+
+ivk_mutex_init( &system->lock );
+ivk_cond_init( &system->work_queued );
+
+for( unsigned int i = 0; i < thread_count; i++ )
+    {
+    system->workers[ i ].system = system;
+    system->workers[ i ].index = i;
+    system->workers[ i ].steal_seed = 0x9E3779B9u * ( i + 1 );
+    }
+system->thread_count = thread_count;
+s_worker = &system->workers[ 0 ];
+
+for( unsigned int i = 1; i < thread_count; i++ )
+    {
+    if( !ivk_thread_create( &system->workers[ i ].thread, worker_main, &system->workers[ i ] ) )
+        {
+        /* The workers already running steal from every deque, the
+        count cannot shrink under them */
+        printf( "Failed to start job thread %u of %u.\n", i, thread_count );
+        system->thread_count = i;
+        ivk_job_system_destroy( system );
+        return false;
+        }
+    }
+
+return true;
+
+}
+
+
+/*
+ * Stops and joins the workers. Nothing may be queued.
+ * Creating thread only.
+ */
+void ivk_job_system_destroy
+    (
+    IVK_job_system_type*    system
+    )
+{
+IVK_ATOMIC_STORE( &system->is_stopping, 1 );
+ivk_mutex_lock( &system->lock );
+ivk_cond_broadcast( &system->work_queued );
+ivk_mutex_unlock( &system->lock );
+
+for( unsigned int i = 1; i < system->thread_count; i++ )
+    {
+    ivk_thread_join( &system->workers[ i ].thread );
+    }
+
+ivk_cond_destroy( &system->work_queued );
+ivk_mutex_destroy( &system->lock );
+free( system->workers );
+memset( system, 0, sizeof( *system ) );
+s_worker = NULL;
+
+}
+
+
+/*
+ * Queues count jobs on the calling thread's deque, adding
+ * them to their counter first
+ */
+void ivk_job_run
+    (
+    IVK_job_system_type*    system,
+    const IVK_job_type*     jobs,
+    uint32_t                count
+    )
+{
+/* Local variables */
+IVK_job_worker_type*    _worker = ( s_worker && s_worker->system == system ) ? s_worker : NULL;
+
+for( uint32_t i = 0; i < count; i++ )
+    {
+    if( jobs[ i ].counter )
+        {
+        IVK_ATOMIC_ADD_U64( &jobs[ i ].counter->pending, 1 );
+        }
+    if( !_worker || !deque_push( &_worker->deque, &jobs[ i ] ) )
+        {
+        /* Not a thread of the system, or its deque is full */
+        execute( _worker, &jobs[ i ] );
+        }
+    }
+
+wake_workers( system );
+
+}
+
+
+/*
+ * Splits [0, count) in ranges of up to batch_size and runs
+ * func on each, as jobs of counter
+ */
+void ivk_job_parallel_for
+    (
+    IVK_job_system_type*    system,
+    IVK_job_func_type       func,
+    void*                   data,
+    uint32_t                count,
+    uint32_t                batch_size,
+    IVK_job_counter_type*   counter
+    )
+{
+/* Local variables */
+IVK_job_type    _job = { 0 };
+
+_job.func = func;
+_job.data = data;
+_job.counter = counter;
+batch_size = ( batch_size > 0 ) ? batch_size : 1;
+
+for( uint32_t first = 0; first < count; first += batch_size )
+    {
+    _job.first = first;
+    _job.count = ( count - first < batch_size ) ? count - first : batch_size;
+    ivk_job_run( system, &_job, 1 );
+    }
+
+}
+
+
+/*
+ * Runs jobs, the calling thread's first, until the counter
+ * gets to 0
+ */
+void ivk_job_wait
+    (
+    IVK_job_system_type*    system,
+    IVK_job_counter_type*   counter
+    )
+{
+/* Local variables */
+IVK_job_worker_type*    _worker = s_worker;
+
+if( !_worker || _worker->system != system )
+    {
+    /* Everything this thread ran went inline */
+    return;
+    }
+
+IVK_TRACE_BEGIN( "job wait" );
+while( IVK_ATOMIC_LOAD( &counter->pending ) > 0 )
+    {
+    /* The last jobs may be running elsewhere */
+    if( !run_one( _worker ) )
+        {
+        ivk_thread_yield();
+        }
+    }
+IVK_TRACE_END( "job wait" );
+
+}
+
+
+/*
+ * Worker thread, runs jobs until the system stops
+ */
+static void worker_main
+    (
+    void*   arg
+    )
+{
+/* Local variables */
+IVK_job_worker_type*    _worker = ( IVK_job_worker_type* )arg;
+IVK_job_system_type*    _system = _worker->system;
+unsigned int            _idle_rounds = 0;
+
+s_worker = _worker;
+ivk_trace_set_thread_name( "job" );
+
+while( !IVK_ATOMIC_LOAD( &_system->is_stopping ) )
+    {
+    if( run_one( _worker ) )
+        {
+        _idle_rounds = 0;
+        continue;
+        }
+    if( ++_idle_rounds < IDLE_ROUNDS )
+        {
+        ivk_thread_yield();
+        continue;
+        }
+
+    /* Announced before looking at the deques one last time, against
+    ivk_job_run that queues before looking at sleeping_count */
+    ivk_mutex_lock( &_system->lock );
+    IVK_ATOMIC_STORE( &_system->sleeping_count, _system->sleeping_count + 1 );
+    IVK_ATOMIC_FENCE();
+    if( !has_work( _system ) && !IVK_ATOMIC_LOAD( &_system->is_stopping ) )
+        {
+        ivk_cond_wait( &_system->work_queued, &_system->lock );
+        }
+    IVK_ATOMIC_STORE( &_system->sleeping_count, _system->sleeping_count - 1 );
+    ivk_mutex_unlock( &_system->lock );
+    _idle_rounds = 0;
+    }
+
+}
+
+
+/*
+ * Runs one job, the worker's own or a stolen one. Returns
+ * false if there was none.
+ */
+static bool run_one
+    (
+    IVK_job_worker_type*    worker
+    )
+{
+/* Local variables */
+IVK_job_system_type*    _system = worker->system;
+IVK_job_type            _job;
+unsigned int            _victim = 0;
+
+if( deque_pop( &worker->deque, &_job ) )
+    {
+    execute( worker, &_job );
+    return true;
+    }
+
+/* xorshift, so the thieves spread over the victims */
+worker->steal_seed ^= worker->steal_seed << 13;
+worker->steal_seed ^= worker->steal_seed >> 17;
+worker->steal_seed ^= worker->steal_seed << 5;
+_victim = worker->steal_seed % _system->thread_count;
+for( unsigned int i = 0; i < _system->thread_count; i++ )
+    {
+    if( _victim != worker->index && deque_steal( &_system->workers[ _victim ].deque, &_job ) )
+        {
+        worker->stolen_count++;
+        execute( worker, &_job );
+        return true;
+        }
+    _victim = ( _victim + 1 ) % _system->thread_count;
+    }
+
+return false;
+
+}
+
+
+/*
+ * Runs a job and counts it down
+ */
+static void execute
+    (
+    IVK_job_worker_type*    worker,
+    const IVK_job_type*     job
+    )
+{
+job->func( job->data, job->first, job->count );
+if( job->counter )
+    {
+    /* Adding all ones counts down */
+    IVK_ATOMIC_ADD_U64( &job->counter->pending, ( uint64_t )-1 );
+    }
+if( worker )
+    {
+    worker->executed_count++;
+    }
+
+}
+
+
+/*
+ * Owner side, false if the deque is full
+ */
+static bool deque_push
+    (
+    IVK_job_deque_type*     deque,
+    const IVK_job_type*     job
+    )
+{
+/* Local variables */
+int64_t     _bottom = deque->bottom;
+int64_t     _top = IVK_ATOMIC_LOAD( &deque->top );
+
+if( _bottom - _top >= IVK_JOB_DEQUE_CAPACITY )
+    {
+    return false;
+    }
+
+/* The release store publishes the job to the thieves */
+deque->jobs[ _bottom & DEQUE_MASK ] = *job;
+IVK_ATOMIC_STORE( &deque->bottom, _bottom + 1 );
+
+return true;
+
+}
+
+
+/*
+ * Owner side, takes the newest job. False if empty.
+ */
+static bool deque_pop
+    (
+    IVK_job_deque_type*     deque,
+    IVK_job_type*           job
+    )
+{
+/* Local variables */
+int64_t     _bottom = deque->bottom - 1;
+int64_t     _top = 0;
+bool        _is_taken = true;
+
+/* Claim the bottom job before looking at top, a thief does the
+opposite */
+IVK_ATOMIC_STORE( &deque->bottom, _bottom );
+IVK_ATOMIC_FENCE();
+_top = IVK_ATOMIC_LOAD( &deque->top );
+
+if( _top > _bottom )
+    {
+    IVK_ATOMIC_STORE( &deque->bottom, _bottom + 1 );
+    return false;
+    }
+
+*job = deque->jobs[ _bottom & DEQUE_MASK ];
+if( _top == _bottom )
+    {
+    /* The last job, race the thieves for it */
+    _is_taken = IVK_ATOMIC_CAS_U64( &deque->top, _top, _top + 1 );
+    IVK_ATOMIC_STORE( &deque->bottom, _bottom + 1 );
+    }
+
+return _is_taken;
+
+}
+
+
+/*
+ * Any thread, takes the oldest job. False if empty or lost
+ * to another thief.
+ */
+static bool deque_steal
+    (
+    IVK_job_deque_type*     deque,
+    IVK_job_type*           job
+    )
+{
+/* Local variables */
+int64_t     _top = IVK_ATOMIC_LOAD( &deque->top );
+int64_t     _bottom = 0;
+
+IVK_ATOMIC_FENCE();
+_bottom = IVK_ATOMIC_LOAD( &deque->bottom );
+if( _top >= _bottom )
+    {
+    return false;
+    }
+
+/* Read before the CAS, the slot is only reused once top moves past */
+*job = deque->jobs[ _top & DEQUE_MASK ];
+
+return IVK_ATOMIC_CAS_U64( &deque->top, _top, _top + 1 );
+
+}
+
+
+/*
+ * Wakes the sleeping workers, if any
+ */
+static void wake_workers
+    (
+    IVK_job_system_type*    system
+    )
+{
+IVK_ATOMIC_FENCE();
+if( IVK_ATOMIC_LOAD( &system->sleeping_count ) > 0 )
+    {
+    ivk_mutex_lock( &system->lock );
+    ivk_cond_broadcast( &system->work_queued );
+    ivk_mutex_unlock( &system->lock );
+    }
+
+}
+
+
+/*
+ * Whether any deque holds a job
+ */
+static bool has_work
+    (
+    IVK_job_system_type*    system
+    )
+{
+for( unsigned int i = 0; i < system->thread_count; i++ )
+    {
+    if( IVK_ATOMIC_LOAD( &system->workers[ i ].deque.top ) < IVK_ATOMIC_LOAD( &system->workers[ i ].deque.bottom ) )
+        {
+        return true;
+        }
+    }
+
+return false;
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ivk_thread.h"
+
+/*
+ * Threads of a job system, the one that creates it included
+ */
+#define IVK_JOB_MAX_THREADS             32
+
+/*
+ * Jobs each thread can have queued, a power of 2. A job
+ * that does not fit runs right away instead.
+ */
+#define IVK_JOB_DEQUE_CAPACITY          4096
+
+/*
+ * Types
+ */
+typedef void ( *IVK_job_func_type )
+    (
+    void*       data,
+    uint32_t    first,
+    uint32_t    count
+    );
+
+/*
+ * Counts the jobs of a fork down to 0 as they finish,
+ * zero-initialize it before the first ivk_job_run
+ */
+typedef struct
+    {
+    volatile uint64_t   pending;
+    } IVK_job_counter_type;
+
+typedef struct
+    {
+    IVK_job_func_type   func;
+    void*               data;
+    uint32_t            first;              /* Range handed to func */
+    uint32_t            count;
+    IVK_job_counter_type*
+                        counter;            /* May be NULL */
+    } IVK_job_type;
+
+/*
+ * Chase-Lev work-stealing deque. The owner pushes and pops
+ * at the bottom, without a lock or a CAS but for the last
+ * job; the other threads steal from the top.
+ */
+typedef struct
+    {
+    volatile int64_t    top;
+    volatile int64_t    bottom;
+    IVK_job_type        jobs[ IVK_JOB_DEQUE_CAPACITY ];
+    } IVK_job_deque_type;
+
+struct IVK_job_system_type;
+
+typedef struct
+    {
+    struct IVK_job_system_type*
+                        system;
+    unsigned int        index;
+    IVK_thread_type     thread;             /* Unused for thread 0 */
+    uint32_t            steal_seed;         /* Picks the first victim */
+    uint64_t            executed_count;
+    uint64_t            stolen_count;
+    IVK_job_deque_type  deque;
+    } IVK_job_worker_type;
+
+/*
+ * Fixed pool of worker threads. Jobs are run and waited on
+ * from the thread that created the system, or from inside
+ * jobs. Waiting runs jobs rather than blocking.
+ */
+typedef struct IVK_job_system_type
+    {
+    IVK_job_worker_type*
+                        workers;            /* 0 is the creating thread */
+    unsigned int        thread_count;
+    volatile uint32_t   is_stopping;
+    volatile uint32_t   sleeping_count;     /* Workers asleep on work_queued */
+    IVK_mutex_type      lock;               /* Only guards the sleep */
+    IVK_cond_type       work_queued;
+    } IVK_job_system_type;
+
+
+/*
+ * Starts thread_count - 1 workers, the calling thread being
+ * the first of the thread_count. 0 for one per hardware
+ * thread.
+ */
+bool ivk_job_system_create
+    (
+    unsigned int            thread_count,
+    IVK_job_system_type*    system
+    );
+
+/*
+ * Stops and joins the workers. Nothing may be queued.
+ * Creating thread only.
+ */
+void ivk_job_system_destroy
+    (
+    IVK_job_system_type*    system
+    );
+
+/*
+ * Queues count jobs on the calling thread's deque, adding
+ * them to their counter first
+ */
+void ivk_job_run
+    (
+    IVK_job_system_type*    system,
+    const IVK_job_type*     jobs,
+    uint32_t                count
+    );
+
+/*
+ * Splits [0, count) in ranges of up to batch_size and runs
+ * func on each, as jobs of counter
+ */
+void ivk_job_parallel_for
+    (
+    IVK_job_system_type*    system,
+    IVK_job_func_type       func,
+    void*                   data,
+    uint32_t                count,
+    uint32_t                batch_size,
+    IVK_job_counter_type*   counter
+    );
+
+/*
+ * Runs jobs, the calling thread's first, until the counter
+ * gets to 0
+ */
+void ivk_job_wait
+    (
+    IVK_job_system_type*    system,
+    IVK_job_counter_type*   counter
+    );
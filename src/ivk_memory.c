@@ -0,0 +1,638 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_memory.h"
+#include "ivk_atomic.h"
+#include "ivk_thread.h"
+
+/*
+ * Every tracked allocation is preceded by this header, right
+ * below the pointer handed out, so frees and reallocations
+ * know the size and the scope to take off
+ */
+typedef struct
+    {
+    uint64_t            size;
+    uint32_t            scope;
+    uint32_t            offset;             /* From the malloc'd block to the pointer */
+    } allocation_header_type;
+
+#define HEADER_SIZE             sizeof( allocation_header_type )
+#define MIN_ALIGNMENT           HEADER_SIZE
+
+/*
+ * Global data
+ */
+const VkAllocationCallbacks* g_ivk_host_allocator = NULL;
+static IVK_host_allocator_type s_host_allocator;
+static volatile uint32_t s_is_settle_claimed = 0;
+static volatile uint32_t s_is_settled = 0;
+
+static const char* s_scope_names[ IVK_MEMORY_SCOPE_COUNT ] =
+    {
+    "command",
+    "object",
+    "cache",
+    "device",
+    "instance"
+    };
+
+/*** Static functions ***/
+/*
+ * PFN_vkAllocationFunction
+ */
+static void* VKAPI_PTR allocation_callback
+    (
+    void*                   user_data,
+    size_t                  size,
+    size_t                  alignment,
+    VkSystemAllocationScope scope
+    );
+
+/*
+ * PFN_vkReallocationFunction
+ */
+static void* VKAPI_PTR reallocation_callback
+    (
+    void*                   user_data,
+    void*                   original,
+    size_t                  size,
+    size_t                  alignment,
+    VkSystemAllocationScope scope
+    );
+
+/*
+ * PFN_vkFreeFunction
+ */
+static void VKAPI_PTR free_callback
+    (
+    void*                   user_data,
+    void*                   memory
+    );
+
+/*
+ * PFN_vkInternalAllocationNotification
+ */
+static void VKAPI_PTR internal_allocation_callback
+    (
+    void*                       user_data,
+    size_t                      size,
+    VkInternalAllocationType    type,
+    VkSystemAllocationScope     scope
+    );
+
+/*
+ * PFN_vkInternalFreeNotification
+ */
+static void VKAPI_PTR internal_free_callback
+    (
+    void*                       user_data,
+    size_t                      size,
+    VkInternalAllocationType    type,
+    VkSystemAllocationScope     scope
+    );
+
+/*
+ * Returns the counters of a scope, unknown scopes count as
+ * instance scope
+ */
+static IVK_memory_scope_stats_type* get_scope
+    (
+    IVK_host_allocator_type*    allocator,
+    VkSystemAllocationScope     scope
+    );
+
+/*
+ * Raises *peak to value if it is lower
+ */
+static void raise_peak
+    (
+    volatile uint64_t*  peak,
+    uint64_t            value
+    );
+
+
+/*
+ * Clears the counters and points the callbacks at them
+ */
+void ivk_host_allocator_init
+    (
+    IVK_host_allocator_type*    allocator
+    )
+{
+memset( allocator, 0, sizeof( *allocator ) );
+
+allocator->callbacks.pUserData = allocator;
+allocator->callbacks.pfnAllocation = allocation_callback;
+allocator->callbacks.pfnReallocation = reallocation_callback;
+allocator->callbacks.pfnFree = free_callback;
+allocator->callbacks.pfnInternalAllocation = internal_allocation_callback;
+allocator->callbacks.pfnInternalFree = internal_free_callback;
+
+}
+
+
+/*
+ * Settles once per process whether the objects of every
+ * context are made with the counting allocator, and points
+ * g_ivk_host_allocator at it if so. The first call decides,
+ * from any thread; the later ones wait for it and get the
+ * same answer, whatever they ask. Returns the allocator,
+ * NULL for the driver's own.
+ */
+IVK_host_allocator_type* ivk_host_allocator_settle
+    (
+    bool                        use_tracking
+    )
+{
+/* Switching later would destroy the objects of the earlier contexts
+with other callbacks than they were created with */
+if( IVK_ATOMIC_EXCHANGE_U32( &s_is_settle_claimed, 1 ) == 0 )
+    {
+    if( use_tracking )
+        {
+        ivk_host_allocator_init( &s_host_allocator );
+        g_ivk_host_allocator = &s_host_allocator.callbacks;
+        }
+    IVK_ATOMIC_STORE( &s_is_settled, 1 );
+    }
+else
+    {
+    while( !IVK_ATOMIC_LOAD( &s_is_settled ) )
+        {
+        ivk_thread_yield();
+        }
+    }
+
+return( g_ivk_host_allocator ? &s_host_allocator : NULL );
+
+}
+
+
+/*
+ * Prints the counters of each scope, and what is still live
+ */
+void ivk_host_allocator_report
+    (
+    const IVK_host_allocator_type*  allocator
+    )
+{
+/* Local variables */
+const IVK_memory_scope_stats_type*
+                        _scope = NULL;
+uint64_t                _live_bytes = 0;
+uint64_t                _live_count = 0;
+
+printf( "Host memory by scope:\n" );
+printf( "  %-10s %12s %12s %12s %12s\n", "scope", "allocations", "peak bytes", "live bytes", "internal" );
+for( unsigned int i = 0; i < IVK_MEMORY_SCOPE_COUNT; i++ )
+    {
+    _scope = &allocator->scopes[ i ];
+    printf
+        (
+        "  %-10s %12llu %12llu %12llu %12llu\n",
+        s_scope_names[ i ],
+        ( unsigned long long )_scope->total_allocation_count,
+        ( unsigned long long )_scope->peak_bytes,
+        ( unsigned long long )_scope->bytes,
+        ( unsigned long long )_scope->internal_bytes
+        );
+    _live_bytes += _scope->bytes;
+    _live_count += _scope->allocation_count;
+    }
+
+if( _live_count > 0 )
+    {
+    printf( "  %llu allocations ( %llu bytes ) still live.\n", ( unsigned long long )_live_count, ( unsigned long long )_live_bytes );
+    }
+if( allocator->failed_count > 0 )
+    {
+    printf( "  %llu allocations failed.\n", ( unsigned long long )allocator->failed_count );
+    }
+
+}
+
+
+/*
+ * Allocates the arena's memory
+ */
+bool ivk_arena_create
+    (
+    size_t              capacity,
+    bool                use_overflow,
+    IVK_arena_type*     arena
+    )
+{
+memset( arena, 0, sizeof( *arena ) );
+
+arena->base = ( unsigned char* )malloc( capacity );
+if( !arena->base )
+    {
+    printf( "Failed to allocate the %zu byte arena.\n", capacity );
+    return false;
+    }
+arena->capacity = capacity;
+arena->use_overflow = use_overflow;
+
+return true;
+
+}
+
+
+/*
+ * Frees the arena's memory
+ */
+void ivk_arena_destroy
+    (
+    IVK_arena_type*     arena
+    )
+{
+/* Local variables */
+IVK_arena_mark_type     _start = { 0 };
+
+ivk_arena_reset( arena, _start );
+free( arena->base );
+memset( arena, 0, sizeof( *arena ) );
+
+}
+
+
+/*
+ * Returns size bytes aligned to alignment ( a power of two,
+ * 0 for IVK_ARENA_DEFAULT_ALIGNMENT ). NULL if the arena is
+ * full and cannot overflow, or malloc failed. The memory is
+ * not cleared.
+ */
+void* ivk_arena_alloc
+    (
+    IVK_arena_type*     arena,
+    size_t              size,
+    size_t              alignment
+    )
+{
+/* Local variables */
+uintptr_t               _address = 0;
+size_t                  _offset = 0;
+IVK_arena_overflow_type*
+                        _block = NULL;
+size_t                  _block_size = 0;
+
+if( alignment == 0 )
+    {
+    alignment = IVK_ARENA_DEFAULT_ALIGNMENT;
+    }
+
+/* Align the address rather than the offset, malloc only guarantees
+so much */
+_address = ( ( uintptr_t )( arena->base + arena->offset ) + alignment - 1 ) & ~( uintptr_t )( alignment - 1 );
+_offset = ( size_t )( _address - ( uintptr_t )arena->base );
+if( arena->base && _offset <= arena->capacity && size <= arena->capacity - _offset )
+    {
+    arena->offset = _offset + size;
+    if( arena->offset + arena->overflow_bytes > arena->high_water )
+        {
+        arena->high_water = arena->offset + arena->overflow_bytes;
+        }
+    return( ( void* )_address );
+    }
+
+arena->overflow_count++;
+if( !arena->use_overflow )
+    {
+    return NULL;
+    }
+
+/* A block of its own, freed with the reset that releases it */
+_block_size = sizeof( IVK_arena_overflow_type ) + alignment - 1 + size;
+_block = ( IVK_arena_overflow_type* )malloc( _block_size );
+if( !_block )
+    {
+    return NULL;
+    }
+_block->next = arena->overflow;
+_block->size = _block_size;
+arena->overflow = _block;
+arena->overflow_bytes += _block_size;
+if( arena->offset + arena->overflow_bytes > arena->high_water )
+    {
+    arena->high_water = arena->offset + arena->overflow_bytes;
+    }
+
+_address = ( ( uintptr_t )( _block + 1 ) + alignment - 1 ) & ~( uintptr_t )( alignment - 1 );
+return( ( void* )_address );
+
+}
+
+
+/*
+ * Returns the current position, to reset to later
+ */
+IVK_arena_mark_type ivk_arena_mark
+    (
+    const IVK_arena_type*   arena
+    )
+{
+/* Local variables */
+IVK_arena_mark_type     _mark;
+
+_mark.offset = arena->offset;
+_mark.overflow = arena->overflow;
+_mark.overflow_bytes = arena->overflow_bytes;
+
+return _mark;
+
+}
+
+
+/*
+ * Releases everything allocated since mark. Marks taken
+ * after it become invalid.
+ */
+void ivk_arena_reset
+    (
+    IVK_arena_type*     arena,
+    IVK_arena_mark_type mark
+    )
+{
+/* Local variables */
+IVK_arena_overflow_type*
+                        _next = NULL;
+
+if( mark.offset < arena->offset )
+    {
+    arena->offset = mark.offset;
+    }
+
+/* The overflow blocks newer than the mark sit in front of it */
+while( arena->overflow && arena->overflow != mark.overflow )
+    {
+    _next = arena->overflow->next;
+    free( arena->overflow );
+    arena->overflow = _next;
+    }
+arena->overflow_bytes = mark.overflow_bytes;
+
+}
+
+
+/*
+ * Releases everything, and grows an overflowing arena to
+ * its high water mark
+ */
+void ivk_arena_clear
+    (
+    IVK_arena_type*     arena
+    )
+{
+/* Local variables */
+IVK_arena_mark_type     _start = { 0 };
+unsigned char*          _base = NULL;
+size_t                  _capacity = arena->capacity;
+
+ivk_arena_reset( arena, _start );
+if( !arena->use_overflow || arena->high_water <= arena->capacity )
+    {
+    return;
+    }
+
+/* Doubling keeps the number of regrowths low while the workload
+ramps up */
+while( _capacity < arena->high_water )
+    {
+    _capacity = _capacity ? _capacity * 2 : IVK_ARENA_DEFAULT_ALIGNMENT;
+    }
+_base = ( unsigned char* )malloc( _capacity );
+if( !_base )
+    {
+    return;
+    }
+free( arena->base );
+arena->base = _base;
+arena->capacity = _capacity;
+
+}
+
+
+/*
+ * Prints the arena's use
+ */
+void ivk_arena_report
+    (
+    const IVK_arena_type*   arena,
+    const char*             name
+    )
+{
+printf
+    (
+    "Arena %s: %zu bytes at the high water mark, %zu reserved, %u allocations did not fit.\n",
+    name,
+    arena->high_water,
+    arena->capacity,
+    arena->overflow_count
+    );
+
+}
+
+
+/*
+ * PFN_vkAllocationFunction
+ */
+static void* VKAPI_PTR allocation_callback
+    (
+    void*                   user_data,
+    size_t                  size,
+    size_t                  alignment,
+    VkSystemAllocationScope scope
+    )
+{
+/* Local variables */
+IVK_host_allocator_type*        _allocator = ( IVK_host_allocator_type* )user_data;
+IVK_memory_scope_stats_type*    _scope = get_scope( _allocator, scope );
+unsigned char*                  _block = NULL;
+uintptr_t                       _address = 0;
+allocation_header_type*         _header = NULL;
+
+if( size == 0 )
+    {
+    return NULL;
+    }
+if( alignment < MIN_ALIGNMENT )
+    {
+    alignment = MIN_ALIGNMENT;
+    }
+
+/* Room for the header below the aligned pointer, whatever malloc
+returns */
+_block = ( unsigned char* )malloc( size + HEADER_SIZE + alignment - 1 );
+if( !_block )
+    {
+    IVK_ATOMIC_ADD_U64( &_allocator->failed_count, 1 );
+    return NULL;
+    }
+_address = ( ( uintptr_t )_block + HEADER_SIZE + alignment - 1 ) & ~( uintptr_t )( alignment - 1 );
+
+_header = ( allocation_header_type* )_address - 1;
+_header->size = size;
+_header->scope = ( uint32_t )( _scope - _allocator->scopes );
+_header->offset = ( uint32_t )( _address - ( uintptr_t )_block );
+
+raise_peak( &_scope->peak_bytes, IVK_ATOMIC_ADD_U64( &_scope->bytes, size ) );
+IVK_ATOMIC_ADD_U64( &_scope->allocation_count, 1 );
+IVK_ATOMIC_ADD_U64( &_scope->total_allocation_count, 1 );
+
+return( ( void* )_address );
+
+}
+
+
+/*
+ * PFN_vkReallocationFunction
+ */
+static void* VKAPI_PTR reallocation_callback
+    (
+    void*                   user_data,
+    void*                   original,
+    size_t                  size,
+    size_t                  alignment,
+    VkSystemAllocationScope scope
+    )
+{
+/* Local variables */
+void*                   _memory = NULL;
+uint64_t                _original_size = 0;
+
+if( !original )
+    {
+    return allocation_callback( user_data, size, alignment, scope );
+    }
+if( size == 0 )
+    {
+    free_callback( user_data, original );
+    return NULL;
+    }
+
+/* The alignment must be kept, which realloc cannot do; on failure
+the original stays valid */
+_memory = allocation_callback( user_data, size, alignment, scope );
+if( !_memory )
+    {
+    return NULL;
+    }
+
+_original_size = ( ( allocation_header_type* )original - 1 )->size;
+memcpy( _memory, original, ( size_t )( ( _original_size < size ) ? _original_size : size ) );
+free_callback( user_data, original );
+
+return _memory;
+
+}
+
+
+/*
+ * PFN_vkFreeFunction
+ */
+static void VKAPI_PTR free_callback
+    (
+    void*                   user_data,
+    void*                   memory
+    )
+{
+/* Local variables */
+IVK_host_allocator_type*        _allocator = ( IVK_host_allocator_type* )user_data;
+IVK_memory_scope_stats_type*    _scope = NULL;
+allocation_header_type*         _header = NULL;
+
+if( !memory )
+    {
+    return;
+    }
+
+_header = ( allocation_header_type* )memory - 1;
+_scope = &_allocator->scopes[ _header->scope ];
+IVK_ATOMIC_ADD_U64( &_scope->bytes, ( uint64_t )0 - _header->size );
+IVK_ATOMIC_ADD_U64( &_scope->allocation_count, ( uint64_t )0 - 1 );
+
+free( ( unsigned char* )memory - _header->offset );
+
+}
+
+
+/*
+ * PFN_vkInternalAllocationNotification
+ */
+static void VKAPI_PTR internal_allocation_callback
+    (
+    void*                       user_data,
+    size_t                      size,
+    VkInternalAllocationType    type,
+    VkSystemAllocationScope     scope
+    )
+{
+/* Local variables */
+IVK_memory_scope_stats_type*    _scope = get_scope( ( IVK_host_allocator_type* )user_data, scope );
+
+( void )type;
+IVK_ATOMIC_ADD_U64( &_scope->internal_bytes, size );
+
+}
+
+
+/*
+ * PFN_vkInternalFreeNotification
+ */
+static void VKAPI_PTR internal_free_callback
+    (
+    void*                       user_data,
+    size_t                      size,
+    VkInternalAllocationType    type,
+    VkSystemAllocationScope     scope
+    )
+{
+/* Local variables */
+IVK_memory_scope_stats_type*    _scope = get_scope( ( IVK_host_allocator_type* )user_data, scope );
+
+( void )type;
+IVK_ATOMIC_ADD_U64( &_scope->internal_bytes, ( uint64_t )0 - size );
+
+}
+
+
+/*
+ * Returns the counters of a scope, unknown scopes count as
+ * instance scope
+ */
+static IVK_memory_scope_stats_type* get_scope
+    (
+    IVK_host_allocator_type*    allocator,
+    VkSystemAllocationScope     scope
+    )
+{
+if( ( unsigned int )scope >= IVK_MEMORY_SCOPE_COUNT )
+    {
+    scope = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE;
+    }
+
+return &allocator->scopes[ scope ];
+
+}
+
+
+/*
+ * Raises *peak to value if it is lower
+ */
+static void raise_peak
+    (
+    volatile uint64_t*  peak,
+    uint64_t            value
+    )
+{
+/* Local variables */
+uint64_t                _peak = IVK_ATOMIC_LOAD( peak );
+
+while( value > _peak && !IVK_ATOMIC_CAS_U64( peak, _peak, value ) )
+    {
+    _peak = IVK_ATOMIC_LOAD( peak );
+    }
+
+}
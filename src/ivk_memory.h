@@ -0,0 +1,195 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+/*
+ * One entry per VkSystemAllocationScope
+ */
+#define IVK_MEMORY_SCOPE_COUNT          ( VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1 )
+
+/*
+ * Alignment of the arena allocations unless asked otherwise,
+ * enough for any scalar type
+ */
+#define IVK_ARENA_DEFAULT_ALIGNMENT     16
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    volatile uint64_t   bytes;              /* Live */
+    volatile uint64_t   peak_bytes;
+    volatile uint64_t   allocation_count;   /* Live */
+    volatile uint64_t   total_allocation_count;
+                                            /* Ever made, reallocations included */
+    volatile uint64_t   internal_bytes;     /* Live, allocated by the driver itself
+                                               and only reported to us */
+    } IVK_memory_scope_stats_type;
+
+/*
+ * VkAllocationCallbacks that count the bytes and the
+ * allocations of each scope. The drivers may allocate from
+ * any thread, the counters are atomic.
+ */
+typedef struct
+    {
+    VkAllocationCallbacks
+                        callbacks;          /* pUserData points back here */
+    IVK_memory_scope_stats_type
+                        scopes[ IVK_MEMORY_SCOPE_COUNT ];
+    volatile uint64_t   failed_count;       /* Allocations the system refused */
+    } IVK_host_allocator_type;
+
+/*
+ * Block malloc'd for an allocation that did not fit
+ */
+typedef struct IVK_arena_overflow_type
+    {
+    struct IVK_arena_overflow_type*
+                        next;               /* Allocated before this one */
+    size_t              size;               /* Of the whole block */
+    } IVK_arena_overflow_type;
+
+/*
+ * Linear scratch memory. Allocating moves the offset up,
+ * resetting moves it back, both in O(1); nothing is freed
+ * individually.
+ *
+ * Allocations that do not fit fail, or with use_overflow
+ * fall back to malloc. Clearing such an arena grows it to
+ * its high water mark, so a steady workload stops touching
+ * the heap after its first frames.
+ */
+typedef struct
+    {
+    unsigned char*      base;
+    size_t              capacity;
+    size_t              offset;
+    bool                use_overflow;
+    IVK_arena_overflow_type*
+                        overflow;           /* Newest first */
+    size_t              overflow_bytes;     /* In the overflow blocks */
+    size_t              high_water;         /* Most bytes in use at once, overflow
+                                               included */
+    unsigned int        overflow_count;     /* Allocations that did not fit */
+    } IVK_arena_type;
+
+/*
+ * Position in an arena to reset to
+ */
+typedef struct
+    {
+    size_t              offset;
+    IVK_arena_overflow_type*
+                        overflow;
+    size_t              overflow_bytes;
+    } IVK_arena_mark_type;
+
+/*
+ * The callbacks every Vulkan object of the library is
+ * created and destroyed with, NULL for the driver's own
+ * allocator. Settled before the first instance is created
+ * and left alone after: an object must be destroyed with
+ * the callbacks it was created with.
+ */
+extern const VkAllocationCallbacks* g_ivk_host_allocator;
+
+
+/*
+ * Clears the counters and points the callbacks at them
+ */
+void ivk_host_allocator_init
+    (
+    IVK_host_allocator_type*    allocator
+    );
+
+/*
+ * Prints the counters of each scope, and what is still live
+ */
+void ivk_host_allocator_report
+    (
+    const IVK_host_allocator_type*  allocator
+    );
+
+/*
+ * Settles once per process whether the objects of every
+ * context are made with the counting allocator, and points
+ * g_ivk_host_allocator at it if so. The first call decides,
+ * from any thread; the later ones wait for it and get the
+ * same answer, whatever they ask. Returns the allocator,
+ * NULL for the driver's own.
+ */
+IVK_host_allocator_type* ivk_host_allocator_settle
+    (
+    bool                        use_tracking
+    );
+
+/*
+ * Allocates the arena's memory
+ */
+bool ivk_arena_create
+    (
+    size_t              capacity,
+    bool                use_overflow,
+    IVK_arena_type*     arena
+    );
+
+/*
+ * Frees the arena's memory
+ */
+void ivk_arena_destroy
+    (
+    IVK_arena_type*     arena
+    );
+
+/*
+ * Returns size bytes aligned to alignment ( a power of two,
+ * 0 for IVK_ARENA_DEFAULT_ALIGNMENT ). NULL if the arena is
+ * full and cannot overflow, or malloc failed. The memory is
+ * not cleared.
+ */
+void* ivk_arena_alloc
+    (
+    IVK_arena_type*     arena,
+    size_t              size,
+    size_t              alignment
+    );
+
+/*
+ * Returns the current position, to reset to later
+ */
+IVK_arena_mark_type ivk_arena_mark
+    (
+    const IVK_arena_type*   arena
+    );
+
+/*
+ * Releases everything allocated since mark. Marks taken
+ * after it become invalid.
+ */
+void ivk_arena_reset
+    (
+    IVK_arena_type*     arena,
+    IVK_arena_mark_type mark
+    );
+
+/*
+ * Releases everything, and grows an overflowing arena to
+ * its high water mark
+ */
+void ivk_arena_clear
+    (
+    IVK_arena_type*     arena
+    );
+
+/*
+ * Prints the arena's use
+ */
+void ivk_arena_report
+    (
+    const IVK_arena_type*   arena,
+    const char*             name
+    );
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ivk_offscreen.h"
+#include "ivk_buffers.h"
+#include "ivk_memory.h"
+#include "ivk_util.h"
+
+
+/*
+ * Creates image_count images to render into in place of the
+ * swapchain images. They are color attachments that can be
+ * copied from, each bound to its own device local memory.
+ * Returns false, with no images, if they cannot be made.
+ */
+bool ivk_offscreen_create_images
+    (
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    unsigned int        image_count,
+    VkExtent2D          extent,
+    VkFormat            format,
+    VkImage**           images,
+    VkDeviceMemory**    images_memory
+    )
+{
+/* Local variables */
+VkImageCreateInfo       _image_create_info = { 0 };
+VkMemoryRequirements    _mem_requirements = { 0 };
+VkMemoryAllocateInfo    _alloc_info = { 0 };
+VkImage*                _images = NULL;
+VkDeviceMemory*         _memory = NULL;
+unsigned int            _memory_type = UINT32_MAX;
+
+_images = ( VkImage* )calloc( image_count, sizeof( VkImage ) );
+_memory = ( VkDeviceMemory* )calloc( image_count, sizeof( VkDeviceMemory ) );
+if( !_images || !_memory )
+    {
+    printf( "Failed to allocate memory for the offscreen images.\n" );
+    free( _images );
+    free( _memory );
+    return false;
+    }
+
+_image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+_image_create_info.imageType = VK_IMAGE_TYPE_2D;
+_image_create_info.format = format;
+_image_create_info.extent.width = extent.width;
+_image_create_info.extent.height = extent.height;
+_image_create_info.extent.depth = 1;
+_image_create_info.mipLevels = 1;
+_image_create_info.arrayLayers = 1;
+_image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+_image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+_image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+for( unsigned int i = 0; i < image_count; i++ )
+    {
+    __vk( vkCreateImage( device, &_image_create_info, g_ivk_host_allocator, &_images[ i ] ) );
+    vkGetImageMemoryRequirements( device, _images[ i ], &_mem_requirements );
+
+    _memory_type = ivk_buffer_find_memory_type
+        (
+        gpu,
+        _mem_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+    if( _memory_type == UINT32_MAX )
+        {
+        printf( "No device local memory for the offscreen images.\n" );
+
+        /* The handles not created yet are still VK_NULL_HANDLE */
+        ivk_offscreen_destroy_images( device, i + 1, _images, _memory );
+        return false;
+        }
+
+    _alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    _alloc_info.allocationSize = _mem_requirements.size;
+    _alloc_info.memoryTypeIndex = _memory_type;
+    __vk( vkAllocateMemory( device, &_alloc_info, g_ivk_host_allocator, &_memory[ i ] ) );
+    __vk( vkBindImageMemory( device, _images[ i ], _memory[ i ], 0 ) );
+    }
+
+*images = _images;
+*images_memory = _memory;
+return true;
+
+}
+
+
+/*
+ * Destroys the offscreen images and frees their memory
+ */
+void ivk_offscreen_destroy_images
+    (
+    VkDevice            device,
+    unsigned int        image_count,
+    VkImage*            images,
+    VkDeviceMemory*     images_memory
+    )
+{
+for( unsigned int i = 0; i < image_count; i++ )
+    {
+    vkDestroyImage( device, images[ i ], g_ivk_host_allocator );
+    vkFreeMemory( device, images_memory[ i ], g_ivk_host_allocator );
+    }
+
+free( images );
+free( images_memory );
+
+}
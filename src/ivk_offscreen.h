@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include "vulkan/vulkan.h"
+
+/*
+ * Default offscreen target format, used when the
+ * configuration leaves it as VK_FORMAT_UNDEFINED
+ */
+#define IVK_OFFSCREEN_DEFAULT_FORMAT    VK_FORMAT_R8G8B8A8_UNORM
+
+/*
+ * Creates image_count images to render into in place of the
+ * swapchain images. They are color attachments that can be
+ * copied from, each bound to its own device local memory.
+ * Returns false, with no images, if they cannot be made.
+ */
+bool ivk_offscreen_create_images
+    (
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    unsigned int        image_count,
+    VkExtent2D          extent,
+    VkFormat            format,
+    VkImage**           images,
+    VkDeviceMemory**    images_memory
+    );
+
+/*
+ * Destroys the offscreen images and frees their memory
+ */
+void ivk_offscreen_destroy_images
+    (
+    VkDevice            device,
+    unsigned int        image_count,
+    VkImage*            images,
+    VkDeviceMemory*     images_memory
+    );
@@ -1,5 +1,7 @@
 #include "ivk_pipeline.h"
 #include "ivk_buffers.h"
+#include "ivk_trace.h"
+#include "ivk_memory.h"
 #include "ivk_util.h"
 #include "vulkan/vulkan.h"
 
@@ -9,6 +11,19 @@
 
 /*** Static functions for initialization ***/
 
+/*
+ * Builds the cache key for a pipeline state by dropping
+ * the fields that are set dynamically.
+ */
+static void make_cache_key
+    (
+    const IVK_pipeline_state_type*  state,
+    unsigned int                    dynamic_state_flags,
+    VkRenderPass                    renderpass,
+    VkFormat                        color_format,
+    IVK_pipeline_cache_key_type*    key
+    );
+
 /*
  * Create a vulkan shader module
  */
@@ -51,14 +66,16 @@ _create_info.pushConstantRangeCount = 0;
 _create_info.pPushConstantRanges = NULL;
 
 /* Create the pipeline layout object */
-__vk( vkCreatePipelineLayout( device, &_create_info, NULL, pipeline_layout ) );
+__vk( vkCreatePipelineLayout( device, &_create_info, g_ivk_host_allocator, pipeline_layout ) );
 
 }
 
 
 /*
  * Creates a graphics pipeline based on the shaders
- * provided
+ * provided, the triangle shaders if NULL. If the renderpass
+ * is VK_NULL_HANDLE, the pipeline is created for dynamic
+ * rendering into a single color attachment of color_format.
  */
 void ivk_pipeline_create
     (
@@ -66,8 +83,12 @@ void ivk_pipeline_create
     VkPipelineLayout    pipeline_layout,
     VkExtent2D          extent,
     VkRenderPass        renderpass,
+    VkFormat            color_format,
     char*               vert_shader,
     char*               frag_shader,
+    const IVK_pipeline_state_type*
+                        state,
+    unsigned int        dynamic_state_flags,
     VkPipeline*         pipeline
     )
 {
@@ -84,7 +105,8 @@ VkPipelineShaderStageCreateInfo _frag_shader_stage_create_info = { 0 };
 
 VkPipelineShaderStageCreateInfo _pipeline_shader_stages[ 2 ];
 
-VkDynamicState  _dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+VkDynamicState  _dynamic_states[ 10 ] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+unsigned int    _dynamic_state_count = 2;
 VkPipelineDynamicStateCreateInfo _dynamic_state_create_info = { 0 };
 
 VkPipelineVertexInputStateCreateInfo _vertex_input_info = { 0 };
@@ -97,15 +119,19 @@ VkRect2D    _scissor = { 0 };
 VkPipelineViewportStateCreateInfo _viewport_state_create_info = { 0 };
 VkPipelineRasterizationStateCreateInfo _rasterizer_create_info = { 0 };
 VkPipelineMultisampleStateCreateInfo  _multi_sampling_create_info = { 0 };
+VkPipelineDepthStencilStateCreateInfo _depth_stencil_create_info = { 0 };
 
 VkPipelineColorBlendAttachmentState _color_blending_attachment = { 0 };
 VkPipelineColorBlendStateCreateInfo _color_blending_create_info = { 0 };
 
+VkPipelineRenderingCreateInfo _rendering_create_info = { 0 };
 VkGraphicsPipelineCreateInfo _pipeline_create_info = { 0 };
 
+IVK_TRACE_BEGIN( "pipeline build" );
+
 /* Read the shader files */
-read_binary_file_into( "..\\src\\shaders\\triangles.vert.spv", &_vert_shdr, &_vert_shdr_spv_size );
-read_binary_file_into( "..\\src\\shaders\\triangles.frag.spv", &_frag_shdr, &_frag_shdr_spv_size );
+read_binary_file_into( vert_shader ? vert_shader : IVK_SHADER_DIR "triangles.vert.spv", &_vert_shdr, &_vert_shdr_spv_size );
+read_binary_file_into( frag_shader ? frag_shader : IVK_SHADER_DIR "triangles.frag.spv", &_frag_shdr, &_frag_shdr_spv_size );
 
 _vert_shader_module = create_shader_module( device, _vert_shdr, _vert_shdr_spv_size );
 _frag_shader_module = create_shader_module( device, _frag_shdr, _frag_shdr_spv_size );
@@ -125,20 +151,20 @@ _frag_shader_stage_create_info.pName = "main";
 _pipeline_shader_stages[ 0 ] = _vert_shader_stage_create_info;
 _pipeline_shader_stages[ 1 ] = _frag_shader_stage_create_info;
 
-/* Set up the vertex input */
-_veretx_bind_desc = ivk_2p3c_get_bind_desc();
-_veretx_bind_desc_arr = ivk_2p3c_get_attr_desc();
+/* Set up the vertex input, the transforms come per instance */
+_veretx_bind_desc = ivk_2p3c_inst_get_bind_desc();
+_veretx_bind_desc_arr = ivk_2p3c_inst_get_attr_desc();
 
 _vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-_vertex_input_info.vertexBindingDescriptionCount = IVK_2P3C_BIND_CNT;
+_vertex_input_info.vertexBindingDescriptionCount = IVK_2P3C_INST_BIND_CNT;
 _vertex_input_info.pVertexBindingDescriptions = _veretx_bind_desc;
-_vertex_input_info.vertexAttributeDescriptionCount = IVK_2P3C_ATTR_CNT;
+_vertex_input_info.vertexAttributeDescriptionCount = IVK_2P3C_INST_ATTR_CNT;
 _vertex_input_info.pVertexAttributeDescriptions = _veretx_bind_desc_arr;
 
 /* Set up the input assembly */
 _input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-_input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-_input_assembly_create_info.primitiveRestartEnable = VK_FALSE;
+_input_assembly_create_info.topology = state->topology;
+_input_assembly_create_info.primitiveRestartEnable = state->primitive_restart_enable;
 
 /* Set up the viewport */
 _viewport.x = 0.0f;
@@ -153,9 +179,28 @@ _scissor.offset.x = 0;
 _scissor.offset.y = 0;
 _scissor.extent = extent;
 
-/* Set up the dynamic states - scissor box and viewport */
+/* Set up the dynamic states - scissor box and viewport, plus
+whatever extended dynamic state is in use */
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_1_BIT )
+    {
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_CULL_MODE;
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_FRONT_FACE;
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY;
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE;
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE;
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_DEPTH_COMPARE_OP;
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_2_BIT )
+    {
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE;
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_3_BIT )
+    {
+    _dynamic_states[ _dynamic_state_count++ ] = VK_DYNAMIC_STATE_POLYGON_MODE_EXT;
+    }
+
 _dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-_dynamic_state_create_info.dynamicStateCount = 2;
+_dynamic_state_create_info.dynamicStateCount = _dynamic_state_count;
 _dynamic_state_create_info.pDynamicStates = &_dynamic_states[ 0 ];
 
 _viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -166,10 +211,10 @@ _viewport_state_create_info.scissorCount = 1;
 _rasterizer_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 _rasterizer_create_info.depthClampEnable  = VK_FALSE;
 _rasterizer_create_info.rasterizerDiscardEnable = VK_FALSE;
-_rasterizer_create_info.polygonMode = VK_POLYGON_MODE_FILL;
+_rasterizer_create_info.polygonMode = state->polygon_mode;
 _rasterizer_create_info.lineWidth = 1.0f;
-_rasterizer_create_info.cullMode = VK_CULL_MODE_NONE;
-_rasterizer_create_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+_rasterizer_create_info.cullMode = state->cull_mode;
+_rasterizer_create_info.frontFace = state->front_face;
 _rasterizer_create_info.depthBiasEnable = VK_FALSE;
 _rasterizer_create_info.depthBiasConstantFactor = 0.0f;
 _rasterizer_create_info.depthBiasClamp = 0.0f;
@@ -184,6 +229,16 @@ _multi_sampling_create_info.pSampleMask = NULL;
 _multi_sampling_create_info.alphaToCoverageEnable = VK_FALSE;
 _multi_sampling_create_info.alphaToOneEnable = VK_FALSE;
 
+/* Set up the depth test. Ignored while there is no depth attachment. */
+_depth_stencil_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+_depth_stencil_create_info.depthTestEnable = state->depth_test_enable;
+_depth_stencil_create_info.depthWriteEnable = state->depth_write_enable;
+_depth_stencil_create_info.depthCompareOp = state->depth_compare_op;
+_depth_stencil_create_info.depthBoundsTestEnable = VK_FALSE;
+_depth_stencil_create_info.stencilTestEnable = VK_FALSE;
+_depth_stencil_create_info.minDepthBounds = 0.0f;
+_depth_stencil_create_info.maxDepthBounds = 1.0f;
+
 /* Set up color blending */
 _color_blending_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 _color_blending_attachment.blendEnable = VK_FALSE;
@@ -213,7 +268,7 @@ _pipeline_create_info.pInputAssemblyState = &_input_assembly_create_info;
 _pipeline_create_info.pViewportState = &_viewport_state_create_info;
 _pipeline_create_info.pRasterizationState = &_rasterizer_create_info;
 _pipeline_create_info.pMultisampleState = &_multi_sampling_create_info;
-_pipeline_create_info.pDepthStencilState = NULL;
+_pipeline_create_info.pDepthStencilState = &_depth_stencil_create_info;
 _pipeline_create_info.pColorBlendState = &_color_blending_create_info;
 _pipeline_create_info.pDynamicState = &_dynamic_state_create_info;
 _pipeline_create_info.layout = pipeline_layout;
@@ -222,15 +277,425 @@ _pipeline_create_info.subpass = 0;
 _pipeline_create_info.basePipelineHandle = NULL;
 _pipeline_create_info.basePipelineIndex = -1;
 
-__vk( vkCreateGraphicsPipelines( device, VK_NULL_HANDLE, 1, &_pipeline_create_info, NULL, pipeline ) );
+/* Dynamic rendering describes the attachments instead of the render pass */
+if( renderpass == VK_NULL_HANDLE )
+    {
+    _rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    _rendering_create_info.colorAttachmentCount = 1;
+    _rendering_create_info.pColorAttachmentFormats = &color_format;
+    _rendering_create_info.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+    _rendering_create_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    _pipeline_create_info.pNext = &_rendering_create_info;
+    }
+
+__vk( vkCreateGraphicsPipelines( device, VK_NULL_HANDLE, 1, &_pipeline_create_info, g_ivk_host_allocator, pipeline ) );
 
 /* Free the files */
 free( _vert_shdr );
 free( _frag_shdr );
 
 /* Destroy shader modules */
-vkDestroyShaderModule( device, _vert_shader_module, NULL );
-vkDestroyShaderModule( device, _frag_shader_module, NULL );
+vkDestroyShaderModule( device, _vert_shader_module, g_ivk_host_allocator );
+vkDestroyShaderModule( device, _frag_shader_module, g_ivk_host_allocator );
+
+IVK_TRACE_END( "pipeline build" );
+}
+
+
+/*
+ * Creates a pipeline for 2D overlays drawn over the scene:
+ * alpha blended triangle lists with the vertex input given,
+ * no culling, no depth test. Viewport and scissor are
+ * dynamic, and carry over from the scene.
+ */
+void ivk_pipeline_create_overlay
+    (
+    VkDevice            device,
+    VkPipelineLayout    pipeline_layout,
+    VkRenderPass        renderpass,
+    VkFormat            color_format,
+    char*               vert_shader,
+    char*               frag_shader,
+    const VkPipelineVertexInputStateCreateInfo*
+                        vertex_input,
+    VkPipeline*         pipeline
+    )
+{
+/* Local variables */
+char*           _vert_shdr = NULL;
+unsigned int    _vert_shdr_spv_size = 0;
+char*           _frag_shdr = NULL;
+unsigned int    _frag_shdr_spv_size = 0;
+VkShaderModule  _vert_shader_module = { 0 };
+VkShaderModule  _frag_shader_module = { 0 };
+
+VkPipelineShaderStageCreateInfo _pipeline_shader_stages[ 2 ] = { 0 };
+
+VkDynamicState  _dynamic_states[ 2 ] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+VkPipelineDynamicStateCreateInfo _dynamic_state_create_info = { 0 };
+
+VkPipelineInputAssemblyStateCreateInfo _input_assembly_create_info = { 0 };
+VkPipelineViewportStateCreateInfo _viewport_state_create_info = { 0 };
+VkPipelineRasterizationStateCreateInfo _rasterizer_create_info = { 0 };
+VkPipelineMultisampleStateCreateInfo  _multi_sampling_create_info = { 0 };
+VkPipelineDepthStencilStateCreateInfo _depth_stencil_create_info = { 0 };
+
+VkPipelineColorBlendAttachmentState _color_blending_attachment = { 0 };
+VkPipelineColorBlendStateCreateInfo _color_blending_create_info = { 0 };
+
+VkPipelineRenderingCreateInfo _rendering_create_info = { 0 };
+VkGraphicsPipelineCreateInfo _pipeline_create_info = { 0 };
+
+IVK_TRACE_BEGIN( "pipeline build" );
+
+/* Read the shader files */
+read_binary_file_into( vert_shader, &_vert_shdr, &_vert_shdr_spv_size );
+read_binary_file_into( frag_shader, &_frag_shdr, &_frag_shdr_spv_size );
+
+_vert_shader_module = create_shader_module( device, _vert_shdr, _vert_shdr_spv_size );
+_frag_shader_module = create_shader_module( device, _frag_shdr, _frag_shdr_spv_size );
+
+_pipeline_shader_stages[ 0 ].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+_pipeline_shader_stages[ 0 ].stage = VK_SHADER_STAGE_VERTEX_BIT;
+_pipeline_shader_stages[ 0 ].module = _vert_shader_module;
+_pipeline_shader_stages[ 0 ].pName = "main";
+_pipeline_shader_stages[ 1 ].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+_pipeline_shader_stages[ 1 ].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+_pipeline_shader_stages[ 1 ].module = _frag_shader_module;
+_pipeline_shader_stages[ 1 ].pName = "main";
+
+_input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+_input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+_input_assembly_create_info.primitiveRestartEnable = VK_FALSE;
+
+_dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+_dynamic_state_create_info.dynamicStateCount = 2;
+_dynamic_state_create_info.pDynamicStates = &_dynamic_states[ 0 ];
+
+_viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+_viewport_state_create_info.viewportCount = 1;
+_viewport_state_create_info.scissorCount = 1;
+
+_rasterizer_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+_rasterizer_create_info.polygonMode = VK_POLYGON_MODE_FILL;
+_rasterizer_create_info.lineWidth = 1.0f;
+_rasterizer_create_info.cullMode = VK_CULL_MODE_NONE;
+_rasterizer_create_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+_multi_sampling_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+_multi_sampling_create_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+_multi_sampling_create_info.minSampleShading = 1.0f;
+
+_depth_stencil_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+_depth_stencil_create_info.depthTestEnable = VK_FALSE;
+_depth_stencil_create_info.depthWriteEnable = VK_FALSE;
+_depth_stencil_create_info.maxDepthBounds = 1.0f;
+
+/* Straight alpha over whatever the scene left */
+_color_blending_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+_color_blending_attachment.blendEnable = VK_TRUE;
+_color_blending_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+_color_blending_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+_color_blending_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+_color_blending_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+_color_blending_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+_color_blending_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+_color_blending_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+_color_blending_create_info.logicOpEnable = VK_FALSE;
+_color_blending_create_info.attachmentCount = 1;
+_color_blending_create_info.pAttachments = &_color_blending_attachment;
+
+_pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+_pipeline_create_info.stageCount = 2;
+_pipeline_create_info.pStages = &_pipeline_shader_stages[ 0 ];
+_pipeline_create_info.pVertexInputState = vertex_input;
+_pipeline_create_info.pInputAssemblyState = &_input_assembly_create_info;
+_pipeline_create_info.pViewportState = &_viewport_state_create_info;
+_pipeline_create_info.pRasterizationState = &_rasterizer_create_info;
+_pipeline_create_info.pMultisampleState = &_multi_sampling_create_info;
+_pipeline_create_info.pDepthStencilState = &_depth_stencil_create_info;
+_pipeline_create_info.pColorBlendState = &_color_blending_create_info;
+_pipeline_create_info.pDynamicState = &_dynamic_state_create_info;
+_pipeline_create_info.layout = pipeline_layout;
+_pipeline_create_info.renderPass = renderpass;
+_pipeline_create_info.subpass = 0;
+_pipeline_create_info.basePipelineIndex = -1;
+
+if( renderpass == VK_NULL_HANDLE )
+    {
+    _rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    _rendering_create_info.colorAttachmentCount = 1;
+    _rendering_create_info.pColorAttachmentFormats = &color_format;
+    _pipeline_create_info.pNext = &_rendering_create_info;
+    }
+
+__vk( vkCreateGraphicsPipelines( device, VK_NULL_HANDLE, 1, &_pipeline_create_info, g_ivk_host_allocator, pipeline ) );
+
+free( _vert_shdr );
+free( _frag_shdr );
+vkDestroyShaderModule( device, _vert_shader_module, g_ivk_host_allocator );
+vkDestroyShaderModule( device, _frag_shader_module, g_ivk_host_allocator );
+
+IVK_TRACE_END( "pipeline build" );
+}
+
+
+/*
+ * Fills in the default pipeline state: filled triangle lists,
+ * no culling, no depth test.
+ */
+void ivk_pipeline_default_state
+    (
+    IVK_pipeline_state_type*    state
+    )
+{
+memset( state, 0, sizeof( *state ) );
+state->cull_mode = VK_CULL_MODE_NONE;
+state->front_face = VK_FRONT_FACE_CLOCKWISE;
+state->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+state->primitive_restart_enable = VK_FALSE;
+state->polygon_mode = VK_POLYGON_MODE_FILL;
+state->depth_test_enable = VK_FALSE;
+state->depth_write_enable = VK_FALSE;
+state->depth_compare_op = VK_COMPARE_OP_LESS;
+
+}
+
+
+/*
+ * Loads the dynamic state commands. On Vulkan 1.3 devices the
+ * core entry points are used, the EXT ones otherwise. Like the
+ * device table, they are the driver's own when is_direct,
+ * else the loader's exports where it has them.
+ */
+void ivk_pipeline_load_dynamic_state
+    (
+    PFN_vkGetDeviceProcAddr         get_device_proc_addr,
+    VkDevice                        device,
+    bool                            is_direct,
+    bool                            is_core,
+    unsigned int                    dynamic_state_flags,
+    IVK_dynamic_state_funcs_type*   funcs
+    )
+{
+memset( funcs, 0, sizeof( *funcs ) );
+
+/* The loader exports the core commands only, not the EXT ones */
+#define LOAD_STATE( member, name )                                          \
+    funcs->member = ( !is_direct && is_core ) ? name :                      \
+        ( PFN_##name )get_device_proc_addr( device, is_core ? #name : #name "EXT" );
+
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_1_BIT )
+    {
+    LOAD_STATE( cmd_set_cull_mode, vkCmdSetCullMode )
+    LOAD_STATE( cmd_set_front_face, vkCmdSetFrontFace )
+    LOAD_STATE( cmd_set_primitive_topology, vkCmdSetPrimitiveTopology )
+    LOAD_STATE( cmd_set_depth_test_enable, vkCmdSetDepthTestEnable )
+    LOAD_STATE( cmd_set_depth_write_enable, vkCmdSetDepthWriteEnable )
+    LOAD_STATE( cmd_set_depth_compare_op, vkCmdSetDepthCompareOp )
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_2_BIT )
+    {
+    LOAD_STATE( cmd_set_primitive_restart_enable, vkCmdSetPrimitiveRestartEnable )
+    }
+#undef LOAD_STATE
+
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_3_BIT )
+    {
+    funcs->cmd_set_polygon_mode = ( PFN_vkCmdSetPolygonModeEXT )get_device_proc_addr( device, "vkCmdSetPolygonModeEXT" );
+    }
+
+}
+
+
+/*
+ * Records the dynamic parts of the pipeline state
+ */
+void ivk_pipeline_set_dynamic_state
+    (
+    const IVK_dynamic_state_funcs_type* funcs,
+    VkCommandBuffer                     command_buffer,
+    unsigned int                        dynamic_state_flags,
+    const IVK_pipeline_state_type*      state
+    )
+{
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_1_BIT )
+    {
+    funcs->cmd_set_cull_mode( command_buffer, state->cull_mode );
+    funcs->cmd_set_front_face( command_buffer, state->front_face );
+    funcs->cmd_set_primitive_topology( command_buffer, state->topology );
+    funcs->cmd_set_depth_test_enable( command_buffer, state->depth_test_enable );
+    funcs->cmd_set_depth_write_enable( command_buffer, state->depth_write_enable );
+    funcs->cmd_set_depth_compare_op( command_buffer, state->depth_compare_op );
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_2_BIT )
+    {
+    funcs->cmd_set_primitive_restart_enable( command_buffer, state->primitive_restart_enable );
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_3_BIT )
+    {
+    funcs->cmd_set_polygon_mode( command_buffer, state->polygon_mode );
+    }
+
+}
+
+
+/*
+ * Returns the pipeline matching the static part of the
+ * state, creating it on first use. VK_NULL_HANDLE if the
+ * cache cannot grow to hold it.
+ */
+VkPipeline ivk_pipeline_cache_get
+    (
+    IVK_pipeline_cache_type*        cache,
+    VkDevice                        device,
+    VkPipelineLayout                pipeline_layout,
+    VkExtent2D                      extent,
+    VkRenderPass                    renderpass,
+    VkFormat                        color_format,
+    const IVK_pipeline_state_type*  state
+    )
+{
+/* Local variables */
+IVK_pipeline_cache_key_type     _key;
+IVK_pipeline_cache_entry_type*  _entry = NULL;
+IVK_pipeline_cache_entry_type*  _entries = NULL;
+unsigned int                    _capacity = 0;
+
+make_cache_key( state, cache->dynamic_state_flags, renderpass, color_format, &_key );
+
+/* The cache stays small, a linear search is enough */
+for( unsigned int i = 0; i < cache->count; i++ )
+    {
+    if( memcmp( &cache->entries[ i ].key, &_key, sizeof( _key ) ) == 0 )
+        {
+        return cache->entries[ i ].pipeline;
+        }
+    }
+
+if( cache->count == cache->capacity )
+    {
+    _capacity = cache->capacity ? cache->capacity * 2 : IVK_PIPELINE_CACHE_INITIAL_SIZE;
+    _entries = ( IVK_pipeline_cache_entry_type* )realloc( cache->entries, _capacity * sizeof( IVK_pipeline_cache_entry_type ) );
+    if( !_entries )
+        {
+        printf( "Failed to grow the pipeline cache to %u pipelines.\n", _capacity );
+        return VK_NULL_HANDLE;
+        }
+    cache->entries = _entries;
+    cache->capacity = _capacity;
+    }
+
+/* Build the pipeline from the key, dynamic fields are overridden
+when recording anyway */
+_entry = &cache->entries[ cache->count ];
+_entry->key = _key;
+ivk_pipeline_create
+    (
+    device,
+    pipeline_layout,
+    extent,
+    renderpass,
+    color_format,
+    NULL,
+    NULL,
+    &_key.state,
+    cache->dynamic_state_flags,
+    &_entry->pipeline
+    );
+cache->count++;
+
+return _entry->pipeline;
+
+}
+
+
+/*
+ * Destroys all the pipelines in the cache
+ */
+void ivk_pipeline_cache_destroy
+    (
+    IVK_pipeline_cache_type*    cache,
+    VkDevice                    device
+    )
+{
+for( unsigned int i = 0; i < cache->count; i++ )
+    {
+    vkDestroyPipeline( device, cache->entries[ i ].pipeline, g_ivk_host_allocator );
+    }
+free( cache->entries );
+cache->entries = NULL;
+cache->count = 0;
+cache->capacity = 0;
+
+}
+
+
+/*
+ * Builds the cache key for a pipeline state by dropping
+ * the fields that are set dynamically.
+ */
+static void make_cache_key
+    (
+    const IVK_pipeline_state_type*  state,
+    unsigned int                    dynamic_state_flags,
+    VkRenderPass                    renderpass,
+    VkFormat                        color_format,
+    IVK_pipeline_cache_key_type*    key
+    )
+{
+/* Clear the padding too, the key is compared with memcmp */
+memset( key, 0, sizeof( *key ) );
+key->state = *state;
+key->renderpass = renderpass;
+key->color_format = color_format;
+
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_1_BIT )
+    {
+    key->state.cull_mode = VK_CULL_MODE_NONE;
+    key->state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    key->state.depth_test_enable = VK_FALSE;
+    key->state.depth_write_enable = VK_FALSE;
+    key->state.depth_compare_op = VK_COMPARE_OP_NEVER;
+
+    /* Unless the device says otherwise, the dynamic topology has
+    to stay in the topology class the pipeline was built with */
+    if( dynamic_state_flags & IVK_DYNAMIC_STATE_ANY_TOPOLOGY_BIT )
+        {
+        key->state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        }
+    else
+        {
+        switch( state->topology )
+            {
+            case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+                key->state.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+                break;
+            case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+            case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+            case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+            case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+                key->state.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+                break;
+            case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+                key->state.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+                break;
+            default:
+                key->state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+                break;
+            }
+        }
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_2_BIT )
+    {
+    key->state.primitive_restart_enable = VK_FALSE;
+    }
+if( dynamic_state_flags & IVK_DYNAMIC_STATE_3_BIT )
+    {
+    key->state.polygon_mode = VK_POLYGON_MODE_FILL;
+    }
+
 }
 
 
@@ -252,7 +717,7 @@ _create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 _create_info.codeSize = shader_spv_size;
 _create_info.pCode = ( uint32_t* )shader_spv;
 
-__vk( vkCreateShaderModule( device, &_create_info, NULL, &_ret ) );
+__vk( vkCreateShaderModule( device, &_create_info, g_ivk_host_allocator, &_ret ) );
 
 return _ret;
 
@@ -273,11 +738,10 @@ static void read_binary_file_into
 {
 /* Local variables */
 FILE*   _input_stream = NULL;
-errno_t _err = 0;
 
 /* Begin the file stream. Print a message if file doesn't exist */
-_err = fopen_s( &_input_stream, input_file_name, "rb" );
-if( _err )
+_input_stream = fopen( input_file_name, "rb" );
+if( !_input_stream )
     {
     printf( "Error reading SPV file: %s\n", input_file_name );
     return;
@@ -292,7 +756,10 @@ rewind( _input_stream );
 
 /* Allocate enough memory to keep all the contents of the file */
 *output_buffer = ( char* )calloc( *buffer_size, sizeof(char) );
-fread_s( *output_buffer, *buffer_size, 1, *buffer_size, _input_stream );
+if( *output_buffer )
+    {
+    fread( *output_buffer, 1, *buffer_size, _input_stream );
+    }
 
 /* Close the file stream */
 fclose( _input_stream );
@@ -1,6 +1,91 @@
 #pragma once
+#include <stdbool.h>
 #include "vulkan/vulkan.h"
 
+/*
+ * Extended dynamic state support. Each bit moves a group of
+ * states out of the pipeline and into the command buffer.
+ */
+#define IVK_DYNAMIC_STATE_1_BIT         0x01    /* Cull mode, front face, topology, depth test */
+#define IVK_DYNAMIC_STATE_2_BIT         0x02    /* Primitive restart */
+#define IVK_DYNAMIC_STATE_3_BIT         0x04    /* Polygon mode */
+#define IVK_DYNAMIC_STATE_ANY_TOPOLOGY_BIT \
+                                        0x08    /* Topology may change class, e.g. lines to triangles */
+
+/*
+ * Directory of the compiled shaders, relative to the working
+ * directory. Forward slashes work on every platform.
+ */
+#ifndef IVK_SHADER_DIR
+    #define IVK_SHADER_DIR              "../src/shaders/"
+#endif
+
+/*
+ * Pipelines the pipeline cache has room for at first, it
+ * doubles whenever it fills up
+ */
+#define IVK_PIPELINE_CACHE_INITIAL_SIZE 16
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    VkCullModeFlags     cull_mode;
+    VkFrontFace         front_face;
+    VkPrimitiveTopology topology;
+    VkBool32            primitive_restart_enable;
+    VkPolygonMode       polygon_mode;
+    VkBool32            depth_test_enable;
+    VkBool32            depth_write_enable;
+    VkCompareOp         depth_compare_op;
+    } IVK_pipeline_state_type;
+
+typedef struct
+    {
+    PFN_vkCmdSetCullMode                cmd_set_cull_mode;
+    PFN_vkCmdSetFrontFace               cmd_set_front_face;
+    PFN_vkCmdSetPrimitiveTopology       cmd_set_primitive_topology;
+    PFN_vkCmdSetDepthTestEnable         cmd_set_depth_test_enable;
+    PFN_vkCmdSetDepthWriteEnable        cmd_set_depth_write_enable;
+    PFN_vkCmdSetDepthCompareOp          cmd_set_depth_compare_op;
+    PFN_vkCmdSetPrimitiveRestartEnable  cmd_set_primitive_restart_enable;
+    PFN_vkCmdSetPolygonModeEXT          cmd_set_polygon_mode;
+    } IVK_dynamic_state_funcs_type;
+
+/*
+ * What a cached pipeline was built for. Pipelines are only
+ * compatible with the render pass, or the color format with
+ * dynamic rendering, they were created against.
+ */
+typedef struct
+    {
+    IVK_pipeline_state_type state;          /* Static part only */
+    VkRenderPass            renderpass;
+    VkFormat                color_format;
+    } IVK_pipeline_cache_key_type;
+
+typedef struct
+    {
+    IVK_pipeline_cache_key_type
+                            key;
+    VkPipeline              pipeline;
+    } IVK_pipeline_cache_entry_type;
+
+/*
+ * Pipelines keyed on the static part of their state. With
+ * extended dynamic state the dynamic fields are dropped from
+ * the key, so every combination of them shares one pipeline.
+ */
+typedef struct
+    {
+    IVK_pipeline_cache_entry_type*
+                        entries;
+    unsigned int        count;
+    unsigned int        capacity;
+    unsigned int        dynamic_state_flags;
+    } IVK_pipeline_cache_type;
+
 
 /*
  * Creates a pipeline layout object
@@ -13,7 +98,11 @@ void ivk_pipeline_create_layout
 
 /*
  * Creates a graphics pipeline based on the shaders
- * provided
+ * provided, the triangle shaders if NULL. If the
+ * renderpass is VK_NULL_HANDLE, the pipeline
+ * is created for dynamic rendering into a single color
+ * attachment of color_format. States covered by
+ * dynamic_state_flags are left to the command buffer.
  */
 void ivk_pipeline_create
     (
@@ -21,7 +110,91 @@ void ivk_pipeline_create
     VkPipelineLayout    pipeline_layout,
     VkExtent2D          extent,
     VkRenderPass        renderpass,
+    VkFormat            color_format,
+    char*               vert_shader,
+    char*               frag_shader,
+    const IVK_pipeline_state_type*
+                        state,
+    unsigned int        dynamic_state_flags,
+    VkPipeline*         pipeline
+    );
+
+/*
+ * Creates a pipeline for 2D overlays drawn over the scene:
+ * alpha blended triangle lists with the vertex input given,
+ * no culling, no depth test. Viewport and scissor are
+ * dynamic, and carry over from the scene.
+ */
+void ivk_pipeline_create_overlay
+    (
+    VkDevice            device,
+    VkPipelineLayout    pipeline_layout,
+    VkRenderPass        renderpass,
+    VkFormat            color_format,
     char*               vert_shader,
     char*               frag_shader,
+    const VkPipelineVertexInputStateCreateInfo*
+                        vertex_input,
     VkPipeline*         pipeline
     );
+
+/*
+ * Fills in the default pipeline state: filled triangle lists,
+ * no culling, no depth test.
+ */
+void ivk_pipeline_default_state
+    (
+    IVK_pipeline_state_type*    state
+    );
+
+/*
+ * Loads the dynamic state commands. On Vulkan 1.3 devices the
+ * core entry points are used, the EXT ones otherwise. Like the
+ * device table, they are the driver's own when is_direct,
+ * else the loader's exports where it has them.
+ */
+void ivk_pipeline_load_dynamic_state
+    (
+    PFN_vkGetDeviceProcAddr         get_device_proc_addr,
+    VkDevice                        device,
+    bool                            is_direct,
+    bool                            is_core,
+    unsigned int                    dynamic_state_flags,
+    IVK_dynamic_state_funcs_type*   funcs
+    );
+
+/*
+ * Records the dynamic parts of the pipeline state
+ */
+void ivk_pipeline_set_dynamic_state
+    (
+    const IVK_dynamic_state_funcs_type* funcs,
+    VkCommandBuffer                     command_buffer,
+    unsigned int                        dynamic_state_flags,
+    const IVK_pipeline_state_type*      state
+    );
+
+/*
+ * Returns the pipeline matching the static part of the
+ * state, creating it on first use. VK_NULL_HANDLE if the
+ * cache cannot grow to hold it.
+ */
+VkPipeline ivk_pipeline_cache_get
+    (
+    IVK_pipeline_cache_type*        cache,
+    VkDevice                        device,
+    VkPipelineLayout                pipeline_layout,
+    VkExtent2D                      extent,
+    VkRenderPass                    renderpass,
+    VkFormat                        color_format,
+    const IVK_pipeline_state_type*  state
+    );
+
+/*
+ * Destroys all the pipelines in the cache
+ */
+void ivk_pipeline_cache_destroy
+    (
+    IVK_pipeline_cache_type*    cache,
+    VkDevice                    device
+    );
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_queue.h"
+
+#define NO_FAMILY               UINT32_MAX
+
+/*
+ * Global data
+ */
+static const char* s_role_names[ IVK_QUEUE_ROLE_COUNT ] =
+    {
+    "graphics",
+    "present",
+    "transfer",
+    "compute"
+    };
+
+/*** Static functions ***/
+/*
+ * Gives a role the next unused queue of a family, or the
+ * family's first one once they are all taken
+ */
+static void assign
+    (
+    const VkQueueFamilyProperties*  families,
+    uint32_t                        family,
+    uint32_t*                       used_counts,
+    IVK_queue_slot_type*            slot
+    );
+
+/*
+ * Best family without graphics having the flags, the
+ * fewer other capabilities the better, and one other than
+ * avoid if possible. NO_FAMILY if there is none.
+ */
+static uint32_t find_dedicated
+    (
+    const VkQueueFamilyProperties*  families,
+    uint32_t                        family_count,
+    VkQueueFlags                    flags,
+    uint32_t                        avoid
+    );
+
+
+/*
+ * Scores the queue families and assigns the roles.
+ * present_support holds a flag per family, NULL when
+ * nothing is presented. False if no family can render, or
+ * none can present.
+ */
+bool ivk_queue_plan
+    (
+    const VkQueueFamilyProperties*  families,
+    uint32_t                        family_count,
+    const VkBool32*                 present_support,
+    IVK_queue_plan_type*            plan
+    )
+{
+/* Local variables */
+uint32_t                _used_counts[ IVK_QUEUE_MAX_FAMILIES ] = { 0 };
+uint32_t                _graphics = NO_FAMILY;
+uint32_t                _present = NO_FAMILY;
+uint32_t                _transfer = NO_FAMILY;
+uint32_t                _compute = NO_FAMILY;
+uint32_t                _score = 0;
+uint32_t                _best_score = 0;
+IVK_queue_slot_type*    _slot = NULL;
+uint32_t                _family_idx = 0;
+
+memset( plan, 0, sizeof( *plan ) );
+family_count = ( family_count > IVK_QUEUE_MAX_FAMILIES ) ? IVK_QUEUE_MAX_FAMILIES : family_count;
+
+/* Graphics: presenting from the same family counts most, then
+compute on it, then room for more queues */
+for( uint32_t i = 0; i < family_count; i++ )
+    {
+    if( !( families[ i ].queueFlags & VK_QUEUE_GRAPHICS_BIT ) || families[ i ].queueCount == 0 )
+        {
+        continue;
+        }
+    _score = 1 + families[ i ].queueCount;
+    _score += ( families[ i ].queueFlags & VK_QUEUE_COMPUTE_BIT ) ? 100 : 0;
+    _score += ( present_support && present_support[ i ] ) ? 1000 : 0;
+    if( _score > _best_score )
+        {
+        _best_score = _score;
+        _graphics = i;
+        }
+    }
+if( _graphics == NO_FAMILY )
+    {
+    printf( "No queue family can render.\n" );
+    return false;
+    }
+
+/* Present: nothing is presented headless, keep the role valid
+regardless */
+_present = _graphics;
+if( present_support && !present_support[ _graphics ] )
+    {
+    _present = NO_FAMILY;
+    for( uint32_t i = 0; i < family_count && _present == NO_FAMILY; i++ )
+        {
+        _present = ( present_support[ i ] && families[ i ].queueCount > 0 ) ? i : NO_FAMILY;
+        }
+    if( _present == NO_FAMILY )
+        {
+        printf( "No queue family can present.\n" );
+        return false;
+        }
+    }
+
+/* Transfer on the copy engine if there is one, compute on an async
+family, apart from each other when the device allows */
+_transfer = find_dedicated( families, family_count, VK_QUEUE_TRANSFER_BIT, NO_FAMILY );
+_compute = find_dedicated( families, family_count, VK_QUEUE_COMPUTE_BIT, _transfer );
+_transfer = ( _transfer == NO_FAMILY ) ? _graphics : _transfer;
+_compute = ( _compute == NO_FAMILY ) ? _graphics : _compute;
+
+assign( families, _graphics, _used_counts, &plan->roles[ IVK_QUEUE_GRAPHICS ] );
+if( _present == _graphics )
+    {
+    /* The frame's submit and present go to the one queue */
+    plan->roles[ IVK_QUEUE_PRESENT ] = plan->roles[ IVK_QUEUE_GRAPHICS ];
+    }
+else
+    {
+    assign( families, _present, _used_counts, &plan->roles[ IVK_QUEUE_PRESENT ] );
+    }
+assign( families, _transfer, _used_counts, &plan->roles[ IVK_QUEUE_TRANSFER ] );
+assign( families, _compute, _used_counts, &plan->roles[ IVK_QUEUE_COMPUTE ] );
+
+/* One create info per family, with as many queues as were handed
+out in it */
+for( unsigned int i = 0; i < IVK_QUEUE_ROLE_COUNT; i++ )
+    {
+    _slot = &plan->roles[ i ];
+    _slot->is_dedicated = !( families[ _slot->family ].queueFlags & VK_QUEUE_GRAPHICS_BIT );
+    for( unsigned int j = 0; j < IVK_QUEUE_ROLE_COUNT; j++ )
+        {
+        _slot->is_shared |= ( j != i && plan->roles[ j ].family == _slot->family && plan->roles[ j ].index == _slot->index );
+        }
+
+    for( _family_idx = 0; _family_idx < plan->family_count; _family_idx++ )
+        {
+        if( plan->families[ _family_idx ] == _slot->family )
+            {
+            break;
+            }
+        }
+    if( _family_idx == plan->family_count )
+        {
+        plan->families[ plan->family_count++ ] = _slot->family;
+        }
+    if( plan->queue_counts[ _family_idx ] < _slot->index + 1 )
+        {
+        plan->queue_counts[ _family_idx ] = _slot->index + 1;
+        }
+    plan->priorities[ i ] = 1.0f;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Fills the device's queue create infos, one per family of
+ * the plan. Returns how many.
+ */
+uint32_t ivk_queue_get_create_infos
+    (
+    const IVK_queue_plan_type*  plan,
+    VkDeviceQueueCreateInfo*    create_infos
+    )
+{
+for( uint32_t i = 0; i < plan->family_count; i++ )
+    {
+    memset( &create_infos[ i ], 0, sizeof( create_infos[ i ] ) );
+    create_infos[ i ].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    create_infos[ i ].queueFamilyIndex = plan->families[ i ];
+    create_infos[ i ].queueCount = plan->queue_counts[ i ];
+    create_infos[ i ].pQueuePriorities = &plan->priorities[ 0 ];
+    }
+
+return plan->family_count;
+
+}
+
+
+/*
+ * Fetches the queue of each role from the new device
+ */
+void ivk_queue_resolve
+    (
+    VkDevice                    device,
+    IVK_queue_plan_type*        plan
+    )
+{
+for( unsigned int i = 0; i < IVK_QUEUE_ROLE_COUNT; i++ )
+    {
+    vkGetDeviceQueue( device, plan->roles[ i ].family, plan->roles[ i ].index, &plan->roles[ i ].queue );
+    }
+
+}
+
+
+/*
+ * Prints the roles, for the startup log
+ */
+void ivk_queue_print
+    (
+    const IVK_queue_plan_type*  plan
+    )
+{
+/* Local variables */
+const IVK_queue_slot_type*  _slot = NULL;
+
+printf( "Queues:" );
+for( unsigned int i = 0; i < IVK_QUEUE_ROLE_COUNT; i++ )
+    {
+    _slot = &plan->roles[ i ];
+    printf
+        (
+        " %s %u.%u%s%s",
+        s_role_names[ i ],
+        _slot->family,
+        _slot->index,
+        _slot->is_dedicated ? " dedicated" : "",
+        _slot->is_shared ? " shared" : ""
+        );
+    printf( ( i + 1 < IVK_QUEUE_ROLE_COUNT ) ? "," : "\n" );
+    }
+
+}
+
+
+/*
+ * Gives a role the next unused queue of a family, or the
+ * family's first one once they are all taken
+ */
+static void assign
+    (
+    const VkQueueFamilyProperties*  families,
+    uint32_t                        family,
+    uint32_t*                       used_counts,
+    IVK_queue_slot_type*            slot
+    )
+{
+slot->family = family;
+slot->index = 0;
+if( used_counts[ family ] < families[ family ].queueCount )
+    {
+    slot->index = used_counts[ family ]++;
+    }
+
+}
+
+
+/*
+ * Best family without graphics having the flags, the
+ * fewer other capabilities the better, and one other than
+ * avoid if possible. NO_FAMILY if there is none.
+ */
+static uint32_t find_dedicated
+    (
+    const VkQueueFamilyProperties*  families,
+    uint32_t                        family_count,
+    VkQueueFlags                    flags,
+    uint32_t                        avoid
+    )
+{
+/* Local variables */
+uint32_t    _family = NO_FAMILY;
+uint32_t    _score = 0;
+uint32_t    _best_score = 0;
+
+for( uint32_t i = 0; i < family_count; i++ )
+    {
+    /* Compute families can always transfer, the flag is optional */
+    if( ( families[ i ].queueFlags & VK_QUEUE_GRAPHICS_BIT ) || families[ i ].queueCount == 0 )
+        {
+        continue;
+        }
+    if( !( families[ i ].queueFlags & flags )
+     && !( flags == VK_QUEUE_TRANSFER_BIT && ( families[ i ].queueFlags & VK_QUEUE_COMPUTE_BIT ) ) )
+        {
+        continue;
+        }
+
+    _score = 10;
+    _score += ( flags == VK_QUEUE_TRANSFER_BIT && !( families[ i ].queueFlags & VK_QUEUE_COMPUTE_BIT ) ) ? 10 : 0;
+    _score += ( i != avoid ) ? 5 : 0;
+    _score += ( i == avoid && families[ i ].queueCount > 1 ) ? 2 : 0;
+    if( _score > _best_score )
+        {
+        _best_score = _score;
+        _family = i;
+        }
+    }
+
+return _family;
+
+}
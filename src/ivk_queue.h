@@ -0,0 +1,97 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+/*
+ * Upper bound on the queue families a device reports that
+ * the planner looks at
+ */
+#define IVK_QUEUE_MAX_FAMILIES          16
+
+/*
+ * Types
+ */
+typedef enum
+    {
+    IVK_QUEUE_GRAPHICS,
+    IVK_QUEUE_PRESENT,
+    IVK_QUEUE_TRANSFER,
+    IVK_QUEUE_COMPUTE,
+    IVK_QUEUE_ROLE_COUNT
+    } IVK_queue_role_type;
+
+/*
+ * Where a role submits. Roles may land on the same queue,
+ * which is then is_shared: submitting to it from two
+ * threads needs a lock.
+ */
+typedef struct
+    {
+    uint32_t            family;
+    uint32_t            index;              /* Within the family */
+    VkQueue             queue;              /* Once the device exists */
+    bool                is_dedicated;       /* Family without graphics */
+    bool                is_shared;          /* Queue of another role too */
+    } IVK_queue_slot_type;
+
+/*
+ * Queues to create and the role of each. Graphics and
+ * present share a family whenever one can do both, so the
+ * swapchain images need no concurrent sharing; transfer and
+ * compute take families of their own when there are some,
+ * else further queues of the graphics family, else its one
+ * queue.
+ */
+typedef struct
+    {
+    IVK_queue_slot_type roles[ IVK_QUEUE_ROLE_COUNT ];
+    uint32_t            family_count;       /* Families to create queues in */
+    uint32_t            families[ IVK_QUEUE_ROLE_COUNT ];
+    uint32_t            queue_counts[ IVK_QUEUE_ROLE_COUNT ];
+                                            /* Of each of families */
+    float               priorities[ IVK_QUEUE_ROLE_COUNT ];
+                                            /* Shared by the create infos */
+    } IVK_queue_plan_type;
+
+
+/*
+ * Scores the queue families and assigns the roles.
+ * present_support holds a flag per family, NULL when
+ * nothing is presented. False if no family can render, or
+ * none can present.
+ */
+bool ivk_queue_plan
+    (
+    const VkQueueFamilyProperties*  families,
+    uint32_t                        family_count,
+    const VkBool32*                 present_support,
+    IVK_queue_plan_type*            plan
+    );
+
+/*
+ * Fills the device's queue create infos, one per family of
+ * the plan. Returns how many.
+ */
+uint32_t ivk_queue_get_create_infos
+    (
+    const IVK_queue_plan_type*  plan,
+    VkDeviceQueueCreateInfo*    create_infos
+    );
+
+/*
+ * Fetches the queue of each role from the new device
+ */
+void ivk_queue_resolve
+    (
+    VkDevice                    device,
+    IVK_queue_plan_type*        plan
+    );
+
+/*
+ * Prints the roles, for the startup log
+ */
+void ivk_queue_print
+    (
+    const IVK_queue_plan_type*  plan
+    );
@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ivk_readback.h"
+#include "ivk_buffers.h"
+#include "ivk_memory.h"
+#include "ivk_util.h"
+
+/*** Static functions ***/
+/*
+ * Returns the size of a pixel in bytes, 0 if the format
+ * is not supported by the readback.
+ */
+static unsigned int get_pixel_size
+    (
+    VkFormat    format
+    );
+
+/*
+ * (Re)creates the host buffer of a slot. Cached memory is
+ * preferred, as the CPU reads every byte of it.
+ */
+static bool create_slot_buffer
+    (
+    VkDevice                device,
+    VkPhysicalDevice        gpu,
+    VkDeviceSize            size,
+    IVK_readback_slot_type* slot
+    );
+
+/*
+ * Creates the buffer of a slot over its block of host
+ * memory. Returns false if the device cannot import it.
+ */
+static bool import_slot_buffer
+    (
+    IVK_readback_type*      readback,
+    VkDevice                device,
+    VkPhysicalDevice        gpu,
+    unsigned int            slot_index
+    );
+
+/*
+ * Destroys the host buffer of a slot
+ */
+static void destroy_slot_buffer
+    (
+    VkDevice                device,
+    IVK_readback_slot_type* slot
+    );
+
+
+/*
+ * Sets up a readback ring of slot_count slots. The buffers
+ * are allocated on first use, sized to the frames copied.
+ * Returns false if the format cannot be read back.
+ */
+bool ivk_readback_create
+    (
+    unsigned int                slot_count,
+    VkFormat                    format,
+    IVK_readback_callback_type  callback,
+    void*                       user_data,
+    IVK_readback_type*          readback
+    )
+{
+memset( readback, 0, sizeof( *readback ) );
+
+readback->pixel_size = get_pixel_size( format );
+if( readback->pixel_size == 0 )
+    {
+    printf( "Readback of format %d not supported.\n", ( int )format );
+    return false;
+    }
+
+if( slot_count < 1 )
+    {
+    slot_count = 1;
+    }
+else if( slot_count > IVK_READBACK_MAX_SLOTS )
+    {
+    slot_count = IVK_READBACK_MAX_SLOTS;
+    }
+
+readback->slot_count = slot_count;
+readback->format = format;
+readback->callback = callback;
+readback->user_data = user_data;
+
+return true;
+
+}
+
+
+/*
+ * Copies straight into host memory owned by the caller,
+ * e.g. shared with another process, rather than into
+ * memory of its own. Needs VK_EXT_external_memory_host.
+ * Each block is size bytes, a multiple of the import
+ * alignment, and slot i always lands in block i. Frames
+ * are dropped while reserve says the next block is in use.
+ */
+void ivk_readback_import_host_memory
+    (
+    IVK_readback_type*                  readback,
+    PFN_vkGetMemoryHostPointerPropertiesEXT
+                                        get_host_pointer_properties,
+    void* const*                        host_memory,
+    VkDeviceSize                        size,
+    IVK_readback_reserve_callback_type  reserve,
+    void*                               user_data
+    )
+{
+for( unsigned int i = 0; i < readback->slot_count; i++ )
+    {
+    readback->host_memory[ i ] = host_memory[ i ];
+    }
+
+readback->host_memory_size = size;
+readback->get_host_pointer_properties = get_host_pointer_properties;
+readback->reserve = reserve;
+readback->reserve_user_data = user_data;
+
+}
+
+
+/*
+ * Destroys the readback buffers. The frames still in
+ * flight must have completed.
+ */
+void ivk_readback_destroy
+    (
+    VkDevice            device,
+    IVK_readback_type*  readback
+    )
+{
+for( unsigned int i = 0; i < readback->slot_count; i++ )
+    {
+    destroy_slot_buffer( device, &readback->slots[ i ] );
+    }
+
+readback->slot_count = 0;
+readback->busy_count = 0;
+
+}
+
+
+/*
+ * Records the copy of a color target into the next free
+ * slot, through funcs. image_state holds the last access to
+ * the image; the barriers go through the batch, which is
+ * flushed before the copy. The image is left in the copy
+ * layout, and the barrier making the copy visible to the
+ * host is left in the batch, for the caller to flush with
+ * its own. Returns false if every slot is busy and the
+ * frame was dropped.
+ */
+bool ivk_readback_record
+    (
+    const IVK_device_funcs_type*
+                        funcs,
+    IVK_readback_type*  readback,
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    VkCommandBuffer     command_buffer,
+    IVK_barrier_batch_type*
+                        barriers,
+    VkImage             image,
+    IVK_barrier_state_type*
+                        image_state,
+    VkExtent2D          extent,
+    uint64_t            frame_value
+    )
+{
+/* Local variables */
+IVK_readback_slot_type* _slot = NULL;
+unsigned int            _slot_index = 0;
+VkDeviceSize            _size = 0;
+bool                    _is_created = false;
+IVK_barrier_state_type  _buffer_state;
+VkBufferImageCopy       _region = { 0 };
+
+/* Never wait for a slot, the render loop must not stall on the CPU
+side falling behind */
+if( readback->slot_count == 0 || readback->busy_count == readback->slot_count ||
+    ( readback->reserve && !readback->reserve( readback->busy_count, readback->reserve_user_data ) ) )
+    {
+    readback->dropped_count++;
+    return false;
+    }
+
+_slot_index = ( readback->head + readback->busy_count ) % readback->slot_count;
+_slot = &readback->slots[ _slot_index ];
+
+/* Only grows on a resize. The slot is free, so the GPU is done with
+the old buffer. Imported memory cannot grow, the frame is dropped. */
+_size = ( VkDeviceSize )extent.width * extent.height * readback->pixel_size;
+
+/* Slot i publishes into ring block i. A frame too big for the block
+is dropped here, whether or not the slot imported it, so it never
+lands in memory of its own and then in another block. */
+if( readback->reserve && _size > readback->host_memory_size )
+    {
+    readback->dropped_count++;
+    return false;
+    }
+
+if( _slot->capacity < _size )
+    {
+    destroy_slot_buffer( device, _slot );
+    if( readback->host_memory[ _slot_index ] && _size <= readback->host_memory_size )
+        {
+        _is_created = import_slot_buffer( readback, device, gpu, _slot_index );
+        }
+    if( !_is_created && !readback->host_memory[ _slot_index ] )
+        {
+        _is_created = create_slot_buffer( device, gpu, _size, _slot );
+        }
+    if( !_is_created )
+        {
+        readback->dropped_count++;
+        return false;
+        }
+    }
+
+/* Move to the copy layout, unless the image already came to it with
+the end of the pass. The slot is free, so the host is done reading its
+buffer; only the copy's write is left to order. */
+ivk_barrier_image
+    (
+    barriers,
+    image,
+    VK_IMAGE_ASPECT_COLOR_BIT,
+    VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+    VK_ACCESS_2_TRANSFER_READ_BIT,
+    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    image_state
+    );
+ivk_barrier_reset( VK_PIPELINE_STAGE_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, &_buffer_state );
+ivk_barrier_buffer( barriers, _slot->buffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, &_buffer_state );
+ivk_barrier_flush( barriers );
+
+_region.bufferOffset = 0;
+_region.bufferRowLength = 0;    /* Tightly packed */
+_region.bufferImageHeight = 0;
+_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+_region.imageSubresource.mipLevel = 0;
+_region.imageSubresource.baseArrayLayer = 0;
+_region.imageSubresource.layerCount = 1;
+_region.imageExtent.width = extent.width;
+_region.imageExtent.height = extent.height;
+_region.imageExtent.depth = 1;
+
+funcs->vkCmdCopyImageToBuffer( command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _slot->buffer, 1, &_region );
+
+/* Make the copy visible to the host once the frame completes, along
+with whatever the caller flushes next */
+ivk_barrier_buffer( barriers, _slot->buffer, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, &_buffer_state );
+
+_slot->extent = extent;
+_slot->frame_value = frame_value;
+readback->busy_count++;
+
+return true;
+
+}
+
+
+/*
+ * Hands the slots whose frames have reached completed_value
+ * to the callback, oldest first. Never blocks.
+ */
+void ivk_readback_poll
+    (
+    const IVK_device_funcs_type*
+                        funcs,
+    IVK_readback_type*  readback,
+    VkDevice            device,
+    uint64_t            completed_value
+    )
+{
+/* Local variables */
+IVK_readback_slot_type* _slot = NULL;
+IVK_readback_frame_type _frame = { 0 };
+VkMappedMemoryRange     _range = { 0 };
+
+while( readback->busy_count > 0 )
+    {
+    _slot = &readback->slots[ readback->head ];
+    if( _slot->frame_value > completed_value )
+        {
+        break;
+        }
+
+    /* Cached memory is not coherent on every device */
+    if( !_slot->is_coherent )
+        {
+        _range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        _range.memory = _slot->memory;
+        _range.offset = 0;
+        _range.size = VK_WHOLE_SIZE;
+        __vk( funcs->vkInvalidateMappedMemoryRanges( device, 1, &_range ) );
+        }
+
+    _frame.frame_number = _slot->frame_value;
+    _frame.width = _slot->extent.width;
+    _frame.height = _slot->extent.height;
+    _frame.row_pitch = _slot->extent.width * readback->pixel_size;
+    _frame.format = readback->format;
+    _frame.pixels = _slot->mapped;
+    _frame.size = ( size_t )_frame.row_pitch * _frame.height;
+    if( readback->callback )
+        {
+        readback->callback( &_frame, readback->user_data );
+        }
+
+    readback->head = ( readback->head + 1 ) % readback->slot_count;
+    readback->busy_count--;
+    readback->delivered_count++;
+    }
+
+}
+
+
+/*
+ * Returns the size of a pixel in bytes, 0 if the format
+ * is not supported by the readback.
+ */
+static unsigned int get_pixel_size
+    (
+    VkFormat    format
+    )
+{
+switch( format )
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        return 4;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    default:
+        return 0;
+    }
+
+}
+
+
+/*
+ * (Re)creates the host buffer of a slot. Cached memory is
+ * preferred, as the CPU reads every byte of it.
+ */
+static bool create_slot_buffer
+    (
+    VkDevice                device,
+    VkPhysicalDevice        gpu,
+    VkDeviceSize            size,
+    IVK_readback_slot_type* slot
+    )
+{
+/* Local variables */
+VkBufferCreateInfo                  _buffer_create_info = { 0 };
+VkMemoryRequirements                _mem_requirements = { 0 };
+VkMemoryAllocateInfo                _alloc_info = { 0 };
+VkPhysicalDeviceMemoryProperties    _mem_properties = { 0 };
+unsigned int                        _memory_type = 0;
+
+_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+_buffer_create_info.size = size;
+_buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+__vk( vkCreateBuffer( device, &_buffer_create_info, g_ivk_host_allocator, &slot->buffer ) );
+
+vkGetBufferMemoryRequirements( device, slot->buffer, &_mem_requirements );
+
+/* Uncached reads are many times slower, fall back to them only if
+there is no choice */
+_memory_type = ivk_buffer_find_memory_type
+    (
+    gpu,
+    _mem_requirements.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+    );
+if( _memory_type == UINT32_MAX )
+    {
+    _memory_type = ivk_buffer_find_memory_type
+        (
+        gpu,
+        _mem_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        );
+    }
+if( _memory_type == UINT32_MAX )
+    {
+    printf( "No host visible memory for the readback.\n" );
+    vkDestroyBuffer( device, slot->buffer, g_ivk_host_allocator );
+    slot->buffer = VK_NULL_HANDLE;
+    return false;
+    }
+
+vkGetPhysicalDeviceMemoryProperties( gpu, &_mem_properties );
+slot->is_coherent = ( _mem_properties.memoryTypes[ _memory_type ].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) != 0;
+
+_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+_alloc_info.allocationSize = _mem_requirements.size;
+_alloc_info.memoryTypeIndex = _memory_type;
+__vk( vkAllocateMemory( device, &_alloc_info, g_ivk_host_allocator, &slot->memory ) );
+__vk( vkBindBufferMemory( device, slot->buffer, slot->memory, 0 ) );
+
+/* Mapped once for the lifetime of the buffer */
+__vk( vkMapMemory( device, slot->memory, 0, VK_WHOLE_SIZE, 0, &slot->mapped ) );
+slot->capacity = size;
+
+return true;
+
+}
+
+
+/*
+ * Creates the buffer of a slot over its block of host
+ * memory. Returns false if the device cannot import it.
+ */
+static bool import_slot_buffer
+    (
+    IVK_readback_type*      readback,
+    VkDevice                device,
+    VkPhysicalDevice        gpu,
+    unsigned int            slot_index
+    )
+{
+/* Local variables */
+IVK_readback_slot_type*             _slot = &readback->slots[ slot_index ];
+void*                               _host_memory = readback->host_memory[ slot_index ];
+VkExternalMemoryBufferCreateInfo    _external_info = { 0 };
+VkBufferCreateInfo                  _buffer_create_info = { 0 };
+VkMemoryRequirements                _mem_requirements = { 0 };
+VkMemoryHostPointerPropertiesEXT    _pointer_properties = { 0 };
+VkImportMemoryHostPointerInfoEXT    _import_info = { 0 };
+VkMemoryAllocateInfo                _alloc_info = { 0 };
+unsigned int                        _memory_type = UINT32_MAX;
+
+_external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+_external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+_buffer_create_info.pNext = &_external_info;
+_buffer_create_info.size = readback->host_memory_size;
+_buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+__vk( vkCreateBuffer( device, &_buffer_create_info, g_ivk_host_allocator, &_slot->buffer ) );
+
+vkGetBufferMemoryRequirements( device, _slot->buffer, &_mem_requirements );
+
+/* The host memory is read by the CPU as is, without a map to
+invalidate, so it has to be coherent */
+_pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+if( readback->get_host_pointer_properties
+        (
+        device,
+        VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        _host_memory,
+        &_pointer_properties
+        ) == VK_SUCCESS )
+    {
+    _memory_type = ivk_buffer_find_memory_type
+        (
+        gpu,
+        _mem_requirements.memoryTypeBits & _pointer_properties.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        );
+    }
+
+_import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+_import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+_import_info.pHostPointer = _host_memory;
+
+_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+_alloc_info.pNext = &_import_info;
+_alloc_info.allocationSize = readback->host_memory_size;
+_alloc_info.memoryTypeIndex = _memory_type;
+
+if( _memory_type == UINT32_MAX ||
+    _mem_requirements.size > readback->host_memory_size ||
+    vkAllocateMemory( device, &_alloc_info, g_ivk_host_allocator, &_slot->memory ) != VK_SUCCESS )
+    {
+    /* This slot copies through memory of its own from now on, and the
+    callback copies on into its block. The other slots keep their
+    imports, each slot still lands in its own block. */
+    printf( "Host memory import failed for slot %u, it allocates its own.\n", slot_index );
+    vkDestroyBuffer( device, _slot->buffer, g_ivk_host_allocator );
+    _slot->buffer = VK_NULL_HANDLE;
+    _slot->memory = VK_NULL_HANDLE;
+    readback->host_memory[ slot_index ] = NULL;
+    return create_slot_buffer( device, gpu, readback->host_memory_size, _slot );
+    }
+__vk( vkBindBufferMemory( device, _slot->buffer, _slot->memory, 0 ) );
+
+_slot->mapped = _host_memory;
+_slot->capacity = readback->host_memory_size;
+_slot->is_coherent = true;
+_slot->is_imported = true;
+
+return true;
+
+}
+
+
+/*
+ * Destroys the host buffer of a slot
+ */
+static void destroy_slot_buffer
+    (
+    VkDevice                device,
+    IVK_readback_slot_type* slot
+    )
+{
+if( slot->buffer == VK_NULL_HANDLE )
+    {
+    return;
+    }
+
+if( !slot->is_imported )
+    {
+    vkUnmapMemory( device, slot->memory );
+    }
+vkDestroyBuffer( device, slot->buffer, g_ivk_host_allocator );
+vkFreeMemory( device, slot->memory, g_ivk_host_allocator );
+
+slot->buffer = VK_NULL_HANDLE;
+slot->memory = VK_NULL_HANDLE;
+slot->mapped = NULL;
+slot->capacity = 0;
+slot->is_imported = false;
+
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+#include "ivk_barrier.h"
+#include "ivk_dispatch.h"
+
+/*
+ * Maximum number of frames the readback can have in flight
+ */
+#define IVK_READBACK_MAX_SLOTS          8
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    uint64_t            frame_number;       /* Timeline value of the frame */
+    unsigned int        width;
+    unsigned int        height;
+    unsigned int        row_pitch;          /* Bytes per row, rows are tightly packed */
+    VkFormat            format;
+    const void*         pixels;             /* Only valid during the callback */
+    size_t              size;
+    } IVK_readback_frame_type;
+
+typedef void ( *IVK_readback_callback_type )
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    );
+
+/*
+ * Asked before a frame is recorded into imported host
+ * memory, with the number of frames already in flight.
+ * Returns false while the owner of the memory still uses
+ * the next slot.
+ */
+typedef bool ( *IVK_readback_reserve_callback_type )
+    (
+    unsigned int    busy_count,
+    void*           user_data
+    );
+
+typedef struct
+    {
+    VkBuffer            buffer;
+    VkDeviceMemory      memory;
+    void*               mapped;             /* Persistently mapped */
+    VkDeviceSize        capacity;
+    bool                is_coherent;
+    bool                is_imported;        /* Memory belongs to the host */
+    VkExtent2D          extent;             /* Of the frame being copied */
+    uint64_t            frame_value;
+    } IVK_readback_slot_type;
+
+/*
+ * A ring of host buffers the color targets are copied into.
+ * Slots are filled in submission order and handed back to
+ * the callback once the frame timeline passes their value.
+ * When all of them are busy the frame is dropped rather
+ * than waiting on the GPU.
+ */
+typedef struct
+    {
+    IVK_readback_slot_type
+                        slots[ IVK_READBACK_MAX_SLOTS ];
+    unsigned int        slot_count;
+    unsigned int        head;               /* Oldest busy slot */
+    unsigned int        busy_count;
+    VkFormat            format;
+    unsigned int        pixel_size;
+    IVK_readback_callback_type
+                        callback;
+    void*               user_data;
+    unsigned int        delivered_count;
+    unsigned int        dropped_count;
+
+    /* Host memory the slots are bound to, one block per slot,
+    with VK_EXT_external_memory_host. NULL to allocate. */
+    void*               host_memory[ IVK_READBACK_MAX_SLOTS ];
+    VkDeviceSize        host_memory_size;
+    PFN_vkGetMemoryHostPointerPropertiesEXT
+                        get_host_pointer_properties;
+    IVK_readback_reserve_callback_type
+                        reserve;
+    void*               reserve_user_data;
+    } IVK_readback_type;
+
+
+/*
+ * Sets up a readback ring of slot_count slots. The buffers
+ * are allocated on first use, sized to the frames copied.
+ * Returns false if the format cannot be read back.
+ */
+bool ivk_readback_create
+    (
+    unsigned int                slot_count,
+    VkFormat                    format,
+    IVK_readback_callback_type  callback,
+    void*                       user_data,
+    IVK_readback_type*          readback
+    );
+
+/*
+ * Copies straight into host memory owned by the caller,
+ * e.g. shared with another process, rather than into
+ * memory of its own. Needs VK_EXT_external_memory_host.
+ * Each block is size bytes, a multiple of the import
+ * alignment, and slot i always lands in block i. Frames
+ * are dropped while reserve says the next block is in use.
+ */
+void ivk_readback_import_host_memory
+    (
+    IVK_readback_type*                  readback,
+    PFN_vkGetMemoryHostPointerPropertiesEXT
+                                        get_host_pointer_properties,
+    void* const*                        host_memory,
+    VkDeviceSize                        size,
+    IVK_readback_reserve_callback_type  reserve,
+    void*                               user_data
+    );
+
+/*
+ * Destroys the readback buffers. The frames still in
+ * flight must have completed.
+ */
+void ivk_readback_destroy
+    (
+    VkDevice            device,
+    IVK_readback_type*  readback
+    );
+
+/*
+ * Records the copy of a color target into the next free
+ * slot, through funcs. image_state holds the last access to
+ * the image; the barriers go through the batch, which is
+ * flushed before the copy. The image is left in the copy
+ * layout, and the barrier making the copy visible to the
+ * host is left in the batch, for the caller to flush with
+ * its own. Returns false if every slot is busy and the
+ * frame was dropped.
+ */
+bool ivk_readback_record
+    (
+    const IVK_device_funcs_type*
+                        funcs,
+    IVK_readback_type*  readback,
+    VkDevice            device,
+    VkPhysicalDevice    gpu,
+    VkCommandBuffer     command_buffer,
+    IVK_barrier_batch_type*
+                        barriers,
+    VkImage             image,
+    IVK_barrier_state_type*
+                        image_state,
+    VkExtent2D          extent,
+    uint64_t            frame_value
+    );
+
+/*
+ * Hands the slots whose frames have reached completed_value
+ * to the callback, oldest first. Never blocks.
+ */
+void ivk_readback_poll
+    (
+    const IVK_device_funcs_type*
+                        funcs,
+    IVK_readback_type*  readback,
+    VkDevice            device,
+    uint64_t            completed_value
+    );
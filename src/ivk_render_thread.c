@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_render_thread.h"
+#include "ivk_atomic.h"
+#include "ivk_trace.h"
+
+/*** Static functions ***/
+/*
+ * Render thread, renders the newest snapshot until stopped
+ */
+static void render_main
+    (
+    void*   arg
+    );
+
+/*
+ * Frees the snapshots
+ */
+static void free_snapshots
+    (
+    IVK_render_thread_type* render_thread
+    );
+
+
+/*
+ * Starts rendering context from a new thread. Each snapshot
+ * starts with room for capacity draws.
+ */
+bool ivk_render_thread_start
+    (
+    IVK_Context*            context,
+    uint32_t                capacity,
+    IVK_render_thread_type* render_thread
+    )
+{
+memset( render_thread, 0, sizeof( *render_thread ) );
+render_thread->context = context;
+
+for( unsigned int i = 0; i < IVK_RENDER_THREAD_SLOTS; i++ )
+    {
+    render_thread->snapshots[ i ].draws = ( IVK_draw_type* )calloc( capacity, sizeof( IVK_draw_type ) );
+    if( !render_thread->snapshots[ i ].draws )
+        {
+        printf( "Failed to allocate the render thread snapshots.\n" );
+        free_snapshots( render_thread );
+        return false;
+        }
+    render_thread->snapshots[ i ].capacity = capacity;
+    }
+
+/* Nothing is fresh yet, the render thread sleeps until the first
+publish */
+render_thread->back = 0;
+render_thread->front = 1;
+render_thread->ready = 2;
+
+ivk_mutex_init( &render_thread->lock );
+ivk_cond_init( &render_thread->published );
+ivk_cond_init( &render_thread->taken );
+
+/* The main thread keeps the window events from here, and the context
+has to give up waiting on them once asked to stop */
+context->is_event_thread = false;
+context->stop_request = &render_thread->is_stopping;
+if( !ivk_thread_create( &render_thread->thread, render_main, render_thread ) )
+    {
+    printf( "Failed to start the render thread.\n" );
+    context->is_event_thread = true;
+    context->stop_request = NULL;
+    ivk_cond_destroy( &render_thread->taken );
+    ivk_cond_destroy( &render_thread->published );
+    ivk_mutex_destroy( &render_thread->lock );
+    free_snapshots( render_thread );
+    return false;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Renders the last snapshot still pending, then stops the
+ * thread and waits for the GPU. The context is the
+ * caller's again afterwards.
+ */
+void ivk_render_thread_stop
+    (
+    IVK_render_thread_type* render_thread
+    )
+{
+IVK_ATOMIC_STORE( &render_thread->is_stopping, 1 );
+ivk_mutex_lock( &render_thread->lock );
+ivk_cond_signal( &render_thread->published );
+ivk_mutex_unlock( &render_thread->lock );
+ivk_thread_join( &render_thread->thread );
+
+ivk_wait_idle( render_thread->context );
+render_thread->context->is_event_thread = true;
+render_thread->context->stop_request = NULL;
+
+ivk_cond_destroy( &render_thread->taken );
+ivk_cond_destroy( &render_thread->published );
+ivk_mutex_destroy( &render_thread->lock );
+free_snapshots( render_thread );
+
+}
+
+
+/*
+ * Returns room for draw_count draws to fill in for the next
+ * snapshot, NULL if it could not grow. Application thread.
+ */
+IVK_draw_type* ivk_render_thread_begin
+    (
+    IVK_render_thread_type* render_thread,
+    uint32_t                draw_count
+    )
+{
+/* Local variables */
+IVK_render_snapshot_type*   _snapshot = &render_thread->snapshots[ render_thread->back ];
+IVK_draw_type*              _draws = NULL;
+uint32_t                    _capacity = 0;
+
+/* The back slot is the application's alone, it can grow in place */
+if( draw_count > _snapshot->capacity )
+    {
+    _capacity = ( _snapshot->capacity * 2 > draw_count ) ? _snapshot->capacity * 2 : draw_count;
+    _draws = ( IVK_draw_type* )realloc( _snapshot->draws, _capacity * sizeof( IVK_draw_type ) );
+    if( !_draws )
+        {
+        printf( "Failed to grow a snapshot to %u draws.\n", draw_count );
+        return NULL;
+        }
+    _snapshot->draws = _draws;
+    _snapshot->capacity = _capacity;
+    }
+_snapshot->draw_count = draw_count;
+
+return _snapshot->draws;
+
+}
+
+
+/*
+ * Hands the snapshot filled in since ivk_render_thread_begin
+ * over to the render thread. Application thread.
+ */
+void ivk_render_thread_publish
+    (
+    IVK_render_thread_type* render_thread
+    )
+{
+/* Local variables */
+uint32_t    _previous = 0;
+
+/* The slot taken back is either the one the render thread let go,
+or a snapshot it never got to, which is simply overwritten */
+_previous = IVK_ATOMIC_EXCHANGE_U32( &render_thread->ready, render_thread->back | IVK_RENDER_THREAD_FRESH );
+render_thread->back = _previous & IVK_RENDER_THREAD_SLOT_MASK;
+render_thread->published_count++;
+
+/* Only a sleeping render thread costs a lock */
+if( IVK_ATOMIC_LOAD( &render_thread->is_idle ) )
+    {
+    ivk_mutex_lock( &render_thread->lock );
+    ivk_cond_signal( &render_thread->published );
+    ivk_mutex_unlock( &render_thread->lock );
+    }
+
+}
+
+
+/*
+ * Waits up to timeout_ms for the render thread to take the
+ * snapshot published last. Returns false if it is still
+ * pending. Application thread.
+ */
+bool ivk_render_thread_wait
+    (
+    IVK_render_thread_type* render_thread,
+    unsigned int            timeout_ms
+    )
+{
+/* Local variables */
+bool    _is_taken = false;
+
+if( !( IVK_ATOMIC_LOAD( &render_thread->ready ) & IVK_RENDER_THREAD_FRESH ) )
+    {
+    return true;
+    }
+
+/* Same handshake as the render thread's sleep, the other way round */
+ivk_mutex_lock( &render_thread->lock );
+IVK_ATOMIC_EXCHANGE_U32( &render_thread->is_waiting, 1 );
+while( IVK_ATOMIC_LOAD( &render_thread->ready ) & IVK_RENDER_THREAD_FRESH )
+    {
+    if( !ivk_cond_wait_ms( &render_thread->taken, &render_thread->lock, timeout_ms ) )
+        {
+        break;
+        }
+    }
+IVK_ATOMIC_STORE( &render_thread->is_waiting, 0 );
+_is_taken = !( IVK_ATOMIC_LOAD( &render_thread->ready ) & IVK_RENDER_THREAD_FRESH );
+ivk_mutex_unlock( &render_thread->lock );
+
+return _is_taken;
+
+}
+
+
+/*
+ * Render thread, renders the newest snapshot until stopped
+ */
+static void render_main
+    (
+    void*   arg
+    )
+{
+/* Local variables */
+IVK_render_thread_type*     _render_thread = ( IVK_render_thread_type* )arg;
+IVK_render_snapshot_type*   _snapshot = NULL;
+
+ivk_trace_set_thread_name( "render" );
+
+for( ;; )
+    {
+    if( IVK_ATOMIC_LOAD( &_render_thread->ready ) & IVK_RENDER_THREAD_FRESH )
+        {
+        _render_thread->front = IVK_ATOMIC_EXCHANGE_U32( &_render_thread->ready, _render_thread->front ) & IVK_RENDER_THREAD_SLOT_MASK;
+        _snapshot = &_render_thread->snapshots[ _render_thread->front ];
+
+        /* Only a waiting application costs a lock */
+        if( IVK_ATOMIC_LOAD( &_render_thread->is_waiting ) )
+            {
+            ivk_mutex_lock( &_render_thread->lock );
+            ivk_cond_signal( &_render_thread->taken );
+            ivk_mutex_unlock( &_render_thread->lock );
+            }
+        ivk_render( _render_thread->context, _snapshot->draws, _snapshot->draw_count );
+        IVK_ATOMIC_STORE( &_render_thread->rendered_count, _render_thread->rendered_count + 1 );
+        continue;
+        }
+
+    /* Stopping only once nothing is pending, the last snapshot is
+    always rendered */
+    if( IVK_ATOMIC_LOAD( &_render_thread->is_stopping ) )
+        {
+        break;
+        }
+
+    /* The exchange orders the flag before the check of ready, against
+    the publish that orders them the other way round */
+    IVK_TRACE_BEGIN( "wait for snapshot" );
+    ivk_mutex_lock( &_render_thread->lock );
+    IVK_ATOMIC_EXCHANGE_U32( &_render_thread->is_idle, 1 );
+    while( !( IVK_ATOMIC_LOAD( &_render_thread->ready ) & IVK_RENDER_THREAD_FRESH )
+        && !IVK_ATOMIC_LOAD( &_render_thread->is_stopping ) )
+        {
+        ivk_cond_wait( &_render_thread->published, &_render_thread->lock );
+        }
+    IVK_ATOMIC_STORE( &_render_thread->is_idle, 0 );
+    ivk_mutex_unlock( &_render_thread->lock );
+    IVK_TRACE_END( "wait for snapshot" );
+    }
+
+}
+
+
+/*
+ * Frees the snapshots
+ */
+static void free_snapshots
+    (
+    IVK_render_thread_type* render_thread
+    )
+{
+for( unsigned int i = 0; i < IVK_RENDER_THREAD_SLOTS; i++ )
+    {
+    free( render_thread->snapshots[ i ].draws );
+    render_thread->snapshots[ i ].draws = NULL;
+    render_thread->snapshots[ i ].capacity = 0;
+    }
+
+}
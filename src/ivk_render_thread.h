@@ -0,0 +1,116 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ivk.h"
+#include "ivk_draw.h"
+#include "ivk_thread.h"
+
+/*
+ * Draw lists in flight between the application and the
+ * render thread: one being written, one being rendered and
+ * the latest one published in between
+ */
+#define IVK_RENDER_THREAD_SLOTS         3
+
+/*
+ * Set in IVK_render_thread_type::ready until the render
+ * thread takes the published slot
+ */
+#define IVK_RENDER_THREAD_FRESH         0x80000000u
+#define IVK_RENDER_THREAD_SLOT_MASK     0x3u
+
+/*
+ * Types
+ */
+typedef struct
+    {
+    IVK_draw_type*      draws;
+    uint32_t            draw_count;
+    uint32_t            capacity;           /* Draws */
+    } IVK_render_snapshot_type;
+
+/*
+ * Renders from its own thread the draw lists the
+ * application publishes. The hand-over is a triple buffer,
+ * the render thread never waits on the application:
+ * publishing replaces a snapshot the render thread has not
+ * taken yet, and the render thread always takes the newest
+ * one. The application may wait for its snapshot to be
+ * taken, to publish no faster than frames are rendered.
+ *
+ * The render thread owns the context while it runs, the
+ * application must not call into it until the thread is
+ * stopped. Meshes and materials are set up before.
+ */
+typedef struct
+    {
+    IVK_Context*        context;
+    IVK_thread_type     thread;
+    IVK_render_snapshot_type
+                        snapshots[ IVK_RENDER_THREAD_SLOTS ];
+    volatile uint32_t   ready;              /* Slot published last, with
+                                               IVK_RENDER_THREAD_FRESH */
+    uint32_t            back;               /* Slot the application writes */
+    uint32_t            front;              /* Slot the render thread reads */
+    volatile uint32_t   is_stopping;
+    volatile uint32_t   is_idle;            /* Render thread asleep on published */
+    IVK_mutex_type      lock;               /* Only guards the sleep */
+    IVK_cond_type       published;
+    volatile uint32_t   is_waiting;         /* Application asleep on taken */
+    IVK_cond_type       taken;
+    uint64_t            published_count;    /* Application side */
+    volatile uint64_t   rendered_count;     /* Snapshots rendered */
+    } IVK_render_thread_type;
+
+
+/*
+ * Starts rendering context from a new thread. Each snapshot
+ * starts with room for capacity draws.
+ */
+bool ivk_render_thread_start
+    (
+    IVK_Context*            context,
+    uint32_t                capacity,
+    IVK_render_thread_type* render_thread
+    );
+
+/*
+ * Renders the last snapshot still pending, then stops the
+ * thread and waits for the GPU. The context is the
+ * caller's again afterwards.
+ */
+void ivk_render_thread_stop
+    (
+    IVK_render_thread_type* render_thread
+    );
+
+/*
+ * Returns room for draw_count draws to fill in for the next
+ * snapshot, NULL if it could not grow. Application thread.
+ */
+IVK_draw_type* ivk_render_thread_begin
+    (
+    IVK_render_thread_type* render_thread,
+    uint32_t                draw_count
+    );
+
+/*
+ * Hands the snapshot filled in since ivk_render_thread_begin
+ * over to the render thread. Application thread.
+ */
+void ivk_render_thread_publish
+    (
+    IVK_render_thread_type* render_thread
+    );
+
+/*
+ * Waits up to timeout_ms for the render thread to take the
+ * snapshot published last. Returns false if it is still
+ * pending. Application thread.
+ */
+bool ivk_render_thread_wait
+    (
+    IVK_render_thread_type* render_thread,
+    unsigned int            timeout_ms
+    );
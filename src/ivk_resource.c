@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_resource.h"
+#include "ivk_memory.h"
+
+/*** Static functions ***/
+/*
+ * Builds the handle of a slot
+ */
+static IVK_handle_type make_handle
+    (
+    const IVK_slot_map_type*    map,
+    uint32_t                    slot
+    );
+
+
+/*
+ * Allocates the slots of a map, all free
+ */
+bool ivk_slot_map_create
+    (
+    uint32_t            capacity,
+    IVK_slot_map_type*  map
+    )
+{
+memset( map, 0, sizeof( *map ) );
+
+if( capacity == 0 || capacity > IVK_HANDLE_MAX_SLOTS )
+    {
+    printf( "Slot map capacity %u out of range.\n", capacity );
+    return false;
+    }
+
+map->generations = ( uint16_t* )calloc( capacity, sizeof( uint16_t ) );
+map->slot_dense = ( uint32_t* )calloc( capacity, sizeof( uint32_t ) );
+map->dense_slot = ( uint32_t* )calloc( capacity, sizeof( uint32_t ) );
+if( !map->generations || !map->slot_dense || !map->dense_slot )
+    {
+    printf( "Failed to allocate the slot map.\n" );
+    ivk_slot_map_destroy( map );
+    return false;
+    }
+
+/* Every slot free, chained in order, all at generation 1 */
+for( uint32_t i = 0; i < capacity; i++ )
+    {
+    map->generations[ i ] = 1;
+    map->slot_dense[ i ] = i + 1;
+    }
+map->capacity = capacity;
+map->free_head = 0;
+
+return true;
+
+}
+
+
+/*
+ * Frees the slots of a map
+ */
+void ivk_slot_map_destroy
+    (
+    IVK_slot_map_type*  map
+    )
+{
+free( map->generations );
+free( map->slot_dense );
+free( map->dense_slot );
+memset( map, 0, sizeof( *map ) );
+
+}
+
+
+/*
+ * Takes a free slot. Its packed index is the old count.
+ * IVK_INVALID_HANDLE if the map is full.
+ */
+IVK_handle_type ivk_slot_map_insert
+    (
+    IVK_slot_map_type*  map
+    )
+{
+/* Local variables */
+uint32_t                _slot = map->free_head;
+
+if( _slot >= map->capacity )
+    {
+    return IVK_INVALID_HANDLE;
+    }
+
+map->free_head = map->slot_dense[ _slot ];
+map->slot_dense[ _slot ] = map->count;
+map->dense_slot[ map->count ] = _slot;
+map->count++;
+
+return make_handle( map, _slot );
+
+}
+
+
+/*
+ * Frees the slot of handle. The pool then moves its entry
+ * at *moved_from, the last one, to *removed, the hole.
+ */
+void ivk_slot_map_remove
+    (
+    IVK_slot_map_type*  map,
+    IVK_handle_type     handle,
+    uint32_t*           removed,
+    uint32_t*           moved_from
+    )
+{
+/* Local variables */
+uint32_t                _slot = IVK_HANDLE_INDEX( handle );
+uint32_t                _dense = IVK_SLOT_MAP_DENSE( map, handle );
+uint32_t                _last = map->count - 1;
+uint32_t                _last_slot = map->dense_slot[ _last ];
+
+/* The last entry fills the hole */
+map->dense_slot[ _dense ] = _last_slot;
+map->slot_dense[ _last_slot ] = _dense;
+map->count--;
+
+/* Outdate the handles of the slot, skipping generation 0 */
+map->generations[ _slot ] = ( uint16_t )( ( map->generations[ _slot ] + 1 ) & IVK_HANDLE_GENERATION_MASK );
+if( map->generations[ _slot ] == 0 )
+    {
+    map->generations[ _slot ] = 1;
+    }
+map->slot_dense[ _slot ] = map->free_head;
+map->free_head = _slot;
+
+*removed = _dense;
+*moved_from = _last;
+
+}
+
+
+/*
+ * Checks that handle is live, see IVK_SLOT_MAP_CHECK
+ */
+bool ivk_slot_map_is_valid
+    (
+    const IVK_slot_map_type*    map,
+    IVK_handle_type             handle
+    )
+{
+/* Local variables */
+uint32_t                _slot = IVK_HANDLE_INDEX( handle );
+
+return( handle != IVK_INVALID_HANDLE &&
+        _slot < map->capacity &&
+        map->generations[ _slot ] == IVK_HANDLE_GENERATION( handle ) &&
+        map->slot_dense[ _slot ] < map->count &&
+        map->dense_slot[ map->slot_dense[ _slot ] ] == _slot );
+
+}
+
+
+/*
+ * Stops the program on a stale handle, see
+ * IVK_SLOT_MAP_CHECK
+ */
+void ivk_slot_map_check
+    (
+    const IVK_slot_map_type*    map,
+    IVK_handle_type             handle,
+    const char*                 file,
+    int                         line
+    )
+{
+if( !ivk_slot_map_is_valid( map, handle ) )
+    {
+    printf( "Stale or invalid handle 0x%08x in %s at line %d.\n", handle, file, line );
+    fflush( stdout );
+    abort();
+    }
+
+}
+
+
+/*
+ * Allocates both pools
+ */
+bool ivk_resource_create
+    (
+    uint32_t                    buffer_capacity,
+    uint32_t                    mesh_capacity,
+    IVK_resource_table_type*    table
+    )
+{
+/* Local variables */
+IVK_buffer_pool_type*   _buffers = &table->buffers;
+IVK_mesh_pool_type*     _meshes = &table->meshes;
+
+memset( table, 0, sizeof( *table ) );
+
+if( !ivk_slot_map_create( buffer_capacity, &_buffers->map ) ||
+    !ivk_slot_map_create( mesh_capacity, &_meshes->map ) )
+    {
+    ivk_resource_destroy( VK_NULL_HANDLE, table );
+    return false;
+    }
+
+_buffers->buffers = ( VkBuffer* )calloc( buffer_capacity, sizeof( VkBuffer ) );
+_buffers->memory = ( VkDeviceMemory* )calloc( buffer_capacity, sizeof( VkDeviceMemory ) );
+_buffers->sizes = ( VkDeviceSize* )calloc( buffer_capacity, sizeof( VkDeviceSize ) );
+_meshes->vertex_buffers = ( IVK_buffer_handle_type* )calloc( mesh_capacity, sizeof( IVK_buffer_handle_type ) );
+_meshes->index_buffers = ( IVK_buffer_handle_type* )calloc( mesh_capacity, sizeof( IVK_buffer_handle_type ) );
+_meshes->vk_vertex_buffers = ( VkBuffer* )calloc( mesh_capacity, sizeof( VkBuffer ) );
+_meshes->vk_index_buffers = ( VkBuffer* )calloc( mesh_capacity, sizeof( VkBuffer ) );
+_meshes->index_counts = ( uint32_t* )calloc( mesh_capacity, sizeof( uint32_t ) );
+if( !_buffers->buffers || !_buffers->memory || !_buffers->sizes ||
+    !_meshes->vertex_buffers || !_meshes->index_buffers ||
+    !_meshes->vk_vertex_buffers || !_meshes->vk_index_buffers || !_meshes->index_counts )
+    {
+    printf( "Failed to allocate the resource table.\n" );
+    ivk_resource_destroy( VK_NULL_HANDLE, table );
+    return false;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Destroys every buffer still in the table, then frees the
+ * pools. The GPU must be done with them.
+ */
+void ivk_resource_destroy
+    (
+    VkDevice                    device,
+    IVK_resource_table_type*    table
+    )
+{
+/* Local variables */
+IVK_buffer_pool_type*   _buffers = &table->buffers;
+IVK_mesh_pool_type*     _meshes = &table->meshes;
+
+/* The live buffers are packed at the front */
+for( uint32_t i = 0; device != VK_NULL_HANDLE && i < _buffers->map.count; i++ )
+    {
+    vkDestroyBuffer( device, _buffers->buffers[ i ], g_ivk_host_allocator );
+    vkFreeMemory( device, _buffers->memory[ i ], g_ivk_host_allocator );
+    }
+
+free( _buffers->buffers );
+free( _buffers->memory );
+free( _buffers->sizes );
+free( _meshes->vertex_buffers );
+free( _meshes->index_buffers );
+free( _meshes->vk_vertex_buffers );
+free( _meshes->vk_index_buffers );
+free( _meshes->index_counts );
+ivk_slot_map_destroy( &_buffers->map );
+ivk_slot_map_destroy( &_meshes->map );
+memset( table, 0, sizeof( *table ) );
+
+}
+
+
+/*
+ * Adds a buffer and the memory bound to it, the table owns
+ * both from here on. IVK_INVALID_HANDLE if the pool is
+ * full.
+ */
+IVK_buffer_handle_type ivk_resource_add_buffer
+    (
+    IVK_resource_table_type*    table,
+    VkBuffer                    buffer,
+    VkDeviceMemory              memory,
+    VkDeviceSize                size
+    )
+{
+/* Local variables */
+IVK_buffer_pool_type*   _buffers = &table->buffers;
+uint32_t                _dense = _buffers->map.count;
+IVK_buffer_handle_type  _handle = ivk_slot_map_insert( &_buffers->map );
+
+if( _handle == IVK_INVALID_HANDLE )
+    {
+    printf( "Buffer pool full.\n" );
+    return IVK_INVALID_HANDLE;
+    }
+
+_buffers->buffers[ _dense ] = buffer;
+_buffers->memory[ _dense ] = memory;
+_buffers->sizes[ _dense ] = size;
+
+return _handle;
+
+}
+
+
+/*
+ * Takes a buffer out of the table and hands its Vulkan
+ * objects back to be destroyed
+ */
+void ivk_resource_remove_buffer
+    (
+    IVK_resource_table_type*    table,
+    IVK_buffer_handle_type      handle,
+    VkBuffer*                   buffer,
+    VkDeviceMemory*             memory
+    )
+{
+/* Local variables */
+IVK_buffer_pool_type*   _buffers = &table->buffers;
+uint32_t                _removed = 0;
+uint32_t                _moved_from = 0;
+
+ivk_slot_map_remove( &_buffers->map, handle, &_removed, &_moved_from );
+
+*buffer = _buffers->buffers[ _removed ];
+*memory = _buffers->memory[ _removed ];
+_buffers->buffers[ _removed ] = _buffers->buffers[ _moved_from ];
+_buffers->memory[ _removed ] = _buffers->memory[ _moved_from ];
+_buffers->sizes[ _removed ] = _buffers->sizes[ _moved_from ];
+
+}
+
+
+/*
+ * Returns the Vulkan buffer of a handle
+ */
+VkBuffer ivk_resource_get_buffer
+    (
+    const IVK_resource_table_type*  table,
+    IVK_buffer_handle_type          handle
+    )
+{
+return table->buffers.buffers[ IVK_SLOT_MAP_DENSE( &table->buffers.map, handle ) ];
+
+}
+
+
+/*
+ * Adds a mesh drawing index_count indices from two buffers
+ * of the table. IVK_INVALID_HANDLE if the pool is full.
+ */
+IVK_mesh_handle_type ivk_resource_add_mesh
+    (
+    IVK_resource_table_type*    table,
+    IVK_buffer_handle_type      vertex_buffer,
+    IVK_buffer_handle_type      index_buffer,
+    uint32_t                    index_count
+    )
+{
+/* Local variables */
+IVK_mesh_pool_type*     _meshes = &table->meshes;
+uint32_t                _dense = _meshes->map.count;
+IVK_mesh_handle_type    _handle = ivk_slot_map_insert( &_meshes->map );
+
+if( _handle == IVK_INVALID_HANDLE )
+    {
+    printf( "Mesh pool full.\n" );
+    return IVK_INVALID_HANDLE;
+    }
+
+_meshes->vertex_buffers[ _dense ] = vertex_buffer;
+_meshes->index_buffers[ _dense ] = index_buffer;
+_meshes->vk_vertex_buffers[ _dense ] = ivk_resource_get_buffer( table, vertex_buffer );
+_meshes->vk_index_buffers[ _dense ] = ivk_resource_get_buffer( table, index_buffer );
+_meshes->index_counts[ _dense ] = index_count;
+
+return _handle;
+
+}
+
+
+/*
+ * Takes a mesh out of the table. Its buffers stay, their
+ * handles are returned.
+ */
+void ivk_resource_remove_mesh
+    (
+    IVK_resource_table_type*    table,
+    IVK_mesh_handle_type        handle,
+    IVK_buffer_handle_type*     vertex_buffer,
+    IVK_buffer_handle_type*     index_buffer
+    )
+{
+/* Local variables */
+IVK_mesh_pool_type*     _meshes = &table->meshes;
+uint32_t                _removed = 0;
+uint32_t                _moved_from = 0;
+
+ivk_slot_map_remove( &_meshes->map, handle, &_removed, &_moved_from );
+
+*vertex_buffer = _meshes->vertex_buffers[ _removed ];
+*index_buffer = _meshes->index_buffers[ _removed ];
+_meshes->vertex_buffers[ _removed ] = _meshes->vertex_buffers[ _moved_from ];
+_meshes->index_buffers[ _removed ] = _meshes->index_buffers[ _moved_from ];
+_meshes->vk_vertex_buffers[ _removed ] = _meshes->vk_vertex_buffers[ _moved_from ];
+_meshes->vk_index_buffers[ _removed ] = _meshes->vk_index_buffers[ _moved_from ];
+_meshes->index_counts[ _removed ] = _meshes->index_counts[ _moved_from ];
+
+}
+
+
+/*
+ * Builds the handle of a slot
+ */
+static IVK_handle_type make_handle
+    (
+    const IVK_slot_map_type*    map,
+    uint32_t                    slot
+    )
+{
+return( ( ( IVK_handle_type )map->generations[ slot ] << IVK_HANDLE_INDEX_BITS ) | slot );
+
+}
@@ -0,0 +1,241 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "vulkan/vulkan.h"
+
+/*
+ * Handles are 32 bits: the slot in the low bits, the slot's
+ * generation in the high bits. A slot's generation moves on
+ * every time it is freed, so a handle kept past the destroy
+ * no longer matches. Generation 0 is never handed out,
+ * which keeps 0 free for IVK_INVALID_HANDLE.
+ */
+#define IVK_HANDLE_INDEX_BITS           20
+#define IVK_HANDLE_MAX_SLOTS            ( 1u << IVK_HANDLE_INDEX_BITS )
+#define IVK_HANDLE_GENERATION_MASK      ( ( 1u << ( 32 - IVK_HANDLE_INDEX_BITS ) ) - 1 )
+#define IVK_HANDLE_INDEX( handle )      ( ( handle ) & ( IVK_HANDLE_MAX_SLOTS - 1 ) )
+#define IVK_HANDLE_GENERATION( handle ) ( ( handle ) >> IVK_HANDLE_INDEX_BITS )
+#define IVK_INVALID_HANDLE              0
+
+/*
+ * Pool sizes
+ */
+#define IVK_RESOURCE_MAX_BUFFERS        4096
+#define IVK_RESOURCE_MAX_MESHES         2048
+
+/*
+ * Stale handle detection. Debug builds compare the
+ * generation on every lookup and stop at the first
+ * mismatch, release builds trust the handle.
+ */
+#if defined( _DEBUG )
+    #define IVK_SLOT_MAP_CHECK( map, handle ) \
+            ivk_slot_map_check( ( map ), ( handle ), __FILE__, __LINE__ )
+#else
+    #define IVK_SLOT_MAP_CHECK( map, handle ) \
+            ( ( void )0 )
+#endif
+
+/*
+ * Packed index of a live handle
+ */
+#define IVK_SLOT_MAP_DENSE( map, handle ) \
+        ( IVK_SLOT_MAP_CHECK( ( map ), ( handle ) ), ( map )->slot_dense[ IVK_HANDLE_INDEX( handle ) ] )
+
+/*
+ * Types
+ */
+typedef uint32_t IVK_handle_type;
+typedef IVK_handle_type IVK_buffer_handle_type;
+typedef IVK_handle_type IVK_mesh_handle_type;
+
+/*
+ * Slots and their generations. The live entries are packed
+ * at the front of the pool's arrays, in [ 0, count ), so
+ * walking them touches no holes; removing one moves the
+ * last entry into its place. Create, destroy and lookup are
+ * O(1).
+ */
+typedef struct
+    {
+    uint32_t            capacity;
+    uint32_t            count;              /* Live */
+    uint32_t            free_head;          /* First free slot, capacity if none */
+    uint16_t*           generations;        /* Per slot */
+    uint32_t*           slot_dense;         /* Per slot, its packed index, or the
+                                               next free slot while free */
+    uint32_t*           dense_slot;         /* Per packed index, its slot */
+    } IVK_slot_map_type;
+
+/*
+ * GPU buffers, one array per field
+ */
+typedef struct
+    {
+    IVK_slot_map_type   map;
+    VkBuffer*           buffers;
+    VkDeviceMemory*     memory;
+    VkDeviceSize*       sizes;
+    } IVK_buffer_pool_type;
+
+/*
+ * Indexed meshes, one array per field. The Vulkan buffers
+ * are copied in, so drawing never goes through the buffer
+ * pool.
+ */
+typedef struct
+    {
+    IVK_slot_map_type   map;
+    IVK_buffer_handle_type*
+                        vertex_buffers;
+    IVK_buffer_handle_type*
+                        index_buffers;
+    VkBuffer*           vk_vertex_buffers;
+    VkBuffer*           vk_index_buffers;
+    uint32_t*           index_counts;
+    } IVK_mesh_pool_type;
+
+typedef struct
+    {
+    IVK_buffer_pool_type
+                        buffers;
+    IVK_mesh_pool_type  meshes;
+    } IVK_resource_table_type;
+
+
+/*
+ * Allocates the slots of a map, all free
+ */
+bool ivk_slot_map_create
+    (
+    uint32_t            capacity,
+    IVK_slot_map_type*  map
+    );
+
+/*
+ * Frees the slots of a map
+ */
+void ivk_slot_map_destroy
+    (
+    IVK_slot_map_type*  map
+    );
+
+/*
+ * Takes a free slot. Its packed index is the old count.
+ * IVK_INVALID_HANDLE if the map is full.
+ */
+IVK_handle_type ivk_slot_map_insert
+    (
+    IVK_slot_map_type*  map
+    );
+
+/*
+ * Frees the slot of handle. The pool then moves its entry
+ * at *moved_from, the last one, to *removed, the hole.
+ */
+void ivk_slot_map_remove
+    (
+    IVK_slot_map_type*  map,
+    IVK_handle_type     handle,
+    uint32_t*           removed,
+    uint32_t*           moved_from
+    );
+
+/*
+ * Checks that handle is live, see IVK_SLOT_MAP_CHECK
+ */
+bool ivk_slot_map_is_valid
+    (
+    const IVK_slot_map_type*    map,
+    IVK_handle_type             handle
+    );
+
+/*
+ * Stops the program on a stale handle, see
+ * IVK_SLOT_MAP_CHECK
+ */
+void ivk_slot_map_check
+    (
+    const IVK_slot_map_type*    map,
+    IVK_handle_type             handle,
+    const char*                 file,
+    int                         line
+    );
+
+/*
+ * Allocates both pools
+ */
+bool ivk_resource_create
+    (
+    uint32_t                    buffer_capacity,
+    uint32_t                    mesh_capacity,
+    IVK_resource_table_type*    table
+    );
+
+/*
+ * Destroys every buffer still in the table, then frees the
+ * pools. The GPU must be done with them.
+ */
+void ivk_resource_destroy
+    (
+    VkDevice                    device,
+    IVK_resource_table_type*    table
+    );
+
+/*
+ * Adds a buffer and the memory bound to it, the table owns
+ * both from here on. IVK_INVALID_HANDLE if the pool is
+ * full.
+ */
+IVK_buffer_handle_type ivk_resource_add_buffer
+    (
+    IVK_resource_table_type*    table,
+    VkBuffer                    buffer,
+    VkDeviceMemory              memory,
+    VkDeviceSize                size
+    );
+
+/*
+ * Takes a buffer out of the table and hands its Vulkan
+ * objects back to be destroyed
+ */
+void ivk_resource_remove_buffer
+    (
+    IVK_resource_table_type*    table,
+    IVK_buffer_handle_type      handle,
+    VkBuffer*                   buffer,
+    VkDeviceMemory*             memory
+    );
+
+/*
+ * Returns the Vulkan buffer of a handle
+ */
+VkBuffer ivk_resource_get_buffer
+    (
+    const IVK_resource_table_type*  table,
+    IVK_buffer_handle_type          handle
+    );
+
+/*
+ * Adds a mesh drawing index_count indices from two buffers
+ * of the table. IVK_INVALID_HANDLE if the pool is full.
+ */
+IVK_mesh_handle_type ivk_resource_add_mesh
+    (
+    IVK_resource_table_type*    table,
+    IVK_buffer_handle_type      vertex_buffer,
+    IVK_buffer_handle_type      index_buffer,
+    uint32_t                    index_count
+    );
+
+/*
+ * Takes a mesh out of the table. Its buffers stay, their
+ * handles are returned.
+ */
+void ivk_resource_remove_mesh
+    (
+    IVK_resource_table_type*    table,
+    IVK_mesh_handle_type        handle,
+    IVK_buffer_handle_type*     vertex_buffer,
+    IVK_buffer_handle_type*     index_buffer
+    );
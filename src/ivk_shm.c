@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ivk_shm.h"
+#include "ivk_atomic.h"
+
+#if !defined( _WIN32 )
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/*** Static functions ***/
+/*
+ * Copies the name of the ring, with the leading slash
+ * POSIX shared memory names need
+ */
+static void set_ring_name
+    (
+    const char*         name,
+    IVK_shm_ring_type*  ring
+    );
+
+/*
+ * Maps size bytes of the ring, creating the object if
+ * is_create is set. Returns false on failure.
+ */
+static bool map_ring
+    (
+    IVK_shm_ring_type*  ring,
+    size_t              size,
+    bool                is_create
+    );
+
+/*
+ * Rounds size up to a multiple of alignment, a power of two
+ */
+static size_t align_up
+    (
+    size_t  size,
+    size_t  alignment
+    );
+
+
+/*
+ * Creates the named ring, replacing any left over by an
+ * earlier producer. The pixels of every slot start on an
+ * alignment boundary ( a power of two, at least the page
+ * size ) so they can be imported as device memory.
+ */
+bool ivk_shm_ring_create
+    (
+    const char*         name,
+    unsigned int        slot_count,
+    size_t              slot_size,
+    size_t              alignment,
+    IVK_shm_ring_type*  ring
+    )
+{
+/* Local variables */
+IVK_shm_header_type*    _header = NULL;
+size_t                  _pixels_offset = 0;
+size_t                  _stride = 0;
+
+memset( ring, 0, sizeof( *ring ) );
+set_ring_name( name, ring );
+ring->is_owner = true;
+
+if( slot_count < 1 )
+    {
+    slot_count = 1;
+    }
+else if( slot_count > IVK_SHM_MAX_SLOTS )
+    {
+    slot_count = IVK_SHM_MAX_SLOTS;
+    }
+if( alignment < 4096 )
+    {
+    alignment = 4096;
+    }
+
+/* Headers first, then the pixels of each slot */
+_pixels_offset = align_up( sizeof( IVK_shm_header_type ), alignment );
+_stride = align_up( slot_size, alignment );
+if( !map_ring( ring, _pixels_offset + _stride * slot_count, true ) )
+    {
+    printf( "Could not create the shared memory ring %s.\n", ring->name );
+    return false;
+    }
+
+/* Fresh objects are zero filled */
+_header = ring->header;
+_header->version = IVK_SHM_VERSION;
+_header->slot_count = slot_count;
+_header->slot_size = _stride;
+_header->slot_stride = _stride;
+_header->total_size = ring->size;
+for( unsigned int i = 0; i < slot_count; i++ )
+    {
+    _header->slots[ i ].offset = _pixels_offset + _stride * i;
+    }
+
+/* Consumers check the magic before anything else */
+IVK_ATOMIC_STORE( &_header->magic, ( uint32_t )IVK_SHM_MAGIC );
+
+return true;
+
+}
+
+
+/*
+ * Maps a ring created by another process, for consuming.
+ * Returns false if it does not exist ( yet ).
+ */
+bool ivk_shm_ring_open
+    (
+    const char*         name,
+    IVK_shm_ring_type*  ring
+    )
+{
+memset( ring, 0, sizeof( *ring ) );
+set_ring_name( name, ring );
+
+/* The size is only known from the header */
+if( !map_ring( ring, 0, false ) )
+    {
+    return false;
+    }
+
+if( IVK_ATOMIC_LOAD( &ring->header->magic ) != IVK_SHM_MAGIC ||
+    ring->header->version != IVK_SHM_VERSION ||
+    ring->header->total_size > ring->size )
+    {
+    printf( "Shared memory ring %s is not compatible.\n", ring->name );
+    ivk_shm_ring_close( ring );
+    return false;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Unmaps the ring. The producer also marks it closed and
+ * removes the name; consumers keep their mapping.
+ */
+void ivk_shm_ring_close
+    (
+    IVK_shm_ring_type*  ring
+    )
+{
+if( !ring->header )
+    {
+    return;
+    }
+
+if( ring->is_owner )
+    {
+    IVK_ATOMIC_STORE( &ring->header->is_closed, 1u );
+    }
+
+#if defined( _WIN32 )
+UnmapViewOfFile( ring->base );
+CloseHandle( ring->mapping );
+#else
+munmap( ring->base, ring->size );
+close( ring->fd );
+if( ring->is_owner )
+    {
+    shm_unlink( ring->name );
+    }
+#endif
+
+ring->header = NULL;
+ring->base = NULL;
+ring->size = 0;
+
+}
+
+
+/*
+ * Returns the pixels of a slot
+ */
+uint8_t* ivk_shm_ring_slot_pixels
+    (
+    const IVK_shm_ring_type*    ring,
+    unsigned int                slot_index
+    )
+{
+return( ring->base + ring->header->slots[ slot_index ].offset );
+
+}
+
+
+/*
+ * Checks whether pending_count frames, already promised to
+ * the ring but not yet written, plus one more would fit.
+ */
+bool ivk_shm_ring_has_room
+    (
+    const IVK_shm_ring_type*    ring,
+    unsigned int                pending_count
+    )
+{
+/* Local variables */
+uint64_t    _used = 0;
+
+_used = ring->header->write_index - IVK_ATOMIC_LOAD( &ring->header->read_index );
+
+return( _used + pending_count < ring->header->slot_count );
+
+}
+
+
+/*
+ * Publishes a frame into the next slot. If the pixels
+ * already are that slot, nothing is copied. Returns false,
+ * and counts a drop, if the consumer has not released the
+ * slot yet or the frame does not fit.
+ */
+bool ivk_shm_ring_write
+    (
+    IVK_shm_ring_type*  ring,
+    uint64_t            frame_number,
+    uint32_t            width,
+    uint32_t            height,
+    uint32_t            row_pitch,
+    uint32_t            format,
+    const void*         pixels,
+    size_t              size
+    )
+{
+/* Local variables */
+IVK_shm_header_type*        _header = ring->header;
+IVK_shm_slot_header_type*   _slot = NULL;
+uint64_t                    _write_index = _header->write_index;
+uint8_t*                    _slot_pixels = NULL;
+
+if( !ivk_shm_ring_has_room( ring, 0 ) || size > _header->slot_size )
+    {
+    IVK_ATOMIC_STORE( &_header->dropped_count, _header->dropped_count + 1 );
+    return false;
+    }
+
+_slot = &_header->slots[ _write_index % _header->slot_count ];
+_slot_pixels = ring->base + _slot->offset;
+if( pixels != _slot_pixels )
+    {
+    memcpy( _slot_pixels, pixels, size );
+    }
+
+_slot->width = width;
+_slot->height = height;
+_slot->row_pitch = row_pitch;
+_slot->format = format;
+_slot->sequence = _write_index;
+_slot->frame_number = frame_number;
+_slot->size = size;
+
+/* The index publishes the slot, the flag is for readers that scan
+the slots rather than follow the index */
+IVK_ATOMIC_STORE( &_slot->ready, 1u );
+IVK_ATOMIC_STORE( &_header->write_index, _write_index + 1 );
+
+return true;
+
+}
+
+
+/*
+ * Returns the oldest published slot, NULL if there is
+ * none. The pixels stay valid until released.
+ */
+const IVK_shm_slot_header_type* ivk_shm_ring_peek
+    (
+    const IVK_shm_ring_type*    ring
+    )
+{
+/* Local variables */
+uint64_t    _read_index = ring->header->read_index;
+
+if( IVK_ATOMIC_LOAD( &ring->header->write_index ) == _read_index )
+    {
+    return NULL;
+    }
+
+return( &ring->header->slots[ _read_index % ring->header->slot_count ] );
+
+}
+
+
+/*
+ * Hands the oldest published slot back to the producer
+ */
+void ivk_shm_ring_release
+    (
+    IVK_shm_ring_type*  ring
+    )
+{
+/* Local variables */
+uint64_t    _read_index = ring->header->read_index;
+
+IVK_ATOMIC_STORE( &ring->header->slots[ _read_index % ring->header->slot_count ].ready, 0u );
+IVK_ATOMIC_STORE( &ring->header->read_index, _read_index + 1 );
+
+}
+
+
+/*
+ * Copies the name of the ring, with the leading slash
+ * POSIX shared memory names need
+ */
+static void set_ring_name
+    (
+    const char*         name,
+    IVK_shm_ring_type*  ring
+    )
+{
+#if defined( _WIN32 )
+snprintf( ring->name, sizeof( ring->name ), "Local\\%s", name[ 0 ] == '/' ? name + 1 : name );
+#else
+snprintf( ring->name, sizeof( ring->name ), "%s%s", name[ 0 ] == '/' ? "" : "/", name );
+#endif
+
+}
+
+
+/*
+ * Maps size bytes of the ring, creating the object if
+ * is_create is set. Returns false on failure.
+ */
+static bool map_ring
+    (
+    IVK_shm_ring_type*  ring,
+    size_t              size,
+    bool                is_create
+    )
+{
+#if defined( _WIN32 )
+/* Local variables */
+MEMORY_BASIC_INFORMATION    _info;
+
+if( is_create )
+    {
+    ring->mapping = CreateFileMappingA
+        (
+        INVALID_HANDLE_VALUE,
+        NULL,
+        PAGE_READWRITE,
+        ( DWORD )( ( uint64_t )size >> 32 ),
+        ( DWORD )size,
+        ring->name
+        );
+    }
+else
+    {
+    ring->mapping = OpenFileMappingA( FILE_MAP_ALL_ACCESS, FALSE, ring->name );
+    }
+if( !ring->mapping )
+    {
+    return false;
+    }
+
+ring->base = ( uint8_t* )MapViewOfFile( ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size );
+if( !ring->base )
+    {
+    CloseHandle( ring->mapping );
+    return false;
+    }
+
+/* Views are rounded up to whole pages */
+VirtualQuery( ring->base, &_info, sizeof( _info ) );
+ring->size = size ? size : _info.RegionSize;
+#else
+/* Local variables */
+struct stat _stat;
+
+if( is_create )
+    {
+    /* A producer that crashed leaves its ring behind */
+    shm_unlink( ring->name );
+    ring->fd = shm_open( ring->name, O_RDWR | O_CREAT | O_EXCL, 0600 );
+    if( ring->fd < 0 )
+        {
+        return false;
+        }
+    if( ftruncate( ring->fd, ( off_t )size ) != 0 )
+        {
+        close( ring->fd );
+        shm_unlink( ring->name );
+        return false;
+        }
+    }
+else
+    {
+    ring->fd = shm_open( ring->name, O_RDWR, 0 );
+    if( ring->fd < 0 )
+        {
+        return false;
+        }
+    if( fstat( ring->fd, &_stat ) != 0 || ( size_t )_stat.st_size < sizeof( IVK_shm_header_type ) )
+        {
+        close( ring->fd );
+        return false;
+        }
+    size = ( size_t )_stat.st_size;
+    }
+
+ring->base = ( uint8_t* )mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0 );
+if( ring->base == MAP_FAILED )
+    {
+    ring->base = NULL;
+    close( ring->fd );
+    if( is_create )
+        {
+        shm_unlink( ring->name );
+        }
+    return false;
+    }
+ring->size = size;
+#endif
+
+ring->header = ( IVK_shm_header_type* )ring->base;
+
+return true;
+
+}
+
+
+/*
+ * Rounds size up to a multiple of alignment, a power of two
+ */
+static size_t align_up
+    (
+    size_t  size,
+    size_t  alignment
+    )
+{
+return( ( size + alignment - 1 ) & ~( alignment - 1 ) );
+
+}
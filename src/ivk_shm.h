@@ -0,0 +1,169 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined( _WIN32 )
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+
+/*
+ * Shared memory layout version, bumped on any change to
+ * the headers below
+ */
+#define IVK_SHM_MAGIC                   0x524B5649  /* "IVKR" */
+#define IVK_SHM_VERSION                 1
+
+/*
+ * Maximum number of slots of a ring
+ */
+#define IVK_SHM_MAX_SLOTS               16
+
+/*
+ * Types. Everything in the mapping is fixed size, so the
+ * consumer may be built separately.
+ */
+typedef struct
+    {
+    volatile uint32_t   ready;              /* Set by the producer, cleared by the consumer */
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            row_pitch;          /* Bytes per row */
+    uint32_t            format;             /* VkFormat */
+    uint32_t            reserved;
+    uint64_t            sequence;           /* Publish count, consecutive */
+    uint64_t            frame_number;       /* Renderer frame, skips dropped frames */
+    uint64_t            size;               /* Bytes of pixels */
+    uint64_t            offset;             /* Of the pixels, from the start of the mapping */
+    } IVK_shm_slot_header_type;
+
+typedef struct
+    {
+    uint32_t            magic;              /* Written last by the producer */
+    uint32_t            version;
+    uint32_t            slot_count;
+    volatile uint32_t   is_closed;          /* The producer has gone away */
+    uint64_t            slot_size;          /* Capacity of each slot */
+    uint64_t            slot_stride;        /* Between the pixels of two slots */
+    uint64_t            total_size;
+
+    /* The indices only grow; the slot is index % slot_count.
+    Kept on separate cache lines, each side writes one. */
+    uint8_t             pad0[ 24 ];
+    volatile uint64_t   write_index;        /* Producer owned */
+    volatile uint64_t   dropped_count;      /* Frames the producer found no room for */
+    uint8_t             pad1[ 48 ];
+    volatile uint64_t   read_index;         /* Consumer owned */
+    uint8_t             pad2[ 56 ];
+
+    IVK_shm_slot_header_type
+                        slots[ IVK_SHM_MAX_SLOTS ];
+    } IVK_shm_header_type;
+
+/*
+ * Process local view of a ring
+ */
+typedef struct
+    {
+    IVK_shm_header_type*
+                        header;
+    uint8_t*            base;               /* Start of the mapping */
+    size_t              size;
+    bool                is_owner;           /* Created it, removes it on close */
+    char                name[ 64 ];
+#if defined( _WIN32 )
+    HANDLE              mapping;
+#else
+    int                 fd;
+#endif
+    } IVK_shm_ring_type;
+
+
+/*
+ * Creates the named ring, replacing any left over by an
+ * earlier producer. The pixels of every slot start on an
+ * alignment boundary ( a power of two, at least the page
+ * size ) so they can be imported as device memory.
+ */
+bool ivk_shm_ring_create
+    (
+    const char*         name,
+    unsigned int        slot_count,
+    size_t              slot_size,
+    size_t              alignment,
+    IVK_shm_ring_type*  ring
+    );
+
+/*
+ * Maps a ring created by another process, for consuming.
+ * Returns false if it does not exist ( yet ).
+ */
+bool ivk_shm_ring_open
+    (
+    const char*         name,
+    IVK_shm_ring_type*  ring
+    );
+
+/*
+ * Unmaps the ring. The producer also marks it closed and
+ * removes the name; consumers keep their mapping.
+ */
+void ivk_shm_ring_close
+    (
+    IVK_shm_ring_type*  ring
+    );
+
+/*
+ * Returns the pixels of a slot
+ */
+uint8_t* ivk_shm_ring_slot_pixels
+    (
+    const IVK_shm_ring_type*    ring,
+    unsigned int                slot_index
+    );
+
+/*
+ * Checks whether pending_count frames, already promised to
+ * the ring but not yet written, plus one more would fit.
+ */
+bool ivk_shm_ring_has_room
+    (
+    const IVK_shm_ring_type*    ring,
+    unsigned int                pending_count
+    );
+
+/*
+ * Publishes a frame into the next slot. If the pixels
+ * already are that slot, nothing is copied. Returns false,
+ * and counts a drop, if the consumer has not released the
+ * slot yet or the frame does not fit.
+ */
+bool ivk_shm_ring_write
+    (
+    IVK_shm_ring_type*  ring,
+    uint64_t            frame_number,
+    uint32_t            width,
+    uint32_t            height,
+    uint32_t            row_pitch,
+    uint32_t            format,
+    const void*         pixels,
+    size_t              size
+    );
+
+/*
+ * Returns the oldest published slot, NULL if there is
+ * none. The pixels stay valid until released.
+ */
+const IVK_shm_slot_header_type* ivk_shm_ring_peek
+    (
+    const IVK_shm_ring_type*    ring
+    );
+
+/*
+ * Hands the oldest published slot back to the producer
+ */
+void ivk_shm_ring_release
+    (
+    IVK_shm_ring_type*  ring
+    );
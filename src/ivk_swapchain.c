@@ -1,7 +1,12 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "ivk_memory.h"
 #include "ivk_util.h"
 #include "ivk_swapchain.h"
+#include "ivk_offscreen.h"
 
 /*
  * Query swapchain support details for a certain
@@ -38,6 +43,7 @@ return;
 
 /*
  * Frees the dynamic memory required by the swapchain details struct.
+ * Safe on zeroed or already freed details.
  */
 void ivk_swapchain_free_support
     (
@@ -49,17 +55,120 @@ swapchain_details->present_modes_count = 0;
 
 free( swapchain_details->formats );
 free( swapchain_details->present_modes );
+swapchain_details->formats = NULL;
+swapchain_details->present_modes = NULL;
 
 return;
 
 }
 
+/*
+ * Present mode preferences per policy, best first. FIFO is
+ * always supported and ends every list.
+ */
+#define MAX_PRESENT_MODE_PREFERENCES    3
+
+typedef struct
+    {
+    VkPresentModeKHR    present_modes[ MAX_PRESENT_MODE_PREFERENCES ];
+    unsigned int        present_mode_count;
+    unsigned int        extra_images;       /* On top of the surface minimum */
+    unsigned int        frames_in_flight;
+    } IVK_present_policy_desc_type;
+
+/*
+ * Clamps a value to [ lo, hi ]
+ */
+static uint32_t clamp_u32
+    (
+    uint32_t    value,
+    uint32_t    lo,
+    uint32_t    hi
+    );
+
+static const IVK_present_policy_desc_type g_present_policies[ IVK_PRESENT_POLICY_COUNT ] =
+    {
+    [ IVK_PRESENT_POLICY_BALANCED ] =
+        {
+        { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR }, 2,
+        1, 2
+        },
+    [ IVK_PRESENT_POLICY_LOW_LATENCY ] =
+        {
+        { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR }, 3,
+        1, 1
+        },
+    [ IVK_PRESENT_POLICY_THROUGHPUT ] =
+        {
+        { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR }, 2,
+        2, 3
+        },
+    [ IVK_PRESENT_POLICY_POWER_SAVE ] =
+        {
+        { VK_PRESENT_MODE_FIFO_KHR }, 1,
+        0, 1
+        }
+    };
+
+
+/*
+ * Resolves a presentation policy against what the surface
+ * supports.
+ */
+void ivk_swapchain_resolve_policy
+    (
+    IVK_present_policy_type             policy,
+    const IVK_swapchain_details_type*   swapchain_details,
+    IVK_present_params_type*            params
+    )
+{
+/* Local variables */
+const IVK_present_policy_desc_type* _desc = NULL;
+const VkSurfaceCapabilitiesKHR*     _capabilities = &swapchain_details->capabilities;
+bool                                _is_found = false;
+
+if( policy >= IVK_PRESENT_POLICY_COUNT )
+    {
+    policy = IVK_PRESENT_POLICY_BALANCED;
+    }
+_desc = &g_present_policies[ policy ];
+
+/* Take the first preferred present mode the surface supports */
+params->present_mode = VK_PRESENT_MODE_FIFO_KHR;
+for( unsigned int i = 0; i < _desc->present_mode_count && !_is_found; i++ )
+    {
+    for( unsigned int j = 0; j < swapchain_details->present_modes_count; j++ )
+        {
+        if( swapchain_details->present_modes[ j ] == _desc->present_modes[ i ] )
+            {
+            params->present_mode = _desc->present_modes[ i ];
+            _is_found = true;
+            break;
+            }
+        }
+    }
+
+/* A maxImageCount of 0 means there is no upper limit */
+params->image_count = _capabilities->minImageCount + _desc->extra_images;
+if( _capabilities->maxImageCount > 0 && params->image_count > _capabilities->maxImageCount )
+    {
+    params->image_count = _capabilities->maxImageCount;
+    }
+
+params->frames_in_flight = _desc->frames_in_flight;
+
+}
+
+
 /*
  * Creates a swapchain with the following characteristics:
- *      - Maximum image extents
+ *      - The surface's current extent, or window_extent if the
+ *        surface leaves it to the swapchain
  *      - 8B8G8R8A color format and SRGB color space
- *      - Mailbox presentation mode
+ *      - The present mode and image count in params
  * Also sets these values for later use.
+ * Passing the swapchain being replaced as old_swapchain lets
+ * frames still in flight on it finish presenting.
  */
 void ivk_swapchain_create
     (
@@ -68,6 +177,10 @@ void ivk_swapchain_create
     VkSurfaceKHR                surface,
     unsigned int                graphics_family_idx,
     unsigned int                present_family_idx,
+    const IVK_present_params_type*
+                                params,
+    VkExtent2D                  window_extent,
+    VkSwapchainKHR              old_swapchain,
     VkSwapchainKHR*             swapchain,
     VkFormat*                   ctx_format,
     VkExtent2D*                 ctx_extent
@@ -75,9 +188,9 @@ void ivk_swapchain_create
 {
 /* Local variables */
 VkSurfaceFormatKHR  _surface_format = swapchain_details->formats[ 0 ];
-VkPresentModeKHR    _present_mode = VK_PRESENT_MODE_FIFO_KHR;
+const VkSurfaceCapabilitiesKHR*
+                    _capabilities = &swapchain_details->capabilities;
 VkExtent2D          _extent = { 0 };
-unsigned int        _image_count = 0;
 VkSwapchainCreateInfoKHR
                     _create_info = { 0 };
 unsigned int        _queue_family_indices[ 2 ];
@@ -95,25 +208,17 @@ for( unsigned int i = 0; i < swapchain_details->format_count; i++ )
         }
     }
 
-/* Make sure the swapchain supports mailbox presentation types. Use
-FIFO otherwise. */
-for( unsigned int i = 0; i < swapchain_details->present_modes_count; i++ )
+/* The swapchain has to match the current extent, unless the surface
+reports the special 0xFFFFFFFF value and lets the window decide */
+if( _capabilities->currentExtent.width != UINT32_MAX )
     {
-    if( swapchain_details->present_modes[ i ] == VK_PRESENT_MODE_MAILBOX_KHR )
-        {
-        _present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
-        break;
-        }
+    _extent = _capabilities->currentExtent;
+    }
+else
+    {
+    _extent.width = clamp_u32( window_extent.width, _capabilities->minImageExtent.width, _capabilities->maxImageExtent.width );
+    _extent.height = clamp_u32( window_extent.height, _capabilities->minImageExtent.height, _capabilities->maxImageExtent.height );
     }
-
-/* We shall use the maximum surface extent for the swapchain.
-This might cause problems on other platforms, but on Win32 it
-should be fine. YOLO */
-_extent.width  = swapchain_details->capabilities.maxImageExtent.width;
-_extent.height = swapchain_details->capabilities.maxImageExtent.height;
-
-/* Set the image count; should be 2 */
-_image_count = swapchain_details->capabilities.minImageCount; /* Temp */
 
 /* Save the queue family indices */
 _queue_family_indices[ 0 ] = graphics_family_idx;
@@ -122,23 +227,34 @@ _queue_family_indices[ 1 ] = present_family_idx;
 /* Create the swapchain */
 _create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 _create_info.surface = surface;
-_create_info.minImageCount = _image_count;
+_create_info.minImageCount = params->image_count;
 _create_info.imageFormat = _surface_format.format;
 _create_info.imageColorSpace = _surface_format.colorSpace;
 _create_info.imageExtent = _extent;
 _create_info.imageArrayLayers = 1;
 _create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-_create_info.pQueueFamilyIndices = &_queue_family_indices[ 0 ];
-_create_info.queueFamilyIndexCount = 2;
-_create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+if( _capabilities->supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT )
+    {
+    /* Lets the readback copy out of the images */
+    _create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+/* One family renders and presents on most devices, the images then
+need no concurrent sharing */
+_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+if( graphics_family_idx != present_family_idx )
+    {
+    _create_info.pQueueFamilyIndices = &_queue_family_indices[ 0 ];
+    _create_info.queueFamilyIndexCount = 2;
+    _create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+    }
 _create_info.preTransform = swapchain_details->capabilities.currentTransform;
 _create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-_create_info.presentMode = _present_mode;
+_create_info.presentMode = params->present_mode;
 _create_info.clipped = VK_TRUE;
-_create_info.oldSwapchain = VK_NULL_HANDLE;
+_create_info.oldSwapchain = old_swapchain;
 
 /* Create the swapchain */
-__vk( vkCreateSwapchainKHR( device, &_create_info, NULL, &_swapchain ) );
+__vk( vkCreateSwapchainKHR( device, &_create_info, g_ivk_host_allocator, &_swapchain ) );
 
 *swapchain = _swapchain;
 *ctx_format = _surface_format.format;
@@ -196,7 +312,7 @@ for( unsigned int i = 0; i < image_count; i++ )
             (
             device,
             &_image_view_create_info,
-            NULL,
+            g_ivk_host_allocator,
             &_views[ i ]
             ) );
 
@@ -220,7 +336,7 @@ void ivk_swapchain_destroy_image_views
 {
 for( unsigned int i = 0; i < image_count; i++ )
     {
-    vkDestroyImageView( device, image_views[ i ], NULL );
+    vkDestroyImageView( device, image_views[ i ], g_ivk_host_allocator );
     }
 
 /* Free the memory */
@@ -230,6 +346,52 @@ return;
 
 }
 
+/*
+ * Destroys a retired swapchain and the objects built on it.
+ */
+void ivk_swapchain_destroy_retired
+    (
+    VkDevice                    device,
+    IVK_swapchain_retired_type* retired
+    )
+{
+if( retired->framebuffers )
+    {
+    for( unsigned int i = 0; i < retired->image_count; i++ )
+        {
+        vkDestroyFramebuffer( device, retired->framebuffers[ i ], g_ivk_host_allocator );
+        }
+    free( retired->framebuffers );
+    }
+
+if( retired->semaphores )
+    {
+    for( unsigned int i = 0; i < retired->image_count; i++ )
+        {
+        vkDestroySemaphore( device, retired->semaphores[ i ], g_ivk_host_allocator );
+        }
+    free( retired->semaphores );
+    }
+
+ivk_swapchain_destroy_image_views( device, retired->image_count, retired->image_views );
+
+/* The swapchain owns its images, the offscreen images own their memory */
+if( retired->swapchain != VK_NULL_HANDLE )
+    {
+    vkDestroySwapchainKHR( device, retired->swapchain, g_ivk_host_allocator );
+    free( retired->images );
+    }
+else if( retired->images_memory )
+    {
+    ivk_offscreen_destroy_images( device, retired->image_count, retired->images, retired->images_memory );
+    }
+
+memset( retired, 0, sizeof( *retired ) );
+return;
+
+}
+
+
 /*
  * Retrieve the swapchain images.
  */
@@ -254,4 +416,27 @@ __vk( vkGetSwapchainImagesKHR( device, swapchain, image_count, *swapchain_images
 
 return;
 
+}
+
+
+/*
+ * Clamps a value to [ lo, hi ]
+ */
+static uint32_t clamp_u32
+    (
+    uint32_t    value,
+    uint32_t    lo,
+    uint32_t    hi
+    )
+{
+if( value < lo )
+    {
+    return lo;
+    }
+if( value > hi )
+    {
+    return hi;
+    }
+return value;
+
 }
\ No newline at end of file
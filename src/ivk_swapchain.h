@@ -10,6 +10,45 @@ typedef struct
     unsigned int             present_modes_count;
     } IVK_swapchain_details_type;
 
+/*
+ * Presentation policies. Each one maps to a present mode,
+ * a swapchain image count and a number of frames in flight.
+ */
+typedef enum
+    {
+    IVK_PRESENT_POLICY_BALANCED = 0,        /* Mailbox if available, FIFO otherwise */
+    IVK_PRESENT_POLICY_LOW_LATENCY,         /* Mailbox or immediate, one frame in flight */
+    IVK_PRESENT_POLICY_THROUGHPUT,          /* Deep queue so the GPU never starves */
+    IVK_PRESENT_POLICY_POWER_SAVE,          /* FIFO, paced by the display */
+    IVK_PRESENT_POLICY_COUNT
+    } IVK_present_policy_type;
+
+typedef struct
+    {
+    VkPresentModeKHR         present_mode;
+    unsigned int             image_count;
+    unsigned int             frames_in_flight;
+    } IVK_present_params_type;
+
+/*
+ * A swapchain replaced by a resize, with everything that
+ * was built on top of it. It is destroyed once the GPU has
+ * passed retire_value on the frame timeline. Headless, the
+ * swapchain is VK_NULL_HANDLE and the images are offscreen
+ * images owning images_memory.
+ */
+typedef struct
+    {
+    VkSwapchainKHR           swapchain;
+    unsigned int             image_count;
+    VkImage*                 images;
+    VkDeviceMemory*          images_memory;     /* Offscreen images only */
+    VkImageView*             image_views;
+    VkFramebuffer*           framebuffers;      /* May be NULL */
+    VkSemaphore*             semaphores;        /* May be NULL */
+    uint64_t                 retire_value;
+    } IVK_swapchain_retired_type;
+
 /*
  * Query swapchain support details for a certain
  * window surface.
@@ -23,17 +62,32 @@ void ivk_swapchain_query_support
 
 /*
  * Frees the dynamic memory required by the swapchain details struct.
+ * Safe on zeroed or already freed details.
  */
 void ivk_swapchain_free_support
     (
     IVK_swapchain_details_type* swapchain_details
     );
 
+/*
+ * Resolves a presentation policy against what the surface
+ * supports.
+ */
+void ivk_swapchain_resolve_policy
+    (
+    IVK_present_policy_type             policy,
+    const IVK_swapchain_details_type*   swapchain_details,
+    IVK_present_params_type*            params
+    );
+
 /*
  * Creates a swapchain with the following characteristics:
- *      - Maximum image extents
+ *      - The surface's current extent, or window_extent if the
+ *        surface leaves it to the swapchain
  *      - 8B8G8R8A color format and SRGB color space
- *      - Mailbox presentation mode
+ *      - The present mode and image count in params
+ * Passing the swapchain being replaced as old_swapchain lets
+ * frames still in flight on it finish presenting.
  */
 void ivk_swapchain_create
     (
@@ -42,6 +96,10 @@ void ivk_swapchain_create
     VkSurfaceKHR                surface,
     unsigned int                graphics_family_idx,
     unsigned int                present_family_idx,
+    const IVK_present_params_type*
+                                params,
+    VkExtent2D                  window_extent,
+    VkSwapchainKHR              old_swapchain,
     VkSwapchainKHR*             swapchain,
     VkFormat*                   ctx_format,
     VkExtent2D*                 ctx_extent
@@ -73,6 +131,16 @@ void ivk_swapchain_destroy_image_views
     );
 
 
+/*
+ * Destroys a retired swapchain and the objects built on it.
+ */
+void ivk_swapchain_destroy_retired
+    (
+    VkDevice                    device,
+    IVK_swapchain_retired_type* retired
+    );
+
+
 /*
  * Retrieve the swapchain images.
  */
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk.h"
+#include "ivk_atomic.h"
+#include "ivk_thread.h"
+
+/*
+ * Test constants
+ */
+#define TEST_WIDTH              320
+#define TEST_HEIGHT             240
+#define PROFILER_FRAMES         16
+#define MAX_REPORTS             IVK_GPU_PROFILER_MAX_NAMES
+#define CONTEXT_FRAMES          8
+#define SETTLING_FRAMES         ( 4 * IVK_MAX_FRAMES_IN_FLIGHT )
+#define COUNTED_FRAMES          64
+
+/*
+ * Types
+ */
+typedef bool ( *test_func_type )
+    (
+    void
+    );
+
+typedef struct
+    {
+    const char*     name;
+    test_func_type  run;
+    } test_type;
+
+typedef struct
+    {
+    IVK_Context         context;
+    bool                track_host_memory;
+    const IVK_host_allocator_type*
+                        host_allocator;     /* The context was given */
+    uint64_t            frame_count;        /* Rendered before the teardown */
+    } context_thread_type;
+
+/*
+ * Timings of the nested zones, e.g. the overlay inside the
+ * scene pass, with the pipeline statistics on
+ */
+bool test_gpu_profiler_nested_zones
+    (
+    void
+    );
+
+/*
+ * Two contexts initialized at once from two threads, only
+ * one of them asking for the host memory tracking
+ */
+bool test_contexts_on_two_threads
+    (
+    void
+    );
+
+/*
+ * Settled frames, counted through the wrapped libc allocator,
+ * make no heap allocations
+ */
+bool test_settled_frames_do_not_allocate
+    (
+    void
+    );
+
+/*
+ * Returns the report of the named zone, NULL if it has none
+ */
+const IVK_gpu_zone_report_type* find_report
+    (
+    const IVK_gpu_zone_report_type* reports,
+    unsigned int                    count,
+    const char*                     name
+    );
+
+/*
+ * Initializes a context, renders a few frames and tears it
+ * down, on a thread of its own
+ */
+void run_context_thread
+    (
+    void*   arg
+    );
+
+/*
+ * Global data
+ */
+test_type tests[] =
+    {
+    { "gpu_profiler_nested_zones", test_gpu_profiler_nested_zones },
+    { "contexts_on_two_threads", test_contexts_on_two_threads },
+    { "settled_frames_do_not_allocate", test_settled_frames_do_not_allocate }
+    };
+
+volatile uint32_t   count_allocations;  /* Set while the frames are counted */
+uint64_t            allocation_count;
+
+#ifdef IVK_TEST_WRAP_ALLOC
+/*
+ * The libc allocator, wrapped at link time ( -Wl,--wrap ) so
+ * the library's calls are counted too
+ */
+void* __real_malloc( size_t size );
+void* __real_calloc( size_t count, size_t size );
+void* __real_realloc( void* ptr, size_t size );
+void __real_free( void* ptr );
+
+void* __wrap_malloc
+    (
+    size_t  size
+    )
+{
+if( IVK_ATOMIC_LOAD( &count_allocations ) )
+    {
+    IVK_ATOMIC_ADD_U64( &allocation_count, 1 );
+    }
+
+return __real_malloc( size );
+
+}
+
+void* __wrap_calloc
+    (
+    size_t  count,
+    size_t  size
+    )
+{
+if( IVK_ATOMIC_LOAD( &count_allocations ) )
+    {
+    IVK_ATOMIC_ADD_U64( &allocation_count, 1 );
+    }
+
+return __real_calloc( count, size );
+
+}
+
+void* __wrap_realloc
+    (
+    void*   ptr,
+    size_t  size
+    )
+{
+if( IVK_ATOMIC_LOAD( &count_allocations ) )
+    {
+    IVK_ATOMIC_ADD_U64( &allocation_count, 1 );
+    }
+
+return __real_realloc( ptr, size );
+
+}
+
+void __wrap_free
+    (
+    void*   ptr
+    )
+{
+if( ptr && IVK_ATOMIC_LOAD( &count_allocations ) )
+    {
+    IVK_ATOMIC_ADD_U64( &allocation_count, 1 );
+    }
+
+__real_free( ptr );
+
+}
+#endif
+
+
+/*
+ * Runs the named tests, or all of them. Each needs a
+ * Vulkan device, but no window.
+ */
+int main
+    (
+    int     argc,
+    char**  argv
+    )
+{
+/* Local variables */
+unsigned int    test_count = sizeof( tests ) / sizeof( tests[ 0 ] );
+unsigned int    failed_count = 0;
+bool            is_selected = false;
+
+for( unsigned int i = 0; i < test_count; i++ )
+    {
+    is_selected = ( argc < 2 );
+    for( int j = 1; j < argc; j++ )
+        {
+        if( strcmp( argv[ j ], tests[ i ].name ) == 0 )
+            {
+            is_selected = true;
+            }
+        }
+    if( !is_selected )
+        {
+        continue;
+        }
+
+    printf( "%s\n", tests[ i ].name );
+    if( tests[ i ].run() )
+        {
+        printf( "  passed\n" );
+        }
+    else
+        {
+        printf( "  FAILED\n" );
+        failed_count++;
+        }
+    }
+
+return( failed_count > 0 ? 1 : 0 );
+
+}
+
+
+/*
+ * Timings of the nested zones, e.g. the overlay inside the
+ * scene pass, with the pipeline statistics on
+ */
+bool test_gpu_profiler_nested_zones
+    (
+    void
+    )
+{
+/* Local variables */
+IVK_Context                     ivk_context;
+IVK_config_type                 ivk_config = { 0 };
+IVK_gpu_zone_report_type        reports[ MAX_REPORTS ];
+unsigned int                    report_count = 0;
+const IVK_gpu_zone_report_type* frame = NULL;
+const IVK_gpu_zone_report_type* scene = NULL;
+const IVK_gpu_zone_report_type* hud = NULL;
+bool                            is_passed = true;
+
+ivk_config.headless = true;
+ivk_config.offscreen_extent.width = TEST_WIDTH;
+ivk_config.offscreen_extent.height = TEST_HEIGHT;
+ivk_config.gpu_profiler = true;
+ivk_config.gpu_statistics = true;
+ivk_config.hud = true;
+if( !ivk_init( &ivk_context, 0, NULL, NULL, &ivk_config ) )
+    {
+    return false;
+    }
+ivk_show_hud( &ivk_context, true );
+
+for( unsigned int i = 0; i < PROFILER_FRAMES; i++ )
+    {
+    ivk_render( &ivk_context, NULL, 0 );
+    }
+ivk_wait_idle( &ivk_context );
+
+report_count = ivk_get_gpu_profile( &ivk_context, reports, MAX_REPORTS );
+if( report_count > MAX_REPORTS )
+    {
+    report_count = MAX_REPORTS;
+    }
+frame = find_report( reports, report_count, "frame" );
+scene = find_report( reports, report_count, "scene" );
+hud = find_report( reports, report_count, "hud" );
+
+/* Every frame is read back, the inner zone included */
+if( !frame || frame->sample_count != PROFILER_FRAMES )
+    {
+    printf( "  %u of %u frames were timed.\n", frame ? frame->sample_count : 0, PROFILER_FRAMES );
+    is_passed = false;
+    }
+if( !scene || !hud || hud->sample_count != scene->sample_count )
+    {
+    printf( "  The hud zone was not timed with the scene.\n" );
+    is_passed = false;
+    }
+
+/* Only the outermost zone counts invocations */
+if( hud && hud->has_statistics )
+    {
+    printf( "  The nested hud zone has statistics.\n" );
+    is_passed = false;
+    }
+
+ivk_teardown( &ivk_context );
+
+return is_passed;
+
+}
+
+
+/*
+ * Two contexts initialized at once from two threads, only
+ * one of them asking for the host memory tracking
+ */
+bool test_contexts_on_two_threads
+    (
+    void
+    )
+{
+/* Local variables */
+static context_thread_type  contexts[ 2 ];
+IVK_thread_type             threads[ 2 ];
+bool                        is_passed = true;
+
+for( unsigned int i = 0; i < 2; i++ )
+    {
+    memset( &contexts[ i ], 0, sizeof( contexts[ i ] ) );
+    contexts[ i ].track_host_memory = ( i == 0 );
+    if( !ivk_thread_create( &threads[ i ], run_context_thread, &contexts[ i ] ) )
+        {
+        printf( "  Could not start thread %u.\n", i );
+        return false;
+        }
+    }
+for( unsigned int i = 0; i < 2; i++ )
+    {
+    ivk_thread_join( &threads[ i ] );
+    }
+
+/* Whichever came first, both made their objects with the same
+callbacks */
+if( contexts[ 0 ].host_allocator != contexts[ 1 ].host_allocator )
+    {
+    printf( "  The contexts were given different allocation callbacks.\n" );
+    is_passed = false;
+    }
+for( unsigned int i = 0; i < 2; i++ )
+    {
+    if( contexts[ i ].frame_count != CONTEXT_FRAMES )
+        {
+        printf( "  Context %u rendered %llu of %u frames.\n", i, ( unsigned long long )contexts[ i ].frame_count, CONTEXT_FRAMES );
+        is_passed = false;
+        }
+    }
+
+return is_passed;
+
+}
+
+
+/*
+ * Settled frames, counted through the wrapped libc allocator,
+ * make no heap allocations
+ */
+bool test_settled_frames_do_not_allocate
+    (
+    void
+    )
+{
+/* Local variables */
+IVK_Context         ivk_context;
+IVK_config_type     ivk_config = { 0 };
+uint64_t            counted = 0;
+
+#ifndef IVK_TEST_WRAP_ALLOC
+printf( "  The allocator is not wrapped on this platform, not counted.\n" );
+return true;
+#endif
+
+ivk_config.headless = true;
+ivk_config.offscreen_extent.width = TEST_WIDTH;
+ivk_config.offscreen_extent.height = TEST_HEIGHT;
+if( !ivk_init( &ivk_context, 0, NULL, NULL, &ivk_config ) )
+    {
+    return false;
+    }
+
+/* Every slot has recorded a few frames, its scratch and the
+batches have grown to fit */
+for( unsigned int i = 0; i < SETTLING_FRAMES; i++ )
+    {
+    ivk_render( &ivk_context, NULL, 0 );
+    }
+
+/* Nothing here prints, stdout allocates its buffer lazily */
+IVK_ATOMIC_STORE( &allocation_count, 0 );
+IVK_ATOMIC_STORE( &count_allocations, 1 );
+for( unsigned int i = 0; i < COUNTED_FRAMES; i++ )
+    {
+    ivk_render( &ivk_context, NULL, 0 );
+    }
+IVK_ATOMIC_STORE( &count_allocations, 0 );
+counted = IVK_ATOMIC_LOAD( &allocation_count );
+
+ivk_wait_idle( &ivk_context );
+ivk_teardown( &ivk_context );
+
+if( counted != 0 )
+    {
+    printf( "  %u settled frames made %llu heap calls.\n", COUNTED_FRAMES, ( unsigned long long )counted );
+    return false;
+    }
+
+return true;
+
+}
+
+
+/*
+ * Returns the report of the named zone, NULL if it has none
+ */
+const IVK_gpu_zone_report_type* find_report
+    (
+    const IVK_gpu_zone_report_type* reports,
+    unsigned int                    count,
+    const char*                     name
+    )
+{
+for( unsigned int i = 0; i < count; i++ )
+    {
+    if( strcmp( reports[ i ].name, name ) == 0 )
+        {
+        return &reports[ i ];
+        }
+    }
+
+return NULL;
+
+}
+
+
+/*
+ * Initializes a context, renders a few frames and tears it
+ * down, on a thread of its own
+ */
+void run_context_thread
+    (
+    void*   arg
+    )
+{
+/* Local variables */
+context_thread_type*    thread = ( context_thread_type* )arg;
+IVK_config_type         ivk_config = { 0 };
+IVK_stats_type          ivk_stats = { 0 };
+
+ivk_config.headless = true;
+ivk_config.offscreen_extent.width = TEST_WIDTH;
+ivk_config.offscreen_extent.height = TEST_HEIGHT;
+ivk_config.track_host_memory = thread->track_host_memory;
+if( !ivk_init( &thread->context, 0, NULL, NULL, &ivk_config ) )
+    {
+    return;
+    }
+thread->host_allocator = thread->context.host_allocator;
+
+for( unsigned int i = 0; i < CONTEXT_FRAMES; i++ )
+    {
+    ivk_render( &thread->context, NULL, 0 );
+    }
+ivk_wait_idle( &thread->context );
+ivk_get_stats( &thread->context, &ivk_stats );
+thread->frame_count = ivk_stats.frame_count;
+
+ivk_teardown( &thread->context );
+
+}
@@ -0,0 +1,323 @@
+#include "ivk_thread.h"
+
+#if !defined( _WIN32 )
+    #include <errno.h>
+    #include <sched.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+/*** Static functions ***/
+/*
+ * Thread entry point, calls the user function
+ */
+#if defined( _WIN32 )
+static DWORD WINAPI thread_main
+    (
+    LPVOID  arg
+    );
+#else
+static void* thread_main
+    (
+    void*   arg
+    );
+#endif
+
+
+/*
+ * Starts a thread running func( arg ). The thread struct
+ * must stay alive until the thread is joined.
+ */
+bool ivk_thread_create
+    (
+    IVK_thread_type*        thread,
+    IVK_thread_func_type    func,
+    void*                   arg
+    )
+{
+thread->func = func;
+thread->arg = arg;
+
+#if defined( _WIN32 )
+thread->handle = CreateThread( NULL, 0, thread_main, thread, 0, NULL );
+return( thread->handle != NULL );
+#else
+return( pthread_create( &thread->handle, NULL, thread_main, thread ) == 0 );
+#endif
+
+}
+
+
+/*
+ * Waits for a thread to finish
+ */
+void ivk_thread_join
+    (
+    IVK_thread_type*    thread
+    )
+{
+#if defined( _WIN32 )
+WaitForSingleObject( thread->handle, INFINITE );
+CloseHandle( thread->handle );
+#else
+pthread_join( thread->handle, NULL );
+#endif
+
+}
+
+
+/*
+ * Returns the number of hardware threads, at least 1
+ */
+unsigned int ivk_thread_hardware_count
+    (
+    void
+    )
+{
+#if defined( _WIN32 )
+/* Local variables */
+SYSTEM_INFO _info;
+
+GetSystemInfo( &_info );
+return( _info.dwNumberOfProcessors > 0 ? ( unsigned int )_info.dwNumberOfProcessors : 1 );
+#else
+/* Local variables */
+long    _count = sysconf( _SC_NPROCESSORS_ONLN );
+
+return( _count > 0 ? ( unsigned int )_count : 1 );
+#endif
+
+}
+
+
+/*
+ * Puts the calling thread to sleep for about ms milliseconds
+ */
+void ivk_thread_sleep_ms
+    (
+    unsigned int    ms
+    )
+{
+#if defined( _WIN32 )
+Sleep( ms );
+#else
+usleep( ( useconds_t )ms * 1000 );
+#endif
+
+}
+
+
+/*
+ * Gives the rest of the calling thread's time slice away
+ */
+void ivk_thread_yield
+    (
+    void
+    )
+{
+#if defined( _WIN32 )
+SwitchToThread();
+#else
+sched_yield();
+#endif
+
+}
+
+
+/*
+ * Mutex functions
+ */
+void ivk_mutex_init
+    (
+    IVK_mutex_type* mutex
+    )
+{
+#if defined( _WIN32 )
+InitializeCriticalSection( mutex );
+#else
+pthread_mutex_init( mutex, NULL );
+#endif
+
+}
+
+
+void ivk_mutex_destroy
+    (
+    IVK_mutex_type* mutex
+    )
+{
+#if defined( _WIN32 )
+DeleteCriticalSection( mutex );
+#else
+pthread_mutex_destroy( mutex );
+#endif
+
+}
+
+
+void ivk_mutex_lock
+    (
+    IVK_mutex_type* mutex
+    )
+{
+#if defined( _WIN32 )
+EnterCriticalSection( mutex );
+#else
+pthread_mutex_lock( mutex );
+#endif
+
+}
+
+
+void ivk_mutex_unlock
+    (
+    IVK_mutex_type* mutex
+    )
+{
+#if defined( _WIN32 )
+LeaveCriticalSection( mutex );
+#else
+pthread_mutex_unlock( mutex );
+#endif
+
+}
+
+
+/*
+ * Condition variable functions
+ */
+void ivk_cond_init
+    (
+    IVK_cond_type*  cond
+    )
+{
+#if defined( _WIN32 )
+InitializeConditionVariable( cond );
+#else
+pthread_cond_init( cond, NULL );
+#endif
+
+}
+
+
+void ivk_cond_destroy
+    (
+    IVK_cond_type*  cond
+    )
+{
+#if defined( _WIN32 )
+/* Nothing to release */
+( void )cond;
+#else
+pthread_cond_destroy( cond );
+#endif
+
+}
+
+
+void ivk_cond_wait
+    (
+    IVK_cond_type*  cond,
+    IVK_mutex_type* mutex
+    )
+{
+#if defined( _WIN32 )
+SleepConditionVariableCS( cond, mutex, INFINITE );
+#else
+pthread_cond_wait( cond, mutex );
+#endif
+
+}
+
+
+/*
+ * Waits like ivk_cond_wait, for at most ms milliseconds.
+ * Returns false if the time ran out.
+ */
+bool ivk_cond_wait_ms
+    (
+    IVK_cond_type*  cond,
+    IVK_mutex_type* mutex,
+    unsigned int    ms
+    )
+{
+#if defined( _WIN32 )
+return( SleepConditionVariableCS( cond, mutex, ms ) != 0 );
+#else
+/* Local variables */
+struct timespec _deadline;
+
+/* The condition variables wait on the realtime clock by default */
+clock_gettime( CLOCK_REALTIME, &_deadline );
+_deadline.tv_sec += ms / 1000;
+_deadline.tv_nsec += ( long )( ms % 1000 ) * 1000000;
+if( _deadline.tv_nsec >= 1000000000 )
+    {
+    _deadline.tv_sec++;
+    _deadline.tv_nsec -= 1000000000;
+    }
+
+return( pthread_cond_timedwait( cond, mutex, &_deadline ) != ETIMEDOUT );
+#endif
+
+}
+
+
+void ivk_cond_signal
+    (
+    IVK_cond_type*  cond
+    )
+{
+#if defined( _WIN32 )
+WakeConditionVariable( cond );
+#else
+pthread_cond_signal( cond );
+#endif
+
+}
+
+
+void ivk_cond_broadcast
+    (
+    IVK_cond_type*  cond
+    )
+{
+#if defined( _WIN32 )
+WakeAllConditionVariable( cond );
+#else
+pthread_cond_broadcast( cond );
+#endif
+
+}
+
+
+/*
+ * Thread entry point, calls the user function
+ */
+#if defined( _WIN32 )
+static DWORD WINAPI thread_main
+    (
+    LPVOID  arg
+    )
+{
+/* Local variables */
+IVK_thread_type*    _thread = ( IVK_thread_type* )arg;
+
+_thread->func( _thread->arg );
+return 0;
+
+}
+#else
+static void* thread_main
+    (
+    void*   arg
+    )
+{
+/* Local variables */
+IVK_thread_type*    _thread = ( IVK_thread_type* )arg;
+
+_thread->func( _thread->arg );
+return NULL;
+
+}
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+#include <stdbool.h>
+
+#if defined( _WIN32 )
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+/*
+ * Storage class of a variable with one instance per thread
+ */
+#if defined( _MSC_VER )
+    #define IVK_THREAD_LOCAL    __declspec( thread )
+#else
+    #define IVK_THREAD_LOCAL    __thread
+#endif
+
+/*
+ * Minimal threading primitives over Win32 and pthreads
+ */
+typedef void ( *IVK_thread_func_type )
+    (
+    void*   arg
+    );
+
+typedef struct
+    {
+#if defined( _WIN32 )
+    HANDLE              handle;
+#else
+    pthread_t           handle;
+#endif
+    IVK_thread_func_type
+                        func;
+    void*               arg;
+    } IVK_thread_type;
+
+#if defined( _WIN32 )
+    typedef CRITICAL_SECTION    IVK_mutex_type;
+    typedef CONDITION_VARIABLE  IVK_cond_type;
+#else
+    typedef pthread_mutex_t     IVK_mutex_type;
+    typedef pthread_cond_t      IVK_cond_type;
+#endif
+
+
+/*
+ * Starts a thread running func( arg ). The thread struct
+ * must stay alive until the thread is joined.
+ */
+bool ivk_thread_create
+    (
+    IVK_thread_type*        thread,
+    IVK_thread_func_type    func,
+    void*                   arg
+    );
+
+/*
+ * Waits for a thread to finish
+ */
+void ivk_thread_join
+    (
+    IVK_thread_type*    thread
+    );
+
+/*
+ * Returns the number of hardware threads, at least 1
+ */
+unsigned int ivk_thread_hardware_count
+    (
+    void
+    );
+
+/*
+ * Puts the calling thread to sleep for about ms milliseconds
+ */
+void ivk_thread_sleep_ms
+    (
+    unsigned int    ms
+    );
+
+/*
+ * Gives the rest of the calling thread's time slice away
+ */
+void ivk_thread_yield
+    (
+    void
+    );
+
+/*
+ * Mutex functions
+ */
+void ivk_mutex_init
+    (
+    IVK_mutex_type* mutex
+    );
+
+void ivk_mutex_destroy
+    (
+    IVK_mutex_type* mutex
+    );
+
+void ivk_mutex_lock
+    (
+    IVK_mutex_type* mutex
+    );
+
+void ivk_mutex_unlock
+    (
+    IVK_mutex_type* mutex
+    );
+
+/*
+ * Condition variable functions
+ */
+void ivk_cond_init
+    (
+    IVK_cond_type*  cond
+    );
+
+void ivk_cond_destroy
+    (
+    IVK_cond_type*  cond
+    );
+
+void ivk_cond_wait
+    (
+    IVK_cond_type*  cond,
+    IVK_mutex_type* mutex
+    );
+
+/*
+ * Waits like ivk_cond_wait, for at most ms milliseconds.
+ * Returns false if the time ran out.
+ */
+bool ivk_cond_wait_ms
+    (
+    IVK_cond_type*  cond,
+    IVK_mutex_type* mutex,
+    unsigned int    ms
+    );
+
+void ivk_cond_signal
+    (
+    IVK_cond_type*  cond
+    );
+
+void ivk_cond_broadcast
+    (
+    IVK_cond_type*  cond
+    );
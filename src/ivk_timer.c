@@ -0,0 +1,41 @@
+#include "ivk_timer.h"
+
+#if defined( _WIN32 )
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/*
+ * Returns a monotonic timestamp in nanoseconds. Only the
+ * difference between two timestamps is meaningful.
+ */
+uint64_t ivk_timer_now_ns
+    (
+    void
+    )
+{
+#if defined( _WIN32 )
+/* Local variables */
+static LARGE_INTEGER    s_frequency = { 0 };
+LARGE_INTEGER           _counter = { 0 };
+
+if( s_frequency.QuadPart == 0 )
+    {
+    QueryPerformanceFrequency( &s_frequency );
+    }
+QueryPerformanceCounter( &_counter );
+
+/* Split the conversion to avoid overflowing the multiplication */
+return( ( uint64_t )( _counter.QuadPart / s_frequency.QuadPart ) * 1000000000ull +
+        ( uint64_t )( _counter.QuadPart % s_frequency.QuadPart ) * 1000000000ull / ( uint64_t )s_frequency.QuadPart );
+#else
+/* Local variables */
+struct timespec _ts;
+
+clock_gettime( CLOCK_MONOTONIC, &_ts );
+return( ( uint64_t )_ts.tv_sec * 1000000000ull + ( uint64_t )_ts.tv_nsec );
+#endif
+
+}
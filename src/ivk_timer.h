@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Returns a monotonic timestamp in nanoseconds. Only the
+ * difference between two timestamps is meaningful.
+ */
+uint64_t ivk_timer_now_ns
+    (
+    void
+    );
+
+/*
+ * Converts a nanosecond interval to milliseconds
+ */
+#define IVK_NS_TO_MS( ns )  ( ( double )( ns ) / 1000000.0 )
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivk_trace.h"
+#include "ivk_atomic.h"
+#include "ivk_thread.h"
+#include "ivk_timer.h"
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+    #include <intrin.h>
+    #define USE_RDTSC           1
+#elif ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    #include <x86intrin.h>
+    #define USE_RDTSC           1
+#else
+    #define USE_RDTSC           0
+#endif
+
+/* Longest exit dump path */
+#define MAX_PATH_LENGTH         512
+
+/*
+ * Global data
+ */
+volatile bool g_ivk_trace_enabled = false;
+
+/* Every thread that ever recorded, newest first */
+static IVK_trace_thread_type* volatile s_threads = NULL;
+
+/* Ring of the calling thread, NULL until its first event */
+static IVK_THREAD_LOCAL IVK_trace_thread_type* s_thread = NULL;
+
+/* Both clocks when tracing started, to convert the ticks */
+static uint64_t s_base_ticks = 0;
+static uint64_t s_base_ns = 0;
+
+static char     s_exit_path[ MAX_PATH_LENGTH ];
+static bool     s_is_exit_registered = false;
+
+/*** Static functions ***/
+/*
+ * Returns the trace clock, rdtsc where available and the
+ * monotonic clock otherwise
+ */
+static uint64_t get_ticks
+    (
+    void
+    );
+
+/*
+ * Returns the ring of the calling thread, registering it on
+ * first use. NULL if out of memory.
+ */
+static IVK_trace_thread_type* get_thread
+    (
+    void
+    );
+
+/*
+ * Dumps the trace to the exit path
+ */
+static void dump_at_exit
+    (
+    void
+    );
+
+
+/*
+ * Starts tracing. With an exit_path the trace is also
+ * dumped there when the process exits.
+ */
+void ivk_trace_enable
+    (
+    const char*     exit_path
+    )
+{
+/* The first start is time zero of the trace */
+if( s_base_ns == 0 )
+    {
+    s_base_ticks = get_ticks();
+    s_base_ns = ivk_timer_now_ns();
+    }
+
+if( exit_path )
+    {
+    snprintf( s_exit_path, sizeof( s_exit_path ), "%s", exit_path );
+    if( !s_is_exit_registered )
+        {
+        s_is_exit_registered = ( atexit( dump_at_exit ) == 0 );
+        }
+    }
+
+g_ivk_trace_enabled = true;
+
+}
+
+
+/*
+ * Stops tracing, keeping what was recorded
+ */
+void ivk_trace_disable
+    (
+    void
+    )
+{
+g_ivk_trace_enabled = false;
+
+}
+
+
+/*
+ * Records an event in the ring of the calling thread, see
+ * IVK_TRACE_BEGIN
+ */
+void ivk_trace_record
+    (
+    const char*                 name,
+    IVK_trace_event_kind_type   kind
+    )
+{
+/* Local variables */
+IVK_trace_thread_type*  _thread = s_thread ? s_thread : get_thread();
+IVK_trace_event_type*   _event = NULL;
+uint64_t                _count = 0;
+
+if( !_thread )
+    {
+    return;
+    }
+
+/* Only this thread writes the ring; the count publishes the event to
+the dump */
+_count = _thread->count;
+_event = &_thread->events[ _count & ( IVK_TRACE_RING_SIZE - 1 ) ];
+_event->name = name;
+_event->ticks = get_ticks();
+_event->kind = kind;
+IVK_ATOMIC_STORE( &_thread->count, _count + 1 );
+
+}
+
+
+/*
+ * Names the calling thread in the trace
+ */
+void ivk_trace_set_thread_name
+    (
+    const char*     name
+    )
+{
+/* Local variables */
+IVK_trace_thread_type*  _thread = get_thread();
+
+if( _thread )
+    {
+    snprintf( _thread->name, sizeof( _thread->name ), "%s", name );
+    }
+
+}
+
+
+/*
+ * Writes the events of every thread as Chrome trace_event
+ * JSON, for chrome://tracing or Perfetto. Best done while
+ * the threads are quiet; the oldest events of a busy
+ * thread may be overwritten as they are written out.
+ */
+bool ivk_trace_dump
+    (
+    const char*     path
+    )
+{
+/* Local variables */
+FILE*                   _file = NULL;
+IVK_trace_thread_type*  _thread = NULL;
+const IVK_trace_event_type*
+                        _event = NULL;
+uint64_t                _count = 0;
+uint64_t                _first = 0;
+uint64_t                _ticks = 0;
+unsigned int            _depth = 0;
+double                  _us_per_tick = 0.001;
+bool                    _is_first_event = true;
+
+_file = fopen( path, "w" );
+if( !_file )
+    {
+    printf( "Could not open %s.\n", path );
+    return false;
+    }
+
+/* Calibrate the ticks against the monotonic clock over the whole
+trace, the longer the better */
+#if USE_RDTSC
+_ticks = get_ticks() - s_base_ticks;
+if( _ticks > 0 )
+    {
+    _us_per_tick = ( double )( ivk_timer_now_ns() - s_base_ns ) / 1000.0 / ( double )_ticks;
+    }
+#endif
+
+fprintf( _file, "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n" );
+for( _thread = IVK_ATOMIC_LOAD( &s_threads ); _thread; _thread = _thread->next )
+    {
+    fprintf
+        (
+        _file,
+        "%s{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": { \"name\": \"%s\" } }",
+        _is_first_event ? "" : ",\n",
+        _thread->thread_id,
+        _thread->name
+        );
+    _is_first_event = false;
+
+    _count = IVK_ATOMIC_LOAD( &_thread->count );
+    _first = ( _count > IVK_TRACE_RING_SIZE ) ? _count - IVK_TRACE_RING_SIZE : 0;
+    _depth = 0;
+    for( uint64_t i = _first; i < _count; i++ )
+        {
+        _event = &_thread->events[ i & ( IVK_TRACE_RING_SIZE - 1 ) ];
+
+        /* The ring may have cut a zone in half, skip its end */
+        if( _event->kind == IVK_TRACE_EVENT_END )
+            {
+            if( _depth == 0 )
+                {
+                continue;
+                }
+            _depth--;
+            }
+        else
+            {
+            _depth++;
+            }
+
+        /* Events from before the start sit at 0 */
+        _ticks = ( _event->ticks > s_base_ticks ) ? _event->ticks - s_base_ticks : 0;
+        fprintf
+            (
+            _file,
+            ",\n{ \"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u }",
+            _event->name,
+            ( _event->kind == IVK_TRACE_EVENT_BEGIN ) ? 'B' : 'E',
+            _ticks * _us_per_tick,
+            _thread->thread_id
+            );
+        }
+    }
+fprintf( _file, "\n]\n}\n" );
+
+fclose( _file );
+
+return true;
+
+}
+
+
+/*
+ * Times count BEGIN / END pairs on the calling thread and
+ * returns the cost of one pair in nanoseconds. The events
+ * are dropped again. Tracing must be enabled.
+ */
+double ivk_trace_measure_overhead
+    (
+    unsigned int    count
+    )
+{
+/* Local variables */
+IVK_trace_thread_type*  _thread = get_thread();
+uint64_t                _saved_count = 0;
+uint64_t                _start_ns = 0;
+uint64_t                _elapsed_ns = 0;
+
+if( !_thread || count == 0 || !g_ivk_trace_enabled )
+    {
+    return 0.0;
+    }
+
+/* Not more than the ring holds, so the events can be taken back */
+if( count > IVK_TRACE_RING_SIZE / 2 )
+    {
+    count = IVK_TRACE_RING_SIZE / 2;
+    }
+
+_saved_count = _thread->count;
+_start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; i < count; i++ )
+    {
+    IVK_TRACE_BEGIN( "overhead" );
+    IVK_TRACE_END( "overhead" );
+    }
+_elapsed_ns = ivk_timer_now_ns() - _start_ns;
+IVK_ATOMIC_STORE( &_thread->count, _saved_count );
+
+return( ( double )_elapsed_ns / count );
+
+}
+
+
+/*
+ * Returns the trace clock, rdtsc where available and the
+ * monotonic clock otherwise
+ */
+static uint64_t get_ticks
+    (
+    void
+    )
+{
+#if USE_RDTSC
+return __rdtsc();
+#else
+return ivk_timer_now_ns();
+#endif
+
+}
+
+
+/*
+ * Returns the ring of the calling thread, registering it on
+ * first use. NULL if out of memory.
+ */
+static IVK_trace_thread_type* get_thread
+    (
+    void
+    )
+{
+/* Local variables */
+IVK_trace_thread_type*  _thread = s_thread;
+IVK_trace_thread_type*  _head = NULL;
+
+if( _thread )
+    {
+    return _thread;
+    }
+
+_thread = ( IVK_trace_thread_type* )calloc( 1, sizeof( IVK_trace_thread_type ) );
+if( !_thread )
+    {
+    return NULL;
+    }
+
+/* Push onto the registry; the id follows from the thread before */
+do
+    {
+    _head = IVK_ATOMIC_LOAD( &s_threads );
+    _thread->next = _head;
+    _thread->thread_id = _head ? _head->thread_id + 1 : 1;
+    } while( !IVK_ATOMIC_CAS_PTR( &s_threads, _head, _thread ) );
+
+snprintf( _thread->name, sizeof( _thread->name ), "thread %u", _thread->thread_id );
+s_thread = _thread;
+
+return _thread;
+
+}
+
+
+/*
+ * Dumps the trace to the exit path
+ */
+static void dump_at_exit
+    (
+    void
+    )
+{
+g_ivk_trace_enabled = false;
+ivk_trace_dump( s_exit_path );
+
+}
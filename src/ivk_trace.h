@@ -0,0 +1,132 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Events kept per thread. Older events are overwritten, so
+ * a dump holds the last IVK_TRACE_RING_SIZE of each thread.
+ */
+#define IVK_TRACE_RING_SIZE             32768   /* Power of two */
+#define IVK_TRACE_NAME_LENGTH           32
+
+/*
+ * Zone instrumentation. Always compiled in; while tracing
+ * is off a zone costs a load and a branch.
+ *
+ * Names must be string literals, or live as long as the
+ * trace, only the pointer is recorded. Every BEGIN needs
+ * its END on the same thread.
+ *
+ * Measured with ivk_trace_measure_overhead on a single
+ * core x86-64 virtual machine: about 50 ns per BEGIN / END
+ * pair with rdtsc, about 90 ns with clock_gettime as the
+ * clock. A virtualized rdtsc is slower than a native one,
+ * --trace reports the figure of the machine at hand.
+ */
+#define IVK_TRACE_BEGIN( name ) do {                        \
+        if( g_ivk_trace_enabled )                           \
+            {                                               \
+            ivk_trace_record( ( name ), IVK_TRACE_EVENT_BEGIN ); \
+            }                                               \
+    } while( 0 )
+
+#define IVK_TRACE_END( name ) do {                          \
+        if( g_ivk_trace_enabled )                           \
+            {                                               \
+            ivk_trace_record( ( name ), IVK_TRACE_EVENT_END ); \
+            }                                               \
+    } while( 0 )
+
+/*
+ * Types
+ */
+typedef enum
+    {
+    IVK_TRACE_EVENT_BEGIN,
+    IVK_TRACE_EVENT_END
+    } IVK_trace_event_kind_type;
+
+typedef struct
+    {
+    const char*         name;
+    uint64_t            ticks;
+    IVK_trace_event_kind_type
+                        kind;
+    } IVK_trace_event_type;
+
+/*
+ * Ring of one thread. Only the owning thread writes it, the
+ * dump reads up to the published count.
+ */
+typedef struct IVK_trace_thread_type
+    {
+    IVK_trace_event_type
+                        events[ IVK_TRACE_RING_SIZE ];
+    volatile uint64_t   count;              /* Events ever recorded */
+    unsigned int        thread_id;
+    char                name[ IVK_TRACE_NAME_LENGTH ];
+    struct IVK_trace_thread_type*
+                        next;               /* Registry of all the threads */
+    } IVK_trace_thread_type;
+
+/*
+ * Set while tracing
+ */
+extern volatile bool g_ivk_trace_enabled;
+
+
+/*
+ * Starts tracing. With an exit_path the trace is also
+ * dumped there when the process exits.
+ */
+void ivk_trace_enable
+    (
+    const char*     exit_path
+    );
+
+/*
+ * Stops tracing, keeping what was recorded
+ */
+void ivk_trace_disable
+    (
+    void
+    );
+
+/*
+ * Records an event in the ring of the calling thread, see
+ * IVK_TRACE_BEGIN
+ */
+void ivk_trace_record
+    (
+    const char*                 name,
+    IVK_trace_event_kind_type   kind
+    );
+
+/*
+ * Names the calling thread in the trace
+ */
+void ivk_trace_set_thread_name
+    (
+    const char*     name
+    );
+
+/*
+ * Writes the events of every thread as Chrome trace_event
+ * JSON, for chrome://tracing or Perfetto. Best done while
+ * the threads are quiet; the oldest events of a busy
+ * thread may be overwritten as they are written out.
+ */
+bool ivk_trace_dump
+    (
+    const char*     path
+    );
+
+/*
+ * Times count BEGIN / END pairs on the calling thread and
+ * returns the cost of one pair in nanoseconds. The events
+ * are dropped again. Tracing must be enabled.
+ */
+double ivk_trace_measure_overhead
+    (
+    unsigned int    count
+    );
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include "glfw/glfw3.h"
@@ -7,11 +8,19 @@
 #include "vulkan/vulkan.h"
 
 #include "ivk.h"
+#include "ivk_timer.h"
+#include "ivk_batch.h"
+#include "ivk_render_thread.h"
+#include "ivk_trace.h"
 
 /* Project constants */
 #define WINDOW_WIDTH    600
 #define WINDOW_HEIGHT   600
 #define WINDOW_NAME     "IVK Window"
+#define HEADLESS_FRAMES 1000
+#define READBACK_SLOTS  3
+#define SHM_SLOTS       4
+#define PUBLISH_WAIT_MS 10      /* Longest the events go unpolled */
 
 /*
  * Global data
@@ -28,6 +37,12 @@ unsigned int indices[] =
     0, 1, 2,
     2, 3, 0
     };
+IVK_Context   ivk_context;             /* The renderer */
+IVK_draw_type triangle_draw = { 0 };     /* The whole scene */
+bool        use_gpu_profile = false;
+bool        use_hud = false;
+bool        use_memory_report = false;
+const char* gpu_profile_path = NULL;
 
 /*
  * Initialize GLFW
@@ -39,47 +54,303 @@ GLFWwindow* init_glfw
     char*        window_name
     );
 
+/*
+ * Initializes IVK without a window, with the triangle.
+ * False if IVK could not be initialized.
+ */
+bool init_headless
+    (
+    void
+    );
+
+/*
+ * Prints the GPU timings and dumps them to the file
+ * given with --gpu-profile
+ */
+void report_gpu_profile
+    (
+    void
+    );
+
+/*
+ * Renders frame_count frames without a window and
+ * reports the throughput
+ */
+int run_headless
+    (
+    unsigned int frame_count,
+    bool         use_readback,
+    const char*  shm_name
+    );
+
+/*
+ * Renders and encodes a sequence of frames, reporting the
+ * throughput and the occupancy of each stage
+ */
+int run_batch
+    (
+    IVK_batch_config_type*  batch_config
+    );
+
+/*
+ * Scene state of each batch frame. Flips the winding
+ * every 30 frames, so the culled quad blinks.
+ */
+void prepare_batch_frame
+    (
+    IVK_Context*    context,
+    unsigned int    frame_index,
+    void*           user_data
+    );
+
+/*
+ * Receives the frames read back. Sums the pixels, so the
+ * data is actually touched.
+ */
+void on_readback
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    );
+
 
 /*
  * Main program
  *  - Initializes the windowing library
  *  - Initializes the IVK library
+ *
+ * With --headless [frames], renders offscreen instead.
+ * Add --readback to copy every frame back to the CPU.
+ * Add --shm name to publish every frame into a shared
+ * memory ring, for shm_consumer name.
+ *
+ * --gpu-profile [file.json|file.csv] times the passes on
+ * the GPU, with pipeline statistics, and reports them at
+ * exit.
+ *
+ * --hud draws the frame times, draw counts and memory use
+ * over the scene.
+ *
+ * --memory-report counts the host memory Vulkan allocates
+ * through the library, and reports it at exit.
+ *
+ * With --batch [frames], renders and encodes offscreen
+ * frames, with --format ppm|png|raw, --out pattern ( e.g.
+ * frame_%05u.%s ) and --workers count.
+ *
+ * --trace file.json records the CPU side of every frame
+ * and writes it at exit, for chrome://tracing or Perfetto.
+ *
+ * --render-thread submits the frames from a thread of their
+ * own, the main thread polls the events and publishes the
+ * scene.
  */
 int main
     (
-    void
+    int     argc,
+    char**  argv
     )
 {
 /* Local variables */
 GLFWwindow*     glfw_window_handle = NULL;
 unsigned int    glfw_extension_count = 0;
 const char**    glfw_extensions = NULL;
+IVK_config_type ivk_config = { 0 };
+IVK_stats_type  ivk_stats = { 0 };
+bool            headless = false;
+bool            use_readback = false;
+bool            batch = false;
+bool            use_render_thread = false;
+const char*     shm_name = NULL;
+const char*     trace_path = NULL;
+unsigned int    frame_count = HEADLESS_FRAMES;
+IVK_batch_config_type
+                batch_config = { 0 };
+IVK_render_thread_type
+                render_thread;
+IVK_draw_type*  snapshot = NULL;
+
+/* Parse the command line */
+for( int i = 1; i < argc; i++ )
+    {
+    if( strcmp( argv[ i ], "--headless" ) == 0 )
+        {
+        headless = true;
+        if( i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 )
+            {
+            frame_count = ( unsigned int )atoi( argv[ ++i ] );
+            }
+        }
+    else if( strcmp( argv[ i ], "--readback" ) == 0 )
+        {
+        use_readback = true;
+        }
+    else if( strcmp( argv[ i ], "--gpu-profile" ) == 0 )
+        {
+        use_gpu_profile = true;
+        if( i + 1 < argc && strncmp( argv[ i + 1 ], "--", 2 ) != 0 )
+            {
+            gpu_profile_path = argv[ ++i ];
+            }
+        }
+    else if( strcmp( argv[ i ], "--hud" ) == 0 )
+        {
+        use_hud = true;
+        }
+    else if( strcmp( argv[ i ], "--memory-report" ) == 0 )
+        {
+        use_memory_report = true;
+        }
+    else if( strcmp( argv[ i ], "--trace" ) == 0 && i + 1 < argc )
+        {
+        trace_path = argv[ ++i ];
+        }
+    else if( strcmp( argv[ i ], "--shm" ) == 0 && i + 1 < argc )
+        {
+        shm_name = argv[ ++i ];
+        }
+    else if( strcmp( argv[ i ], "--batch" ) == 0 )
+        {
+        batch = true;
+        if( i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 )
+            {
+            frame_count = ( unsigned int )atoi( argv[ ++i ] );
+            }
+        }
+    else if( strcmp( argv[ i ], "--format" ) == 0 && i + 1 < argc )
+        {
+        i++;
+        if( strcmp( argv[ i ], "ppm" ) == 0 )
+            {
+            batch_config.file_type = IVK_IMAGE_FILE_PPM;
+            }
+        else if( strcmp( argv[ i ], "png" ) == 0 )
+            {
+            batch_config.file_type = IVK_IMAGE_FILE_PNG;
+            }
+        else
+            {
+            batch_config.file_type = IVK_IMAGE_FILE_RAW;
+            }
+        }
+    else if( strcmp( argv[ i ], "--out" ) == 0 && i + 1 < argc )
+        {
+        batch_config.output_pattern = argv[ ++i ];
+        }
+    else if( strcmp( argv[ i ], "--workers" ) == 0 && i + 1 < argc )
+        {
+        batch_config.worker_count = ( unsigned int )atoi( argv[ ++i ] );
+        }
+    else if( strcmp( argv[ i ], "--render-thread" ) == 0 )
+        {
+        use_render_thread = true;
+        }
+    }
+
+if( trace_path )
+    {
+    ivk_trace_enable( trace_path );
+    ivk_trace_set_thread_name( "main" );
+    printf( "Tracing to %s, %.1f ns per zone.\n", trace_path, ivk_trace_measure_overhead( 10000 ) );
+    }
+
+if( batch )
+    {
+    batch_config.frame_count = frame_count;
+    return run_batch( &batch_config );
+    }
+
+if( headless )
+    {
+    return run_headless( frame_count, use_readback, shm_name );
+    }
 
 /* Initialize the GLFW windowing library */
 glfw_window_handle = init_glfw( WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_NAME );
 glfw_extensions = glfwGetRequiredInstanceExtensions( &glfw_extension_count );
 
 /* Initialie IVK library */
-ivk_init( glfw_extension_count, glfw_extensions, glfw_window_handle );
+ivk_config.dynamic_rendering = true;
+ivk_config.extended_dynamic_state = true;
+ivk_config.gpu_profiler = use_gpu_profile;
+ivk_config.gpu_statistics = use_gpu_profile;
+ivk_config.hud = use_hud;
+ivk_config.track_host_memory = use_memory_report;
+if( !ivk_init( &ivk_context, glfw_extension_count, glfw_extensions, glfw_window_handle, &ivk_config ) )
+    {
+    glfwDestroyWindow( glfw_window_handle );
+    glfwTerminate();
+    return 1;
+    }
 
 /* Initialize a triangle for rendering */
-ivk_init_triangle
-    ( 
+triangle_draw.mesh = ivk_create_mesh
+    (
+    &ivk_context,
     &triangle_data[ 0 ], 
     4,
     &indices[ 0 ],
     6
     );
+glm_mat4_identity( triangle_draw.transform );
+
+if( shm_name )
+    {
+    ivk_enable_shm_output( &ivk_context, shm_name, SHM_SLOTS );
+    }
 
-/* Main loop */
-while( !glfwWindowShouldClose( glfw_window_handle ) )
+/* Main loop. The render thread always takes the newest scene, so
+publishing faster than it renders would only replace snapshots: each
+one waits to be taken. The wait is bounded, a render thread held up by
+a minimized window needs the events polled. */
+if( use_render_thread && ivk_render_thread_start( &ivk_context, 1, &render_thread ) )
     {
-    ivk_render();
-    glfwPollEvents();
+    while( !glfwWindowShouldClose( glfw_window_handle ) )
+        {
+        snapshot = ivk_render_thread_begin( &render_thread, 1 );
+        snapshot[ 0 ] = triangle_draw;
+        ivk_render_thread_publish( &render_thread );
+        ivk_render_thread_wait( &render_thread, PUBLISH_WAIT_MS );
+        glfwPollEvents();
+        }
+    ivk_render_thread_stop( &render_thread );
+    printf
+        (
+        "Render thread: %llu scenes published, %llu rendered\n",
+        ( unsigned long long )render_thread.published_count,
+        ( unsigned long long )render_thread.rendered_count
+        );
+    }
+else
+    {
+    while( !glfwWindowShouldClose( glfw_window_handle ) )
+        {
+        ivk_render( &ivk_context, &triangle_draw, 1 );
+        glfwPollEvents();
+        }
+    }
+
+/* Report the resize hitches */
+ivk_get_stats( &ivk_context, &ivk_stats );
+if( ivk_stats.resize_count > 0 )
+    {
+    printf
+        (
+        "Resize hitch over %u resizes: avg %.3f ms, max %.3f ms\n",
+        ivk_stats.resize_count,
+        ivk_stats.total_resize_ms / ivk_stats.resize_count,
+        ivk_stats.max_resize_ms
+        );
+    }
+printf( "Acquire to present: %.3f ms\n", ivk_stats.acquire_to_present_ms );
+if( ivk_stats.is_present_wait_enabled )
+    {
+    printf( "Present to display: %.3f ms\n", ivk_stats.present_to_display_ms );
     }
 
 /* Teardown */
-ivk_teardown();
+report_gpu_profile();
+ivk_teardown( &ivk_context );
 glfwDestroyWindow( glfw_window_handle );
 glfwTerminate();
 
@@ -88,6 +359,281 @@ return 0;
 }
 
 
+/*
+ * Initializes IVK without a window, with the triangle.
+ * False if IVK could not be initialized.
+ */
+bool init_headless
+    (
+    void
+    )
+{
+/* Local variables */
+IVK_config_type ivk_config = { 0 };
+
+/* No window, so no instance extensions either */
+ivk_config.dynamic_rendering = true;
+ivk_config.extended_dynamic_state = true;
+ivk_config.headless = true;
+ivk_config.offscreen_extent.width = WINDOW_WIDTH;
+ivk_config.offscreen_extent.height = WINDOW_HEIGHT;
+ivk_config.gpu_profiler = use_gpu_profile;
+ivk_config.gpu_statistics = use_gpu_profile;
+ivk_config.hud = use_hud;
+ivk_config.track_host_memory = use_memory_report;
+if( !ivk_init( &ivk_context, 0, NULL, NULL, &ivk_config ) )
+    {
+    return false;
+    }
+
+triangle_draw.mesh = ivk_create_mesh
+    (
+    &ivk_context,
+    &triangle_data[ 0 ],
+    4,
+    &indices[ 0 ],
+    6
+    );
+glm_mat4_identity( triangle_draw.transform );
+
+return true;
+
+}
+
+
+/*
+ * Prints the GPU timings and dumps them to the file
+ * given with --gpu-profile
+ */
+void report_gpu_profile
+    (
+    void
+    )
+{
+/* Local variables */
+IVK_gpu_zone_report_type    reports[ IVK_GPU_PROFILER_MAX_NAMES ];
+unsigned int                zone_count = 0;
+
+if( !use_gpu_profile )
+    {
+    return;
+    }
+
+ivk_wait_idle( &ivk_context );
+zone_count = ivk_get_gpu_profile( &ivk_context, &reports[ 0 ], IVK_GPU_PROFILER_MAX_NAMES );
+for( unsigned int i = 0; i < zone_count; i++ )
+    {
+    printf
+        (
+        "GPU %-10s avg %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms ( %u samples )\n",
+        reports[ i ].name,
+        reports[ i ].average_ms,
+        reports[ i ].p50_ms,
+        reports[ i ].p95_ms,
+        reports[ i ].p99_ms,
+        reports[ i ].sample_count
+        );
+    if( reports[ i ].has_statistics )
+        {
+        printf
+            (
+            "    %.0f vertex, %.0f fragment invocations, %.0f primitives clipped into %.0f\n",
+            reports[ i ].statistics[ IVK_GPU_STATISTIC_VERTEX_INVOCATIONS ],
+            reports[ i ].statistics[ IVK_GPU_STATISTIC_FRAGMENT_INVOCATIONS ],
+            reports[ i ].statistics[ IVK_GPU_STATISTIC_CLIPPING_INVOCATIONS ],
+            reports[ i ].statistics[ IVK_GPU_STATISTIC_CLIPPING_PRIMITIVES ]
+            );
+        }
+    }
+
+if( gpu_profile_path )
+    {
+    ivk_dump_gpu_profile( &ivk_context, gpu_profile_path );
+    }
+
+}
+
+
+/*
+ * Renders frame_count frames without a window and
+ * reports the throughput
+ */
+int run_headless
+    (
+    unsigned int frame_count,
+    bool         use_readback,
+    const char*  shm_name
+    )
+{
+/* Local variables */
+IVK_stats_type  ivk_stats = { 0 };
+uint64_t        start_ns = 0;
+double          elapsed_ms = 0.0;
+uint64_t        pixel_sum = 0;
+
+if( !init_headless() )
+    {
+    return 1;
+    }
+
+if( shm_name )
+    {
+    ivk_enable_shm_output( &ivk_context, shm_name, SHM_SLOTS );
+    }
+else if( use_readback )
+    {
+    ivk_enable_readback( &ivk_context, READBACK_SLOTS, on_readback, &pixel_sum );
+    }
+
+/* Count until the GPU has finished the last frame */
+start_ns = ivk_timer_now_ns();
+for( unsigned int i = 0; i < frame_count; i++ )
+    {
+    ivk_render( &ivk_context, &triangle_draw, 1 );
+    }
+ivk_wait_idle( &ivk_context );
+elapsed_ms = IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns );
+
+printf
+    (
+    "Rendered %u frames in %.3f ms ( %.1f fps )\n",
+    frame_count,
+    elapsed_ms,
+    frame_count * 1000.0 / elapsed_ms
+    );
+
+if( shm_name )
+    {
+    ivk_disable_shm_output( &ivk_context );
+    ivk_get_stats( &ivk_context, &ivk_stats );
+    printf
+        (
+        "Published %llu frames, dropped %llu ( %s )\n",
+        ( unsigned long long )ivk_stats.shm_published_count,
+        ( unsigned long long )ivk_stats.shm_dropped_count,
+        ivk_stats.is_shm_zero_copy ? "zero copy" : "copied"
+        );
+    }
+else if( use_readback )
+    {
+    ivk_disable_readback( &ivk_context );
+    ivk_get_stats( &ivk_context, &ivk_stats );
+    printf
+        (
+        "Read back %u frames, dropped %u ( checksum %llu )\n",
+        ivk_stats.readback_delivered_count,
+        ivk_stats.readback_dropped_count,
+        ( unsigned long long )pixel_sum
+        );
+    }
+
+report_gpu_profile();
+ivk_teardown( &ivk_context );
+
+return 0;
+
+}
+
+
+/*
+ * Renders and encodes a sequence of frames, reporting the
+ * throughput and the occupancy of each stage
+ */
+int run_batch
+    (
+    IVK_batch_config_type*  batch_config
+    )
+{
+/* Local variables */
+IVK_batch_stats_type    batch_stats = { 0 };
+IVK_pipeline_state_type pipeline_state;
+
+if( !init_headless() )
+    {
+    return 1;
+    }
+
+ivk_pipeline_default_state( &pipeline_state );
+pipeline_state.cull_mode = VK_CULL_MODE_BACK_BIT;
+batch_config->prepare_frame = prepare_batch_frame;
+batch_config->user_data = &pipeline_state;
+batch_config->draws = &triangle_draw;
+batch_config->draw_count = 1;
+
+if( !ivk_batch_run( &ivk_context, batch_config, &batch_stats ) )
+    {
+    printf( "Batch run failed.\n" );
+    }
+
+printf
+    (
+    "Batch: %u frames rendered, %u written, %u dropped in %.3f ms ( %.1f fps, %u workers )\n",
+    batch_stats.frames_rendered,
+    batch_stats.frames_written,
+    batch_stats.frames_dropped,
+    batch_stats.elapsed_ms,
+    batch_stats.fps,
+    batch_stats.worker_count
+    );
+printf
+    (
+    "Occupancy: render %.1f%%, readback %.1f%%, stalled on encoders %.1f%%, encode %.1f%%\n",
+    batch_stats.render_occupancy * 100.0,
+    batch_stats.readback_occupancy * 100.0,
+    batch_stats.stall_occupancy * 100.0,
+    batch_stats.encode_occupancy * 100.0
+    );
+
+report_gpu_profile();
+ivk_teardown( &ivk_context );
+
+return 0;
+
+}
+
+
+/*
+ * Scene state of each batch frame. Flips the winding
+ * every 30 frames, so the culled quad blinks.
+ */
+void prepare_batch_frame
+    (
+    IVK_Context*    context,
+    unsigned int    frame_index,
+    void*           user_data
+    )
+{
+/* Local variables */
+IVK_pipeline_state_type*    state = ( IVK_pipeline_state_type* )user_data;
+
+state->front_face = ( ( frame_index / 30 ) % 2 ) ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+ivk_set_pipeline_state( context, state );
+
+}
+
+
+/*
+ * Receives the frames read back. Sums the pixels, so the
+ * data is actually touched.
+ */
+void on_readback
+    (
+    const IVK_readback_frame_type*  frame,
+    void*                           user_data
+    )
+{
+/* Local variables */
+uint64_t*       sum = ( uint64_t* )user_data;
+const uint8_t*  bytes = ( const uint8_t* )frame->pixels;
+
+for( size_t i = 0; i < frame->size; i++ )
+    {
+    *sum += bytes[ i ];
+    }
+
+}
+
+
 /*
  * Initialize GLFW
  */
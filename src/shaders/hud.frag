@@ -0,0 +1,19 @@
+#version 450
+
+layout(location = 0) in vec2  fragCell;
+layout(location = 1) in vec4  fragColor;
+layout(location = 2) flat in uvec2 fragGlyph;
+
+layout(location = 0) out vec4 outColor;
+
+/* The glyph travels with the quad as five columns of seven
+bits, so the font needs no texture */
+void main() {
+    ivec2 cell = min( ivec2( fragCell ), ivec2( 4, 6 ) );
+    uint column = ( cell.x < 4 ) ? ( fragGlyph.x >> ( 8 * cell.x ) ) : fragGlyph.y;
+    if( ( ( column >> cell.y ) & 1u ) == 0u )
+        {
+        discard;
+        }
+    outColor = fragColor;
+}
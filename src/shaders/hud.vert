@@ -0,0 +1,23 @@
+#version 450
+
+layout(location = 0) in  vec2  vertPos;      /* Pixels */
+layout(location = 1) in  vec2  vertCell;     /* Glyph cell, 5 x 7 */
+layout(location = 2) in  vec4  vertColor;
+layout(location = 3) in  uvec2 vertGlyph;
+
+layout(location = 0) out vec2  fragCell;
+layout(location = 1) out vec4  fragColor;
+layout(location = 2) flat out uvec2 fragGlyph;
+
+layout( push_constant ) uniform ivk_hud_push_type
+    {
+    vec2 scale;                             /* 2 / extent */
+    } push;
+
+void main() 
+{
+gl_Position = vec4( vertPos * push.scale - 1.0f, 0.0f, 1.0f );
+fragCell = vertCell;
+fragColor = vertColor;
+fragGlyph = vertGlyph;
+}
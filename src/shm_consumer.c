@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ivk_shm.h"
+#include "ivk_timer.h"
+
+#if !defined( _WIN32 )
+    #include <time.h>
+#endif
+
+/* Project constants */
+#define DEFAULT_RING_NAME   "ivk_frames"
+#define OPEN_TIMEOUT_MS     5000.0
+#define IDLE_TIMEOUT_MS     2000.0
+#define TOUCH_STRIDE        64      /* Bytes between the pixels read */
+
+/*
+ * Sleeps for about a tenth of a millisecond
+ */
+void nap
+    (
+    void
+    );
+
+/*
+ * Consumes the frames of a shared memory ring, checking that
+ * the sequence numbers follow each other and measuring the
+ * throughput.
+ *
+ * shm_consumer [name] [frames]
+ *
+ * Stops after the given number of frames, when the producer
+ * closes the ring or when no frame came for a while. Returns
+ * non zero if the sequence was broken.
+ */
+int main
+    (
+    int     argc,
+    char**  argv
+    )
+{
+/* Local variables */
+const char*     name = DEFAULT_RING_NAME;
+unsigned int    frame_limit = 0;
+IVK_shm_ring_type
+                ring;
+const IVK_shm_slot_header_type*
+                slot = NULL;
+const uint8_t*  pixels = NULL;
+uint64_t        start_ns = 0;
+uint64_t        idle_ns = 0;
+uint64_t        first_ns = 0;
+uint64_t        last_ns = 0;
+uint64_t        expected_sequence = 0;
+uint64_t        last_frame_number = 0;
+unsigned int    frame_count = 0;
+unsigned int    sequence_errors = 0;
+unsigned int    not_ready_count = 0;
+uint64_t        skipped_frames = 0;
+uint64_t        byte_count = 0;
+uint64_t        checksum = 0;
+double          elapsed_ms = 0.0;
+
+if( argc > 1 )
+    {
+    name = argv[ 1 ];
+    }
+if( argc > 2 )
+    {
+    frame_limit = ( unsigned int )atoi( argv[ 2 ] );
+    }
+
+/* The producer may not be up yet */
+start_ns = ivk_timer_now_ns();
+while( !ivk_shm_ring_open( name, &ring ) )
+    {
+    if( IVK_NS_TO_MS( ivk_timer_now_ns() - start_ns ) > OPEN_TIMEOUT_MS )
+        {
+        printf( "No shared memory ring %s.\n", name );
+        return 1;
+        }
+    nap();
+    }
+
+printf
+    (
+    "Opened %s: %u slots of %llu bytes\n",
+    ring.name,
+    ring.header->slot_count,
+    ( unsigned long long )ring.header->slot_size
+    );
+
+/* Join at whatever the producer is up to */
+expected_sequence = ring.header->read_index;
+idle_ns = ivk_timer_now_ns();
+while( frame_limit == 0 || frame_count < frame_limit )
+    {
+    slot = ivk_shm_ring_peek( &ring );
+    if( !slot )
+        {
+        /* Closed is only final once the ring is drained */
+        if( ring.header->is_closed && !ivk_shm_ring_peek( &ring ) )
+            {
+            break;
+            }
+        if( IVK_NS_TO_MS( ivk_timer_now_ns() - idle_ns ) > IDLE_TIMEOUT_MS )
+            {
+            printf( "No frame for %.0f ms, stopping.\n", IDLE_TIMEOUT_MS );
+            break;
+            }
+        nap();
+        continue;
+        }
+
+    last_ns = ivk_timer_now_ns();
+    idle_ns = last_ns;
+    if( frame_count == 0 )
+        {
+        first_ns = last_ns;
+        }
+
+    if( !slot->ready )
+        {
+        not_ready_count++;
+        }
+    if( slot->sequence != expected_sequence )
+        {
+        printf
+            (
+            "Sequence broken: expected %llu, got %llu\n",
+            ( unsigned long long )expected_sequence,
+            ( unsigned long long )slot->sequence
+            );
+        sequence_errors++;
+        }
+    expected_sequence = slot->sequence + 1;
+
+    /* Frames that never made it, dropped by the renderer or
+    by the ring */
+    if( frame_count > 0 && slot->frame_number > last_frame_number + 1 )
+        {
+        skipped_frames += slot->frame_number - last_frame_number - 1;
+        }
+    last_frame_number = slot->frame_number;
+
+    /* Straight from the mapping, touching every cache line */
+    pixels = ring.base + slot->offset;
+    for( uint64_t i = 0; i < slot->size; i += TOUCH_STRIDE )
+        {
+        checksum += pixels[ i ];
+        }
+
+    byte_count += slot->size;
+    frame_count++;
+    ivk_shm_ring_release( &ring );
+    }
+
+/* Time between the first and the last frame, so the waits for
+the producer are left out */
+elapsed_ms = IVK_NS_TO_MS( last_ns - first_ns );
+printf
+    (
+    "Consumed %u frames, %.1f MB in %.3f ms ( %.1f fps, %.1f MB/s )\n",
+    frame_count,
+    byte_count / ( 1024.0 * 1024.0 ),
+    elapsed_ms,
+    elapsed_ms > 0.0 ? ( frame_count - 1 ) * 1000.0 / elapsed_ms : 0.0,
+    elapsed_ms > 0.0 ? byte_count / ( 1024.0 * 1024.0 ) * 1000.0 / elapsed_ms : 0.0
+    );
+printf
+    (
+    "Sequence errors %u, not ready %u, frames skipped %llu, of which dropped by the ring %llu ( checksum %llu )\n",
+    sequence_errors,
+    not_ready_count,
+    ( unsigned long long )skipped_frames,
+    ( unsigned long long )ring.header->dropped_count,
+    ( unsigned long long )checksum
+    );
+
+ivk_shm_ring_close( &ring );
+
+return( sequence_errors == 0 && not_ready_count == 0 ? 0 : 1 );
+
+}
+
+
+/*
+ * Sleeps for about a tenth of a millisecond
+ */
+void nap
+    (
+    void
+    )
+{
+#if defined( _WIN32 )
+Sleep( 0 );
+#else
+/* Local variables */
+struct timespec duration = { 0, 100000 };
+
+nanosleep( &duration, NULL );
+#endif
+
+}